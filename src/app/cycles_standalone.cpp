@@ -432,6 +432,39 @@ static void options_parse(int argc, const char **argv)
              "--tile-height %d",
              &options.session_params.tile_size.y,
              "Tile height in pixels",
+             "--light-tree",
+             &options.scene_params.use_light_tree,
+             "Sample lights with a light tree",
+             "--bvh-compressed",
+             &options.scene_params.use_bvh_compressed_nodes,
+             "Store BVH nodes with quantized bounds",
+             "--bvh-cache %s",
+             &options.scene_params.bvh_cache_path,
+             "Directory to cache geometry BVHs in",
+             "--background-cache %s",
+             &options.scene_params.background_cache_path,
+             "Directory to cache background importance maps in",
+             "--procedural-bake-cache %s",
+             &options.scene_params.procedural_bake_cache_path,
+             "Directory to cache baked procedural textures in",
+             "--texture-dedup",
+             &options.scene_params.use_image_dedup,
+             "Load image textures with identical pixels only once",
+             "--texture-budget %d",
+             &options.scene_params.texture_memory_budget,
+             "Memory for image textures in MB, lowering the resolution of small ones to fit",
+             "--compressed-textures",
+             &options.scene_params.use_image_compression,
+             "Store 8 bit image textures block compressed when rendering on the CPU",
+             "--paged-textures",
+             &options.scene_params.texture.use_paged_images,
+             "Load image texture tiles on demand when rendering on the CPU",
+             "--paged-texture-memory %d",
+             &options.scene_params.texture.paged_cache_size,
+             "Memory for paged texture tiles in MB",
+             "--lazy-udim-tiles",
+             &options.scene_params.texture.use_lazy_udim_tiles,
+             "Load UDIM tiles when first used when rendering on the CPU",
              "--list-devices",
              &list,
              "List information about all available devices",
@@ -392,6 +392,12 @@ class CyclesRenderSettings(bpy.types.PropertyGroup):
         min=0.0, max=1.0,
         default=0.01,
     )
+    use_light_tree: BoolProperty(
+        name="Light Tree",
+        description="Sample lights and emissive triangles by their estimated contribution at the shading point, "
+        "which reduces noise in scenes with many lights (not used by branched path tracing)",
+        default=False,
+    )
 
     use_adaptive_sampling: BoolProperty(
         name="Use Adaptive Sampling",
@@ -682,6 +688,29 @@ class CyclesRenderSettings(bpy.types.PropertyGroup):
         description="Use special type BVH optimized for hair (uses more ram but renders faster)",
         default=True,
     )
+    debug_use_compressed_bvh: BoolProperty(
+        name="Use Compressed BVH",
+        description="Store BVH nodes with quantized bounds (uses less ram but may render slower)",
+        default=False,
+    )
+    debug_bvh_cache_path: StringProperty(
+        name="BVH Cache Path",
+        description="Absolute path of a directory to cache BVHs of geometry in, to skip building them again in later renders",
+        default="",
+        subtype='DIR_PATH',
+    )
+    debug_background_cache_path: StringProperty(
+        name="Background Cache Path",
+        description="Absolute path of a directory to cache world importance maps in, to skip shading the world again in later renders",
+        default="",
+        subtype='DIR_PATH',
+    )
+    debug_procedural_bake_cache_path: StringProperty(
+        name="Procedural Bake Cache Path",
+        description="Absolute path of a directory to cache baked procedural textures in, to skip baking them again in later renders",
+        default="",
+        subtype='DIR_PATH',
+    )
     debug_bvh_time_steps: IntProperty(
         name="BVH Time Steps",
         description="Split BVH primitives by this number of time steps to speed up render time in cost of memory",
@@ -811,7 +840,7 @@ class CyclesRenderSettings(bpy.types.PropertyGroup):
     texture_auto_convert: BoolProperty(
         name="Auto Convert Textures",
         default=True,
-        description="Automatically convert textures to .tx files for optimal texture cache performance"
+        description="Convert textures to .tx files in the background for optimal texture cache performance, rendering with the original files until they are ready"
     )
 
     texture_accept_unmipped: BoolProperty(
@@ -871,6 +900,44 @@ class CyclesRenderSettings(bpy.types.PropertyGroup):
         description="Custom path for the texture cache"
     )
 
+    use_texture_dedup: BoolProperty(
+        name="Deduplicate Textures",
+        default=False,
+        description="Load image textures with identical pixels only once, also when they are different files (CPU only)",
+    )
+
+    use_compressed_textures: BoolProperty(
+        name="Compressed Textures",
+        default=False,
+        description="Store 8 bit image textures block compressed when rendering on the CPU, using less memory at a small loss of quality",
+    )
+
+    use_paged_textures: BoolProperty(
+        name="Paged Textures",
+        default=False,
+        description="Load image textures in tiles when first used by CPU rendering, instead of fully before rendering",
+    )
+
+    paged_texture_cache_size: IntProperty(
+        name="Paged Texture Memory (MB)",
+        default=4096,
+        description="Memory for paged texture tiles, least recently used tiles are freed when it is exceeded",
+        min=1
+    )
+
+    use_lazy_udim_tiles: BoolProperty(
+        name="Lazy UDIM Tiles",
+        default=False,
+        description="Load UDIM tiles when first used by CPU rendering, so tiles that are never seen are not loaded",
+    )
+
+    texture_memory_budget: IntProperty(
+        name="Texture Budget (MB)",
+        default=0,
+        description="Memory for image textures, lowering the resolution of textures that are small on screen first to fit. Zero to disable",
+        min=0
+    )
+
     ao_bounces: IntProperty(
         name="AO Bounces",
         default=0,
@@ -315,6 +315,10 @@ class CYCLES_RENDER_PT_sampling_advanced(CyclesButtonsPanel, Panel):
         col.prop(cscene, "min_transparent_bounces")
         col.prop(cscene, "light_sampling_threshold", text="Light Threshold")
 
+        col = layout.column()
+        col.active = not use_branched_path(context)
+        col.prop(cscene, "use_light_tree")
+
         if cscene.progressive != 'PATH' and use_branched_path(context):
             col = layout.column(align=True)
             col.prop(cscene, "sample_all_lights_direct")
@@ -719,10 +723,15 @@ class CYCLES_RENDER_PT_performance_acceleration_structure(CyclesButtonsPanel, Pa
         sub = col.column()
         sub.active = not use_embree
         sub.prop(cscene, "debug_use_hair_bvh")
+        sub.prop(cscene, "debug_use_compressed_bvh")
+        sub.prop(cscene, "debug_bvh_cache_path")
         sub = col.column()
         sub.active = not cscene.debug_use_spatial_splits and not use_embree
         sub.prop(cscene, "debug_bvh_time_steps")
 
+        col.prop(cscene, "debug_background_cache_path")
+        col.prop(cscene, "debug_procedural_bake_cache_path")
+
 
 class CYCLES_RENDER_PT_performance_final_render(CyclesButtonsPanel, Panel):
     bl_label = "Final Render"
@@ -741,6 +750,16 @@ class CYCLES_RENDER_PT_performance_final_render(CyclesButtonsPanel, Panel):
         col.prop(rd, "use_save_buffers")
         col.prop(rd, "use_persistent_data", text="Persistent Images")
 
+        cscene = scene.cycles
+        col.prop(cscene, "use_texture_dedup")
+        col.prop(cscene, "use_compressed_textures")
+        col.prop(cscene, "texture_memory_budget", text="Texture Budget")
+        col.prop(cscene, "use_paged_textures")
+        sub = col.column()
+        sub.active = cscene.use_paged_textures
+        sub.prop(cscene, "paged_texture_cache_size", text="Memory")
+        col.prop(cscene, "use_lazy_udim_tiles")
+
 class CYCLES_RENDER_PT_texture_cache(CyclesButtonsPanel, Panel):
     bl_label = "Texture Cache"
     bl_options = {'DEFAULT_CLOSED'}
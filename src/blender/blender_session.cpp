@@ -21,6 +21,7 @@
 #include "render/buffers.h"
 #include "render/camera.h"
 #include "render/colorspace.h"
+#include "render/image.h"
 #include "render/film.h"
 #include "render/integrator.h"
 #include "render/light.h"
@@ -831,6 +832,9 @@ void BlenderSession::synchronize(BL::Depsgraph &b_depsgraph_)
     scene->film->tag_update(scene);
   }
 
+  /* Swap in textures that finished converting to .tx files in the background. */
+  scene->image_manager->tag_converted_images();
+
   /* reset if needed */
   if (scene->need_reset()) {
     session->reset(buffer_params, session_params.samples);
@@ -779,7 +779,12 @@ SceneParams BlenderSync::get_scene_params(BL::Scene &b_scene, bool background)
 
   params.use_bvh_spatial_split = RNA_boolean_get(&cscene, "debug_use_spatial_splits");
   params.use_bvh_unaligned_nodes = RNA_boolean_get(&cscene, "debug_use_hair_bvh");
+  params.use_bvh_compressed_nodes = RNA_boolean_get(&cscene, "debug_use_compressed_bvh");
+  params.bvh_cache_path = get_string(cscene, "debug_bvh_cache_path");
+  params.background_cache_path = get_string(cscene, "debug_background_cache_path");
+  params.procedural_bake_cache_path = get_string(cscene, "debug_procedural_bake_cache_path");
   params.num_bvh_time_steps = RNA_int_get(&cscene, "debug_bvh_time_steps");
+  params.use_light_tree = RNA_boolean_get(&cscene, "use_light_tree");
 
   PointerRNA csscene = RNA_pointer_get(&b_scene.ptr, "cycles_curves");
   params.hair_subdivisions = get_int(csscene, "subdivisions");
@@ -804,6 +809,10 @@ SceneParams BlenderSync::get_scene_params(BL::Scene &b_scene, bool background)
   else {
     params.texture_limit = 0;
   }
+  params.texture_memory_budget = RNA_int_get(&cscene, "texture_memory_budget");
+
+  params.use_image_dedup = RNA_boolean_get(&cscene, "use_texture_dedup");
+  params.use_image_compression = RNA_boolean_get(&cscene, "use_compressed_textures");
 
   params.bvh_layout = DebugFlags().cpu.bvh_layout;
 
@@ -817,6 +826,9 @@ SceneParams BlenderSync::get_scene_params(BL::Scene &b_scene, bool background)
   params.texture.auto_tile = RNA_boolean_get(&cscene, "texture_auto_tile");
   params.texture.diffuse_blur = RNA_float_get(&cscene, "texture_blur_diffuse");
   params.texture.glossy_blur = RNA_float_get(&cscene, "texture_blur_glossy");
+  params.texture.use_paged_images = RNA_boolean_get(&cscene, "use_paged_textures");
+  params.texture.paged_cache_size = RNA_int_get(&cscene, "paged_texture_cache_size");
+  params.texture.use_lazy_udim_tiles = RNA_boolean_get(&cscene, "use_lazy_udim_tiles");
   params.texture.use_custom_cache_path = RNA_boolean_get(&cscene, "use_custom_cache_path");
   if (params.texture.use_custom_cache_path) {
     char *path = RNA_string_get_alloc(&cscene, "custom_cache_path", NULL, 0);
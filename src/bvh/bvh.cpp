@@ -487,6 +487,10 @@ void BVH::pack_instances(size_t nodes_size, size_t leaf_nodes_size)
           nsize = BVH_UNALIGNED_NODE_SIZE;
           nsize_bbox = 0;
         }
+        else if (bvh_nodes[i].x & PATH_RAY_NODE_COMPRESSED) {
+          nsize = BVH_COMPRESSED_NODE_SIZE;
+          nsize_bbox = 0;
+        }
         else {
           nsize = BVH_NODE_SIZE;
           nsize_bbox = 0;
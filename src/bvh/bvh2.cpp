@@ -28,7 +28,10 @@ CCL_NAMESPACE_BEGIN
 BVH2::BVH2(const BVHParams &params_,
            const vector<Geometry *> &geometry_,
            const vector<Object *> &objects_)
-    : BVH(params_, geometry_, objects_)
+    : BVH(params_, geometry_, objects_),
+      top_level_nodes_size(0),
+      top_level_leaf_nodes_size(0),
+      top_level_prims_size(0)
 {
 }
 
@@ -91,6 +94,11 @@ void BVH2::pack_aligned_node(int idx,
                              uint visibility0,
                              uint visibility1)
 {
+  if (params.use_compressed_nodes) {
+    pack_compressed_node(idx, b0, b1, c0, c1, visibility0, visibility1);
+    return;
+  }
+
   assert(idx + BVH_NODE_SIZE <= pack.nodes.size());
   assert(c0 < 0 || c0 < pack.nodes.size());
   assert(c1 < 0 || c1 < pack.nodes.size());
@@ -115,6 +123,105 @@ void BVH2::pack_aligned_node(int idx,
   memcpy(&pack.nodes[idx], data, sizeof(int4) * BVH_NODE_SIZE);
 }
 
+/* Quantize the child bounds along one axis to 8 bits, relative to the origin. The
+ * decoded bounds are computed the same way as in the kernel and are always conservative,
+ * so rays can't miss geometry. */
+static uint pack_compressed_axis(float origin,
+                                 float scale,
+                                 float min0,
+                                 float max0,
+                                 float min1,
+                                 float max1,
+                                 bool valid0,
+                                 bool valid1)
+{
+  const float inv_scale = 1.0f / scale;
+  const float mins[2] = {min0, min1};
+  const float maxs[2] = {max0, max1};
+  const bool valid[2] = {valid0, valid1};
+  uint lo[2] = {0, 0}, hi[2] = {0, 0};
+
+  for (int i = 0; i < 2; i++) {
+    if (!valid[i]) {
+      /* Empty child, only reached by rays that ignore visibility. */
+      continue;
+    }
+
+    lo[i] = (uint)clamp((int)floorf((mins[i] - origin) * inv_scale), 0, 255);
+    while (lo[i] > 0 && origin + (float)lo[i] * scale > mins[i]) {
+      lo[i]--;
+    }
+
+    hi[i] = (uint)clamp((int)ceilf((maxs[i] - origin) * inv_scale), 0, 255);
+    while (hi[i] < 255 && origin + (float)hi[i] * scale < maxs[i]) {
+      hi[i]++;
+    }
+  }
+
+  return lo[0] | (lo[1] << 8) | (hi[0] << 16) | (hi[1] << 24);
+}
+
+void BVH2::pack_compressed_node(int idx,
+                                const BoundBox &b0,
+                                const BoundBox &b1,
+                                int c0,
+                                int c1,
+                                uint visibility0,
+                                uint visibility1)
+{
+  assert(idx + BVH_COMPRESSED_NODE_SIZE <= pack.nodes.size());
+  assert(c0 < 0 || c0 < pack.nodes.size());
+  assert(c1 < 0 || c1 < pack.nodes.size());
+
+  const bool valid0 = b0.valid(), valid1 = b1.valid();
+  BoundBox bounds = BoundBox::empty;
+  if (valid0) {
+    bounds.grow(b0);
+  }
+  if (valid1) {
+    bounds.grow(b1);
+  }
+  if (!bounds.valid()) {
+    bounds = BoundBox(make_float3(0.0f, 0.0f, 0.0f));
+  }
+
+  int4 data[BVH_COMPRESSED_NODE_SIZE];
+  data[0] = make_int4(visibility0 | PATH_RAY_NODE_COMPRESSED,
+                      visibility1 | PATH_RAY_NODE_COMPRESSED,
+                      c0,
+                      c1);
+
+  uint exponents = 0;
+  uint quantized[3];
+
+  for (int axis = 0; axis < 3; axis++) {
+    const float origin = bounds.min[axis];
+    const float extent = bounds.max[axis] - origin;
+
+    /* Smallest power of two scale that covers the extent in 255 steps, stored as a biased
+     * float exponent. Rounding in the kernel may need one more step. */
+    int exponent;
+    frexpf(extent / 255.0f, &exponent);
+    int biased = clamp(exponent + 127, 1, 254);
+    while (biased < 254 && origin + 255.0f * __uint_as_float(biased << 23) < bounds.max[axis]) {
+      biased++;
+    }
+
+    const float scale = __uint_as_float(biased << 23);
+    exponents |= (uint)biased << (8 * axis);
+    quantized[axis] = pack_compressed_axis(
+        origin, scale, b0.min[axis], b0.max[axis], b1.min[axis], b1.max[axis], valid0, valid1);
+  }
+
+  data[1] = make_int4(__float_as_int(bounds.min.x),
+                      __float_as_int(bounds.min.y),
+                      __float_as_int(bounds.min.z),
+                      (int)exponents);
+  data[2] = make_int4((int)quantized[0], (int)quantized[1], (int)quantized[2], 0);
+
+  memcpy(&pack.nodes[idx], data, sizeof(int4) * BVH_COMPRESSED_NODE_SIZE);
+}
+
 void BVH2::pack_unaligned_inner(const BVHStackEntry &e,
                                 const BVHStackEntry &e0,
                                 const BVHStackEntry &e1)
@@ -172,14 +279,18 @@ void BVH2::pack_nodes(const BVHNode *root)
   if (params.use_unaligned_nodes) {
     const size_t num_unaligned_nodes = root->getSubtreeSize(BVH_STAT_UNALIGNED_INNER_COUNT);
     node_size = (num_unaligned_nodes * BVH_UNALIGNED_NODE_SIZE) +
-                (num_inner_nodes - num_unaligned_nodes) * BVH_NODE_SIZE;
+                (num_inner_nodes - num_unaligned_nodes) * aligned_node_size();
   }
   else {
-    node_size = num_inner_nodes * BVH_NODE_SIZE;
+    node_size = num_inner_nodes * aligned_node_size();
   }
   /* Resize arrays */
   pack.nodes.clear();
   pack.leaf_nodes.clear();
+  top_level_nodes_size = node_size;
+  top_level_leaf_nodes_size = num_leaf_nodes * BVH_NODE_LEAF_SIZE;
+  top_level_prims_size = pack.prim_index.size();
+
   /* For top level BVH, first merge existing BVH's so we know the offsets. */
   if (params.top_level) {
     pack_instances(node_size, num_leaf_nodes * BVH_NODE_LEAF_SIZE);
@@ -198,7 +309,7 @@ void BVH2::pack_nodes(const BVHNode *root)
   }
   else {
     stack.push_back(BVHStackEntry(root, nextNodeIdx));
-    nextNodeIdx += root->has_unaligned() ? BVH_UNALIGNED_NODE_SIZE : BVH_NODE_SIZE;
+    nextNodeIdx += root->has_unaligned() ? BVH_UNALIGNED_NODE_SIZE : aligned_node_size();
   }
 
   while (stack.size()) {
@@ -220,7 +331,7 @@ void BVH2::pack_nodes(const BVHNode *root)
         else {
           idx[i] = nextNodeIdx;
           nextNodeIdx += e.node->get_child(i)->has_unaligned() ? BVH_UNALIGNED_NODE_SIZE :
-                                                                 BVH_NODE_SIZE;
+                                                                 aligned_node_size();
         }
       }
 
@@ -253,7 +364,13 @@ void BVH2::refit_node(int idx, bool leaf, BoundBox &bbox, uint &visibility)
     const int c0 = data[0].x;
     const int c1 = data[0].y;
 
-    BVH::refit_primitives(c0, c1, bbox, visibility);
+    if (c0 < 0) {
+      /* Object instance in the top level. */
+      BVH::refit_primitives(~c0, ~c0 + 1, bbox, visibility);
+    }
+    else {
+      BVH::refit_primitives(c0, c1, bbox, visibility);
+    }
 
     /* TODO(sergey): De-duplicate with pack_leaf(). */
     float4 leaf_data[BVH_NODE_LEAF_SIZE];
@@ -264,7 +381,7 @@ void BVH2::refit_node(int idx, bool leaf, BoundBox &bbox, uint &visibility)
     memcpy(&pack.leaf_nodes[idx], leaf_data, sizeof(float4) * BVH_NODE_LEAF_SIZE);
   }
   else {
-    assert(idx + BVH_NODE_SIZE <= pack.nodes.size());
+    assert(idx + aligned_node_size() <= pack.nodes.size());
 
     const int4 *data = &pack.nodes[idx];
     const bool is_unaligned = (data[0].x & PATH_RAY_NODE_UNALIGNED) != 0;
@@ -292,4 +409,81 @@ void BVH2::refit_node(int idx, bool leaf, BoundBox &bbox, uint &visibility)
   }
 }
 
+/* Top Level Refit */
+
+template<typename T> static void copy_prefix(array<T> &to, const array<T> &from, size_t size)
+{
+  to.resize(size);
+  if (size) {
+    memcpy(to.data(), from.data(), sizeof(T) * size);
+  }
+}
+
+void BVH2::keep_top_level()
+{
+  assert(params.top_level);
+
+  copy_prefix(top_level_pack.nodes, pack.nodes, top_level_nodes_size);
+  copy_prefix(top_level_pack.leaf_nodes, pack.leaf_nodes, top_level_leaf_nodes_size);
+  copy_prefix(top_level_pack.prim_index, pack.prim_index, top_level_prims_size);
+  copy_prefix(top_level_pack.prim_object, pack.prim_object, top_level_prims_size);
+  copy_prefix(top_level_pack.prim_type, pack.prim_type, top_level_prims_size);
+  top_level_pack.root_index = pack.root_index;
+
+  top_level_geometry.resize(objects.size());
+  top_level_traceable.resize(objects.size());
+
+  for (size_t i = 0; i < objects.size(); i++) {
+    top_level_geometry[i] = objects[i]->geometry;
+    top_level_traceable[i] = objects[i]->is_traceable();
+  }
+}
+
+bool BVH2::can_refit_top_level(const vector<Object *> &new_objects) const
+{
+  if (top_level_geometry.size() != objects.size() || new_objects.size() != objects.size()) {
+    return false;
+  }
+
+  for (size_t i = 0; i < objects.size(); i++) {
+    const Object *ob = new_objects[i];
+
+    if (ob != objects[i] || ob->geometry != top_level_geometry[i] ||
+        ob->is_traceable() != top_level_traceable[i]) {
+      return false;
+    }
+    /* Primitives of geometry with applied transform are part of the top level itself. */
+    if (ob->is_traceable() && !ob->geometry->is_instanced()) {
+      return false;
+    }
+  }
+
+  return true;
+}
+
+void BVH2::refit_top_level(const vector<Object *> &new_objects)
+{
+  assert(can_refit_top_level(new_objects));
+
+  objects = new_objects;
+
+  /* Refit works on the packed arrays, which no longer hold the merged data. */
+  pack.nodes.steal_data(top_level_pack.nodes);
+  pack.leaf_nodes.steal_data(top_level_pack.leaf_nodes);
+  pack.prim_index.steal_data(top_level_pack.prim_index);
+  pack.prim_object.steal_data(top_level_pack.prim_object);
+  pack.prim_type.steal_data(top_level_pack.prim_type);
+  pack.root_index = top_level_pack.root_index;
+
+  BoundBox bbox = BoundBox::empty;
+  uint visibility = 0;
+  refit_node(0, (pack.root_index == -1) ? true : false, bbox, visibility);
+
+  top_level_pack.nodes.steal_data(pack.nodes);
+  top_level_pack.leaf_nodes.steal_data(pack.leaf_nodes);
+  top_level_pack.prim_index.steal_data(pack.prim_index);
+  top_level_pack.prim_object.steal_data(pack.prim_object);
+  top_level_pack.prim_type.steal_data(pack.prim_type);
+}
+
 CCL_NAMESPACE_END
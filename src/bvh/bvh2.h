@@ -37,12 +37,27 @@ class Progress;
 #define BVH_NODE_SIZE 4
 #define BVH_NODE_LEAF_SIZE 1
 #define BVH_UNALIGNED_NODE_SIZE 7
+#define BVH_COMPRESSED_NODE_SIZE 3
 
 /* BVH2
  *
  * Typical BVH with each node having two children.
  */
 class BVH2 : public BVH {
+ public:
+  /* Top level refitting for dynamic scenes.
+   *
+   * The packed arrays of a top level BVH start with the top level nodes and the object
+   * instances, followed by the merged geometry BVHs. When objects only moved, the merged
+   * part stays valid and only the top level nodes need new bounds. keep_top_level()
+   * saves a copy of the top level part, before the packed arrays are moved to the device. */
+  void keep_top_level();
+  bool can_refit_top_level(const vector<Object *> &objects) const;
+  void refit_top_level(const vector<Object *> &objects);
+
+  /* Top level part of the packed arrays, valid after keep_top_level(). */
+  PackedBVH top_level_pack;
+
  protected:
   /* constructor */
   friend class BVH;
@@ -69,6 +84,19 @@ class BVH2 : public BVH {
                          int c1,
                          uint visibility0,
                          uint visibility1);
+  void pack_compressed_node(int idx,
+                            const BoundBox &b0,
+                            const BoundBox &b1,
+                            int c0,
+                            int c1,
+                            uint visibility0,
+                            uint visibility1);
+
+  /* Size of an aligned inner node, depending on whether it's compressed. */
+  int aligned_node_size() const
+  {
+    return params.use_compressed_nodes ? BVH_COMPRESSED_NODE_SIZE : BVH_NODE_SIZE;
+  }
 
   void pack_unaligned_inner(const BVHStackEntry &e,
                             const BVHStackEntry &e0,
@@ -86,6 +114,15 @@ class BVH2 : public BVH {
   /* refit */
   void refit_nodes() override;
   void refit_node(int idx, bool leaf, BoundBox &bbox, uint &visibility);
+
+  /* Size of the top level part of the packed arrays. */
+  size_t top_level_nodes_size;
+  size_t top_level_leaf_nodes_size;
+  size_t top_level_prims_size;
+
+  /* Objects the kept top level was built for. */
+  vector<Geometry *> top_level_geometry;
+  vector<bool> top_level_traceable;
 };
 
 CCL_NAMESPACE_END
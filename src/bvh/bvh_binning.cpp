@@ -23,10 +23,17 @@
 
 #include "util/util_algorithm.h"
 #include "util/util_boundbox.h"
+#include "util/util_tbb.h"
 #include "util/util_types.h"
+#include "util/util_vector.h"
 
 CCL_NAMESPACE_BEGIN
 
+/* Ranges with at least this many references are binned in parallel, in chunks of
+ * the task size. */
+static const size_t BVH_BINNING_PARALLEL_THRESHOLD = 131072;
+static const size_t BVH_BINNING_TASK_SIZE = 32768;
+
 /* SSE replacements */
 
 __forceinline void prefetch_L1(const void * /*ptr*/)
@@ -97,74 +104,36 @@ BVHObjectBinning::BVHObjectBinning(const BVHRange &job,
   scale = rcp(cent_bounds_.size()) * make_float3((float)num_bins);
 
   /* initialize binning counter and bounds */
-  BoundBox bin_bounds[MAX_BINS][4]; /* bounds for every bin in every dimension */
-  int4 bin_count[MAX_BINS];         /* number of primitives mapped to bin */
+  Bins bins;
+  bins.reset(num_bins);
 
-  for (size_t i = 0; i < num_bins; i++) {
-    bin_count[i] = make_int4(0);
-    bin_bounds[i][0] = bin_bounds[i][1] = bin_bounds[i][2] = BoundBox::empty;
+  /* map geometry to bins */
+  if (size() < BVH_BINNING_PARALLEL_THRESHOLD) {
+    bin_prims(prims, start(), end(), bins);
   }
-
-  /* map geometry to bins, unrolled once */
-  {
-    ssize_t i;
-
-    for (i = 0; i < ssize_t(size()) - 1; i += 2) {
-      prefetch_L2(&prims[start() + i + 8]);
-
-      /* map even and odd primitive to bin */
-      const BVHReference &prim0 = prims[start() + i + 0];
-      const BVHReference &prim1 = prims[start() + i + 1];
-
-      BoundBox bounds0 = get_prim_bounds(prim0);
-      BoundBox bounds1 = get_prim_bounds(prim1);
-
-      int4 bin0 = get_bin(bounds0);
-      int4 bin1 = get_bin(bounds1);
-
-      /* increase bounds for bins for even primitive */
-      int b00 = (int)extract<0>(bin0);
-      bin_count[b00][0]++;
-      bin_bounds[b00][0].grow(bounds0);
-      int b01 = (int)extract<1>(bin0);
-      bin_count[b01][1]++;
-      bin_bounds[b01][1].grow(bounds0);
-      int b02 = (int)extract<2>(bin0);
-      bin_count[b02][2]++;
-      bin_bounds[b02][2].grow(bounds0);
-
-      /* increase bounds of bins for odd primitive */
-      int b10 = (int)extract<0>(bin1);
-      bin_count[b10][0]++;
-      bin_bounds[b10][0].grow(bounds1);
-      int b11 = (int)extract<1>(bin1);
-      bin_count[b11][1]++;
-      bin_bounds[b11][1].grow(bounds1);
-      int b12 = (int)extract<2>(bin1);
-      bin_count[b12][2]++;
-      bin_bounds[b12][2].grow(bounds1);
-    }
-
-    /* for uneven number of primitives */
-    if (i < ssize_t(size())) {
-      /* map primitive to bin */
-      const BVHReference &prim0 = prims[start() + i];
-      BoundBox bounds0 = get_prim_bounds(prim0);
-      int4 bin0 = get_bin(bounds0);
-
-      /* increase bounds of bins */
-      int b00 = (int)extract<0>(bin0);
-      bin_count[b00][0]++;
-      bin_bounds[b00][0].grow(bounds0);
-      int b01 = (int)extract<1>(bin0);
-      bin_count[b01][1]++;
-      bin_bounds[b01][1].grow(bounds0);
-      int b02 = (int)extract<2>(bin0);
-      bin_count[b02][2]++;
-      bin_bounds[b02][2].grow(bounds0);
+  else {
+    /* Bin fixed size chunks in parallel and merge them in order. Bounds and counts
+     * merge exactly, so the result is the same as binning on a single thread. */
+    const size_t num_tasks = divide_up(size(), BVH_BINNING_TASK_SIZE);
+    vector<Bins> task_bins(num_tasks);
+
+    parallel_for(blocked_range<size_t>(0, num_tasks, 1), [&](const blocked_range<size_t> &r) {
+      for (size_t task = r.begin(); task != r.end(); task++) {
+        const size_t task_start = start() + task * BVH_BINNING_TASK_SIZE;
+        const size_t task_end = min(task_start + BVH_BINNING_TASK_SIZE, (size_t)end());
+        task_bins[task].reset(num_bins);
+        bin_prims(prims, task_start, task_end, task_bins[task]);
+      }
+    });
+
+    for (size_t task = 0; task < num_tasks; task++) {
+      bins.merge(task_bins[task], num_bins);
     }
   }
 
+  const BoundBox(&bin_bounds)[MAX_BINS][4] = bins.bounds;
+  const int4(&bin_count)[MAX_BINS] = bins.count;
+
   /* sweep from right to left and compute parallel prefix of merged bounds */
   float4 r_area[MAX_BINS];  /* area of bounds of primitives on the right */
   float4 r_count[MAX_BINS]; /* number of primitives on the right */
@@ -226,6 +195,91 @@ BVHObjectBinning::BVHObjectBinning(const BVHRange &job,
   leafSAH = bounds_.half_area() * blocks(size());
 }
 
+void BVHObjectBinning::Bins::reset(size_t num_bins)
+{
+  for (size_t i = 0; i < num_bins; i++) {
+    count[i] = make_int4(0);
+    bounds[i][0] = bounds[i][1] = bounds[i][2] = BoundBox::empty;
+  }
+}
+
+void BVHObjectBinning::Bins::merge(const Bins &other, size_t num_bins)
+{
+  for (size_t i = 0; i < num_bins; i++) {
+    count[i] = count[i] + other.count[i];
+    bounds[i][0].grow(other.bounds[i][0]);
+    bounds[i][1].grow(other.bounds[i][1]);
+    bounds[i][2].grow(other.bounds[i][2]);
+  }
+}
+
+void BVHObjectBinning::bin_prims(const BVHReference *prims,
+                                 size_t begin,
+                                 size_t end,
+                                 Bins &bins) const
+{
+  BoundBox(&bin_bounds)[MAX_BINS][4] = bins.bounds;
+  int4(&bin_count)[MAX_BINS] = bins.count;
+
+  /* map geometry to bins, unrolled once */
+  size_t i;
+
+  for (i = begin; i + 1 < end; i += 2) {
+    prefetch_L2(&prims[i + 8]);
+
+    /* map even and odd primitive to bin */
+    const BVHReference &prim0 = prims[i + 0];
+    const BVHReference &prim1 = prims[i + 1];
+
+    BoundBox bounds0 = get_prim_bounds(prim0);
+    BoundBox bounds1 = get_prim_bounds(prim1);
+
+    int4 bin0 = get_bin(bounds0);
+    int4 bin1 = get_bin(bounds1);
+
+    /* increase bounds for bins for even primitive */
+    int b00 = (int)extract<0>(bin0);
+    bin_count[b00][0]++;
+    bin_bounds[b00][0].grow(bounds0);
+    int b01 = (int)extract<1>(bin0);
+    bin_count[b01][1]++;
+    bin_bounds[b01][1].grow(bounds0);
+    int b02 = (int)extract<2>(bin0);
+    bin_count[b02][2]++;
+    bin_bounds[b02][2].grow(bounds0);
+
+    /* increase bounds of bins for odd primitive */
+    int b10 = (int)extract<0>(bin1);
+    bin_count[b10][0]++;
+    bin_bounds[b10][0].grow(bounds1);
+    int b11 = (int)extract<1>(bin1);
+    bin_count[b11][1]++;
+    bin_bounds[b11][1].grow(bounds1);
+    int b12 = (int)extract<2>(bin1);
+    bin_count[b12][2]++;
+    bin_bounds[b12][2].grow(bounds1);
+  }
+
+  /* for uneven number of primitives */
+  if (i < end) {
+    /* map primitive to bin */
+    const BVHReference &prim0 = prims[i];
+    BoundBox bounds0 = get_prim_bounds(prim0);
+    int4 bin0 = get_bin(bounds0);
+
+    /* increase bounds of bins */
+    int b00 = (int)extract<0>(bin0);
+    bin_count[b00][0]++;
+    bin_bounds[b00][0].grow(bounds0);
+    int b01 = (int)extract<1>(bin0);
+    bin_count[b01][1]++;
+    bin_bounds[b01][1].grow(bounds0);
+    int b02 = (int)extract<2>(bin0);
+    bin_count[b02][2]++;
+    bin_bounds[b02][2].grow(bounds0);
+  }
+}
+
 void BVHObjectBinning::split(BVHReference *prims,
                              BVHObjectBinning &left_o,
                              BVHObjectBinning &right_o) const
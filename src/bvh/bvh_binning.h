@@ -27,12 +27,13 @@ CCL_NAMESPACE_BEGIN
 
 class BVHBuild;
 
-/* Single threaded object binner. Finds the split with the best SAH heuristic
+/* Object binner. Finds the split with the best SAH heuristic
  * by testing for each dimension multiple partitionings for regular spaced
  * partition locations. A partitioning for a partition location is computed,
  * by putting primitives whose centroid is on the left and right of the split
  * location to different sets. The SAH is evaluated by computing the number of
- * blocks occupied by the primitives in the partitions. */
+ * blocks occupied by the primitives in the partitions. Big ranges near the
+ * root are binned in parallel, into separate bins that are merged afterwards. */
 
 class BVHObjectBinning : public BVHRange {
  public:
@@ -71,6 +72,17 @@ class BVHObjectBinning : public BVHRange {
   enum { MAX_BINS = 32 };
   enum { LOG_BLOCK_SIZE = 2 };
 
+  struct Bins {
+    BoundBox bounds[MAX_BINS][4]; /* bounds for every bin in every dimension */
+    int4 count[MAX_BINS];         /* number of primitives mapped to bin */
+
+    void reset(size_t num_bins);
+    void merge(const Bins &other, size_t num_bins);
+  };
+
+  /* map primitives [begin, end) to bins */
+  void bin_prims(const BVHReference *prims, size_t begin, size_t end, Bins &bins) const;
+
   /* computes the bin numbers for each dimension for a box. */
   __forceinline int4 get_bin(const BoundBox &box) const
   {
@@ -0,0 +1,361 @@
+/*
+ * Copyright 2011-2020 Blender Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "bvh/bvh_cache.h"
+
+#include "bvh/bvh.h"
+#include "bvh/bvh_params.h"
+
+#include "render/attribute.h"
+#include "render/hair.h"
+#include "render/mesh.h"
+#include "render/pointcloud.h"
+
+#include "util/util_algorithm.h"
+#include "util/util_cache.h"
+#include "util/util_logging.h"
+#include "util/util_md5.h"
+#include "util/util_path.h"
+#include "util/util_time.h"
+
+#ifndef _WIN32
+#  include <fcntl.h>
+#  include <sys/mman.h>
+#  include <sys/stat.h>
+#  include <unistd.h>
+#endif
+
+CCL_NAMESPACE_BEGIN
+
+/* Increase when the file format or anything the BVH build depends on changes. */
+#define BVH_CACHE_VERSION 1
+#define BVH_CACHE_NUM_ARRAYS 10
+
+static const char BVH_CACHE_MAGIC[8] = {'C', 'Y', 'C', 'L', 'B', 'V', 'H', '\0'};
+
+struct BVHCacheHeader {
+  char magic[8];
+  uint32_t version;
+  int32_t root_index;
+  uint64_t num_elements[BVH_CACHE_NUM_ARRAYS];
+};
+
+/* Calls the functor for every array of the packed BVH, in file order. */
+template<typename PackType, typename Func>
+static void packed_bvh_foreach_array(PackType &pack, Func &func)
+{
+  func(pack.nodes);
+  func(pack.leaf_nodes);
+  func(pack.object_node);
+  func(pack.prim_tri_index);
+  func(pack.prim_tri_verts);
+  func(pack.prim_type);
+  func(pack.prim_visibility);
+  func(pack.prim_index);
+  func(pack.prim_object);
+  func(pack.prim_time);
+}
+
+struct BVHCacheCountArrays {
+  uint64_t *num_elements;
+  int index;
+
+  template<typename T> void operator()(const array<T> &arr)
+  {
+    num_elements[index++] = arr.size();
+  }
+};
+
+struct BVHCacheArraysSize {
+  const uint64_t *num_elements;
+  int index;
+  uint64_t size;
+
+  template<typename T> void operator()(const array<T> &)
+  {
+    size += num_elements[index++] * sizeof(T);
+  }
+};
+
+struct BVHCacheReadArrays {
+  const uint64_t *num_elements;
+  int index;
+  const uint8_t *data;
+
+  template<typename T> void operator()(array<T> &arr)
+  {
+    const size_t num = num_elements[index++];
+    arr.resize(num);
+    if (num) {
+      memcpy(arr.data(), data, sizeof(T) * num);
+      data += sizeof(T) * num;
+    }
+  }
+};
+
+struct BVHCacheWriteArrays {
+  CacheFileWriter *writer;
+
+  template<typename T> void operator()(const array<T> &arr)
+  {
+    writer->write_array(arr.data(), arr.size());
+  }
+};
+
+/* Read-only view of a whole file, memory mapped where supported so the cached data is
+ * paged in directly instead of going through an intermediate buffer. */
+class BVHCacheFile {
+ public:
+  BVHCacheFile() : data(NULL), size(0)
+  {
+  }
+
+  ~BVHCacheFile()
+  {
+#ifndef _WIN32
+    if (data) {
+      munmap((void *)data, size);
+    }
+#endif
+  }
+
+  bool open(const string &filepath)
+  {
+#ifdef _WIN32
+    if (!path_read_binary(filepath, buffer) || buffer.empty()) {
+      return false;
+    }
+    data = buffer.data();
+    size = buffer.size();
+    return true;
+#else
+    const int fd = ::open(filepath.c_str(), O_RDONLY);
+    if (fd == -1) {
+      return false;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size == 0) {
+      ::close(fd);
+      return false;
+    }
+
+    void *mapped = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if (mapped == MAP_FAILED) {
+      return false;
+    }
+
+    data = (const uint8_t *)mapped;
+    size = st.st_size;
+    return true;
+#endif
+  }
+
+  const uint8_t *data;
+  size_t size;
+
+ protected:
+#ifdef _WIN32
+  vector<uint8_t> buffer;
+#endif
+};
+
+/* Hashing. */
+
+static void bvh_cache_hash(MD5Hash &md5, const void *data, size_t size)
+{
+  const uint8_t *bytes = (const uint8_t *)data;
+  while (size > 0) {
+    const int chunk = (int)std::min(size, (size_t)(1 << 30));
+    md5.append(bytes, chunk);
+    bytes += chunk;
+    size -= chunk;
+  }
+}
+
+template<typename T> static void bvh_cache_hash_value(MD5Hash &md5, const T value)
+{
+  bvh_cache_hash(md5, &value, sizeof(value));
+}
+
+template<typename T> static void bvh_cache_hash_array(MD5Hash &md5, const array<T> &arr)
+{
+  bvh_cache_hash_value(md5, (uint64_t)arr.size());
+  bvh_cache_hash(md5, arr.data(), sizeof(T) * arr.size());
+}
+
+/* The padding of float3 is not initialized, so only hash the used components. */
+static void bvh_cache_hash_float3(MD5Hash &md5, const float3 *data, size_t num)
+{
+  bvh_cache_hash_value(md5, (uint64_t)num);
+
+  float buffer[3 * 1024];
+  for (size_t i = 0; i < num; i += 1024) {
+    const size_t chunk = std::min(num - i, (size_t)1024);
+    for (size_t j = 0; j < chunk; j++) {
+      buffer[j * 3 + 0] = data[i + j].x;
+      buffer[j * 3 + 1] = data[i + j].y;
+      buffer[j * 3 + 2] = data[i + j].z;
+    }
+    bvh_cache_hash(md5, buffer, sizeof(float) * 3 * chunk);
+  }
+}
+
+/* BVH Cache */
+
+BVHCache::BVHCache() : num_hits(0), num_misses(0), loaded_size(0), stored_size(0)
+{
+}
+
+void BVHCache::set_path(const string &path_)
+{
+  path = path_;
+}
+
+string BVHCache::filepath(const string &key) const
+{
+  return path_join(path, key + ".bvh");
+}
+
+string BVHCache::key(const Geometry *geom, const BVHParams &params) const
+{
+  MD5Hash md5;
+
+  bvh_cache_hash_value(md5, (int)BVH_CACHE_VERSION);
+
+  /* Parameters. */
+  bvh_cache_hash_value(md5, (int)params.bvh_layout);
+  bvh_cache_hash_value(md5, params.top_level);
+  bvh_cache_hash_value(md5, params.use_spatial_split);
+  bvh_cache_hash_value(md5, params.spatial_split_alpha);
+  bvh_cache_hash_value(md5, params.unaligned_split_threshold);
+  bvh_cache_hash_value(md5, params.sah_node_cost);
+  bvh_cache_hash_value(md5, params.sah_primitive_cost);
+  bvh_cache_hash_value(md5, params.min_leaf_size);
+  bvh_cache_hash_value(md5, params.max_triangle_leaf_size);
+  bvh_cache_hash_value(md5, params.max_motion_triangle_leaf_size);
+  bvh_cache_hash_value(md5, params.max_curve_leaf_size);
+  bvh_cache_hash_value(md5, params.max_motion_curve_leaf_size);
+  bvh_cache_hash_value(md5, params.max_point_leaf_size);
+  bvh_cache_hash_value(md5, params.max_motion_point_leaf_size);
+  bvh_cache_hash_value(md5, params.use_unaligned_nodes);
+  bvh_cache_hash_value(md5, params.use_compressed_nodes);
+  bvh_cache_hash_value(md5, params.num_motion_triangle_steps);
+  bvh_cache_hash_value(md5, params.num_motion_curve_steps);
+  bvh_cache_hash_value(md5, params.num_motion_point_steps);
+  bvh_cache_hash_value(md5, params.bvh_type);
+  bvh_cache_hash_value(md5, params.curve_subdivisions);
+
+  /* Geometry. */
+  bvh_cache_hash_value(md5, (int)geom->type);
+  bvh_cache_hash_value(md5, geom->motion_steps);
+  bvh_cache_hash_value(md5, geom->use_motion_blur);
+
+  if (geom->type == Geometry::MESH) {
+    const Mesh *mesh = static_cast<const Mesh *>(geom);
+    bvh_cache_hash_float3(md5, mesh->verts.data(), mesh->verts.size());
+    bvh_cache_hash_array(md5, mesh->triangles);
+  }
+  else if (geom->type == Geometry::HAIR) {
+    const Hair *hair = static_cast<const Hair *>(geom);
+    bvh_cache_hash_value(md5, (int)hair->curve_shape);
+    bvh_cache_hash_float3(md5, hair->curve_keys.data(), hair->curve_keys.size());
+    bvh_cache_hash_array(md5, hair->curve_radius);
+    bvh_cache_hash_array(md5, hair->curve_first_key);
+  }
+  else if (geom->type == Geometry::POINTCLOUD) {
+    const PointCloud *pointcloud = static_cast<const PointCloud *>(geom);
+    bvh_cache_hash_value(md5, (int)pointcloud->point_style);
+    bvh_cache_hash_float3(md5, pointcloud->points.data(), pointcloud->points.size());
+    bvh_cache_hash_array(md5, pointcloud->radius);
+  }
+
+  const Attribute *attr_mP = geom->attributes.find(ATTR_STD_MOTION_VERTEX_POSITION);
+  if (attr_mP) {
+    bvh_cache_hash_float3(
+        md5, (const float3 *)attr_mP->buffer.data(), attr_mP->buffer.size() / sizeof(float3));
+  }
+
+  return md5.get_hex();
+}
+
+bool BVHCache::load(const string &key, PackedBVH &pack)
+{
+  const double time_start = time_dt();
+  const string filepath = this->filepath(key);
+
+  BVHCacheFile file;
+  bool valid = file.open(filepath) && file.size >= sizeof(BVHCacheHeader);
+
+  BVHCacheHeader header;
+  if (valid) {
+    memcpy(&header, file.data, sizeof(header));
+    valid = memcmp(header.magic, BVH_CACHE_MAGIC, sizeof(header.magic)) == 0 &&
+            header.version == BVH_CACHE_VERSION;
+  }
+
+  if (valid) {
+    BVHCacheArraysSize arrays_size = {header.num_elements, 0, 0};
+    packed_bvh_foreach_array(pack, arrays_size);
+    valid = file.size == sizeof(header) + arrays_size.size;
+  }
+
+  if (!valid) {
+    thread_scoped_lock lock(mutex);
+    num_misses++;
+    return false;
+  }
+
+  BVHCacheReadArrays read_arrays = {header.num_elements, 0, file.data + sizeof(header)};
+  packed_bvh_foreach_array(pack, read_arrays);
+  pack.root_index = header.root_index;
+
+  VLOG(2) << "Loaded cached BVH " << filepath << " ("
+          << string_human_readable_size(file.size) << ") in " << time_dt() - time_start
+          << " seconds.";
+
+  thread_scoped_lock lock(mutex);
+  num_hits++;
+  loaded_size += file.size;
+  return true;
+}
+
+void BVHCache::store(const string &key, const PackedBVH &pack)
+{
+  BVHCacheHeader header;
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, BVH_CACHE_MAGIC, sizeof(header.magic));
+  header.version = BVH_CACHE_VERSION;
+  header.root_index = pack.root_index;
+
+  BVHCacheCountArrays count_arrays = {header.num_elements, 0};
+  packed_bvh_foreach_array(pack, count_arrays);
+
+  CacheFileWriter writer(filepath(key));
+  writer.write(&header, sizeof(header));
+  BVHCacheWriteArrays write_arrays = {&writer};
+  packed_bvh_foreach_array(pack, write_arrays);
+
+  if (!writer.commit()) {
+    return;
+  }
+
+  thread_scoped_lock lock(mutex);
+  stored_size += writer.size();
+}
+
+CCL_NAMESPACE_END
@@ -0,0 +1,72 @@
+/*
+ * Copyright 2011-2020 Blender Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __BVH_CACHE_H__
+#define __BVH_CACHE_H__
+
+#include "util/util_string.h"
+#include "util/util_thread.h"
+#include "util/util_types.h"
+
+CCL_NAMESPACE_BEGIN
+
+class BVHParams;
+class Geometry;
+struct PackedBVH;
+
+/* Persistent cache of packed BVH2 data of geometry.
+ *
+ * Every BVH is stored in its own file in the cache directory, named after a hash of
+ * everything the build depends on: the geometry data, the BVH parameters and the layout.
+ * Static geometry that is rendered over and over, like on a render farm, then skips the
+ * BVH build and only reads the file. Only the BVH2 layout can be cached, Embree keeps
+ * its BVH internal. */
+class BVHCache {
+ public:
+  BVHCache();
+
+  /* Directory to store the cache files in, caching is disabled when empty. */
+  void set_path(const string &path);
+  bool enabled() const
+  {
+    return !path.empty();
+  }
+
+  /* Hash of the geometry data and parameters that identify its BVH. */
+  string key(const Geometry *geom, const BVHParams &params) const;
+
+  /* Load the packed BVH of the given key, returns false when it's not in the cache or
+   * the file is invalid. */
+  bool load(const string &key, PackedBVH &pack);
+  /* Write the packed BVH to the cache. */
+  void store(const string &key, const PackedBVH &pack);
+
+  /* Statistics since the cache was created. */
+  size_t num_hits;
+  size_t num_misses;
+  size_t loaded_size;
+  size_t stored_size;
+
+ protected:
+  string filepath(const string &key) const;
+
+  string path;
+  thread_mutex mutex;
+};
+
+CCL_NAMESPACE_END
+
+#endif /* __BVH_CACHE_H__ */
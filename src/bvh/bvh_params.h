@@ -76,6 +76,12 @@ class BVHParams {
    */
   bool use_unaligned_nodes;
 
+  /* Store aligned nodes with child bounds quantized to 8 bits, using less memory and
+   * bandwidth at the cost of slightly looser bounds.
+   * Only used for BVH2 layout.
+   */
+  bool use_compressed_nodes;
+
   /* Split time range to this number of steps and create leaf node for each
    * of this time steps.
    *
@@ -117,6 +123,7 @@ class BVHParams {
     top_level = false;
     bvh_layout = BVH_LAYOUT_BVH2;
     use_unaligned_nodes = false;
+    use_compressed_nodes = false;
 
     num_motion_triangle_steps = 0;
     num_motion_curve_steps = 0;
@@ -26,9 +26,33 @@
 #include "render/pointcloud.h"
 
 #include "util/util_algorithm.h"
+#include "util/util_tbb.h"
 
 CCL_NAMESPACE_BEGIN
 
+/* Ranges with at least this many references are binned in parallel, in chunks of
+ * the task size. Spatial binning clips references, so chunks are smaller than for
+ * object binning. */
+static const size_t BVH_SPATIAL_BINNING_PARALLEL_THRESHOLD = 65536;
+static const size_t BVH_SPATIAL_BINNING_TASK_SIZE = 8192;
+
+struct BVHSpatialTaskBins {
+  BVHSpatialBin bins[3][BVHParams::NUM_SPATIAL_BINS];
+};
+
+static void spatial_bins_reset(BVHSpatialBin (*bins)[BVHParams::NUM_SPATIAL_BINS])
+{
+  for (int dim = 0; dim < 3; dim++) {
+    for (int i = 0; i < BVHParams::NUM_SPATIAL_BINS; i++) {
+      BVHSpatialBin &bin = bins[dim][i];
+
+      bin.bounds = BoundBox::empty;
+      bin.enter = 0;
+      bin.exit = 0;
+    }
+  }
+}
+
 /* Object Split */
 
 BVHObjectSplit::BVHObjectSplit(BVHBuild *builder,
@@ -160,44 +184,43 @@ BVHSpatialSplit::BVHSpatialSplit(const BVHBuild &builder,
   float3 binSize = (range_bounds.max - origin) * (1.0f / (float)BVHParams::NUM_SPATIAL_BINS);
   float3 invBinSize = 1.0f / binSize;
 
-  for (int dim = 0; dim < 3; dim++) {
-    for (int i = 0; i < BVHParams::NUM_SPATIAL_BINS; i++) {
-      BVHSpatialBin &bin = storage_->bins[dim][i];
-
-      bin.bounds = BoundBox::empty;
-      bin.enter = 0;
-      bin.exit = 0;
-    }
-  }
-
   /* chop references into bins. */
-  for (unsigned int refIdx = range.start(); refIdx < range.end(); refIdx++) {
-    const BVHReference &ref = references_->at(refIdx);
-    BoundBox prim_bounds = get_prim_bounds(ref);
-    float3 firstBinf = (prim_bounds.min - origin) * invBinSize;
-    float3 lastBinf = (prim_bounds.max - origin) * invBinSize;
-    int3 firstBin = make_int3((int)firstBinf.x, (int)firstBinf.y, (int)firstBinf.z);
-    int3 lastBin = make_int3((int)lastBinf.x, (int)lastBinf.y, (int)lastBinf.z);
-
-    firstBin = clamp(firstBin, 0, BVHParams::NUM_SPATIAL_BINS - 1);
-    lastBin = clamp(lastBin, firstBin, BVHParams::NUM_SPATIAL_BINS - 1);
-
-    for (int dim = 0; dim < 3; dim++) {
-      BVHReference currRef(
-          get_prim_bounds(ref), ref.prim_index(), ref.prim_object(), ref.prim_type());
-
-      for (int i = firstBin[dim]; i < lastBin[dim]; i++) {
-        BVHReference leftRef, rightRef;
-
-        split_reference(
-            builder, leftRef, rightRef, currRef, dim, origin[dim] + binSize[dim] * (float)(i + 1));
-        storage_->bins[dim][i].bounds.grow(leftRef.bounds());
-        currRef = rightRef;
+  if (range.size() < BVH_SPATIAL_BINNING_PARALLEL_THRESHOLD) {
+    spatial_bins_reset(storage_->bins);
+    bin_references(
+        builder, range.start(), range.end(), origin, binSize, invBinSize, storage_->bins);
+  }
+  else {
+    /* Bin fixed size chunks in parallel and merge them in order. Bounds and counts
+     * merge exactly, so the result is the same as binning on a single thread. */
+    const size_t num_tasks = divide_up(range.size(), BVH_SPATIAL_BINNING_TASK_SIZE);
+    vector<BVHSpatialTaskBins> task_bins(num_tasks);
+
+    parallel_for(blocked_range<size_t>(0, num_tasks, 1), [&](const blocked_range<size_t> &r) {
+      for (size_t task = r.begin(); task != r.end(); task++) {
+        const size_t task_start = range.start() + task * BVH_SPATIAL_BINNING_TASK_SIZE;
+        const size_t task_end = min(task_start + BVH_SPATIAL_BINNING_TASK_SIZE,
+                                    (size_t)range.end());
+        spatial_bins_reset(task_bins[task].bins);
+        bin_references(
+            builder, task_start, task_end, origin, binSize, invBinSize, task_bins[task].bins);
+      }
+    });
+
+    /* The storage is only written after the loop, while waiting for it this thread may
+     * build another node with the same thread local storage. */
+    spatial_bins_reset(storage_->bins);
+    for (size_t task = 0; task < num_tasks; task++) {
+      for (int dim = 0; dim < 3; dim++) {
+        for (int i = 0; i < BVHParams::NUM_SPATIAL_BINS; i++) {
+          BVHSpatialBin &bin = storage_->bins[dim][i];
+          const BVHSpatialBin &task_bin = task_bins[task].bins[dim][i];
+
+          bin.bounds.grow(task_bin.bounds);
+          bin.enter += task_bin.enter;
+          bin.exit += task_bin.exit;
+        }
       }
-
-      storage_->bins[dim][lastBin[dim]].bounds.grow(currRef.bounds());
-      storage_->bins[dim][firstBin[dim]].enter++;
-      storage_->bins[dim][lastBin[dim]].exit++;
     }
   }
 
@@ -234,6 +257,45 @@ BVHSpatialSplit::BVHSpatialSplit(const BVHBuild &builder,
   }
 }
 
+void BVHSpatialSplit::bin_references(const BVHBuild &builder,
+                                     size_t begin,
+                                     size_t end,
+                                     const float3 &origin,
+                                     const float3 &binSize,
+                                     const float3 &invBinSize,
+                                     BVHSpatialBin (*bins)[BVHParams::NUM_SPATIAL_BINS])
+{
+  for (size_t refIdx = begin; refIdx < end; refIdx++) {
+    const BVHReference &ref = references_->at(refIdx);
+    BoundBox prim_bounds = get_prim_bounds(ref);
+    float3 firstBinf = (prim_bounds.min - origin) * invBinSize;
+    float3 lastBinf = (prim_bounds.max - origin) * invBinSize;
+    int3 firstBin = make_int3((int)firstBinf.x, (int)firstBinf.y, (int)firstBinf.z);
+    int3 lastBin = make_int3((int)lastBinf.x, (int)lastBinf.y, (int)lastBinf.z);
+
+    firstBin = clamp(firstBin, 0, BVHParams::NUM_SPATIAL_BINS - 1);
+    lastBin = clamp(lastBin, firstBin, BVHParams::NUM_SPATIAL_BINS - 1);
+
+    for (int dim = 0; dim < 3; dim++) {
+      BVHReference currRef(
+          get_prim_bounds(ref), ref.prim_index(), ref.prim_object(), ref.prim_type());
+
+      for (int i = firstBin[dim]; i < lastBin[dim]; i++) {
+        BVHReference leftRef, rightRef;
+
+        split_reference(
+            builder, leftRef, rightRef, currRef, dim, origin[dim] + binSize[dim] * (float)(i + 1));
+        bins[dim][i].bounds.grow(leftRef.bounds());
+        currRef = rightRef;
+      }
+
+      bins[dim][lastBin[dim]].bounds.grow(currRef.bounds());
+      bins[dim][firstBin[dim]].enter++;
+      bins[dim][lastBin[dim]].exit++;
+    }
+  }
+}
+
 void BVHSpatialSplit::split(BVHBuild *builder,
                             BVHRange &left,
                             BVHRange &right,
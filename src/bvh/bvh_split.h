@@ -103,6 +103,15 @@ class BVHSpatialSplit {
   const BVHUnaligned *unaligned_heuristic_;
   const Transform *aligned_space_;
 
+  /* Chop references [begin, end) into the given bins. */
+  void bin_references(const BVHBuild &builder,
+                      size_t begin,
+                      size_t end,
+                      const float3 &origin,
+                      const float3 &binSize,
+                      const float3 &invBinSize,
+                      BVHSpatialBin (*bins)[BVHParams::NUM_SPATIAL_BINS]);
+
   /* Lower-level functions which calculates boundaries of left and right nodes
    * needed for spatial split.
    *
@@ -145,6 +145,8 @@ class CUDADevice : public Device {
 
   void mem_copy_to(device_memory &mem) override;
 
+  void mem_copy_to_partial(device_memory &mem, size_t offset, size_t size) override;
+
   void mem_copy_from(device_memory &mem, int y, int w, int h, int elem) override;
 
   void mem_zero(device_memory &mem) override;
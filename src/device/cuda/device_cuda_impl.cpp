@@ -1016,6 +1016,27 @@ void CUDADevice::mem_copy_to(device_memory &mem)
   }
 }
 
+void CUDADevice::mem_copy_to_partial(device_memory &mem, size_t offset, size_t size)
+{
+  if (mem.type == MEM_PIXELS || mem.type == MEM_TEXTURE || !mem.device_pointer ||
+      !mem.is_resident(this)) {
+    mem_copy_to(mem);
+    return;
+  }
+
+  if (!mem.host_pointer) {
+    return;
+  }
+
+  /* Same as generic_copy_to(), restricted to the given range. */
+  if (!cuda_mem_map[&mem].use_mapped_host || mem.host_pointer != mem.shared_pointer) {
+    const CUDAContextScope scope(this);
+    cuda_assert(cuMemcpyHtoD((CUdeviceptr)mem.device_pointer + offset,
+                             (char *)mem.host_pointer + offset,
+                             size));
+  }
+}
+
 void CUDADevice::mem_copy_from(device_memory &mem, int y, int w, int h, int elem)
 {
   if (mem.type == MEM_PIXELS && !background) {
@@ -499,6 +499,12 @@ class Device {
 
   virtual void mem_alloc(device_memory &mem) = 0;
   virtual void mem_copy_to(device_memory &mem) = 0;
+  /* Copy a byte range of memory that is already allocated on the device with the same
+   * size. Devices without support for partial copies copy the entire memory. */
+  virtual void mem_copy_to_partial(device_memory &mem, size_t /*offset*/, size_t /*size*/)
+  {
+    mem_copy_to(mem);
+  }
   virtual void mem_copy_from(device_memory &mem, int y, int w, int h, int elem) = 0;
   virtual void mem_zero(device_memory &mem) = 0;
   virtual void mem_free(device_memory &mem) = 0;
@@ -47,6 +47,7 @@
 #include "render/buffers.h"
 #include "render/coverage.h"
 
+#include "util/util_algorithm.h"
 #include "util/util_debug.h"
 #include "util/util_foreach.h"
 #include "util/util_function.h"
@@ -188,6 +189,12 @@ class CPUDevice : public Device {
 #endif
   thread_spin_lock oidn_task_lock;
 
+  /* Tiles waiting to be denoised by the OpenImageDenoise worker thread. */
+  thread_mutex oidn_queue_mutex;
+  thread_condition_variable oidn_queue_cond;
+  vector<RenderTileNeighbors *> oidn_queue;
+  bool oidn_queue_finish;
+
   bool use_split_kernel;
 
   DeviceRequestedFeatures requested_features;
@@ -314,6 +321,7 @@ class CPUDevice : public Device {
       VLOG(1) << "Will be using split kernel.";
     }
     need_texture_info = false;
+    oidn_queue_finish = false;
 
 #define REGISTER_SPLIT_KERNEL(name) \
   split_kernels[#name] = KernelFunctions<void (*)(KernelGlobals *, KernelData *)>( \
@@ -430,6 +438,14 @@ class CPUDevice : public Device {
     }
   }
 
+  void mem_copy_to_partial(device_memory &mem, size_t /*offset*/, size_t /*size*/)
+  {
+    /* Device memory is the host memory, so once allocated there is nothing to copy. */
+    if (!mem.device_pointer) {
+      mem_copy_to(mem);
+    }
+  }
+
   void mem_copy_from(device_memory & /*mem*/, int /*y*/, int /*w*/, int /*h*/, int /*elem*/)
   {
     /* no-op */
@@ -503,7 +519,8 @@ class CPUDevice : public Device {
             << string_human_readable_size(mem.memory_size()) << ")";
 
     mem.device_pointer = (device_ptr)mem.host_pointer;
-    mem.device_size = mem.memory_size();
+    /* Shared memory is already accounted for by the texture owning it. */
+    mem.device_size = mem.host_shared ? 0 : mem.memory_size();
     stats.mem_alloc(mem.device_size);
 
     const uint slot = mem.slot;
@@ -903,15 +920,14 @@ class CPUDevice : public Device {
     }
   }
 
-  void render(DeviceTask &task, RenderTile &tile, KernelGlobals *kg)
+  void render(DeviceTask &task, RenderTile &tile, KernelGlobals *kg, Coverage &coverage)
   {
     const bool use_coverage = kernel_data.film.cryptomatte_passes & CRYPT_ACCURATE;
 
     scoped_timer timer(&tile.buffers->render_time);
 
-    Coverage coverage(kg, tile);
     if (use_coverage) {
-      coverage.init_path_trace();
+      coverage.init_path_trace(tile);
     }
 
     float *render_buffer = (float *)tile.buffer;
@@ -982,10 +998,8 @@ class CPUDevice : public Device {
 
     /* Only one at a time, since OpenImageDenoise itself is multithreaded for full
      * buffers, and for tiled rendering because creating multiple devices and filters
-     * is slow and memory hungry as well.
-     *
-     * TODO: optimize tiled rendering case, by batching together denoising of many
-     * tiles somehow? */
+     * is slow and memory hungry as well. Tiled rendering batches adjacent tiles into
+     * larger regions instead, see denoise_openimagedenoise_worker(). */
     static thread_mutex mutex;
     thread_scoped_lock lock(mutex);
 
@@ -1101,36 +1115,86 @@ class CPUDevice : public Device {
     }
     else {
       /* Per-tile denoising. */
-      rtile.sample = rtile.start_sample + rtile.num_samples;
-      const float scale = 1.0f / rtile.sample;
-      const float invscale = rtile.sample;
-      const size_t pass_stride = task.pass_stride;
-
-      /* Map neighboring tiles into one buffer for denoising. */
-      RenderTileNeighbors neighbors(rtile);
-      task.map_neighbor_tiles(neighbors, this);
-      RenderTile &center_tile = neighbors.tiles[RenderTileNeighbors::CENTER];
-      rtile = center_tile;
-
-      /* Calculate size of the tile to denoise (including overlap). The overlap
-       * size was chosen empirically. OpenImageDenoise specifies an overlap size
-       * of 128 but this is significantly bigger than typical tile size. */
-      const int4 rect = rect_clip(rect_expand(center_tile.bounds(), 64), neighbors.bounds());
-      const int2 rect_size = make_int2(rect.z - rect.x, rect.w - rect.y);
-
-      /* Adjacent tiles are in separate memory regions, copy into single buffer. */
-      array<float> merged(rect_size.x * rect_size.y * task.pass_stride);
+      RenderTileNeighbors *neighbors = denoise_openimagedenoise_map_tiles(task, rtile);
+      denoise_openimagedenoise_tiles(task, &neighbors, 1);
+      task.unmap_neighbor_tiles(*neighbors, this);
+      delete neighbors;
+    }
+  }
 
+  RenderTileNeighbors *denoise_openimagedenoise_map_tiles(DeviceTask &task, RenderTile &rtile)
+  {
+    rtile.sample = rtile.start_sample + rtile.num_samples;
+
+    /* Map neighboring tiles, they are needed as input to denoise the tile. */
+    RenderTileNeighbors *neighbors = new RenderTileNeighbors(rtile);
+    task.map_neighbor_tiles(*neighbors, this);
+    rtile = neighbors->tiles[RenderTileNeighbors::CENTER];
+
+    return neighbors;
+  }
+
+  /* Denoise a row of horizontally adjacent tiles as one region, so the overlap needed
+   * around the tiles is only denoised once for all of them. */
+  void denoise_openimagedenoise_tiles(DeviceTask &task,
+                                      RenderTileNeighbors *const *tiles,
+                                      const int num_tiles)
+  {
+    const RenderTile &first_tile = tiles[0]->tiles[RenderTileNeighbors::CENTER];
+    const RenderTile &last_tile = tiles[num_tiles - 1]->tiles[RenderTileNeighbors::CENTER];
+    const float scale = 1.0f / first_tile.sample;
+    const float invscale = first_tile.sample;
+    const size_t pass_stride = task.pass_stride;
+
+    /* Region covered by the neighbors of all tiles. */
+    int4 bounds = tiles[0]->bounds();
+    for (int i = 1; i < num_tiles; i++) {
+      const int4 tile_bounds = tiles[i]->bounds();
+      bounds.y = max(bounds.y, tile_bounds.y);
+      bounds.z = max(bounds.z, tile_bounds.z);
+      bounds.w = min(bounds.w, tile_bounds.w);
+    }
+
+    /* Calculate size of the region to denoise (including overlap). The overlap
+     * size was chosen empirically. OpenImageDenoise specifies an overlap size
+     * of 128 but this is significantly bigger than typical tile size. */
+    const int4 center_bounds = make_int4(
+        first_tile.x, first_tile.y, last_tile.x + last_tile.w, last_tile.y + last_tile.h);
+    const int4 rect = rect_clip(rect_expand(center_bounds, 64), bounds);
+    const int2 rect_size = make_int2(rect.z - rect.x, rect.w - rect.y);
+
+    /* Adjacent tiles are in separate memory regions, copy into single buffer. Tiles in
+     * the row share most of their neighbors, those are only copied once. */
+    array<float> merged(rect_size.x * rect_size.y * task.pass_stride);
+    vector<int2> copied_tiles;
+
+    for (int t = 0; t < num_tiles; t++) {
       for (int i = 0; i < RenderTileNeighbors::SIZE; i++) {
-        RenderTile &ntile = neighbors.tiles[i];
+        RenderTile &ntile = tiles[t]->tiles[i];
         if (!ntile.buffer) {
           continue;
         }
 
+        const int2 tile_pos = make_int2(ntile.x, ntile.y);
+        bool copied = false;
+        foreach (const int2 &pos, copied_tiles) {
+          if (pos.x == tile_pos.x && pos.y == tile_pos.y) {
+            copied = true;
+            break;
+          }
+        }
+        if (copied) {
+          continue;
+        }
+        copied_tiles.push_back(tile_pos);
+
         const int xmin = max(ntile.x, rect.x);
         const int ymin = max(ntile.y, rect.y);
         const int xmax = min(ntile.x + ntile.w, rect.z);
         const int ymax = min(ntile.y + ntile.h, rect.w);
+        if (xmin >= xmax || ymin >= ymax) {
+          continue;
+        }
 
         const size_t tile_offset = ntile.offset + xmin + ymin * ntile.stride;
         const float *tile_buffer = (float *)ntile.buffer + tile_offset * pass_stride;
@@ -1147,38 +1211,111 @@ class CPUDevice : public Device {
           merged_buffer += merged_stride * pass_stride;
         }
       }
+    }
 
-      /* Denoise */
-      denoise_openimagedenoise_buffer(
-          task, merged.data(), 0, rect_size.x, 0, 0, rect_size.x, rect_size.y, 1.0f);
+    /* Denoise */
+    denoise_openimagedenoise_buffer(
+        task, merged.data(), 0, rect_size.x, 0, 0, rect_size.x, rect_size.y, 1.0f);
 
-      /* Copy back result from merged buffer. */
-      RenderTile &ntile = neighbors.target;
-      if (ntile.buffer) {
-        const int xmin = max(ntile.x, rect.x);
-        const int ymin = max(ntile.y, rect.y);
-        const int xmax = min(ntile.x + ntile.w, rect.z);
-        const int ymax = min(ntile.y + ntile.h, rect.w);
+    /* Copy back result from merged buffer. */
+    for (int t = 0; t < num_tiles; t++) {
+      RenderTile &ntile = tiles[t]->target;
+      if (!ntile.buffer) {
+        continue;
+      }
 
-        const size_t tile_offset = ntile.offset + xmin + ymin * ntile.stride;
-        float *tile_buffer = (float *)ntile.buffer + tile_offset * pass_stride;
+      const int xmin = max(ntile.x, rect.x);
+      const int ymin = max(ntile.y, rect.y);
+      const int xmax = min(ntile.x + ntile.w, rect.z);
+      const int ymax = min(ntile.y + ntile.h, rect.w);
 
-        const size_t merged_stride = rect_size.x;
-        const size_t merged_offset = (xmin - rect.x) + (ymin - rect.y) * merged_stride;
-        const float *merged_buffer = merged.data() + merged_offset * pass_stride;
+      const size_t tile_offset = ntile.offset + xmin + ymin * ntile.stride;
+      float *tile_buffer = (float *)ntile.buffer + tile_offset * pass_stride;
 
-        for (int y = ymin; y < ymax; y++) {
-          for (int x = 0; x < pass_stride * (xmax - xmin); x += pass_stride) {
-            tile_buffer[x + 0] = merged_buffer[x + 0] * invscale;
-            tile_buffer[x + 1] = merged_buffer[x + 1] * invscale;
-            tile_buffer[x + 2] = merged_buffer[x + 2] * invscale;
+      const size_t merged_stride = rect_size.x;
+      const size_t merged_offset = (xmin - rect.x) + (ymin - rect.y) * merged_stride;
+      const float *merged_buffer = merged.data() + merged_offset * pass_stride;
+
+      for (int y = ymin; y < ymax; y++) {
+        for (int x = 0; x < pass_stride * (xmax - xmin); x += pass_stride) {
+          tile_buffer[x + 0] = merged_buffer[x + 0] * invscale;
+          tile_buffer[x + 1] = merged_buffer[x + 1] * invscale;
+          tile_buffer[x + 2] = merged_buffer[x + 2] * invscale;
+        }
+        tile_buffer += ntile.stride * pass_stride;
+        merged_buffer += merged_stride * pass_stride;
+      }
+    }
+  }
+
+  /* Queue a tile for the denoise worker thread. Neighbors stay mapped until it is done. */
+  void denoise_openimagedenoise_push(DeviceTask &task, RenderTile &rtile)
+  {
+    RenderTileNeighbors *neighbors = denoise_openimagedenoise_map_tiles(task, rtile);
+
+    thread_scoped_lock lock(oidn_queue_mutex);
+    oidn_queue.push_back(neighbors);
+    oidn_queue_cond.notify_all();
+  }
+
+  static bool denoise_openimagedenoise_tile_order(const RenderTileNeighbors *a,
+                                                  const RenderTileNeighbors *b)
+  {
+    const RenderTile &tile_a = a->tiles[RenderTileNeighbors::CENTER];
+    const RenderTile &tile_b = b->tiles[RenderTileNeighbors::CENTER];
+    return (tile_a.y != tile_b.y) ? tile_a.y < tile_b.y : tile_a.x < tile_b.x;
+  }
+
+  /* Denoises tiles in the background while the thread that acquired them continues path
+   * tracing. All tiles queued while the previous batch was denoised are processed together,
+   * with horizontally adjacent tiles merged into one region. */
+  void denoise_openimagedenoise_worker(DeviceTask *task)
+  {
+    /* Limit region size, so memory usage for the merged buffer stays reasonable. */
+    const int max_batch_tiles = 8;
+
+    vector<RenderTileNeighbors *> batch;
+
+    while (true) {
+      {
+        thread_scoped_lock lock(oidn_queue_mutex);
+        while (oidn_queue.empty() && !oidn_queue_finish) {
+          oidn_queue_cond.wait(lock);
+        }
+        if (oidn_queue.empty()) {
+          return;
+        }
+        batch.swap(oidn_queue);
+      }
+
+      sort(batch.begin(), batch.end(), denoise_openimagedenoise_tile_order);
+
+      for (size_t start = 0; start < batch.size();) {
+        size_t end = start + 1;
+        while (end < batch.size() && end - start < max_batch_tiles) {
+          const RenderTile &prev = batch[end - 1]->tiles[RenderTileNeighbors::CENTER];
+          const RenderTile &next = batch[end]->tiles[RenderTileNeighbors::CENTER];
+          if (next.y != prev.y || next.h != prev.h || next.x != prev.x + prev.w ||
+              next.sample != prev.sample) {
+            break;
           }
-          tile_buffer += ntile.stride * pass_stride;
-          merged_buffer += merged_stride * pass_stride;
+          end++;
         }
+
+        denoise_openimagedenoise_tiles(*task, &batch[start], end - start);
+
+        for (size_t i = start; i < end; i++) {
+          RenderTile &tile = batch[i]->tiles[RenderTileNeighbors::CENTER];
+          task->unmap_neighbor_tiles(*batch[i], this);
+          task->update_progress(&tile, tile.w * tile.h);
+          task->release_tile(tile);
+          delete batch[i];
+        }
+
+        start = end;
       }
 
-      task.unmap_neighbor_tiles(neighbors, this);
+      batch.clear();
     }
   }
 
@@ -1229,6 +1366,9 @@ class CPUDevice : public Device {
 
     profiler.add_state(&kg->profiler);
 
+    /* Cryptomatte coverage, reused for all tiles rendered by this thread. */
+    Coverage coverage(kg);
+
     CPUSplitKernel *split_kernel = NULL;
     if (use_split_kernel) {
       split_kernel = new CPUSplitKernel(this);
@@ -1245,13 +1385,20 @@ class CPUDevice : public Device {
 
     /* OpenImageDenoise: we can only denoise with one thread at a time, so to
      * avoid waiting with mutex locks in the denoiser, we let only a single
-     * thread acquire denoising tiles. */
+     * thread acquire denoising tiles. It hands them to a worker thread, so it
+     * can continue path tracing while they are being denoised. */
     uint tile_types = task.tile_types;
     bool hold_denoise_lock = false;
+    thread *oidn_worker = NULL;
     if ((tile_types & RenderTile::DENOISE) && task.denoising.type == DENOISER_OPENIMAGEDENOISE) {
-      if (!oidn_task_lock.try_lock()) {
-        tile_types &= ~RenderTile::DENOISE;
+      if (oidn_task_lock.try_lock()) {
         hold_denoise_lock = true;
+        oidn_queue_finish = false;
+        oidn_worker = new thread(
+            function_bind(&CPUDevice::denoise_openimagedenoise_worker, this, &task));
+      }
+      else {
+        tile_types &= ~RenderTile::DENOISE;
       }
     }
 
@@ -1263,15 +1410,17 @@ class CPUDevice : public Device {
           split_kernel->path_trace(task, tile, kgbuffer, void_buffer);
         }
         else {
-          render(task, tile, kg);
+          render(task, tile, kg, coverage);
         }
       }
       else if (tile.task == RenderTile::BAKE) {
-        render(task, tile, kg);
+        render(task, tile, kg, coverage);
       }
       else if (tile.task == RenderTile::DENOISE) {
         if (task.denoising.type == DENOISER_OPENIMAGEDENOISE) {
-          denoise_openimagedenoise(task, tile);
+          /* The worker thread updates progress and releases the tile once denoised. */
+          denoise_openimagedenoise_push(task, tile);
+          continue;
         }
         else if (task.denoising.type == DENOISER_NLM) {
           if (denoising == NULL) {
@@ -1291,6 +1440,16 @@ class CPUDevice : public Device {
       }
     }
 
+    if (oidn_worker) {
+      {
+        thread_scoped_lock lock(oidn_queue_mutex);
+        oidn_queue_finish = true;
+        oidn_queue_cond.notify_all();
+      }
+      oidn_worker->join();
+      delete oidn_worker;
+    }
+
     if (hold_denoise_lock) {
       oidn_task_lock.unlock();
     }
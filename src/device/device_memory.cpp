@@ -17,6 +17,8 @@
 #include "device/device_memory.h"
 #include "device/device.h"
 
+#include "util/util_texture_compress.h"
+
 CCL_NAMESPACE_BEGIN
 
 /* Device Memory */
@@ -92,6 +94,14 @@ void device_memory::device_copy_to()
   }
 }
 
+void device_memory::device_copy_to_partial(size_t offset, size_t size)
+{
+  if (host_pointer) {
+    assert(offset + size <= memory_size());
+    device->mem_copy_to_partial(*this, offset, size);
+  }
+}
+
 void device_memory::device_copy_from(int y, int w, int h, int elem)
 {
   assert(type != MEM_TEXTURE && type != MEM_READ_ONLY && type != MEM_GLOBAL);
@@ -150,7 +160,7 @@ device_texture::device_texture(Device *device,
                                ImageDataType image_data_type,
                                InterpolationType interpolation,
                                ExtensionType extension)
-    : device_memory(device, name, MEM_TEXTURE), slot(slot)
+    : device_memory(device, name, MEM_TEXTURE), slot(slot), host_shared(false)
 {
   switch (image_data_type) {
     case IMAGE_DATA_TYPE_FLOAT4:
@@ -188,11 +198,23 @@ device_texture::device_texture(Device *device,
       data_elements = 1;
       break;
     case IMAGE_DATA_TYPE_OIIO:
+    case IMAGE_DATA_TYPE_PAGED:
+    case IMAGE_DATA_TYPE_LAZY:
       /* Assumes 64 bit pointers to be stored as uint. */
       static_assert(sizeof(void*) == sizeof(uint64_t), "");
       data_type = TYPE_UINT64;
       data_elements = 1;
       break;
+    case IMAGE_DATA_TYPE_BC1:
+    case IMAGE_DATA_TYPE_BC4:
+      /* One 64 bit block per 4x4 texels. */
+      data_type = TYPE_UINT64;
+      data_elements = 1;
+      break;
+    case IMAGE_DATA_TYPE_BC3:
+      data_type = TYPE_UINT64;
+      data_elements = 2;
+      break;
     case IMAGE_DATA_NUM_TYPES:
       assert(0);
       return;
@@ -207,13 +229,25 @@ device_texture::device_texture(Device *device,
 device_texture::~device_texture()
 {
   device_free();
+  if (host_shared) {
+    host_pointer = 0;
+  }
   host_free();
 }
 
 /* Host memory allocation. */
 void *device_texture::alloc(const size_t width, const size_t height, const size_t depth)
 {
-  const size_t new_size = size(width, height, depth);
+  /* Block compressed textures are sized in texels but stored in blocks of 4x4 texels. */
+  const bool is_block = (info.data_type == IMAGE_DATA_TYPE_BC1 ||
+                         info.data_type == IMAGE_DATA_TYPE_BC3 ||
+                         info.data_type == IMAGE_DATA_TYPE_BC4);
+  const size_t stored_width = is_block ? texture_num_blocks(width) : width;
+  const size_t stored_height = is_block ? texture_num_blocks(height) : height;
+
+  const size_t new_size = size(stored_width, stored_height, depth);
+  assert(!host_shared);
+  assert(!is_block || depth <= 1);
 
   if (new_size != data_size) {
     device_free();
@@ -223,8 +257,8 @@ void *device_texture::alloc(const size_t width, const size_t height, const size_
   }
 
   data_size = new_size;
-  data_width = width;
-  data_height = height;
+  data_width = stored_width;
+  data_height = stored_height;
   data_depth = depth;
 
   info.width = width;
@@ -239,4 +273,26 @@ void device_texture::copy_to_device()
   device_copy_to();
 }
 
+void device_texture::share_host_memory(const device_texture &other)
+{
+  assert(data_type == other.data_type && data_elements == other.data_elements);
+
+  device_free();
+  if (!host_shared) {
+    host_free();
+  }
+
+  host_pointer = other.host_pointer;
+  host_shared = true;
+
+  data_size = other.data_size;
+  data_width = other.data_width;
+  data_height = other.data_height;
+  data_depth = other.data_depth;
+
+  info.width = other.info.width;
+  info.height = other.info.height;
+  info.depth = other.info.depth;
+}
+
 CCL_NAMESPACE_END
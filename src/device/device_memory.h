@@ -253,6 +253,7 @@ class device_memory {
   void device_alloc();
   void device_free();
   void device_copy_to();
+  void device_copy_to_partial(size_t offset, size_t size);
   void device_copy_from(int y, int w, int h, int elem);
   void device_zero();
 
@@ -325,7 +326,7 @@ template<typename T> class device_only_memory : public device_memory {
 template<typename T> class device_vector : public device_memory {
  public:
   device_vector(Device *device, const char *name, MemoryType type)
-      : device_memory(device, name, type)
+      : device_memory(device, name, type), modified_begin(0), modified_end(0)
   {
     data_type = device_type_traits<T>::data_type;
     data_elements = device_type_traits<T>::num_elements;
@@ -348,6 +349,7 @@ template<typename T> class device_vector : public device_memory {
       host_free();
       host_pointer = host_alloc(sizeof(T) * new_size);
       assert(device_pointer == 0);
+      clear_modified();
     }
 
     data_size = new_size;
@@ -376,6 +378,7 @@ template<typename T> class device_vector : public device_memory {
       host_free();
       host_pointer = new_ptr;
       assert(device_pointer == 0);
+      clear_modified();
     }
 
     data_size = new_size;
@@ -398,6 +401,7 @@ template<typename T> class device_vector : public device_memory {
     data_depth = 0;
     host_pointer = from.steal_pointer();
     assert(device_pointer == 0);
+    clear_modified();
   }
 
   /* Free device and host memory. */
@@ -412,6 +416,8 @@ template<typename T> class device_vector : public device_memory {
     data_depth = 0;
     host_pointer = 0;
     assert(device_pointer == 0);
+
+    clear_modified();
   }
 
   size_t size()
@@ -433,6 +439,63 @@ template<typename T> class device_vector : public device_memory {
   void copy_to_device()
   {
     device_copy_to();
+    clear_modified();
+  }
+
+  /* Tag a range of elements as modified on the host, for incremental updates where only
+   * part of the data changed. */
+  void tag_modified(size_t offset, size_t num)
+  {
+    if (num == 0) {
+      return;
+    }
+
+    assert(offset + num <= data_size);
+
+    if (modified_end == modified_begin) {
+      modified_begin = offset;
+      modified_end = offset + num;
+    }
+    else {
+      modified_begin = (offset < modified_begin) ? offset : modified_begin;
+      modified_end = (offset + num > modified_end) ? offset + num : modified_end;
+    }
+  }
+
+  void tag_modified()
+  {
+    tag_modified(0, data_size);
+  }
+
+  bool is_modified() const
+  {
+    return modified_end != modified_begin;
+  }
+
+  void clear_modified()
+  {
+    modified_begin = 0;
+    modified_end = 0;
+  }
+
+  /* Copy the modified range to the device. If the memory was reallocated since the last
+   * copy, everything is copied. */
+  void copy_to_device_if_modified()
+  {
+    if (!is_modified()) {
+      return;
+    }
+
+    if (device_pointer && device_size == memory_size()) {
+      const size_t elem_size = memory_elements_size(1);
+      device_copy_to_partial(modified_begin * elem_size,
+                             (modified_end - modified_begin) * elem_size);
+    }
+    else {
+      device_copy_to();
+    }
+
+    clear_modified();
   }
 
   void copy_from_device()
@@ -455,6 +518,10 @@ template<typename T> class device_vector : public device_memory {
   {
     return width * ((height == 0) ? 1 : height) * ((depth == 0) ? 1 : depth);
   }
+
+  /* Range of elements modified on the host since the last copy to the device. */
+  size_t modified_begin;
+  size_t modified_end;
 };
 
 /* Pixel Memory
@@ -528,8 +595,14 @@ class device_texture : public device_memory {
   void *alloc(const size_t width, const size_t height, const size_t depth = 0);
   void copy_to_device();
 
+  /* Use the host memory of another texture with identical pixels instead of allocating
+   * own, the other texture must outlive this one. */
+  void share_host_memory(const device_texture &other);
+
   uint slot;
   TextureInfo info;
+  /* Host memory is owned by another texture. */
+  bool host_shared;
 
  protected:
   size_t size(const size_t width, const size_t height, const size_t depth)
@@ -371,6 +371,45 @@ class MultiDevice : public Device {
     stats.mem_alloc(mem.device_size - existing_size);
   }
 
+  void mem_copy_to_partial(device_memory &mem, size_t offset, size_t size)
+  {
+    device_ptr key = mem.device_pointer;
+
+    /* Nothing allocated yet, or memory that lives on every device. */
+    if (!key || strcmp(mem.name, "RenderBuffers") == 0) {
+      mem_copy_to(mem);
+      return;
+    }
+
+    size_t existing_size = mem.device_size;
+
+    foreach (const vector<SubDevice *> &island, peer_islands) {
+      SubDevice *owner_sub = find_suitable_mem_device(key, island);
+      mem.device = owner_sub->device;
+      mem.device_pointer = owner_sub->ptr_map[key];
+      mem.device_size = existing_size;
+
+      owner_sub->device->mem_copy_to_partial(mem, offset, size);
+
+      if (owner_sub->ptr_map[key] != mem.device_pointer) {
+        /* Device fell back to a full copy and reallocated, update the other devices. */
+        owner_sub->ptr_map[key] = mem.device_pointer;
+
+        if (mem.type == MEM_GLOBAL || mem.type == MEM_TEXTURE) {
+          foreach (SubDevice *island_sub, island) {
+            if (island_sub != owner_sub) {
+              island_sub->device->mem_copy_to(mem);
+            }
+          }
+        }
+      }
+    }
+
+    mem.device = this;
+    mem.device_pointer = key;
+    stats.mem_alloc(mem.device_size - existing_size);
+  }
+
   void mem_copy_from(device_memory &mem, int y, int w, int h, int elem)
   {
     device_ptr key = mem.device_pointer;
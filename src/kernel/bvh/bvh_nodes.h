@@ -28,6 +28,20 @@ ccl_device_forceinline Transform bvh_unaligned_node_fetch_space(KernelGlobals *k
   return space;
 }
 
+/* Bounds of one axis of both children of a compressed node, in the same order as an
+ * aligned node: child 0 min, child 1 min, child 0 max, child 1 max. The scale is a power
+ * of two stored as a biased float exponent, so decoding is exact. */
+ccl_device_forceinline float4 bvh_compressed_node_decode_axis(const float origin,
+                                                              const uint exponent,
+                                                              const uint quantized)
+{
+  const float scale = __uint_as_float((exponent & 0xFF) << 23);
+  return make_float4(origin + (float)(quantized & 0xFF) * scale,
+                     origin + (float)((quantized >> 8) & 0xFF) * scale,
+                     origin + (float)((quantized >> 16) & 0xFF) * scale,
+                     origin + (float)(quantized >> 24) * scale);
+}
+
 ccl_device_forceinline int bvh_aligned_node_intersect(KernelGlobals *kg,
                                                       const float3 P,
                                                       const float3 idir,
@@ -38,12 +52,25 @@ ccl_device_forceinline int bvh_aligned_node_intersect(KernelGlobals *kg,
 {
 
   /* fetch node data */
-#ifdef __VISIBILITY_FLAG__
   float4 cnodes = kernel_tex_fetch(__bvh_nodes, node_addr + 0);
-#endif
-  float4 node0 = kernel_tex_fetch(__bvh_nodes, node_addr + 1);
-  float4 node1 = kernel_tex_fetch(__bvh_nodes, node_addr + 2);
-  float4 node2 = kernel_tex_fetch(__bvh_nodes, node_addr + 3);
+  float4 node0, node1, node2;
+
+  if (__float_as_uint(cnodes.x) & PATH_RAY_NODE_COMPRESSED) {
+    /* Child bounds quantized to 8 bits relative to the node origin. */
+    const float4 origin = kernel_tex_fetch(__bvh_nodes, node_addr + 1);
+    const float4 quantized = kernel_tex_fetch(__bvh_nodes, node_addr + 2);
+    const uint exponents = __float_as_uint(origin.w);
+    node0 = bvh_compressed_node_decode_axis(origin.x, exponents, __float_as_uint(quantized.x));
+    node1 = bvh_compressed_node_decode_axis(
+        origin.y, exponents >> 8, __float_as_uint(quantized.y));
+    node2 = bvh_compressed_node_decode_axis(
+        origin.z, exponents >> 16, __float_as_uint(quantized.z));
+  }
+  else {
+    node0 = kernel_tex_fetch(__bvh_nodes, node_addr + 1);
+    node1 = kernel_tex_fetch(__bvh_nodes, node_addr + 2);
+    node2 = kernel_tex_fetch(__bvh_nodes, node_addr + 3);
+  }
 
   /* intersect ray against child nodes */
   float c0lox = (node0.x - P.x) * idir.x;
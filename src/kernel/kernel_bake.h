@@ -480,6 +480,36 @@ ccl_device void kernel_background_evaluate(KernelGlobals *kg,
   ShaderData sd;
   PathState state = {0};
   uint4 in = input[i];
+  int path_flag = 0; /* we can't know which type of BSDF this is for */
+
+  /* Procedural bakes evaluate the background closure of a shader at a point in space, the
+   * shader index is stored one based in the last component. */
+  if (in.w != 0) {
+    float3 P = make_float3(__uint_as_float(in.x), __uint_as_float(in.y), __uint_as_float(in.z));
+    float3 N = make_float3(0.0f, 0.0f, 1.0f);
+
+    shader_setup_from_sample(kg,
+                             &sd,
+                             P,
+                             N,
+                             N,
+                             NULL,
+                             in.w - 1,
+                             OBJECT_NONE,
+                             PRIM_NONE,
+                             0.0f,
+                             0.0f,
+                             0.0f,
+                             0.5f,
+                             false,
+                             LAMP_NONE);
+
+    shader_eval_surface(kg, &sd, &state, NULL, path_flag | PATH_RAY_EMISSION);
+    float3 color = shader_background_eval(&sd);
+
+    output[i] += make_float4(color.x, color.y, color.z, 0.0f);
+    return;
+  }
 
   /* setup ray */
   Ray ray;
@@ -502,7 +532,6 @@ ccl_device void kernel_background_evaluate(KernelGlobals *kg,
   shader_setup_from_background(kg, &sd, &ray);
 
   /* evaluate */
-  int path_flag = 0; /* we can't know which type of BSDF this is for */
   shader_eval_surface(kg, &sd, &state, NULL, path_flag | PATH_RAY_EMISSION);
   float3 color = shader_background_eval(&sd);
 
@@ -234,6 +234,9 @@ ccl_device_noinline_cpu float3 indirect_primitive_emission(
     /* multiple importance sampling, get triangle light pdf,
      * and compute weight with respect to BSDF pdf */
     float pdf = triangle_light_pdf(kg, sd, t);
+    if (kernel_data.integrator.use_light_tree) {
+      pdf *= light_tree_triangle_pdf_factor(kg, sd, t);
+    }
     float mis_weight = power_heuristic(bsdf_pdf, pdf);
 
     return L * mis_weight;
@@ -258,6 +261,10 @@ ccl_device_noinline_cpu void indirect_lamp_emission(KernelGlobals *kg,
     if (!lamp_light_eval(kg, lamp, ray->P, ray->D, ray->t, &ls))
       continue;
 
+    if (kernel_data.integrator.use_light_tree) {
+      ls.pdf *= light_tree_lamp_pdf_factor(kg, lamp, ray->P);
+    }
+
 #ifdef __PASSES__
     /* use visibility flag to skip lights */
     if (ls.shader & SHADER_EXCLUDE_ANY) {
@@ -22,6 +22,7 @@
 #include "kernel/kernel_profiling.h"
 
 #ifdef __KERNEL_CPU__
+#  include "util/util_coverage_map.h"
 #  include "util/util_map.h"
 #  include "util/util_vector.h"
 #endif
@@ -48,8 +49,6 @@ struct OSLShadingSystem;
 struct OIIOGlobals;
 #  endif
 
-typedef unordered_map<float, float> CoverageMap;
-
 struct Intersection;
 struct VolumeStep;
 
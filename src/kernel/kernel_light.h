@@ -611,14 +611,15 @@ ccl_device_forceinline void triangle_light_sample(KernelGlobals *kg,
 
 /* Light Distribution */
 
-ccl_device int light_distribution_sample(KernelGlobals *kg, float *randu)
+/* Sample an emitter from distribution entries [first, first + num). */
+ccl_device int light_distribution_sample_range(KernelGlobals *kg, float *randu, int first, int num)
 {
   /* This is basically std::upper_bound as used by pbrt, to find a point light or
    * triangle to emit from, proportional to area. a good improvement would be to
    * also sample proportional to power, though it's not so well defined with
    * arbitrary shaders. */
-  int first = 0;
-  int len = kernel_data.integrator.num_distribution + 1;
+  const int begin = first;
+  int len = num + 1;
   float r = *randu;
 
   do {
@@ -636,7 +637,7 @@ ccl_device int light_distribution_sample(KernelGlobals *kg, float *randu)
 
   /* Clamping should not be needed but float rounding errors seem to
    * make this fail on rare occasions. */
-  int index = clamp(first - 1, 0, kernel_data.integrator.num_distribution - 1);
+  int index = clamp(first - 1, begin, begin + num - 1);
 
   /* Rescale to reuse random number. this helps the 2D samples within
    * each area light be stratified as well. */
@@ -647,6 +648,183 @@ ccl_device int light_distribution_sample(KernelGlobals *kg, float *randu)
   return index;
 }
 
+ccl_device int light_distribution_sample(KernelGlobals *kg, float *randu)
+{
+  return light_distribution_sample_range(
+      kg, randu, 0, kernel_data.integrator.num_distribution);
+}
+
+/* Light Tree
+ *
+ * Local emitters are stored first in the distribution, ordered by the leaves of a
+ * BVH. Traversal picks a child proportional to its estimated contribution at the
+ * shading point, and the leaf emitter from the distribution. The returned factor
+ * converts the distribution pdf of the emitter into the pdf of the tree. */
+
+ccl_device_inline float light_tree_node_importance(const ccl_global KernelLightTreeNode *knode,
+                                                   float3 P)
+{
+  const float3 bbox_min = make_float3(knode->bbox_min[0], knode->bbox_min[1], knode->bbox_min[2]);
+  const float3 bbox_max = make_float3(knode->bbox_max[0], knode->bbox_max[1], knode->bbox_max[2]);
+  const float radius_sq = 0.25f * len_squared(bbox_max - bbox_min);
+
+  float dist;
+  const float3 D = safe_normalize_len(0.5f * (bbox_min + bbox_max) - P, &dist);
+  const float dist_sq = dist * dist;
+
+  float cos_theta = 1.0f;
+
+  if (knode->theta_o + knode->theta_e < M_PI_F) {
+    /* Angle between the cone axis and the direction towards P, reduced by the cone
+     * and the angle the bounding sphere subtends. */
+    const float3 axis = make_float3(knode->axis[0], knode->axis[1], knode->axis[2]);
+    const float theta = safe_acosf(dot(axis, -D));
+    const float theta_u = (dist_sq > radius_sq) ? safe_asinf(sqrtf(radius_sq / dist_sq)) :
+                                                  M_PI_F;
+    const float theta_prime = max(theta - knode->theta_o - theta_u, 0.0f);
+
+    if (theta_prime >= knode->theta_e) {
+      return 0.0f;
+    }
+
+    cos_theta = cosf(theta_prime);
+  }
+
+  return knode->energy * cos_theta / max(max(dist_sq, radius_sq), 1e-8f);
+}
+
+/* Probability to pick the left child of an inner node. */
+ccl_device_inline float light_tree_left_probability(KernelGlobals *kg,
+                                                    const ccl_global KernelLightTreeNode *knode,
+                                                    int node,
+                                                    float3 P)
+{
+  const ccl_global KernelLightTreeNode *left = &kernel_tex_fetch(__light_tree_nodes, node + 1);
+  const ccl_global KernelLightTreeNode *right = &kernel_tex_fetch(__light_tree_nodes,
+                                                                 knode->right_child);
+  const float left_importance = light_tree_node_importance(left, P);
+  const float right_importance = light_tree_node_importance(right, P);
+
+  if (left_importance + right_importance > 0.0f) {
+    return left_importance / (left_importance + right_importance);
+  }
+  else if (left->energy + right->energy > 0.0f) {
+    return left->energy / (left->energy + right->energy);
+  }
+
+  return 0.5f;
+}
+
+ccl_device_inline float light_tree_leaf_pdf_factor(KernelGlobals *kg,
+                                                   const ccl_global KernelLightTreeNode *knode,
+                                                   int num_local,
+                                                   float probability)
+{
+  const float local_area = kernel_tex_fetch(__light_distribution, num_local).totarea;
+  const float leaf_min = kernel_tex_fetch(__light_distribution, knode->first).totarea;
+  const float leaf_max = kernel_tex_fetch(__light_distribution, knode->first + knode->num).totarea;
+
+  return (leaf_max > leaf_min) ? local_area * probability / (leaf_max - leaf_min) : 0.0f;
+}
+
+ccl_device int light_tree_sample(KernelGlobals *kg, float3 P, float *randu, float *pdf_factor)
+{
+  const ccl_global KernelLightTreeNode *knode = &kernel_tex_fetch(__light_tree_nodes, 0);
+  const int num_local = knode->num;
+  const float local_area = kernel_tex_fetch(__light_distribution, num_local).totarea;
+  float r = *randu;
+
+  /* Distant and background lights keep their distribution probability. */
+  if (r >= local_area) {
+    *pdf_factor = 1.0f;
+    return light_distribution_sample(kg, randu);
+  }
+
+  r /= local_area;
+
+  int node = 0;
+  float probability = 1.0f;
+
+  while (knode->right_child != -1) {
+    const float p_left = light_tree_left_probability(kg, knode, node, P);
+
+    /* Rescale to reuse the random number for the next level. */
+    if (r < p_left) {
+      node = node + 1;
+      r = r / p_left;
+      probability *= p_left;
+    }
+    else {
+      node = knode->right_child;
+      r = (r - p_left) / (1.0f - p_left);
+      probability *= 1.0f - p_left;
+    }
+
+    r = min(r, 1.0f - FLT_EPSILON);
+    knode = &kernel_tex_fetch(__light_tree_nodes, node);
+  }
+
+  const float leaf_min = kernel_tex_fetch(__light_distribution, knode->first).totarea;
+  const float leaf_max = kernel_tex_fetch(__light_distribution, knode->first + knode->num).totarea;
+  *randu = leaf_min + r * (leaf_max - leaf_min);
+  *pdf_factor = light_tree_leaf_pdf_factor(kg, knode, num_local, probability);
+
+  return light_distribution_sample_range(kg, randu, knode->first, knode->num);
+}
+
+/* Factor for the pdf of distribution entry index, when sampled from P. */
+ccl_device float light_tree_pdf_factor(KernelGlobals *kg, float3 P, int index)
+{
+  const ccl_global KernelLightTreeNode *knode = &kernel_tex_fetch(__light_tree_nodes, 0);
+  const int num_local = knode->num;
+
+  if (index < 0 || index >= num_local) {
+    return 1.0f;
+  }
+
+  int node = 0;
+  float probability = 1.0f;
+
+  while (knode->right_child != -1) {
+    const float p_left = light_tree_left_probability(kg, knode, node, P);
+    const int right_child = knode->right_child;
+
+    if (index < kernel_tex_fetch(__light_tree_nodes, right_child).first) {
+      node = node + 1;
+      probability *= p_left;
+    }
+    else {
+      node = right_child;
+      probability *= 1.0f - p_left;
+    }
+
+    knode = &kernel_tex_fetch(__light_tree_nodes, node);
+  }
+
+  return light_tree_leaf_pdf_factor(kg, knode, num_local, probability);
+}
+
+ccl_device_inline float light_tree_triangle_pdf_factor(KernelGlobals *kg,
+                                                       ShaderData *sd,
+                                                       float t)
+{
+  const int offset = kernel_tex_fetch(__light_tree_emitters, sd->object);
+  if (offset == LIGHT_TREE_NONE) {
+    return 1.0f;
+  }
+
+  /* sd contains the point on the light source, the tree was sampled from Px. */
+  const float3 Px = sd->P + sd->I * t;
+  return light_tree_pdf_factor(kg, Px, kernel_tex_fetch(__light_tree_emitters, offset + sd->prim));
+}
+
+ccl_device_inline float light_tree_lamp_pdf_factor(KernelGlobals *kg, int lamp, float3 P)
+{
+  const int index = kernel_tex_fetch(__light_tree_emitters,
+                                     kernel_data.integrator.light_tree_lamp_offset + lamp);
+  return light_tree_pdf_factor(kg, P, index);
+}
+
 /* Generic Light */
 
 ccl_device_inline bool light_select_reached_max_bounces(KernelGlobals *kg, int index, int bounce)
@@ -665,7 +843,10 @@ ccl_device_noinline bool light_sample(KernelGlobals *kg,
 {
   if (lamp < 0) {
     /* sample index */
-    int index = light_distribution_sample(kg, &randu);
+    float pdf_factor = 1.0f;
+    int index = (kernel_data.integrator.use_light_tree) ?
+                    light_tree_sample(kg, P, &randu, &pdf_factor) :
+                    light_distribution_sample(kg, &randu);
 
     /* fetch light data */
     const ccl_global KernelLightDistribution *kdistribution = &kernel_tex_fetch(
@@ -678,10 +859,22 @@ ccl_device_noinline bool light_sample(KernelGlobals *kg,
 
       triangle_light_sample(kg, prim, object, randu, randv, time, ls, P);
       ls->shader |= shader_flag;
+      ls->pdf *= pdf_factor;
       return (ls->pdf > 0.0f);
     }
 
     lamp = -prim - 1;
+
+    if (UNLIKELY(light_select_reached_max_bounces(kg, lamp, bounce))) {
+      return false;
+    }
+
+    if (!lamp_light_sample(kg, lamp, randu, randv, P, ls)) {
+      return false;
+    }
+
+    ls->pdf *= pdf_factor;
+    return (ls->pdf > 0.0f);
   }
 
   if (UNLIKELY(light_select_reached_max_bounces(kg, lamp, bounce))) {
@@ -23,11 +23,25 @@
 
 CCL_NAMESPACE_BEGIN
 
+/* Kind of texture lookup, chosen from the ray type. Diffuse and glossy paths are blurred
+ * to hit coarser MIP levels, less important paths use a single level without filtering. */
+typedef enum OIIOLookupType {
+  OIIO_LOOKUP_FULL = 0,
+  OIIO_LOOKUP_GLOSSY,
+  OIIO_LOOKUP_DIFFUSE,
+  OIIO_LOOKUP_NEAREST,
+  OIIO_LOOKUP_NEAREST_GLOSSY,
+  OIIO_LOOKUP_NEAREST_DIFFUSE,
+
+  OIIO_LOOKUP_NUM_TYPES,
+} OIIOLookupType;
+
+/* Image slot of the texture system, with the lookup options for every lookup type built
+ * when the image is loaded rather than for every lookup. */
 struct OIIOTexture {
   OIIO::TextureSystem::TextureHandle *handle;
-  OIIO::TextureOpt::InterpMode interpolation;
-  OIIO::TextureOpt::Wrap extension;
-  bool is_linear;
+  OIIO::TextureOpt options[OIIO_LOOKUP_NUM_TYPES];
+  float missingcolor[4];
 };
 
 struct OIIOGlobals {
@@ -0,0 +1,213 @@
+/*
+ * Copyright 2011-2020 Blender Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __KERNEL_PAGED_IMAGE_H__
+#define __KERNEL_PAGED_IMAGE_H__
+
+#include <atomic>
+
+CCL_NAMESPACE_BEGIN
+
+/* Demand Paged Images
+ *
+ * CPU only. Every MIP level of the image is split into square tiles that are only loaded
+ * when a texture lookup first touches them, so texels that are never seen by a ray never
+ * take up memory. Loading and eviction are implemented on the host by ImageCache, the
+ * kernel only sees this interface. */
+
+#define PAGED_IMAGE_TILE_SIZE_LOG2 6
+#define PAGED_IMAGE_TILE_SIZE (1 << PAGED_IMAGE_TILE_SIZE_LOG2)
+#define PAGED_IMAGE_MAX_LEVELS 16
+#define PAGED_IMAGE_NUM_SHARDS 64
+
+/* Epoch based reclamation of evicted tiles. Texture lookups register as readers of the
+ * current epoch while they use tile pointers, and the host only advances the epoch when no
+ * reader of the one before is left. Tiles evicted in an epoch can no longer be seen by any
+ * lookup once the epoch advanced twice, their memory is then reused. */
+class KernelPagedImageEpoch {
+ public:
+  KernelPagedImageEpoch() : epoch(0)
+  {
+    for (int i = 0; i < PAGED_IMAGE_NUM_SHARDS; i++) {
+      shards[i].readers[0] = 0;
+      shards[i].readers[1] = 0;
+    }
+  }
+
+  /* Register a lookup as reader, returns the parity of the epoch to pass to exit(). */
+  ccl_always_inline int enter(int shard)
+  {
+    for (;;) {
+      const uint64_t current = epoch.load(std::memory_order_seq_cst);
+      const int parity = (int)(current & 1);
+      std::atomic<uint32_t> &readers = shards[shard].readers[parity];
+      readers.fetch_add(1, std::memory_order_seq_cst);
+      /* Retry if the epoch advanced before the reader was visible to the host. */
+      if (epoch.load(std::memory_order_seq_cst) == current) {
+        return parity;
+      }
+      readers.fetch_sub(1, std::memory_order_release);
+    }
+  }
+
+  ccl_always_inline void exit(int shard, int parity)
+  {
+    shards[shard].readers[parity].fetch_sub(1, std::memory_order_release);
+  }
+
+  /* Host only, by a single thread at a time. Advance the epoch if no reader of the previous
+   * one is left, and return the current epoch. */
+  uint64_t try_advance()
+  {
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    const uint64_t current = epoch.load(std::memory_order_relaxed);
+    const int previous = (int)((current + 1) & 1);
+    for (int i = 0; i < PAGED_IMAGE_NUM_SHARDS; i++) {
+      if (shards[i].readers[previous].load(std::memory_order_seq_cst) != 0) {
+        return current;
+      }
+    }
+    epoch.store(current + 1, std::memory_order_seq_cst);
+    return current + 1;
+  }
+
+  std::atomic<uint64_t> epoch;
+
+ protected:
+  /* Reader counts by epoch parity, padded to a cache line each like the hit counters. */
+  struct Shard {
+    std::atomic<uint32_t> readers[2];
+    char pad[64 - 2 * sizeof(std::atomic<uint32_t>)];
+  };
+  Shard shards[PAGED_IMAGE_NUM_SHARDS];
+};
+
+class KernelPagedImage {
+ public:
+  struct Tile {
+    /* Texels in the storage type of the image, row by row, NULL when not resident. */
+    std::atomic<void *> pixels;
+    /* Set on every access and cleared by the eviction clock, to approximate LRU. */
+    std::atomic<bool> used;
+  };
+
+  struct Level {
+    int width, height;
+    int tiles_x, tiles_y;
+    Tile *tiles;
+  };
+
+  KernelPagedImage() : readers(NULL), data_type(IMAGE_DATA_TYPE_BYTE4), num_levels(0)
+  {
+    for (int i = 0; i < PAGED_IMAGE_NUM_SHARDS; i++) {
+      shards[i].hits = 0;
+    }
+  }
+
+  virtual ~KernelPagedImage()
+  {
+  }
+
+  /* Texels of a tile, loading it on first access. The pointer stays valid until the lookup
+   * exits the reader epoch, even if the tile gets evicted meanwhile. */
+  ccl_always_inline const void *tile_pixels(int level, int tx, int ty, int shard)
+  {
+    Tile &tile = levels[level].tiles[ty * levels[level].tiles_x + tx];
+    void *pixels = tile.pixels.load(std::memory_order_acquire);
+
+    if (pixels) {
+      /* Avoid writing to shared cache lines when the flag is already set. */
+      if (!tile.used.load(std::memory_order_relaxed)) {
+        tile.used.store(true, std::memory_order_relaxed);
+      }
+      /* No atomic increment, threads sharing a shard may lose a few counts but hits
+       * stay as cheap as a regular texture lookup. */
+      std::atomic<uint64_t> &hits = shards[shard].hits;
+      hits.store(hits.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+      return pixels;
+    }
+
+    return load_tile(level, tx, ty);
+  }
+
+  uint64_t num_hits() const
+  {
+    uint64_t hits = 0;
+    for (int i = 0; i < PAGED_IMAGE_NUM_SHARDS; i++) {
+      hits += shards[i].hits.load(std::memory_order_relaxed);
+    }
+    return hits;
+  }
+
+  /* Readers of the cache the tiles are stored in. */
+  KernelPagedImageEpoch *readers;
+
+  /* Storage type of the texels, one of the 2D image data types. */
+  ImageDataType data_type;
+
+  int num_levels;
+  Level levels[PAGED_IMAGE_MAX_LEVELS];
+
+ protected:
+  /* Slow path, loads the tile if no other thread did in the meantime. */
+  virtual const void *load_tile(int level, int tx, int ty) = 0;
+
+  /* Hit counters, padded to a cache line each so render threads don't share them. */
+  struct Shard {
+    std::atomic<uint64_t> hits;
+    char pad[64 - sizeof(std::atomic<uint64_t>)];
+  };
+  Shard shards[PAGED_IMAGE_NUM_SHARDS];
+};
+
+/* Lazily Loaded Images
+ *
+ * CPU only. The whole image is loaded on the first texture lookup, for UDIM tiles of which
+ * only a few may be seen by rays. Threads looking up the image while it is being loaded wait
+ * for it, so renders do not depend on the timing of the loading. */
+
+class KernelLazyImage {
+ public:
+  KernelLazyImage() : info(NULL)
+  {
+  }
+
+  virtual ~KernelLazyImage()
+  {
+  }
+
+  /* Texture of the loaded pixels, loading them on first access. */
+  ccl_always_inline const TextureInfo *texture()
+  {
+    const TextureInfo *loaded = info.load(std::memory_order_acquire);
+    return (loaded) ? loaded : load();
+  }
+
+  bool is_loaded() const
+  {
+    return info.load(std::memory_order_acquire) != NULL;
+  }
+
+ protected:
+  /* Slow path, loads the pixels if no other thread did in the meantime. */
+  virtual const TextureInfo *load() = 0;
+
+  std::atomic<const TextureInfo *> info;
+};
+
+CCL_NAMESPACE_END
+
+#endif /* __KERNEL_PAGED_IMAGE_H__ */
@@ -34,11 +34,13 @@ CCL_NAMESPACE_BEGIN
     if ((object) != PRIM_NONE) { \
       profiling_helper.set_object(object); \
     }
+#  define PROFILING_TEXTURE(texture) profiling_helper.set_texture(texture)
 #else
 #  define PROFILING_INIT(kg, event)
 #  define PROFILING_EVENT(event)
 #  define PROFILING_SHADER(shader)
 #  define PROFILING_OBJECT(object)
+#  define PROFILING_TEXTURE(texture)
 #endif /* __KERNEL_CPU__ */
 
 CCL_NAMESPACE_END
@@ -303,8 +303,8 @@ enum PathRayFlag {
                                  PATH_RAY_SHADOW_TRANSPARENT_NON_CATCHER),
   PATH_RAY_SHADOW = (PATH_RAY_SHADOW_OPAQUE | PATH_RAY_SHADOW_TRANSPARENT),
 
-  /* Unused, free to reuse. */
-  PATH_RAY_UNUSED = (1 << 11),
+  /* Special flag to tag compressed BVH nodes. */
+  PATH_RAY_NODE_COMPRESSED = (1 << 11),
 
   /* Ray visibility for volume scattering. */
   PATH_RAY_VOLUME_SCATTER = (1 << 12),
@@ -1451,7 +1451,9 @@ typedef struct KernelIntegrator {
 
   int max_closures;
 
-  int pad1, pad2;
+  /* light tree */
+  int use_light_tree;
+  int light_tree_lamp_offset;
 } KernelIntegrator;
 static_assert_align(KernelIntegrator, 16);
 
@@ -1553,6 +1555,18 @@ typedef struct KernelObject {
 } KernelObject;
 static_assert_align(KernelObject, 16);
 
+/* Majorant grid of a volume object, offset is -1 when there is none. Cells are scaled by the
+ * bound of the shader extinction relative to the density. */
+typedef struct KernelVolumeMajorant {
+  Transform tfm;
+  int offset;
+  int res_x, res_y, res_z;
+  float scale;
+  int emission;
+  int pad1, pad2;
+} KernelVolumeMajorant;
+static_assert_align(KernelVolumeMajorant, 16);
+
 typedef struct KernelSpotLight {
   float radius;
   float invarea;
@@ -1615,6 +1629,29 @@ typedef struct KernelLightDistribution {
 } KernelLightDistribution;
 static_assert_align(KernelLightDistribution, 16);
 
+/* Light tree node, bounding the emitters of the light distribution by position and
+ * emission direction. Emitters [first, first + num) in the distribution belong to the
+ * node. Inner nodes have the left child directly after them. */
+typedef struct KernelLightTreeNode {
+  float bbox_min[3];
+  float energy;
+  float bbox_max[3];
+  /* Bounding cone of the normals. */
+  float theta_o;
+  float axis[3];
+  /* Spread of emission around the normals. */
+  float theta_e;
+  int first;
+  int num;
+  /* -1 for leaf nodes. */
+  int right_child;
+  int pad;
+} KernelLightTreeNode;
+static_assert_align(KernelLightTreeNode, 16);
+
+/* Emitter table entry for primitives and lamps that are not in the light distribution. */
+#define LIGHT_TREE_NONE 0x7FFFFFFF
+
 typedef struct KernelParticle {
   int index;
   float age;
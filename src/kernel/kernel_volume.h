@@ -191,6 +191,189 @@ ccl_device_inline void kernel_volume_step_init(KernelGlobals *kg,
   *step_offset = path_state_rng_1D_hash(kg, state, 0x1e31d8a4) * step;
 }
 
+/* Volume Majorant
+ *
+ * Coarse grid of a volume object per block of voxels, with an upper bound of the extinction in
+ * each cell and zero where the volume is empty. Shadows use ratio tracking and distance
+ * sampling uses delta tracking with it, so empty cells are skipped and free-flight steps are
+ * long where the volume is thin. Only used when the object is the only volume in the stack. */
+
+typedef struct VolumeMajorant {
+  int offset;
+  int res[3];
+  float P[3], D[3];
+  float scale;
+  bool emission;
+
+  /* Current cell for traversing the grid from t_enter to t_exit. */
+  int cell[3];
+  int step[3];
+  float t_max[3];
+  float t_delta[3];
+  float t_enter, t_exit;
+
+  /* Current segment along the ray, with its extinction bound. Before and after the grid the
+   * volume is empty. */
+  float seg_end;
+  float value;
+} VolumeMajorant;
+
+ccl_device_inline void kernel_volume_majorant_load_cell(KernelGlobals *kg, VolumeMajorant *m)
+{
+  const float t_next = fminf(fminf(m->t_max[0], m->t_max[1]), m->t_max[2]);
+  const int index = (m->cell[2] * m->res[1] + m->cell[1]) * m->res[0] + m->cell[0];
+
+  m->seg_end = fminf(t_next, m->t_exit);
+  m->value = kernel_tex_fetch(__volume_majorant, m->offset + index) * m->scale;
+}
+
+ccl_device_inline void kernel_volume_majorant_enter(KernelGlobals *kg, VolumeMajorant *m)
+{
+  for (int a = 0; a < 3; a++) {
+    const float p = m->P[a] + m->t_enter * m->D[a];
+    m->cell[a] = clamp((int)floorf(p), 0, m->res[a] - 1);
+
+    if (m->D[a] > 0.0f) {
+      m->step[a] = 1;
+      m->t_delta[a] = 1.0f / m->D[a];
+      m->t_max[a] = m->t_enter + (m->cell[a] + 1 - p) * m->t_delta[a];
+    }
+    else if (m->D[a] < 0.0f) {
+      m->step[a] = -1;
+      m->t_delta[a] = -1.0f / m->D[a];
+      m->t_max[a] = m->t_enter + (p - m->cell[a]) * m->t_delta[a];
+    }
+    else {
+      m->step[a] = 0;
+      m->t_delta[a] = FLT_MAX;
+      m->t_max[a] = FLT_MAX;
+    }
+  }
+
+  kernel_volume_majorant_load_cell(kg, m);
+}
+
+ccl_device_inline void kernel_volume_majorant_leave(VolumeMajorant *m, float ray_t)
+{
+  m->t_enter = m->t_exit = ray_t;
+  m->seg_end = ray_t;
+  m->value = 0.0f;
+}
+
+/* Move to the segment following the current one. */
+ccl_device void kernel_volume_majorant_advance(KernelGlobals *kg, VolumeMajorant *m, float ray_t)
+{
+  if (m->seg_end < m->t_enter) {
+    kernel_volume_majorant_enter(kg, m);
+    return;
+  }
+  if (m->seg_end >= m->t_exit) {
+    kernel_volume_majorant_leave(m, ray_t);
+    return;
+  }
+
+  const int a = (m->t_max[0] < m->t_max[1]) ? ((m->t_max[0] < m->t_max[2]) ? 0 : 2) :
+                                              ((m->t_max[1] < m->t_max[2]) ? 1 : 2);
+  m->cell[a] += m->step[a];
+  m->t_max[a] += m->t_delta[a];
+
+  if (m->cell[a] < 0 || m->cell[a] >= m->res[a]) {
+    kernel_volume_majorant_leave(m, ray_t);
+    return;
+  }
+
+  kernel_volume_majorant_load_cell(kg, m);
+}
+
+ccl_device bool kernel_volume_majorant_init(KernelGlobals *kg,
+                                            ccl_addr_space VolumeStack *stack,
+                                            Ray *ray,
+                                            VolumeMajorant *m)
+{
+  if (stack[0].shader == SHADER_NONE || stack[0].object == OBJECT_NONE ||
+      stack[1].shader != SHADER_NONE) {
+    return false;
+  }
+
+  const KernelVolumeMajorant info = kernel_tex_fetch(__object_volume_majorant, stack[0].object);
+  if (info.offset < 0) {
+    return false;
+  }
+
+  const float3 P = transform_point(&info.tfm, ray->P);
+  const float3 D = transform_direction(&info.tfm, ray->D);
+
+  m->offset = info.offset;
+  m->res[0] = info.res_x;
+  m->res[1] = info.res_y;
+  m->res[2] = info.res_z;
+  m->P[0] = P.x;
+  m->P[1] = P.y;
+  m->P[2] = P.z;
+  m->D[0] = D.x;
+  m->D[1] = D.y;
+  m->D[2] = D.z;
+  m->scale = info.scale;
+  m->emission = (info.emission != 0);
+
+  /* Clip the ray to the grid. */
+  float t0 = 0.0f, t1 = ray->t;
+  for (int a = 0; a < 3; a++) {
+    if (m->D[a] != 0.0f) {
+      const float inv_d = 1.0f / m->D[a];
+      const float near_t = (0.0f - m->P[a]) * inv_d;
+      const float far_t = (m->res[a] - m->P[a]) * inv_d;
+      t0 = fmaxf(t0, fminf(near_t, far_t));
+      t1 = fminf(t1, fmaxf(near_t, far_t));
+    }
+    else if (m->P[a] < 0.0f || m->P[a] > m->res[a]) {
+      t1 = -1.0f;
+    }
+  }
+
+  if (t0 >= t1) {
+    kernel_volume_majorant_leave(m, ray->t);
+  }
+  else {
+    m->t_enter = t0;
+    m->t_exit = t1;
+    if (t0 > 0.0f) {
+      m->seg_end = t0;
+      m->value = 0.0f;
+    }
+    else {
+      kernel_volume_majorant_enter(kg, m);
+    }
+  }
+
+  return true;
+}
+
+/* Sample the next tentative collision after t, for a free-flight optical depth tau measured
+ * with the majorant. Returns false when the ray leaves the volume first. */
+ccl_device bool kernel_volume_majorant_sample(
+    KernelGlobals *kg, VolumeMajorant *m, float ray_t, float tau, float *t)
+{
+  for (;;) {
+    const float seg_end = fminf(m->seg_end, ray_t);
+
+    if (m->value > 0.0f && seg_end > *t) {
+      const float seg_tau = m->value * (seg_end - *t);
+      if (tau < seg_tau) {
+        *t += tau / m->value;
+        return true;
+      }
+      tau -= seg_tau;
+    }
+
+    *t = fmaxf(*t, seg_end);
+    if (*t >= ray_t) {
+      return false;
+    }
+    kernel_volume_majorant_advance(kg, m, ray_t);
+  }
+}
+
 /* Volume Shadows
  *
  * These functions are used to attenuate shadow rays to lights. Both absorption
@@ -272,6 +455,47 @@ ccl_device void kernel_volume_shadow_heterogeneous(KernelGlobals *kg,
   *throughput = tp;
 }
 
+/* heterogeneous volume with a majorant: ratio tracking, multiplying the throughput by the
+ * probability of a null collision at tentative collisions sampled with the majorant */
+ccl_device void kernel_volume_shadow_ratio_tracking(KernelGlobals *kg,
+                                                    ccl_addr_space PathState *state,
+                                                    Ray *ray,
+                                                    ShaderData *sd,
+                                                    VolumeMajorant *majorant,
+                                                    float3 *throughput)
+{
+  float3 tp = *throughput;
+  const float tp_eps = 1e-6f; /* todo: this is likely not the right value */
+  const int max_steps = kernel_data.integrator.volume_max_steps;
+
+  uint lcg_state = lcg_state_init_addrspace(state, 0x4f8a1b2c);
+  float xi = path_state_rng_1D_hash(kg, state, 0x1e31d8a4);
+  float t = 0.0f;
+
+  for (int i = 0; i < max_steps; i++) {
+    if (!kernel_volume_majorant_sample(kg, majorant, ray->t, -logf(1.0f - xi), &t)) {
+      break;
+    }
+
+    float3 new_P = ray->P + ray->D * t;
+    float3 sigma_t = make_float3(0.0f, 0.0f, 0.0f);
+
+    if (volume_shader_extinction_sample(kg, sd, state, new_P, &sigma_t)) {
+      /* clamped for extinction above the bound, which would make the estimate negative */
+      tp = max(tp * (make_float3(1.0f, 1.0f, 1.0f) - sigma_t / majorant->value),
+               make_float3(0.0f, 0.0f, 0.0f));
+
+      /* stop if nearly all light is blocked */
+      if (tp.x < tp_eps && tp.y < tp_eps && tp.z < tp_eps)
+        break;
+    }
+
+    xi = lcg_step_float(&lcg_state);
+  }
+
+  *throughput = tp;
+}
+
 /* get the volume attenuation over line segment defined by ray, with the
  * assumption that there are no surfaces blocking light between the endpoints */
 ccl_device_noinline void kernel_volume_shadow(KernelGlobals *kg,
@@ -283,8 +507,13 @@ ccl_device_noinline void kernel_volume_shadow(KernelGlobals *kg,
   shader_setup_from_volume(kg, shadow_sd, ray);
 
   float step_size = volume_stack_step_size(kg, state->volume_stack);
-  if (step_size != FLT_MAX)
-    kernel_volume_shadow_heterogeneous(kg, state, ray, shadow_sd, throughput, step_size);
+  if (step_size != FLT_MAX) {
+    VolumeMajorant majorant;
+    if (kernel_volume_majorant_init(kg, state->volume_stack, ray, &majorant))
+      kernel_volume_shadow_ratio_tracking(kg, state, ray, shadow_sd, &majorant, throughput);
+    else
+      kernel_volume_shadow_heterogeneous(kg, state, ray, shadow_sd, throughput, step_size);
+  }
   else
     kernel_volume_shadow_homogeneous(kg, state, ray, shadow_sd, throughput);
 }
@@ -690,6 +919,82 @@ kernel_volume_integrate_heterogeneous_distance(KernelGlobals *kg,
   return VOLUME_PATH_ATTENUATED;
 }
 
+/* heterogeneous volume with a majorant: delta tracking, tentative collisions are sampled with
+ * the majorant and either scatter or continue as null collisions. With colored extinction the
+ * probabilities follow the coefficients weighted by the throughput of all channels, and the
+ * throughput is multiplied by the ratio of coefficient and probability (spectral tracking).
+ * Emission is not bounded by the majorant, volumes with emission use ray marching instead. */
+ccl_device VolumeIntegrateResult
+kernel_volume_integrate_delta_tracking(KernelGlobals *kg,
+                                       ccl_addr_space PathState *state,
+                                       Ray *ray,
+                                       ShaderData *sd,
+                                       VolumeMajorant *majorant,
+                                       ccl_addr_space float3 *throughput)
+{
+  float3 tp = *throughput;
+  const float tp_eps = 1e-6f; /* todo: this is likely not the right value */
+  const int max_steps = kernel_data.integrator.volume_max_steps;
+  const float3 zero = make_float3(0.0f, 0.0f, 0.0f);
+
+  uint lcg_state = lcg_state_init_addrspace(state, 0x7d3e9a15);
+  float xi = path_state_rng_1D(kg, state, PRNG_SCATTER_DISTANCE);
+  float t = 0.0f;
+
+  for (int i = 0; i < max_steps; i++) {
+    if (!kernel_volume_majorant_sample(kg, majorant, ray->t, -logf(1.0f - xi), &t)) {
+      break;
+    }
+
+    float3 new_P = ray->P + ray->D * t;
+    VolumeShaderCoefficients coeff ccl_optional_struct_init;
+
+    if (volume_shader_sample(kg, sd, state, new_P, &coeff)) {
+      int closure_flag = sd->flag;
+      const float sigma_bar = majorant->value;
+      const float3 sigma_t = (closure_flag & SD_EXTINCTION) ? coeff.sigma_t : zero;
+      const float3 sigma_n = make_float3(sigma_bar, sigma_bar, sigma_bar) - sigma_t;
+      float p_null = 1.0f;
+
+#  ifdef __VOLUME_SCATTER__
+      if (closure_flag & SD_SCATTER) {
+        const float scatter_weight = dot(coeff.sigma_s, tp);
+        const float null_weight = dot(fabs(sigma_n), tp);
+
+        /* decide if we will scatter or continue */
+        p_null = (scatter_weight + null_weight > 0.0f) ?
+                     null_weight / (scatter_weight + null_weight) :
+                     0.0f;
+        if (lcg_step_float(&lcg_state) >= p_null) {
+          tp *= coeff.sigma_s / (sigma_bar * (1.0f - p_null));
+
+          /* move to new location to scatter to new direction */
+          sd->P = new_P;
+          *throughput = tp;
+
+          return VOLUME_PATH_SCATTERED;
+        }
+      }
+#  endif
+
+      /* null collision, clamped for extinction above the bound */
+      tp = max(tp * sigma_n / (sigma_bar * p_null), zero);
+
+      /* stop if nearly all light blocked */
+      if (tp.x < tp_eps && tp.y < tp_eps && tp.z < tp_eps) {
+        tp = zero;
+        break;
+      }
+    }
+
+    xi = lcg_step_float(&lcg_state);
+  }
+
+  *throughput = tp;
+
+  return VOLUME_PATH_ATTENUATED;
+}
+
 /* get the volume attenuation and emission over line segment defined by
  * ray, with the assumption that there are no surfaces blocking light
  * between the endpoints. distance sampling is used to decide if we will
@@ -706,9 +1011,15 @@ kernel_volume_integrate(KernelGlobals *kg,
 {
   shader_setup_from_volume(kg, sd, ray);
 
-  if (step_size != FLT_MAX)
+  if (step_size != FLT_MAX) {
+    VolumeMajorant majorant;
+    if (kernel_volume_majorant_init(kg, state->volume_stack, ray, &majorant) &&
+        !majorant.emission)
+      return kernel_volume_integrate_delta_tracking(kg, state, ray, sd, &majorant, throughput);
+
     return kernel_volume_integrate_heterogeneous_distance(
         kg, state, buffer, ray, sd, L, throughput, step_size);
+  }
   else
     return kernel_volume_integrate_homogeneous(kg, state, buffer, ray, sd, L, throughput, true);
 }
@@ -22,6 +22,11 @@
 #  include <nanovdb/util/SampleFromVoxels.h>
 #endif
 
+#include "kernel/kernel_paged_image.h"
+
+#include "util/util_hash.h"
+#include "util/util_texture_compress.h"
+
 #ifdef __OIIO__
 #  include "kernel/kernel_oiio_globals.h"
 #  define NEAREST_LOOKUP_PATHS \
@@ -483,6 +488,199 @@ template<typename T> struct TextureInterpolator {
   }
 };
 
+/* Interpolation of demand paged images, loading the tiles that are touched. */
+template<typename T> struct PagedTextureInterpolator {
+  static ccl_always_inline float4
+  read(KernelPagedImage *image, int level, int x, int y, int shard)
+  {
+    const KernelPagedImage::Level &l = image->levels[level];
+    if (x < 0 || y < 0 || x >= l.width || y >= l.height) {
+      return make_float4(0.0f, 0.0f, 0.0f, 0.0f);
+    }
+    const T *pixels = (const T *)image->tile_pixels(
+        level, x >> PAGED_IMAGE_TILE_SIZE_LOG2, y >> PAGED_IMAGE_TILE_SIZE_LOG2, shard);
+    const int tile_x = x & (PAGED_IMAGE_TILE_SIZE - 1);
+    const int tile_y = y & (PAGED_IMAGE_TILE_SIZE - 1);
+    return TextureInterpolator<T>::read(pixels[(tile_y << PAGED_IMAGE_TILE_SIZE_LOG2) + tile_x]);
+  }
+
+  static ccl_always_inline int wrap(int x, int width, uint extension)
+  {
+    switch (extension) {
+      case EXTENSION_REPEAT:
+        return TextureInterpolator<T>::wrap_periodic(x, width);
+      case EXTENSION_EXTEND:
+        return TextureInterpolator<T>::wrap_clamp(x, width);
+      default:
+        /* Clip, read() returns zero outside of the image. */
+        return x;
+    }
+  }
+
+  static ccl_always_inline float4 interp(
+      const TextureInfo &info, KernelPagedImage *image, int level, float x, float y, int shard)
+  {
+    const int width = image->levels[level].width;
+    const int height = image->levels[level].height;
+    int ix, iy;
+
+    switch (info.interpolation) {
+      case INTERPOLATION_CLOSEST: {
+        if (info.extension == EXTENSION_CLIP && (x < 0.0f || y < 0.0f || x > 1.0f || y > 1.0f)) {
+          return make_float4(0.0f, 0.0f, 0.0f, 0.0f);
+        }
+        frac(x * (float)width, &ix);
+        frac(y * (float)height, &iy);
+        const uint extension = (info.extension == EXTENSION_REPEAT) ? EXTENSION_REPEAT :
+                                                                       EXTENSION_EXTEND;
+        return read(image, level, wrap(ix, width, extension), wrap(iy, height, extension), shard);
+      }
+      case INTERPOLATION_LINEAR: {
+        const float tx = frac(x * (float)width - 0.5f, &ix);
+        const float ty = frac(y * (float)height - 0.5f, &iy);
+        const int x0 = wrap(ix, width, info.extension);
+        const int x1 = wrap(ix + 1, width, info.extension);
+        const int y0 = wrap(iy, height, info.extension);
+        const int y1 = wrap(iy + 1, height, info.extension);
+        return (1.0f - ty) * ((1.0f - tx) * read(image, level, x0, y0, shard) +
+                              tx * read(image, level, x1, y0, shard)) +
+               ty * ((1.0f - tx) * read(image, level, x0, y1, shard) +
+                     tx * read(image, level, x1, y1, shard));
+      }
+      default: {
+        const float tx = frac(x * (float)width - 0.5f, &ix);
+        const float ty = frac(y * (float)height - 0.5f, &iy);
+        float u[4], v[4];
+        SET_CUBIC_SPLINE_WEIGHTS(u, tx);
+        SET_CUBIC_SPLINE_WEIGHTS(v, ty);
+
+        float4 r = make_float4(0.0f, 0.0f, 0.0f, 0.0f);
+        for (int j = 0; j < 4; j++) {
+          const int yj = wrap(iy + j - 1, height, info.extension);
+          float4 row = make_float4(0.0f, 0.0f, 0.0f, 0.0f);
+          for (int i = 0; i < 4; i++) {
+            row += u[i] * read(image, level, wrap(ix + i - 1, width, info.extension), yj, shard);
+          }
+          r += v[j] * row;
+        }
+        return r;
+      }
+    }
+  }
+};
+
+/* MIP level matching the footprint of the lookup, the finest one the file has when the
+ * footprint is smaller than a texel. */
+ccl_device_inline int paged_image_level(const KernelPagedImage *image,
+                                        differential ds,
+                                        differential dt)
+{
+  const float footprint = max(max(fabsf(ds.dx), fabsf(ds.dy)) * image->levels[0].width,
+                              max(fabsf(dt.dx), fabsf(dt.dy)) * image->levels[0].height);
+  if (!(footprint > 1.0f)) {
+    return 0;
+  }
+  const int level = (int)log2f(min(footprint, 1e9f));
+  return min(level, image->num_levels - 1);
+}
+
+/* Interpolation of block compressed images, decoding the texels that are touched. */
+template<typename B> struct BlockTextureInterpolator {
+  static ccl_always_inline float4 decode(const TextureBlockBC1 &block, int i)
+  {
+    return texture_block_decode(block, i, false);
+  }
+
+  static ccl_always_inline float4 decode(const TextureBlockBC3 &block, int i)
+  {
+    float4 r = texture_block_decode(block.color, i, true);
+    r.w = texture_block_decode(block.alpha, i) * (1.0f / 255.0f);
+    return r;
+  }
+
+  static ccl_always_inline float4 decode(const TextureBlockBC4 &block, int i)
+  {
+    const float f = texture_block_decode(block, i) * (1.0f / 255.0f);
+    return make_float4(f, f, f, 1.0f);
+  }
+
+  static ccl_always_inline float4 read(const TextureInfo &info, int x, int y)
+  {
+    if (x < 0 || y < 0 || x >= info.width || y >= info.height) {
+      return make_float4(0.0f, 0.0f, 0.0f, 0.0f);
+    }
+    const B *blocks = (const B *)info.data;
+    const int blocks_x = texture_num_blocks(info.width);
+    const B &block = blocks[(y >> 2) * blocks_x + (x >> 2)];
+    return decode(block, ((y & 3) << 2) + (x & 3));
+  }
+
+  static ccl_always_inline int wrap(int x, int width, uint extension)
+  {
+    switch (extension) {
+      case EXTENSION_REPEAT:
+        return TextureInterpolator<uchar>::wrap_periodic(x, width);
+      case EXTENSION_EXTEND:
+        return TextureInterpolator<uchar>::wrap_clamp(x, width);
+      default:
+        /* Clip, read() returns zero outside of the image. */
+        return x;
+    }
+  }
+
+  static ccl_always_inline float4 interp(const TextureInfo &info, float x, float y)
+  {
+    if (UNLIKELY(!info.data)) {
+      return make_float4(0.0f, 0.0f, 0.0f, 0.0f);
+    }
+
+    const int width = info.width;
+    const int height = info.height;
+    int ix, iy;
+
+    switch (info.interpolation) {
+      case INTERPOLATION_CLOSEST: {
+        if (info.extension == EXTENSION_CLIP && (x < 0.0f || y < 0.0f || x > 1.0f || y > 1.0f)) {
+          return make_float4(0.0f, 0.0f, 0.0f, 0.0f);
+        }
+        frac(x * (float)width, &ix);
+        frac(y * (float)height, &iy);
+        const uint extension = (info.extension == EXTENSION_REPEAT) ? EXTENSION_REPEAT :
+                                                                       EXTENSION_EXTEND;
+        return read(info, wrap(ix, width, extension), wrap(iy, height, extension));
+      }
+      case INTERPOLATION_LINEAR: {
+        const float tx = frac(x * (float)width - 0.5f, &ix);
+        const float ty = frac(y * (float)height - 0.5f, &iy);
+        const int x0 = wrap(ix, width, info.extension);
+        const int x1 = wrap(ix + 1, width, info.extension);
+        const int y0 = wrap(iy, height, info.extension);
+        const int y1 = wrap(iy + 1, height, info.extension);
+        return (1.0f - ty) * ((1.0f - tx) * read(info, x0, y0) + tx * read(info, x1, y0)) +
+               ty * ((1.0f - tx) * read(info, x0, y1) + tx * read(info, x1, y1));
+      }
+      default: {
+        const float tx = frac(x * (float)width - 0.5f, &ix);
+        const float ty = frac(y * (float)height - 0.5f, &iy);
+        float u[4], v[4];
+        SET_CUBIC_SPLINE_WEIGHTS(u, tx);
+        SET_CUBIC_SPLINE_WEIGHTS(v, ty);
+
+        float4 r = make_float4(0.0f, 0.0f, 0.0f, 0.0f);
+        for (int j = 0; j < 4; j++) {
+          const int yj = wrap(iy + j - 1, height, info.extension);
+          float4 row = make_float4(0.0f, 0.0f, 0.0f, 0.0f);
+          for (int i = 0; i < 4; i++) {
+            row += u[i] * read(info, wrap(ix + i - 1, width, info.extension), yj);
+          }
+          r += v[j] * row;
+        }
+        return r;
+      }
+    }
+  }
+};
+
 #ifdef WITH_NANOVDB
 template<typename T> struct NanoVDBInterpolator {
 
@@ -593,9 +791,23 @@ template<typename T> struct NanoVDBInterpolator {
 
 ccl_device float4 kernel_tex_image_interp(KernelGlobals *kg, int id, float x, float y, differential ds, differential dt, uint path_flag)
 {
-  const TextureInfo &info = kernel_tex_fetch(__texture_info, id);
+  PROFILING_INIT(kg, PROFILING_TEXTURE_LOOKUP);
+  PROFILING_TEXTURE(id);
+
   float4 r = make_float4(TEX_IMAGE_MISSING_R, TEX_IMAGE_MISSING_G, TEX_IMAGE_MISSING_B, TEX_IMAGE_MISSING_A);
 
+  const TextureInfo *tex_info = &kernel_tex_fetch(__texture_info, id);
+  /* Lazily loaded images are looked up in the texture of their pixels, loaded here on first
+   * use. */
+  if (tex_info->data_type == IMAGE_DATA_TYPE_LAZY) {
+    KernelLazyImage *image = *((KernelLazyImage **)tex_info->data);
+    tex_info = (image) ? image->texture() : NULL;
+    if (UNLIKELY(!tex_info)) {
+      return r;
+    }
+  }
+  const TextureInfo &info = *tex_info;
+
   switch (info.data_type) {
     case IMAGE_DATA_TYPE_HALF:
       r = TextureInterpolator<half>::interp(info, x, y);
@@ -631,69 +843,27 @@ ccl_device float4 kernel_tex_image_interp(KernelGlobals *kg, int id, float x, fl
       if (!kg->oiio || !kg->oiio->tex_sys || !info.data) {
         return r;
       }
-      /* Options: Anisotropic is a quality/speed tradeoff.
-       * Interpolation and extensions are supported in OIIO under different constants.
-       * */
-      OIIO::TextureOpt options;
-      options.anisotropic = 8;
-      float missingcolor[4] = {
-          TEX_IMAGE_MISSING_R, TEX_IMAGE_MISSING_G, TEX_IMAGE_MISSING_B, TEX_IMAGE_MISSING_A};
-      options.missingcolor = missingcolor;
-      options.mipmode = OIIO::TextureOpt::MipModeAniso;
-      options.sblur = options.tblur = 0.0f;
-      switch (info.interpolation) {
-        case INTERPOLATION_SMART:
-          options.interpmode = OIIO::TextureOpt::InterpSmartBicubic;
-          break;
-        case INTERPOLATION_CUBIC:
-          options.interpmode = OIIO::TextureOpt::InterpBicubic;
-          break;
-        case INTERPOLATION_LINEAR:
-          options.interpmode = OIIO::TextureOpt::InterpBilinear;
-          break;
-        //case INTERPOLATION_NONE:
-        case INTERPOLATION_CLOSEST:
-        default:
-          options.interpmode = OIIO::TextureOpt::InterpClosest;
-          break;
-      }
-      switch (info.extension) {
-        case EXTENSION_CLIP:
-          options.swrap = options.twrap = OIIO::TextureOpt::WrapBlack;
-          break;
-        case EXTENSION_EXTEND:
-          options.swrap = options.twrap = OIIO::TextureOpt::WrapClamp;
-          break;
-        case EXTENSION_REPEAT:
-        default:
-          options.swrap = options.twrap = OIIO::TextureOpt::WrapPeriodic;
-          break;
+
+      OIIOTexture *texture = *((OIIOTexture **)info.data);
+      if (!texture || !texture->handle) {
+        return r;
       }
 
       /* Texture lookup simplifications on less important paths. */
-      if (path_flag & NEAREST_LOOKUP_PATHS && !(path_flag & PATH_RAY_SINGULAR)) {
-        options.interpmode = OIIO::TextureOpt::InterpClosest;
-        options.mipmode = OIIO::TextureOpt::MipModeOneLevel;
-      }
-      else {
-        options.mipmode = OIIO::TextureOpt::MipModeAniso;
-      }
+      int type = OIIO_LOOKUP_FULL;
       if (path_flag & DIFFUSE_BLUR_PATHS) {
-        options.sblur = options.tblur = kg->oiio->diffuse_blur;
+        type = OIIO_LOOKUP_DIFFUSE;
       }
       else if (path_flag & PATH_RAY_GLOSSY) {
-        options.sblur = options.tblur = kg->oiio->glossy_blur;
+        type = OIIO_LOOKUP_GLOSSY;
       }
-      else {
-        options.sblur = options.tblur = 0.0f;
-      }
-  
-      OIIO::TextureSystem::TextureHandle *handle = *((OIIO::TextureSystem::TextureHandle**)info.data);
-      kernel_assert(handle && kg->oiio->tex_sys->good(handle));
-      if(handle && !kg->oiio->tex_sys->good(handle)) {
-        return r;
+      if (path_flag & NEAREST_LOOKUP_PATHS && !(path_flag & PATH_RAY_SINGULAR)) {
+        type += OIIO_LOOKUP_NEAREST;
       }
-      kg->oiio->tex_sys->texture(handle,
+
+      /* The texture system takes the options by reference, copy the prebuilt ones. */
+      OIIO::TextureOpt options = texture->options[type];
+      kg->oiio->tex_sys->texture(texture->handle,
                                  (OIIO::TextureSystem::Perthread *)kg->oiio_tdata,
                                  options,
                                  x,
@@ -707,6 +877,60 @@ ccl_device float4 kernel_tex_image_interp(KernelGlobals *kg, int id, float x, fl
 #endif
       break;
     }
+    case IMAGE_DATA_TYPE_PAGED: {
+      KernelPagedImage *image = *((KernelPagedImage **)info.data);
+      if (UNLIKELY(!image)) {
+        return make_float4(0.0f, 0.0f, 0.0f, 0.0f);
+      }
+      const int level = paged_image_level(image, ds, dt);
+      /* Spread hit counters over shards by thread, every thread has its own globals. */
+      const int shard = hash_uint((uint)((size_t)kg >> 4)) % PAGED_IMAGE_NUM_SHARDS;
+      /* Paged images are stored top to bottom, like in the file. */
+      y = 1.0f - y;
+      /* Evicted tiles are not reused while the lookup reads them. */
+      const int parity = image->readers->enter(shard);
+
+      switch (image->data_type) {
+        case IMAGE_DATA_TYPE_HALF:
+          r = PagedTextureInterpolator<half>::interp(info, image, level, x, y, shard);
+          break;
+        case IMAGE_DATA_TYPE_BYTE:
+          r = PagedTextureInterpolator<uchar>::interp(info, image, level, x, y, shard);
+          break;
+        case IMAGE_DATA_TYPE_USHORT:
+          r = PagedTextureInterpolator<uint16_t>::interp(info, image, level, x, y, shard);
+          break;
+        case IMAGE_DATA_TYPE_FLOAT:
+          r = PagedTextureInterpolator<float>::interp(info, image, level, x, y, shard);
+          break;
+        case IMAGE_DATA_TYPE_HALF4:
+          r = PagedTextureInterpolator<half4>::interp(info, image, level, x, y, shard);
+          break;
+        case IMAGE_DATA_TYPE_BYTE4:
+          r = PagedTextureInterpolator<uchar4>::interp(info, image, level, x, y, shard);
+          break;
+        case IMAGE_DATA_TYPE_USHORT4:
+          r = PagedTextureInterpolator<ushort4>::interp(info, image, level, x, y, shard);
+          break;
+        case IMAGE_DATA_TYPE_FLOAT4:
+          r = PagedTextureInterpolator<float4>::interp(info, image, level, x, y, shard);
+          break;
+        default:
+          kernel_assert(0);
+          break;
+      }
+      image->readers->exit(shard, parity);
+      break;
+    }
+    case IMAGE_DATA_TYPE_BC1:
+      r = BlockTextureInterpolator<TextureBlockBC1>::interp(info, x, y);
+      break;
+    case IMAGE_DATA_TYPE_BC3:
+      r = BlockTextureInterpolator<TextureBlockBC3>::interp(info, x, y);
+      break;
+    case IMAGE_DATA_TYPE_BC4:
+      r = BlockTextureInterpolator<TextureBlockBC4>::interp(info, x, y);
+      break;
     default:
       assert(0);
   }
@@ -748,6 +972,11 @@ ccl_device float4 kernel_tex_image_interp_3d(KernelGlobals *kg,
       return NanoVDBInterpolator<nanovdb::Vec3f>::interp_3d(info, P.x, P.y, P.z, interp);
 #endif
     case IMAGE_DATA_TYPE_OIIO:
+    case IMAGE_DATA_TYPE_PAGED:
+    case IMAGE_DATA_TYPE_BC1:
+    case IMAGE_DATA_TYPE_BC3:
+    case IMAGE_DATA_TYPE_BC4:
+    case IMAGE_DATA_TYPE_LAZY:
       return make_float4(TEX_IMAGE_MISSING_R, TEX_IMAGE_MISSING_G, TEX_IMAGE_MISSING_B, TEX_IMAGE_MISSING_A);
     default:
       assert(0);
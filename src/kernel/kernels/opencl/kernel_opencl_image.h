@@ -111,7 +111,9 @@ ccl_device_inline float4 svm_image_texture_read(
   }
 #endif
   /* Unsupported. */
-  else if (texture_type == IMAGE_DATA_TYPE_OIIO) {
+  else if (texture_type == IMAGE_DATA_TYPE_OIIO || texture_type == IMAGE_DATA_TYPE_PAGED ||
+           texture_type == IMAGE_DATA_TYPE_BC1 || texture_type == IMAGE_DATA_TYPE_BC3 ||
+           texture_type == IMAGE_DATA_TYPE_BC4 || texture_type == IMAGE_DATA_TYPE_LAZY) {
     return make_float4(TEX_IMAGE_MISSING_R, TEX_IMAGE_MISSING_G, TEX_IMAGE_MISSING_B, TEX_IMAGE_MISSING_A);
   }
   /* Byte */
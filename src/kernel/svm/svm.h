@@ -384,6 +384,19 @@ ccl_device_noinline void svm_eval_nodes(KernelGlobals *kg,
       case NODE_VECTOR_MATH:
         svm_node_vector_math(kg, sd, stack, node.y, node.z, node.w, &offset);
         break;
+      case NODE_MATH_PAIR: {
+        svm_node_math(kg, sd, stack, node.y, node.z, node.w, &offset);
+        uint4 second_node = read_node(kg, &offset);
+        svm_node_math(kg, sd, stack, second_node.y, second_node.z, second_node.w, &offset);
+        break;
+      }
+      case NODE_VECTOR_MATH_PAIR: {
+        svm_node_vector_math(kg, sd, stack, node.y, node.z, node.w, &offset);
+        uint4 second_node = read_node(kg, &offset);
+        svm_node_vector_math(
+            kg, sd, stack, second_node.y, second_node.z, second_node.w, &offset);
+        break;
+      }
       case NODE_RGB_RAMP:
         svm_node_rgb_ramp(kg, sd, stack, node, &offset);
         break;
@@ -461,6 +474,9 @@ ccl_device_noinline void svm_eval_nodes(KernelGlobals *kg,
       case NODE_IES:
         svm_node_ies(kg, sd, stack, node, &offset);
         break;
+      case NODE_TEX_BAKED:
+        svm_node_tex_baked(kg, sd, stack, node, &offset);
+        break;
 #endif /* NODES_GROUP(NODE_GROUP_LEVEL_2) */
 
 #if NODES_GROUP(NODE_GROUP_LEVEL_3)
@@ -106,6 +106,9 @@ typedef enum ShaderNodeType {
   NODE_PRINCIPLED_VOLUME,
   NODE_MATH,
   NODE_VECTOR_MATH,
+  /* Two consecutive math nodes in one dispatch, the second node is stored unchanged. */
+  NODE_MATH_PAIR,
+  NODE_VECTOR_MATH_PAIR,
   NODE_RGB_RAMP,
   NODE_GAMMA,
   NODE_BRIGHTCONTRAST,
@@ -130,6 +133,7 @@ typedef enum ShaderNodeType {
   NODE_NORMAL,
   NODE_LIGHT_FALLOFF,
   NODE_IES,
+  NODE_TEX_BAKED,
   NODE_RGB_CURVES,
   NODE_VECTOR_CURVES,
   NODE_TANGENT,
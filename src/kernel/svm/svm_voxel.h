@@ -67,4 +67,26 @@ ccl_device void svm_node_tex_volume(KernelGlobals *kg, ShaderData *sd, float *st
   }
 }
 
+/* 3D texture baked from a procedural subgraph, looked up at the texture coordinate mapped
+ * from the bounds the subgraph was baked in. */
+ccl_device void svm_node_tex_baked(
+    KernelGlobals *kg, ShaderData *sd, float *stack, uint4 node, int *offset)
+{
+  uint co_offset, out_offset;
+  svm_unpack_node_uchar2(node.z, &co_offset, &out_offset);
+
+  float4 bounds_min = read_node_float(kg, offset);
+  float4 bounds_inv_size = read_node_float(kg, offset);
+
+  int id = node.y;
+  float3 co = stack_load_float3(stack, co_offset);
+  co = (co - float4_to_float3(bounds_min)) * float4_to_float3(bounds_inv_size);
+
+  float4 r = kernel_tex_image_interp_3d(kg, id, co, INTERPOLATION_NONE);
+
+  if (stack_valid(out_offset)) {
+    stack_store_float3(stack, out_offset, make_float3(r.x, r.y, r.z));
+  }
+}
+
 CCL_NAMESPACE_END
@@ -0,0 +1,381 @@
+/*
+ * Copyright 2011-2020 Blender Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "render/background_map.h"
+
+#include "render/graph.h"
+#include "render/nodes.h"
+#include "render/shader.h"
+
+#include "util/util_foreach.h"
+#include "util/util_logging.h"
+#include "util/util_math.h"
+#include "util/util_md5.h"
+#include "util/util_path.h"
+#include "util/util_task.h"
+#include "util/util_time.h"
+
+CCL_NAMESPACE_BEGIN
+
+/* Increase when the file format or the way maps are built changes. */
+#define BACKGROUND_MAP_CACHE_VERSION 1
+/* Number of maps kept in memory. */
+#define BACKGROUND_MAP_CACHE_NUM_RECENT 4
+
+static const char BACKGROUND_MAP_CACHE_MAGIC[8] = {'C', 'Y', 'C', 'L', 'B', 'G', 'M', '\0'};
+
+struct BackgroundMapCacheHeader {
+  char magic[8];
+  uint32_t version;
+  int32_t res_x;
+  int32_t res_y;
+};
+
+/* Importance of a pixel, its luminance weighted by the solid angle of its row. */
+static float background_pixel_weight(const float3 color, const int y, const int res_y)
+{
+  return average(color) * sinf(M_PI_F * (y + 0.5f) / res_y);
+}
+
+static void background_cdf(
+    int start, int end, int res_x, int res_y, const vector<float3> *pixels, float2 *cond_cdf)
+{
+  int cdf_width = res_x + 1;
+  /* Conditional CDFs (rows, U direction). */
+  for (int i = start; i < end; i++) {
+    cond_cdf[i * cdf_width].x = background_pixel_weight((*pixels)[i * res_x], i, res_y);
+    cond_cdf[i * cdf_width].y = 0.0f;
+
+    for (int j = 1; j < res_x; j++) {
+      cond_cdf[i * cdf_width + j].x = background_pixel_weight(
+          (*pixels)[i * res_x + j], i, res_y);
+      cond_cdf[i * cdf_width + j].y = cond_cdf[i * cdf_width + j - 1].y +
+                                      cond_cdf[i * cdf_width + j - 1].x / res_x;
+    }
+
+    float cdf_total = cond_cdf[i * cdf_width + res_x - 1].y +
+                      cond_cdf[i * cdf_width + res_x - 1].x / res_x;
+    float cdf_total_inv = 1.0f / cdf_total;
+
+    /* stuff the total into the brightness value for the last entry, because
+     * we are going to normalize the CDFs to 0.0 to 1.0 afterwards */
+    cond_cdf[i * cdf_width + res_x].x = cdf_total;
+
+    if (cdf_total > 0.0f)
+      for (int j = 1; j < res_x; j++)
+        cond_cdf[i * cdf_width + j].y *= cdf_total_inv;
+
+    cond_cdf[i * cdf_width + res_x].y = 1.0f;
+  }
+}
+
+/* Background Map */
+
+BackgroundMap::BackgroundMap() : res(make_int2(0, 0))
+{
+}
+
+void BackgroundMap::build(const vector<float3> &pixels, const int2 res_)
+{
+  res = res_;
+
+  /* build row distributions and column distribution for the infinite area environment light */
+  int cdf_width = res.x + 1;
+  marginal_cdf.resize(res.y + 1);
+  conditional_cdf.resize(cdf_width * res.y);
+
+  float2 *marg_cdf = marginal_cdf.data();
+  float2 *cond_cdf = conditional_cdf.data();
+
+  /* Create CDF in parallel. */
+  const int rows_per_task = divide_up(10240, res.x);
+  parallel_for(blocked_range<size_t>(0, res.y, rows_per_task),
+               [&](const blocked_range<size_t> &r) {
+                 background_cdf(r.begin(), r.end(), res.x, res.y, &pixels, cond_cdf);
+               });
+
+  /* marginal CDFs (column, V direction, sum of rows) */
+  marg_cdf[0].x = cond_cdf[res.x].x;
+  marg_cdf[0].y = 0.0f;
+
+  for (int i = 1; i < res.y; i++) {
+    marg_cdf[i].x = cond_cdf[i * cdf_width + res.x].x;
+    marg_cdf[i].y = marg_cdf[i - 1].y + marg_cdf[i - 1].x / res.y;
+  }
+
+  float cdf_total = marg_cdf[res.y - 1].y + marg_cdf[res.y - 1].x / res.y;
+  marg_cdf[res.y].x = cdf_total;
+
+  if (cdf_total > 0.0f)
+    for (int i = 1; i < res.y; i++)
+      marg_cdf[i].y /= cdf_total;
+
+  marg_cdf[res.y].y = 1.0f;
+}
+
+/* Automatic Resolution */
+
+int2 background_map_reduce_resolution(vector<float3> &pixels,
+                                      int2 res,
+                                      const int min_width,
+                                      const float max_error)
+{
+  /* The error is the total variation distance between the pixel distribution and the
+   * one with every 2x2 block of pixels replaced by their average. It is summed over the
+   * levels, which bounds the distance to the full resolution distribution. */
+  float error = 0.0f;
+
+  while (res.x / 2 >= min_width && res.x % 2 == 0 && res.y % 2 == 0) {
+    const int2 half_res = make_int2(res.x / 2, res.y / 2);
+    vector<float3> half_pixels(half_res.x * half_res.y);
+    vector<double> row_total(half_res.y, 0.0);
+    vector<double> row_difference(half_res.y, 0.0);
+
+    parallel_for(blocked_range<size_t>(0, half_res.y), [&](const blocked_range<size_t> &r) {
+      for (size_t y = r.begin(); y != r.end(); y++) {
+        double total = 0.0, difference = 0.0;
+
+        for (int x = 0; x < half_res.x; x++) {
+          const int i = (2 * y) * res.x + 2 * x;
+          const float3 colors[4] = {
+              pixels[i], pixels[i + 1], pixels[i + res.x], pixels[i + res.x + 1]};
+          /* Solid angle of the averaged pixel, the change of the solid angle between rows
+           * is taken into account when building the map at the lower resolution. */
+          float weights[4];
+          float sum = 0.0f;
+          for (int k = 0; k < 4; k++) {
+            weights[k] = fabsf(background_pixel_weight(colors[k], y, half_res.y));
+            sum += weights[k];
+          }
+
+          const float mean = sum * 0.25f;
+          for (int k = 0; k < 4; k++) {
+            difference += fabsf(weights[k] - mean);
+          }
+          total += sum;
+
+          half_pixels[y * half_res.x + x] = (colors[0] + colors[1] + colors[2] + colors[3]) *
+                                            0.25f;
+        }
+
+        row_total[y] = total;
+        row_difference[y] = difference;
+      }
+    });
+
+    double total = 0.0, difference = 0.0;
+    for (int y = 0; y < half_res.y; y++) {
+      total += row_total[y];
+      difference += row_difference[y];
+    }
+
+    const float level_error = (total > 0.0) ? (float)(0.5 * difference / total) : 0.0f;
+    if (error + level_error > max_error) {
+      break;
+    }
+
+    error += level_error;
+    pixels.swap(half_pixels);
+    res = half_res;
+  }
+
+  return res;
+}
+
+/* Background Map Cache */
+
+BackgroundMapCache::BackgroundMapCache()
+    : num_hits(0), num_misses(0), recent(BACKGROUND_MAP_CACHE_NUM_RECENT)
+{
+}
+
+void BackgroundMapCache::set_path(const string &path_)
+{
+  path = path_;
+}
+
+string BackgroundMapCache::filepath(const string &key) const
+{
+  return path_join(path, key + ".bgmap");
+}
+
+template<typename T> static void background_map_hash_value(MD5Hash &md5, const T value)
+{
+  md5.append((const uint8_t *)&value, sizeof(value));
+}
+
+string BackgroundMapCache::key(Shader *shader, const int2 res, const bool auto_resolution)
+{
+  MD5Hash md5;
+
+  background_map_hash_value(md5, (int)BACKGROUND_MAP_CACHE_VERSION);
+  background_map_hash_value(md5, res.x);
+  background_map_hash_value(md5, res.y);
+  background_map_hash_value(md5, auto_resolution);
+
+  shader->graph->hash(md5);
+
+  /* Socket values only contain the image file names, so add what was actually loaded and
+   * when the files were modified. */
+  foreach (ShaderNode *node, shader->graph->nodes) {
+    if (node->type == PointDensityTextureNode::node_type) {
+      return "";
+    }
+    if (node->type == BakedTextureNode::node_type) {
+      /* The baked subgraph was disconnected from the graph, only its key tells it apart.
+       * Until the bake is done the node outputs a constant color, don't cache that. */
+      BakedTextureNode *baked = static_cast<BakedTextureNode *>(node);
+      if (!baked->bake_key.empty()) {
+        if (baked->handle.empty()) {
+          return "";
+        }
+        md5.append(baked->bake_key);
+      }
+      continue;
+    }
+    if (node->special_type != SHADER_SPECIAL_TYPE_IMAGE_SLOT) {
+      continue;
+    }
+
+    ImageSlotTextureNode *image_node = static_cast<ImageSlotTextureNode *>(node);
+    ustring filename;
+    vector<int> tiles;
+    if (node->type == ImageTextureNode::node_type) {
+      ImageTextureNode *image = static_cast<ImageTextureNode *>(node);
+      filename = image->filename;
+      tiles.assign(image->tiles.begin(), image->tiles.end());
+    }
+    else if (node->type == EnvironmentTextureNode::node_type) {
+      filename = static_cast<EnvironmentTextureNode *>(node)->filename;
+    }
+    else {
+      continue;
+    }
+
+    if (image_node->handle.empty()) {
+      continue;
+    }
+    if (filename.empty()) {
+      /* Pixels from the host application. */
+      return "";
+    }
+
+    if (tiles.empty()) {
+      background_map_hash_value(md5, path_modified_time(filename.string()));
+    }
+    foreach (int tile, tiles) {
+      string tile_filename = filename.string();
+      string_replace(tile_filename, "<UDIM>", string_printf("%04d", tile));
+      background_map_hash_value(md5, path_modified_time(tile_filename));
+    }
+
+    for (int i = 0; i < image_node->handle.num_tiles(); i++) {
+      device_texture *mem = image_node->handle.image_memory(i);
+      if (mem) {
+        background_map_hash_value(md5, mem->info.data_type);
+        background_map_hash_value(md5, mem->info.width);
+        background_map_hash_value(md5, mem->info.height);
+      }
+    }
+  }
+
+  return md5.get_hex();
+}
+
+bool BackgroundMapCache::load(const string &key, BackgroundMap &map)
+{
+  thread_scoped_lock lock(mutex);
+
+  if (recent.find(key, map)) {
+    num_hits++;
+    return true;
+  }
+
+  if (!path.empty() && load_file(key, map)) {
+    recent.insert(key, map);
+    num_hits++;
+    return true;
+  }
+
+  num_misses++;
+  return false;
+}
+
+bool BackgroundMapCache::load_file(const string &key, BackgroundMap &map)
+{
+  const double time_start = time_dt();
+  const string filepath = this->filepath(key);
+
+  vector<uint8_t> data;
+  if (!path_read_binary(filepath, data) || data.size() < sizeof(BackgroundMapCacheHeader)) {
+    return false;
+  }
+
+  BackgroundMapCacheHeader header;
+  memcpy(&header, data.data(), sizeof(header));
+  if (memcmp(header.magic, BACKGROUND_MAP_CACHE_MAGIC, sizeof(header.magic)) != 0 ||
+      header.version != BACKGROUND_MAP_CACHE_VERSION || header.res_x <= 0 || header.res_y <= 0) {
+    return false;
+  }
+
+  const size_t num_marginal = header.res_y + 1;
+  const size_t num_conditional = (size_t)(header.res_x + 1) * header.res_y;
+  if (data.size() != sizeof(header) + (num_marginal + num_conditional) * sizeof(float2)) {
+    return false;
+  }
+
+  const uint8_t *cdf_data = data.data() + sizeof(header);
+  map.res = make_int2(header.res_x, header.res_y);
+  map.marginal_cdf.resize(num_marginal);
+  memcpy(map.marginal_cdf.data(), cdf_data, num_marginal * sizeof(float2));
+  cdf_data += num_marginal * sizeof(float2);
+  map.conditional_cdf.resize(num_conditional);
+  memcpy(map.conditional_cdf.data(), cdf_data, num_conditional * sizeof(float2));
+
+  VLOG(2) << "Loaded cached background importance map " << filepath << " ("
+          << string_human_readable_size(data.size()) << ") in " << time_dt() - time_start
+          << " seconds.";
+
+  return true;
+}
+
+void BackgroundMapCache::store(const string &key, const BackgroundMap &map)
+{
+  string filepath;
+  {
+    thread_scoped_lock lock(mutex);
+    recent.insert(key, map);
+    if (path.empty()) {
+      return;
+    }
+    filepath = this->filepath(key);
+  }
+
+  BackgroundMapCacheHeader header;
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, BACKGROUND_MAP_CACHE_MAGIC, sizeof(header.magic));
+  header.version = BACKGROUND_MAP_CACHE_VERSION;
+  header.res_x = map.res.x;
+  header.res_y = map.res.y;
+
+  CacheFileWriter writer(filepath);
+  writer.write(&header, sizeof(header));
+  writer.write_array(map.marginal_cdf.data(), map.marginal_cdf.size());
+  writer.write_array(map.conditional_cdf.data(), map.conditional_cdf.size());
+  writer.commit();
+}
+
+CCL_NAMESPACE_END
@@ -0,0 +1,89 @@
+/*
+ * Copyright 2011-2020 Blender Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __BACKGROUND_MAP_H__
+#define __BACKGROUND_MAP_H__
+
+#include "util/util_cache.h"
+#include "util/util_string.h"
+#include "util/util_thread.h"
+#include "util/util_types.h"
+#include "util/util_vector.h"
+
+CCL_NAMESPACE_BEGIN
+
+class Shader;
+
+/* Background Importance Map
+ *
+ * Distributions for sampling the background in equirectangular projection: a conditional
+ * CDF per row and a marginal CDF over the rows, weighted by the solid angle of the pixels. */
+class BackgroundMap {
+ public:
+  BackgroundMap();
+
+  /* Build the CDFs from the shaded background pixels, rows are built in parallel. */
+  void build(const vector<float3> &pixels, const int2 res);
+
+  int2 res;
+  vector<float2> marginal_cdf;
+  vector<float2> conditional_cdf;
+};
+
+/* Automatic resolution: halve the resolution of the shaded pixels for as long as the
+ * distribution of the 2x2 averaged pixels stays within the error of the full resolution
+ * one, so smooth backgrounds get small maps. The pixels are replaced by the averaged ones
+ * and the new resolution is returned. */
+int2 background_map_reduce_resolution(vector<float3> &pixels,
+                                      int2 res,
+                                      const int min_width,
+                                      const float max_error);
+
+/* Cache of importance maps, kept in memory for the most recently used backgrounds so
+ * switching between them does not shade the background again, and optionally stored on
+ * disk for renders of the same background in other sessions. */
+class BackgroundMapCache {
+ public:
+  BackgroundMapCache();
+
+  /* Directory to store the cache files in, no files are stored when empty. */
+  void set_path(const string &path);
+
+  /* Hash of the background shader and everything the map depends on. Empty when the map
+   * can't be cached, like for images with pixels from the host application. */
+  static string key(Shader *shader, const int2 res, const bool auto_resolution);
+
+  /* Load the map of the given key from memory or disk, returns false when not cached. */
+  bool load(const string &key, BackgroundMap &map);
+  /* Add the map to the memory cache and write it to disk. */
+  void store(const string &key, const BackgroundMap &map);
+
+  /* Statistics since the cache was created. */
+  size_t num_hits;
+  size_t num_misses;
+
+ protected:
+  string filepath(const string &key) const;
+  bool load_file(const string &key, BackgroundMap &map);
+
+  string path;
+  CacheMRU<BackgroundMap> recent;
+  thread_mutex mutex;
+};
+
+CCL_NAMESPACE_END
+
+#endif /* __BACKGROUND_MAP_H__ */
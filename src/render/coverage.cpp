@@ -24,13 +24,13 @@
 #include "kernel/kernel_globals.h"
 #include "kernel/kernel_id_passes.h"
 
-#include "util/util_map.h"
+#include "util/util_algorithm.h"
 
 CCL_NAMESPACE_BEGIN
 
-static bool crypomatte_comp(const pair<float, float> &i, const pair<float, float> j)
+static bool crypomatte_comp(const CoverageMap::Entry &i, const CoverageMap::Entry &j)
 {
-  return i.first > j.first;
+  return i.weight > j.weight;
 }
 
 void Coverage::finalize()
@@ -49,22 +49,24 @@ void Coverage::finalize()
   }
 }
 
-void Coverage::init_path_trace()
+void Coverage::init_path_trace(RenderTile &tile_)
 {
+  tile = &tile_;
   kg->coverage_object = kg->coverage_material = kg->coverage_asset = NULL;
 
   if (kernel_data.film.cryptomatte_passes & CRYPT_ACCURATE) {
+    const size_t num_pixels = tile->w * tile->h;
     if (kernel_data.film.cryptomatte_passes & CRYPT_OBJECT) {
-      coverage_object.clear();
-      coverage_object.resize(tile.w * tile.h);
+      coverage_object.reset(num_pixels);
+      kg->coverage_object = &coverage_object;
     }
     if (kernel_data.film.cryptomatte_passes & CRYPT_MATERIAL) {
-      coverage_material.clear();
-      coverage_material.resize(tile.w * tile.h);
+      coverage_material.reset(num_pixels);
+      kg->coverage_material = &coverage_material;
     }
     if (kernel_data.film.cryptomatte_passes & CRYPT_ASSET) {
-      coverage_asset.clear();
-      coverage_asset.resize(tile.w * tile.h);
+      coverage_asset.reset(num_pixels);
+      kg->coverage_asset = &coverage_asset;
     }
   }
 }
@@ -72,20 +74,20 @@ void Coverage::init_path_trace()
 void Coverage::init_pixel(int x, int y)
 {
   if (kernel_data.film.cryptomatte_passes & CRYPT_ACCURATE) {
-    const int pixel_index = tile.w * (y - tile.y) + x - tile.x;
+    const int pixel_index = tile->w * (y - tile->y) + x - tile->x;
     if (kernel_data.film.cryptomatte_passes & CRYPT_OBJECT) {
-      kg->coverage_object = &coverage_object[pixel_index];
+      coverage_object.set_pixel(pixel_index);
     }
     if (kernel_data.film.cryptomatte_passes & CRYPT_MATERIAL) {
-      kg->coverage_material = &coverage_material[pixel_index];
+      coverage_material.set_pixel(pixel_index);
     }
     if (kernel_data.film.cryptomatte_passes & CRYPT_ASSET) {
-      kg->coverage_asset = &coverage_asset[pixel_index];
+      coverage_asset.set_pixel(pixel_index);
     }
   }
 }
 
-void Coverage::finalize_buffer(vector<CoverageMap> &coverage, const int pass_offset)
+void Coverage::finalize_buffer(CoverageMap &coverage, const int pass_offset)
 {
   if (kernel_data.film.cryptomatte_passes & CRYPT_ACCURATE) {
     flatten_buffer(coverage, pass_offset);
@@ -95,41 +97,38 @@ void Coverage::finalize_buffer(vector<CoverageMap> &coverage, const int pass_off
   }
 }
 
-void Coverage::flatten_buffer(vector<CoverageMap> &coverage, const int pass_offset)
+void Coverage::flatten_buffer(CoverageMap &coverage, const int pass_offset)
 {
   /* Sort the coverage map and write it to the output */
   int pixel_index = 0;
-  int pass_stride = tile.buffers->params.get_passes_size();
-  for (int y = 0; y < tile.h; ++y) {
-    for (int x = 0; x < tile.w; ++x) {
-      const CoverageMap &pixel = coverage[pixel_index];
-      if (!pixel.empty()) {
+  int pass_stride = tile->buffers->params.get_passes_size();
+  for (int y = 0; y < tile->h; ++y) {
+    for (int x = 0; x < tile->w; ++x) {
+      if (coverage.num_entries(pixel_index)) {
         /* buffer offset */
-        int index = x + y * tile.stride;
-        float *buffer = (float *)tile.buffer + index * pass_stride;
+        int index = x + y * tile->stride;
+        float *buffer = (float *)tile->buffer + index * pass_stride;
 
         /* sort the cryptomatte pixel */
-        vector<pair<float, float>> sorted_pixel;
-        for (CoverageMap::const_iterator it = pixel.begin(); it != pixel.end(); ++it) {
-          sorted_pixel.push_back(std::make_pair(it->second, it->first));
-        }
-        sort(sorted_pixel.begin(), sorted_pixel.end(), crypomatte_comp);
+        entries.clear();
+        coverage.get_entries(pixel_index, entries);
+        sort(entries.begin(), entries.end(), crypomatte_comp);
         int num_slots = 2 * (kernel_data.film.cryptomatte_depth);
-        if (sorted_pixel.size() > num_slots) {
+        if (entries.size() > num_slots) {
           float leftover = 0.0f;
-          for (vector<pair<float, float>>::iterator it = sorted_pixel.begin() + num_slots;
-               it != sorted_pixel.end();
+          for (vector<CoverageMap::Entry>::iterator it = entries.begin() + num_slots;
+               it != entries.end();
                ++it) {
-            leftover += it->first;
+            leftover += it->weight;
           }
-          sorted_pixel[num_slots - 1].first += leftover;
+          entries[num_slots - 1].weight += leftover;
         }
-        int limit = min(num_slots, sorted_pixel.size());
+        int limit = min(num_slots, entries.size());
         for (int i = 0; i < limit; ++i) {
           kernel_write_id_slots(buffer + kernel_data.film.pass_cryptomatte + pass_offset,
                                 2 * (kernel_data.film.cryptomatte_depth),
-                                sorted_pixel[i].second,
-                                sorted_pixel[i].first);
+                                entries[i].id,
+                                entries[i].weight);
         }
       }
       ++pixel_index;
@@ -140,12 +139,12 @@ void Coverage::flatten_buffer(vector<CoverageMap> &coverage, const int pass_offs
 void Coverage::sort_buffer(const int pass_offset)
 {
   /* Sort the coverage map and write it to the output */
-  int pass_stride = tile.buffers->params.get_passes_size();
-  for (int y = 0; y < tile.h; ++y) {
-    for (int x = 0; x < tile.w; ++x) {
+  int pass_stride = tile->buffers->params.get_passes_size();
+  for (int y = 0; y < tile->h; ++y) {
+    for (int x = 0; x < tile->w; ++x) {
       /* buffer offset */
-      int index = x + y * tile.stride;
-      float *buffer = (float *)tile.buffer + index * pass_stride;
+      int index = x + y * tile->stride;
+      float *buffer = (float *)tile->buffer + index * pass_stride;
       kernel_sort_id_slots(buffer + kernel_data.film.pass_cryptomatte + pass_offset,
                            2 * (kernel_data.film.cryptomatte_depth));
     }
@@ -17,7 +17,7 @@
 #ifndef __COVERAGE_H__
 #define __COVERAGE_H__
 
-#include "util/util_map.h"
+#include "util/util_coverage_map.h"
 #include "util/util_vector.h"
 
 CCL_NAMESPACE_BEGIN
@@ -25,25 +25,26 @@ CCL_NAMESPACE_BEGIN
 struct KernelGlobals;
 class RenderTile;
 
-typedef unordered_map<float, float> CoverageMap;
-
+/* Per-thread coverage for accurate Cryptomatte. Meant to be kept alive for all tiles a
+ * thread renders, so the coverage map memory is reused. */
 class Coverage {
  public:
-  Coverage(KernelGlobals *kg_, RenderTile &tile_) : kg(kg_), tile(tile_)
+  explicit Coverage(KernelGlobals *kg_) : kg(kg_), tile(NULL)
   {
   }
-  void init_path_trace();
+  void init_path_trace(RenderTile &tile_);
   void init_pixel(int x, int y);
   void finalize();
 
  private:
-  vector<CoverageMap> coverage_object;
-  vector<CoverageMap> coverage_material;
-  vector<CoverageMap> coverage_asset;
+  CoverageMap coverage_object;
+  CoverageMap coverage_material;
+  CoverageMap coverage_asset;
   KernelGlobals *kg;
-  RenderTile &tile;
-  void finalize_buffer(vector<CoverageMap> &coverage, const int pass_offset);
-  void flatten_buffer(vector<CoverageMap> &coverage, const int pass_offset);
+  RenderTile *tile;
+  vector<CoverageMap::Entry> entries;
+  void finalize_buffer(CoverageMap &coverage, const int pass_offset);
+  void flatten_buffer(CoverageMap &coverage, const int pass_offset);
   void sort_buffer(const int pass_offset);
 };
 
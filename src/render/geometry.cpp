@@ -15,6 +15,7 @@
  */
 
 #include "bvh/bvh.h"
+#include "bvh/bvh2.h"
 #include "bvh/bvh_build.h"
 #include "bvh/bvh_embree.h"
 
@@ -38,9 +39,12 @@
 
 #include "kernel/osl/osl_globals.h"
 
+#include "util/util_algorithm.h"
 #include "util/util_foreach.h"
 #include "util/util_logging.h"
 #include "util/util_progress.h"
+#include "util/util_tbb.h"
+#include "util/util_time.h"
 
 CCL_NAMESPACE_BEGIN
 
@@ -74,6 +78,12 @@ Geometry::Geometry(const NodeType *node_type, const Type type)
   attr_map_offset = 0;
   optix_prim_offset = 0;
   prim_offset = 0;
+
+  need_update_packed = true;
+  for (int i = 0; i < 4; i++) {
+    attr_packed_offset[i] = 0;
+    attr_packed_size[i] = 0;
+  }
 }
 
 Geometry::~Geometry()
@@ -168,8 +178,13 @@ bool Geometry::has_true_displacement() const
   return false;
 }
 
-void Geometry::compute_bvh(
-    Device *device, DeviceScene *dscene, SceneParams *params, Progress *progress, int n, int total)
+void Geometry::compute_bvh(Device *device,
+                           DeviceScene *dscene,
+                           SceneParams *params,
+                           BVHCache *bvh_cache,
+                           Progress *progress,
+                           int n,
+                           int total)
 {
   if (progress->get_cancel())
     return;
@@ -209,6 +224,7 @@ void Geometry::compute_bvh(
       bparams.bvh_layout = bvh_layout;
       bparams.use_unaligned_nodes = dscene->data.bvh.have_curves &&
                                     params->use_bvh_unaligned_nodes;
+      bparams.use_compressed_nodes = params->use_bvh_compressed_nodes;
       bparams.num_motion_triangle_steps = params->num_bvh_time_steps;
       bparams.num_motion_curve_steps = params->num_bvh_time_steps;
       bparams.num_motion_point_steps = params->num_bvh_time_steps;
@@ -217,7 +233,19 @@ void Geometry::compute_bvh(
 
       delete bvh;
       bvh = BVH::create(bparams, geometry, objects);
-      MEM_GUARDED_CALL(progress, bvh->build, *progress);
+
+      /* Static geometry is often the same as in previous renders, load it from the cache
+       * instead of building when possible. */
+      const bool use_cache = bvh_cache->enabled() && bvh_layout == BVH_LAYOUT_BVH2;
+      const string cache_key = (use_cache) ? bvh_cache->key(this, bparams) : "";
+
+      if (!use_cache || !bvh_cache->load(cache_key, bvh->pack)) {
+        MEM_GUARDED_CALL(progress, bvh->build, *progress);
+
+        if (use_cache && !progress->get_cancel()) {
+          bvh_cache->store(cache_key, bvh->pack);
+        }
+      }
     }
   }
 
@@ -576,10 +604,17 @@ GeometryManager::GeometryManager()
 {
   need_update = true;
   need_flags_update = true;
+  top_level_bvh = NULL;
+  bvh_num_nodes = 0;
+  bvh_num_compressed_nodes = 0;
+  bvh_nodes_size = 0;
+  bvh_uncompressed_nodes_size = 0;
+  bvh_build_time = 0.0;
 }
 
 GeometryManager::~GeometryManager()
 {
+  delete top_level_bvh;
 }
 
 void GeometryManager::update_osl_attributes(Device *device,
@@ -829,7 +864,8 @@ static void update_attribute_element_offset(Geometry *geom,
                                             Attribute *mattr,
                                             AttributePrimitive prim,
                                             TypeDesc &type,
-                                            AttributeDescriptor &desc)
+                                            AttributeDescriptor &desc,
+                                            bool copy_data)
 {
   if (mattr) {
     /* store element and type */
@@ -853,8 +889,11 @@ static void update_attribute_element_offset(Geometry *geom,
       offset = attr_uchar4_offset;
 
       assert(attr_uchar4.size() >= offset + size);
-      for (size_t k = 0; k < size; k++) {
-        attr_uchar4[offset + k] = data[k];
+      if (copy_data) {
+        for (size_t k = 0; k < size; k++) {
+          attr_uchar4[offset + k] = data[k];
+        }
+        attr_uchar4.tag_modified(offset, size);
       }
       attr_uchar4_offset += size;
     }
@@ -863,8 +902,11 @@ static void update_attribute_element_offset(Geometry *geom,
       offset = attr_float_offset;
 
       assert(attr_float.size() >= offset + size);
-      for (size_t k = 0; k < size; k++) {
-        attr_float[offset + k] = data[k];
+      if (copy_data) {
+        for (size_t k = 0; k < size; k++) {
+          attr_float[offset + k] = data[k];
+        }
+        attr_float.tag_modified(offset, size);
       }
       attr_float_offset += size;
     }
@@ -873,8 +915,11 @@ static void update_attribute_element_offset(Geometry *geom,
       offset = attr_float2_offset;
 
       assert(attr_float2.size() >= offset + size);
-      for (size_t k = 0; k < size; k++) {
-        attr_float2[offset + k] = data[k];
+      if (copy_data) {
+        for (size_t k = 0; k < size; k++) {
+          attr_float2[offset + k] = data[k];
+        }
+        attr_float2.tag_modified(offset, size);
       }
       attr_float2_offset += size;
     }
@@ -883,8 +928,11 @@ static void update_attribute_element_offset(Geometry *geom,
       offset = attr_float3_offset;
 
       assert(attr_float3.size() >= offset + size * 3);
-      for (size_t k = 0; k < size * 3; k++) {
-        attr_float3[offset + k] = (&tfm->x)[k];
+      if (copy_data) {
+        for (size_t k = 0; k < size * 3; k++) {
+          attr_float3[offset + k] = (&tfm->x)[k];
+        }
+        attr_float3.tag_modified(offset, size * 3);
       }
       attr_float3_offset += size * 3;
     }
@@ -893,8 +941,11 @@ static void update_attribute_element_offset(Geometry *geom,
       offset = attr_float3_offset;
 
       assert(attr_float3.size() >= offset + size);
-      for (size_t k = 0; k < size; k++) {
-        attr_float3[offset + k] = data[k];
+      if (copy_data) {
+        for (size_t k = 0; k < size; k++) {
+          attr_float3[offset + k] = data[k];
+        }
+        attr_float3.tag_modified(offset, size);
       }
       attr_float3_offset += size;
     }
@@ -995,9 +1046,17 @@ void GeometryManager::device_update_attributes(Device *device,
   size_t attr_float2_size = 0;
   size_t attr_float3_size = 0;
   size_t attr_uchar4_size = 0;
+
+  /* Geometry whose attribute data did not change and did not move in the arrays keeps the
+   * data from the previous update, only the attribute descriptors are recomputed. */
+  vector<bool> geom_repack(scene->geometry.size(), false);
+
   for (size_t i = 0; i < scene->geometry.size(); i++) {
     Geometry *geom = scene->geometry[i];
     AttributeRequestSet &attributes = geom_attributes[i];
+    const size_t attr_start[4] = {
+        attr_float_size, attr_float2_size, attr_float3_size, attr_uchar4_size};
+
     foreach (AttributeRequest &req, attributes.requests) {
       Attribute *attr = geom->attributes.find(req);
 
@@ -1022,8 +1081,31 @@ void GeometryManager::device_update_attributes(Device *device,
                                       &attr_uchar4_size);
       }
     }
+
+    const size_t attr_end[4] = {
+        attr_float_size, attr_float2_size, attr_float3_size, attr_uchar4_size};
+
+    for (int j = 0; j < 4; j++) {
+      const size_t attr_size = attr_end[j] - attr_start[j];
+      if (geom->attr_packed_offset[j] != attr_start[j] ||
+          geom->attr_packed_size[j] != attr_size) {
+        geom->attr_packed_offset[j] = attr_start[j];
+        geom->attr_packed_size[j] = attr_size;
+        geom_repack[i] = true;
+      }
+    }
+
+    if (geom->need_update_packed) {
+      geom_repack[i] = true;
+    }
   }
 
+  /* Reallocation loses the previous data, so everything has to be packed again. */
+  const bool pack_all = dscene->attributes_float.size() != attr_float_size ||
+                        dscene->attributes_float2.size() != attr_float2_size ||
+                        dscene->attributes_float3.size() != attr_float3_size ||
+                        dscene->attributes_uchar4.size() != attr_uchar4_size;
+
   dscene->attributes_float.alloc(attr_float_size);
   dscene->attributes_float2.alloc(attr_float2_size);
   dscene->attributes_float3.alloc(attr_float3_size);
@@ -1038,6 +1120,7 @@ void GeometryManager::device_update_attributes(Device *device,
   for (size_t i = 0; i < scene->geometry.size(); i++) {
     Geometry *geom = scene->geometry[i];
     AttributeRequestSet &attributes = geom_attributes[i];
+    const bool copy_data = pack_all || geom_repack[i];
 
     /* todo: we now store std and name attributes from requests even if
      * they actually refer to the same mesh attributes, optimize */
@@ -1055,7 +1138,8 @@ void GeometryManager::device_update_attributes(Device *device,
                                       attr,
                                       ATTR_PRIM_GEOMETRY,
                                       req.type,
-                                      req.desc);
+                                      req.desc,
+                                      copy_data);
 
       if (geom->type == Geometry::MESH) {
         Mesh *mesh = static_cast<Mesh *>(geom);
@@ -1073,7 +1157,8 @@ void GeometryManager::device_update_attributes(Device *device,
                                         subd_attr,
                                         ATTR_PRIM_SUBD,
                                         req.subd_type,
-                                        req.subd_desc);
+                                        req.subd_desc,
+                                        copy_data);
       }
 
       if (progress.get_cancel())
@@ -1094,16 +1179,16 @@ void GeometryManager::device_update_attributes(Device *device,
   progress.set_status("Updating Mesh", "Copying Attributes to device");
 
   if (dscene->attributes_float.size()) {
-    dscene->attributes_float.copy_to_device();
+    dscene->attributes_float.copy_to_device_if_modified();
   }
   if (dscene->attributes_float2.size()) {
-    dscene->attributes_float2.copy_to_device();
+    dscene->attributes_float2.copy_to_device_if_modified();
   }
   if (dscene->attributes_float3.size()) {
-    dscene->attributes_float3.copy_to_device();
+    dscene->attributes_float3.copy_to_device_if_modified();
   }
   if (dscene->attributes_uchar4.size()) {
-    dscene->attributes_uchar4.copy_to_device();
+    dscene->attributes_uchar4.copy_to_device_if_modified();
   }
 
   if (progress.get_cancel())
@@ -1135,6 +1220,13 @@ void GeometryManager::mesh_calc_offset(Scene *scene)
     if (geom->type == Geometry::MESH) {
       Mesh *mesh = static_cast<Mesh *>(geom);
 
+      /* Packed data refers to the offsets, so it has to be updated when they move. */
+      if (mesh->vert_offset != vert_size || mesh->prim_offset != tri_size ||
+          mesh->patch_offset != patch_size || mesh->face_offset != face_size ||
+          mesh->corner_offset != corner_size || mesh->normals_offset != normals_size) {
+        mesh->need_update_packed = true;
+      }
+
       mesh->vert_offset = vert_size;
       mesh->prim_offset = tri_size;
 
@@ -1173,6 +1265,10 @@ void GeometryManager::mesh_calc_offset(Scene *scene)
     else if (geom->type == Geometry::HAIR) {
       Hair *hair = static_cast<Hair *>(geom);
 
+      if (hair->curvekey_offset != curve_key_size || hair->prim_offset != curve_size) {
+        hair->need_update_packed = true;
+      }
+
       hair->curvekey_offset = curve_key_size;
       hair->prim_offset = curve_size;
 
@@ -1185,6 +1281,10 @@ void GeometryManager::mesh_calc_offset(Scene *scene)
     else if (geom->is_pointcloud()) {
       PointCloud *pointcloud = static_cast<PointCloud *>(geom);
 
+      if (pointcloud->prim_offset != point_size) {
+        pointcloud->need_update_packed = true;
+      }
+
       pointcloud->prim_offset = point_size;
 
       point_size += pointcloud->num_points() * pointcloud->num_attributes();
@@ -1273,11 +1373,18 @@ void GeometryManager::device_update_mesh(
     }
   }
 
-  /* Fill in all the arrays. */
+  /* Fill in all the arrays. Arrays keep their contents between updates, only geometry
+   * tagged with need_update_packed is packed again, unless the array was reallocated. */
   if (tri_size != 0) {
     /* normals */
     progress.set_status("Updating Mesh", "Computing normals");
 
+    const bool pack_all = dscene->tri_shader.size() != tri_size ||
+                          dscene->tri_vnormal.size() != normals_size ||
+                          dscene->tri_vindex.size() != tri_size ||
+                          dscene->tri_patch.size() != tri_size ||
+                          dscene->tri_patch_uv.size() != vert_size;
+
     uint *tri_shader = dscene->tri_shader.alloc(tri_size);
     float4 *vnormal = dscene->tri_vnormal.alloc(normals_size);
     uint4 *tri_vindex = dscene->tri_vindex.alloc(tri_size);
@@ -1287,14 +1394,40 @@ void GeometryManager::device_update_mesh(
     foreach (Geometry *geom, scene->geometry) {
       if (geom->type == Geometry::MESH) {
         Mesh *mesh = static_cast<Mesh *>(geom);
-        mesh->pack_shaders(scene, &tri_shader[mesh->prim_offset]);
-        mesh->pack_normals(&vnormal[mesh->normals_offset]);
-        mesh->pack_verts(tri_prim_index,
-                         &tri_vindex[mesh->prim_offset],
-                         &tri_patch[mesh->prim_offset],
-                         &tri_patch_uv[mesh->vert_offset],
-                         mesh->vert_offset,
-                         mesh->prim_offset);
+        const size_t num_triangles = mesh->num_triangles();
+
+        if (pack_all || mesh->need_update_packed) {
+          mesh->pack_shaders(scene, &tri_shader[mesh->prim_offset]);
+          mesh->pack_normals(&vnormal[mesh->normals_offset]);
+          mesh->pack_verts(tri_prim_index,
+                           &tri_vindex[mesh->prim_offset],
+                           &tri_patch[mesh->prim_offset],
+                           &tri_patch_uv[mesh->vert_offset],
+                           mesh->vert_offset,
+                           mesh->prim_offset);
+
+          const size_t num_normals = (mesh->attributes.find(ATTR_STD_CORNER_NORMAL)) ?
+                                         num_triangles * 3 :
+                                         mesh->verts.size();
+
+          dscene->tri_shader.tag_modified(mesh->prim_offset, num_triangles);
+          dscene->tri_vnormal.tag_modified(mesh->normals_offset, num_normals);
+          dscene->tri_vindex.tag_modified(mesh->prim_offset, num_triangles);
+          dscene->tri_patch.tag_modified(mesh->prim_offset, num_triangles);
+          dscene->tri_patch_uv.tag_modified(mesh->vert_offset, mesh->verts.size());
+        }
+        else {
+          /* The BVH is built again on every update and may reorder primitives, so the
+           * primitive index stored in the vertex indices can change for unmodified meshes. */
+          for (size_t i = 0; i < num_triangles; i++) {
+            const size_t tri = mesh->prim_offset + i;
+            if (tri_vindex[tri].w != tri_prim_index[tri]) {
+              tri_vindex[tri].w = tri_prim_index[tri];
+              dscene->tri_vindex.tag_modified(tri, 1);
+            }
+          }
+        }
+
         if (progress.get_cancel())
           return;
       }
@@ -1303,11 +1436,11 @@ void GeometryManager::device_update_mesh(
     /* vertex coordinates */
     progress.set_status("Updating Mesh", "Copying Mesh to device");
 
-    dscene->tri_shader.copy_to_device();
-    dscene->tri_vnormal.copy_to_device();
-    dscene->tri_vindex.copy_to_device();
-    dscene->tri_patch.copy_to_device();
-    dscene->tri_patch_uv.copy_to_device();
+    dscene->tri_shader.copy_to_device_if_modified();
+    dscene->tri_vnormal.copy_to_device_if_modified();
+    dscene->tri_vindex.copy_to_device_if_modified();
+    dscene->tri_patch.copy_to_device_if_modified();
+    dscene->tri_patch_uv.copy_to_device_if_modified();
 
     /* Updating the normal buffer offset to be indexed by object */
     int *vnormal_offset = dscene->object_vnormal_offset.alloc(scene->objects.size());
@@ -1332,73 +1465,126 @@ void GeometryManager::device_update_mesh(
 
     dscene->object_vnormal_offset.copy_to_device();
   }
+  else {
+    dscene->tri_shader.free();
+    dscene->tri_vnormal.free();
+    dscene->tri_vindex.free();
+    dscene->tri_patch.free();
+    dscene->tri_patch_uv.free();
+    dscene->object_vnormal_offset.free();
+  }
 
   if (curve_size != 0) {
     progress.set_status("Updating Mesh", "Copying Hair to device");
 
+    const bool pack_all = dscene->curve_keys.size() != curve_key_size ||
+                          dscene->curves.size() != curve_size;
+
     float4 *curve_keys = dscene->curve_keys.alloc(curve_key_size);
     float4 *curves = dscene->curves.alloc(curve_size);
 
     foreach (Geometry *geom, scene->geometry) {
       if (geom->type == Geometry::HAIR) {
         Hair *hair = static_cast<Hair *>(geom);
-        hair->pack_curves(scene,
-                          &curve_keys[hair->curvekey_offset],
-                          &curves[hair->prim_offset],
-                          hair->curvekey_offset);
+
+        if (pack_all || hair->need_update_packed) {
+          hair->pack_curves(scene,
+                            &curve_keys[hair->curvekey_offset],
+                            &curves[hair->prim_offset],
+                            hair->curvekey_offset);
+
+          dscene->curve_keys.tag_modified(hair->curvekey_offset, hair->curve_keys.size());
+          dscene->curves.tag_modified(hair->prim_offset, hair->num_curves());
+        }
+
         if (progress.get_cancel())
           return;
       }
     }
 
-    dscene->curve_keys.copy_to_device();
-    dscene->curves.copy_to_device();
+    dscene->curve_keys.copy_to_device_if_modified();
+    dscene->curves.copy_to_device_if_modified();
+  }
+  else {
+    dscene->curve_keys.free();
+    dscene->curves.free();
   }
 
   if (point_size != 0) {
     progress.set_status("Updating Mesh", "Copying Point clouds to device");
 
+    const bool pack_all = dscene->points.size() != point_size ||
+                          dscene->points_shader.size() != point_size;
+
     float4 *points = dscene->points.alloc(point_size);
     uint *points_shader = dscene->points_shader.alloc(point_size);
 
     foreach (Geometry *geom, scene->geometry) {
       if (geom->is_pointcloud()) {
         PointCloud *pointcloud = static_cast<PointCloud *>(geom);
-        pointcloud->pack(
-            scene, &points[pointcloud->prim_offset], &points_shader[pointcloud->prim_offset]);
+
+        if (pack_all || pointcloud->need_update_packed) {
+          pointcloud->pack(
+              scene, &points[pointcloud->prim_offset], &points_shader[pointcloud->prim_offset]);
+
+          const size_t num_points = pointcloud->num_points() * pointcloud->num_attributes();
+          dscene->points.tag_modified(pointcloud->prim_offset, num_points);
+          dscene->points_shader.tag_modified(pointcloud->prim_offset, num_points);
+        }
+
         if (progress.get_cancel())
           return;
       }
     }
 
-    dscene->points.copy_to_device();
-    dscene->points_shader.copy_to_device();
+    dscene->points.copy_to_device_if_modified();
+    dscene->points_shader.copy_to_device_if_modified();
+  }
+  else {
+    dscene->points.free();
+    dscene->points_shader.free();
   }
 
   if (patch_size != 0) {
     progress.set_status("Updating Mesh", "Copying Patches to device");
 
+    const bool pack_all = dscene->patches.size() != patch_size;
+
     uint *patch_data = dscene->patches.alloc(patch_size);
 
     foreach (Geometry *geom, scene->geometry) {
       if (geom->type == Geometry::MESH) {
         Mesh *mesh = static_cast<Mesh *>(geom);
+
+        if (!mesh->subd_faces.size() || !(pack_all || mesh->need_update_packed)) {
+          continue;
+        }
+
         mesh->pack_patches(&patch_data[mesh->patch_offset],
                            mesh->vert_offset,
                            mesh->face_offset,
                            mesh->corner_offset);
 
+        Mesh::SubdFace &last = mesh->subd_faces[mesh->subd_faces.size() - 1];
+        size_t num_patch_data = (last.ptex_offset + last.num_ptex_faces()) * 8;
+
         if (mesh->patch_table) {
           mesh->patch_table->copy_adjusting_offsets(&patch_data[mesh->patch_table_offset],
                                                     mesh->patch_table_offset);
+          num_patch_data += mesh->patch_table->total_size();
         }
 
+        dscene->patches.tag_modified(mesh->patch_offset, num_patch_data);
+
         if (progress.get_cancel())
           return;
       }
     }
 
-    dscene->patches.copy_to_device();
+    dscene->patches.copy_to_device_if_modified();
+  }
+  else {
+    dscene->patches.free();
   }
 
   if (for_displacement) {
@@ -1424,6 +1610,37 @@ void GeometryManager::device_update_bvh(Device *device,
                                         Scene *scene,
                                         Progress &progress)
 {
+  /* Objects moved but no geometry BVH changed, only refit the kept top level. */
+  if (top_level_bvh) {
+    if (top_level_bvh->can_refit_top_level(scene->objects)) {
+      progress.set_status("Updating Scene BVH", "Refitting top level");
+
+      top_level_bvh->refit_top_level(scene->objects);
+
+      const PackedBVH &top_level = top_level_bvh->top_level_pack;
+
+      if (top_level.nodes.size()) {
+        memcpy(dscene->bvh_nodes.data(),
+               top_level.nodes.data(),
+               sizeof(int4) * top_level.nodes.size());
+        dscene->bvh_nodes.tag_modified(0, top_level.nodes.size());
+        dscene->bvh_nodes.copy_to_device_if_modified();
+      }
+      if (top_level.leaf_nodes.size()) {
+        memcpy(dscene->bvh_leaf_nodes.data(),
+               top_level.leaf_nodes.data(),
+               sizeof(int4) * top_level.leaf_nodes.size());
+        dscene->bvh_leaf_nodes.tag_modified(0, top_level.leaf_nodes.size());
+        dscene->bvh_leaf_nodes.copy_to_device_if_modified();
+      }
+
+      VLOG(1) << "Refitted top level BVH of " << scene->objects.size() << " objects.";
+      return;
+    }
+
+    device_free_bvh(device, dscene);
+  }
+
   /* bvh build */
   progress.set_status("Updating Scene BVH", "Building");
 
@@ -1434,6 +1651,7 @@ void GeometryManager::device_update_bvh(Device *device,
   bparams.use_spatial_split = scene->params.use_bvh_spatial_split;
   bparams.use_unaligned_nodes = dscene->data.bvh.have_curves &&
                                 scene->params.use_bvh_unaligned_nodes;
+  bparams.use_compressed_nodes = scene->params.use_bvh_compressed_nodes;
   bparams.num_motion_triangle_steps = scene->params.num_bvh_time_steps;
   bparams.num_motion_curve_steps = scene->params.num_bvh_time_steps;
   bparams.num_motion_point_steps = scene->params.num_bvh_time_steps;
@@ -1442,9 +1660,13 @@ void GeometryManager::device_update_bvh(Device *device,
 
   VLOG(1) << "Using " << bvh_layout_name(bparams.bvh_layout) << " layout.";
 
+  const double build_start = time_dt();
+
   BVH *bvh = BVH::create(bparams, scene->geometry, scene->objects);
   bvh->build(progress, &device->stats);
 
+  bvh_build_time = time_dt() - build_start;
+
   if (progress.get_cancel()) {
 #ifdef WITH_EMBREE
     if (dscene->data.bvh.scene) {
@@ -1456,11 +1678,22 @@ void GeometryManager::device_update_bvh(Device *device,
     return;
   }
 
+  /* Keep the top level of dynamic scenes for refitting when objects move. */
+  const bool keep_top_level = (bparams.bvh_layout == BVH_LAYOUT_BVH2 &&
+                               bparams.bvh_type == SceneParams::BVH_DYNAMIC);
+  if (keep_top_level) {
+    static_cast<BVH2 *>(bvh)->keep_top_level();
+  }
+
   /* copy to device */
   progress.set_status("Updating Scene BVH", "Copying BVH to device");
 
   PackedBVH &pack = bvh->pack;
 
+  if (bparams.bvh_layout == BVH_LAYOUT_BVH2) {
+    collect_bvh_node_statistics(pack.nodes);
+  }
+
   if (pack.nodes.size()) {
     dscene->bvh_nodes.steal_data(pack.nodes);
     dscene->bvh_nodes.copy_to_device();
@@ -1509,7 +1742,12 @@ void GeometryManager::device_update_bvh(Device *device,
 
   bvh->copy_to_device(progress, dscene);
 
-  delete bvh;
+  if (keep_top_level) {
+    top_level_bvh = static_cast<BVH2 *>(bvh);
+  }
+  else {
+    delete bvh;
+  }
 }
 
 void GeometryManager::device_update_preprocess(Device *device, Scene *scene, Progress &progress)
@@ -1640,6 +1878,25 @@ void GeometryManager::device_update_volume_images(Device *device, Scene *scene,
   pool.wait_work();
 }
 
+static void tessellate_mesh(
+    Mesh *mesh, Camera *dicing_camera, Progress *progress, size_t n, size_t total)
+{
+  if (progress->get_cancel())
+    return;
+
+  string msg = "Tessellating ";
+  if (mesh->name == "")
+    msg += string_printf("%u/%u", (uint)(n + 1), (uint)total);
+  else
+    msg += string_printf("%s %u/%u", mesh->name.c_str(), (uint)(n + 1), (uint)total);
+
+  progress->set_status("Updating Mesh", msg);
+
+  mesh->subd_params->camera = dicing_camera;
+  DiagSplit dsplit(*mesh->subd_params);
+  mesh->tessellate(&dsplit);
+}
+
 void GeometryManager::device_update(Device *device,
                                     DeviceScene *dscene,
                                     Scene *scene,
@@ -1652,6 +1909,7 @@ void GeometryManager::device_update(Device *device,
 
   bool true_displacement_used = false;
   size_t total_tess_needed = 0;
+  vector<Mesh *> updated_meshes;
 
   foreach (Geometry *geom, scene->geometry) {
     foreach (Shader *shader, geom->used_shaders) {
@@ -1659,16 +1917,15 @@ void GeometryManager::device_update(Device *device,
         geom->need_update = true;
     }
 
+    /* Set here, since the BVH build clears need_update before the device arrays are
+     * packed. */
+    if (geom->need_update) {
+      geom->need_update_packed = true;
+    }
+
     if (geom->need_update && geom->type == Geometry::MESH) {
       Mesh *mesh = static_cast<Mesh *>(geom);
-
-      /* Update normals. */
-      mesh->add_face_normals();
-      mesh->add_vertex_normals();
-
-      if (mesh->need_attribute(scene, ATTR_STD_POSITION_UNDISPLACED)) {
-        mesh->add_undisplaced();
-      }
+      updated_meshes.push_back(mesh);
 
       /* Test if we need tessellation. */
       if (mesh->subdivision_type != Mesh::SUBDIVISION_NONE && mesh->num_subd_verts == 0 &&
@@ -1686,12 +1943,32 @@ void GeometryManager::device_update(Device *device,
     }
   }
 
+  /* Update normals. Big meshes are split up further internally. */
+  parallel_for(blocked_range<size_t>(0, updated_meshes.size(), 1),
+               [&](const blocked_range<size_t> &r) {
+                 for (size_t i = r.begin(); i != r.end(); i++) {
+                   Mesh *mesh = updated_meshes[i];
+
+                   mesh->add_face_normals();
+                   mesh->add_vertex_normals();
+
+                   if (mesh->need_attribute(scene, ATTR_STD_POSITION_UNDISPLACED)) {
+                     mesh->add_undisplaced();
+                   }
+                 }
+               });
+
+  if (progress.get_cancel())
+    return;
+
   /* Tessellate meshes that are using subdivision */
   if (total_tess_needed) {
     Camera *dicing_camera = scene->dicing_camera;
     dicing_camera->update(scene);
 
-    size_t i = 0;
+    vector<Mesh *> tess_meshes;
+    tess_meshes.reserve(total_tess_needed);
+
     foreach (Geometry *geom, scene->geometry) {
       if (!(geom->need_update && geom->type == Geometry::MESH)) {
         continue;
@@ -1700,25 +1977,31 @@ void GeometryManager::device_update(Device *device,
       Mesh *mesh = static_cast<Mesh *>(geom);
       if (mesh->subdivision_type != Mesh::SUBDIVISION_NONE && mesh->num_subd_verts == 0 &&
           mesh->subd_params) {
-        string msg = "Tessellating ";
-        if (mesh->name == "")
-          msg += string_printf("%u/%u", (uint)(i + 1), (uint)total_tess_needed);
-        else
-          msg += string_printf(
-              "%s %u/%u", mesh->name.c_str(), (uint)(i + 1), (uint)total_tess_needed);
-
-        progress.set_status("Updating Mesh", msg);
+        tess_meshes.push_back(mesh);
+      }
+    }
 
-        mesh->subd_params->camera = dicing_camera;
-        DiagSplit dsplit(*mesh->subd_params);
-        mesh->tessellate(&dsplit);
+    /* Start with the biggest meshes, so they don't end up being processed last on
+     * a single thread. Stable sort keeps the order deterministic for equal sizes. */
+    stable_sort(tess_meshes.begin(), tess_meshes.end(), [](Mesh *a, Mesh *b) {
+      return a->subd_faces.size() > b->subd_faces.size();
+    });
 
-        i++;
+    /* Meshes are independent of each other, and each one is diced in parallel internally
+     * as well, so the output does not depend on scheduling. */
+    TaskPool pool;
 
-        if (progress.get_cancel())
-          return;
-      }
+    for (size_t i = 0; i < tess_meshes.size(); i++) {
+      pool.push(function_bind(
+          &tessellate_mesh, tess_meshes[i], dicing_camera, &progress, i, tess_meshes.size()));
     }
+
+    TaskPool::Summary summary;
+    pool.wait_work(&summary);
+    VLOG(2) << "Mesh tessellation pool statistics:\n" << summary.full_report();
+
+    if (progress.get_cancel())
+      return;
   }
 
   /* Update images needed for true displacement. */
@@ -1730,8 +2013,15 @@ void GeometryManager::device_update(Device *device,
     scene->object_manager->device_update_flags(device, dscene, scene, progress, false);
   }
 
-  /* Device update. */
-  device_free(device, dscene);
+  /* Device update. Geometry arrays are updated in place when possible, only the BVH is
+   * rebuilt from scratch. The displacement kernels expect different array contents than
+   * the final render kernels, so those still start from scratch. */
+  if (true_displacement_used) {
+    device_free(device, dscene);
+  }
+  else if (!top_level_bvh) {
+    device_free_bvh(device, dscene);
+  }
 
   mesh_calc_offset(scene);
   if (true_displacement_used) {
@@ -1768,6 +2058,11 @@ void GeometryManager::device_update(Device *device,
       return;
   }
 
+  /* Geometry BVHs are merged into the scene BVH, so a kept one can't be refit. */
+  if (top_level_bvh && num_bvh > 0) {
+    device_free_bvh(device, dscene);
+  }
+
   /* Device re-update after displacement. */
   if (displacement_done) {
     device_free(device, dscene);
@@ -1779,11 +2074,20 @@ void GeometryManager::device_update(Device *device,
 
   TaskPool pool;
 
+  bvh_cache.set_path(scene->params.bvh_cache_path);
+
   size_t i = 0;
   foreach (Geometry *geom, scene->geometry) {
     if (geom->need_update) {
-      pool.push(function_bind(
-          &Geometry::compute_bvh, geom, device, dscene, &scene->params, &progress, i, num_bvh));
+      pool.push(function_bind(&Geometry::compute_bvh,
+                              geom,
+                              device,
+                              dscene,
+                              &scene->params,
+                              &bvh_cache,
+                              &progress,
+                              i,
+                              num_bvh));
       if (geom->need_build_bvh(bvh_layout)) {
         i++;
       }
@@ -1818,6 +2122,10 @@ void GeometryManager::device_update(Device *device,
   if (progress.get_cancel())
     return;
 
+  foreach (Geometry *geom, scene->geometry) {
+    geom->need_update_packed = false;
+  }
+
   need_update = false;
 
   if (true_displacement_used) {
@@ -1831,8 +2139,11 @@ void GeometryManager::device_update(Device *device,
   }
 }
 
-void GeometryManager::device_free(Device *device, DeviceScene *dscene)
+void GeometryManager::device_free_bvh(Device *device, DeviceScene *dscene)
 {
+  delete top_level_bvh;
+  top_level_bvh = NULL;
+
 #ifdef WITH_EMBREE
   if (dscene->data.bvh.scene) {
     if (dscene->data.bvh.bvh_layout == BVH_LAYOUT_EMBREE)
@@ -1851,6 +2162,27 @@ void GeometryManager::device_free(Device *device, DeviceScene *dscene)
   dscene->prim_index.free();
   dscene->prim_object.free();
   dscene->prim_time.free();
+
+  /* Signal for shaders like displacement not to do ray tracing. */
+  dscene->data.bvh.bvh_layout = BVH_LAYOUT_NONE;
+
+#ifdef WITH_OSL
+  OSLGlobals *og = (OSLGlobals *)device->osl_memory();
+
+  if (og) {
+    og->object_name_map.clear();
+    og->attribute_map.clear();
+    og->object_names.clear();
+  }
+#else
+  (void)device;
+#endif
+}
+
+void GeometryManager::device_free(Device *device, DeviceScene *dscene)
+{
+  device_free_bvh(device, dscene);
+
   dscene->tri_shader.free();
   dscene->tri_vnormal.free();
   dscene->object_vnormal_offset.free();
@@ -1867,21 +2199,6 @@ void GeometryManager::device_free(Device *device, DeviceScene *dscene)
   dscene->attributes_float2.free();
   dscene->attributes_float3.free();
   dscene->attributes_uchar4.free();
-
-  /* Signal for shaders like displacement not to do ray tracing. */
-  dscene->data.bvh.bvh_layout = BVH_LAYOUT_NONE;
-
-#ifdef WITH_OSL
-  OSLGlobals *og = (OSLGlobals *)device->osl_memory();
-
-  if (og) {
-    og->object_name_map.clear();
-    og->attribute_map.clear();
-    og->object_names.clear();
-  }
-#else
-  (void)device;
-#endif
 }
 
 void GeometryManager::tag_update(Scene *scene)
@@ -1896,6 +2213,44 @@ void GeometryManager::collect_statistics(const Scene *scene, RenderStats *stats)
     stats->mesh.geometry.add_entry(
         NamedSizeEntry(string(geometry->name.c_str()), geometry->get_total_size_in_bytes()));
   }
+
+  stats->bvh.num_nodes = bvh_num_nodes;
+  stats->bvh.num_compressed_nodes = bvh_num_compressed_nodes;
+  stats->bvh.nodes_size = bvh_nodes_size;
+  stats->bvh.uncompressed_nodes_size = bvh_uncompressed_nodes_size;
+  stats->bvh.build_time = bvh_build_time;
+  stats->bvh.cache_hits = bvh_cache.num_hits;
+  stats->bvh.cache_misses = bvh_cache.num_misses;
+  stats->bvh.cache_loaded_size = bvh_cache.loaded_size;
+  stats->bvh.cache_stored_size = bvh_cache.stored_size;
+}
+
+void GeometryManager::collect_bvh_node_statistics(const array<int4> &nodes)
+{
+  bvh_num_nodes = 0;
+  bvh_num_compressed_nodes = 0;
+  bvh_uncompressed_nodes_size = 0;
+  bvh_nodes_size = nodes.size() * sizeof(int4);
+
+  /* Walk the nodes in memory order, their size is given by the flags in the first
+   * element. */
+  for (size_t i = 0; i < nodes.size(); bvh_num_nodes++) {
+    size_t nsize, nsize_uncompressed;
+    if (nodes[i].x & PATH_RAY_NODE_UNALIGNED) {
+      nsize = nsize_uncompressed = BVH_UNALIGNED_NODE_SIZE;
+    }
+    else if (nodes[i].x & PATH_RAY_NODE_COMPRESSED) {
+      nsize = BVH_COMPRESSED_NODE_SIZE;
+      nsize_uncompressed = BVH_NODE_SIZE;
+      bvh_num_compressed_nodes++;
+    }
+    else {
+      nsize = nsize_uncompressed = BVH_NODE_SIZE;
+    }
+
+    bvh_uncompressed_nodes_size += nsize_uncompressed * sizeof(int4);
+    i += nsize;
+  }
 }
 
 void GeometryManager::create_motion_blur_geometry(
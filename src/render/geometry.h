@@ -19,6 +19,7 @@
 
 #include "graph/node.h"
 
+#include "bvh/bvh_cache.h"
 #include "bvh/bvh_params.h"
 
 #include "render/attribute.h"
@@ -32,6 +33,7 @@
 CCL_NAMESPACE_BEGIN
 
 class BVH;
+class BVH2;
 class Device;
 class DeviceScene;
 class Mesh;
@@ -86,6 +88,15 @@ class Geometry : public Node {
   bool need_update;
   bool need_update_rebuild;
 
+  /* Packed data in the global device arrays is out of date, either because the geometry
+   * changed or because its offsets in the arrays moved. Geometry without this flag keeps
+   * its packed data from the previous device update. */
+  bool need_update_packed;
+
+  /* Range of the packed attribute data in the float, float2, float3 and uchar4 arrays. */
+  size_t attr_packed_offset[4];
+  size_t attr_packed_size[4];
+
   /* Constructor/Destructor */
   explicit Geometry(const NodeType *node_type, const Type type);
   virtual ~Geometry();
@@ -111,6 +122,7 @@ class Geometry : public Node {
   void compute_bvh(Device *device,
                    DeviceScene *dscene,
                    SceneParams *params,
+                   BVHCache *bvh_cache,
                    Progress *progress,
                    int n,
                    int total);
@@ -162,6 +174,7 @@ class GeometryManager {
   void device_update_preprocess(Device *device, Scene *scene, Progress &progress);
   void device_update(Device *device, DeviceScene *dscene, Scene *scene, Progress &progress);
   void device_free(Device *device, DeviceScene *dscene);
+  void device_free_bvh(Device *device, DeviceScene *dscene);
 
   /* Updates */
   void tag_update(Scene *scene);
@@ -208,6 +221,22 @@ class GeometryManager {
   void device_update_displacement_images(Device *device, Scene *scene, Progress &progress);
 
   void device_update_volume_images(Device *device, Scene *scene, Progress &progress);
+
+  void collect_bvh_node_statistics(const array<int4> &nodes);
+
+  /* Scene BVH kept for dynamic scenes with the BVH2 layout, so moving objects only
+   * refits its top level instead of rebuilding and merging all geometry BVHs again. */
+  BVH2 *top_level_bvh;
+
+  /* Persistent cache of geometry BVHs. */
+  BVHCache bvh_cache;
+
+  /* Statistics of the last scene BVH build, reported by collect_statistics(). */
+  size_t bvh_num_nodes;
+  size_t bvh_num_compressed_nodes;
+  size_t bvh_nodes_size;
+  size_t bvh_uncompressed_nodes_size;
+  double bvh_build_time;
 };
 
 CCL_NAMESPACE_END
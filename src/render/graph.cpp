@@ -417,6 +417,22 @@ void ShaderGraph::find_dependencies(ShaderNodeSet &dependencies, ShaderInput *in
   }
 }
 
+ShaderOutput *ShaderGraph::copy_dependencies(ShaderInput *input)
+{
+  assert(input->link);
+
+  ShaderNodeSet dependencies;
+  find_dependencies(dependencies, input);
+
+  ShaderNodeMap nnodemap;
+  copy_nodes(dependencies, nnodemap);
+  foreach (NodePair &pair, nnodemap) {
+    add(pair.second);
+  }
+
+  return nnodemap[input->link->parent]->output(input->link->name());
+}
+
 void ShaderGraph::clear_nodes()
 {
   foreach (ShaderNode *node, nodes) {
@@ -746,6 +762,25 @@ void ShaderGraph::break_cycles(ShaderNode *node, vector<bool> &visited, vector<b
   on_stack[node->id] = false;
 }
 
+static void shader_node_hash(MD5Hash &md5, ShaderNode *node)
+{
+  node->hash(md5);
+  foreach (ShaderInput *input, node->inputs) {
+    int link_id = (input->link) ? input->link->parent->id : 0;
+    md5.append((uint8_t *)&link_id, sizeof(link_id));
+    if (input->link) {
+      md5.append(input->link->name().string());
+    }
+  }
+
+  if (node->special_type == SHADER_SPECIAL_TYPE_OSL) {
+    /* Hash takes into account socket values, to detect changes
+     * in the code of the node we need an exception. */
+    OSLNode *oslnode = static_cast<OSLNode *>(node);
+    md5.append(oslnode->bytecode_hash);
+  }
+}
+
 void ShaderGraph::compute_displacement_hash()
 {
   /* Compute hash of all nodes linked to displacement, to detect if we need
@@ -762,21 +797,50 @@ void ShaderGraph::compute_displacement_hash()
 
   MD5Hash md5;
   foreach (ShaderNode *node, nodes_displace) {
+    shader_node_hash(md5, node);
+  }
+
+  displacement_hash = md5.get_hex();
+}
+
+void ShaderGraph::hash(MD5Hash &md5)
+{
+  foreach (ShaderNode *node, nodes) {
+    shader_node_hash(md5, node);
+  }
+}
+
+void ShaderGraph::hash(MD5Hash &md5, ShaderInput *input)
+{
+  ShaderNodeSet dependencies;
+  find_dependencies(dependencies, input);
+
+  /* Number links by the order of the nodes in the subgraph rather than their ids. */
+  map<ShaderNode *, int> indices;
+  foreach (ShaderNode *node, dependencies) {
+    const int index = indices.size() + 1;
+    indices[node] = index;
+  }
+
+  foreach (ShaderNode *node, dependencies) {
     node->hash(md5);
-    foreach (ShaderInput *input, node->inputs) {
-      int link_id = (input->link) ? input->link->parent->id : 0;
-      md5.append((uint8_t *)&link_id, sizeof(link_id));
+    foreach (ShaderInput *in, node->inputs) {
+      const int link_index = (in->link) ? indices[in->link->parent] : 0;
+      md5.append((uint8_t *)&link_index, sizeof(link_index));
+      if (in->link) {
+        md5.append(in->link->name().string());
+      }
     }
 
     if (node->special_type == SHADER_SPECIAL_TYPE_OSL) {
-      /* Hash takes into account socket values, to detect changes
-       * in the code of the node we need an exception. */
       OSLNode *oslnode = static_cast<OSLNode *>(node);
       md5.append(oslnode->bytecode_hash);
     }
   }
 
-  displacement_hash = md5.get_hex();
+  if (input->link) {
+    md5.append(input->link->name().string());
+  }
 }
 
 void ShaderGraph::clean(Scene *scene)
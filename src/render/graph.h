@@ -268,6 +268,12 @@ class ShaderNode : public Node {
    * is to be handled in the subclass.
    */
   virtual bool equals(const ShaderNode &other);
+
+  /* Hash of runtime state that compile() depends on but is not stored in sockets, like
+   * image slots, to reuse compiled shaders. */
+  virtual void hash_compile_state(MD5Hash & /*md5*/)
+  {
+  }
 };
 
 /* Node definition utility macros */
@@ -335,12 +341,22 @@ class ShaderGraph {
 
   void remove_proxy_nodes();
   void compute_displacement_hash();
+  /* Hash of all nodes, their socket values and links, to detect changes of the graph. */
+  void hash(MD5Hash &md5);
+  /* Hash of the nodes an input depends on, the same for identical subgraphs in any graph. */
+  void hash(MD5Hash &md5, ShaderInput *input);
   void simplify(Scene *scene);
   void finalize(Scene *scene,
                 bool do_bump = false,
                 bool do_simplify = false,
                 bool bump_in_object_space = false);
 
+  /* Find all nodes an input depends on directly and indirectly. */
+  void find_dependencies(ShaderNodeSet &dependencies, ShaderInput *input);
+  /* Add copies of the nodes a linked input of another graph depends on, returns the copy of
+   * the output the input is linked to. */
+  ShaderOutput *copy_dependencies(ShaderInput *input);
+
   int get_num_closures();
 
   void dump_graph(const char *filename);
@@ -348,7 +364,6 @@ class ShaderGraph {
  protected:
   typedef pair<ShaderNode *const, ShaderNode *> NodePair;
 
-  void find_dependencies(ShaderNodeSet &dependencies, ShaderInput *input);
   void clear_nodes();
   void copy_nodes(ShaderNodeSet &nodes, ShaderNodeMap &nnodemap);
 
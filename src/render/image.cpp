@@ -16,20 +16,32 @@
 
 #include "render/image.h"
 #include "device/device.h"
+#include "render/background.h"
+#include "render/camera.h"
 #include "render/colorspace.h"
+#include "render/image_cache.h"
 #include "render/image_oiio.h"
+#include "render/image_tx.h"
 #include "render/image_vdb.h"
+#include "render/light.h"
+#include "render/mesh.h"
+#include "render/nodes.h"
+#include "render/object.h"
 #include "render/scene.h"
+#include "render/shader.h"
 #include "render/stats.h"
 
 #include "util/util_foreach.h"
 #include "util/util_image.h"
 #include "util/util_image_impl.h"
 #include "util/util_logging.h"
+#include "util/util_map.h"
+#include "util/util_murmurhash.h"
 #include "util/util_path.h"
 #include "util/util_progress.h"
 #include "util/util_task.h"
 #include "util/util_texture.h"
+#include "util/util_texture_compress.h"
 #include "util/util_unique_ptr.h"
 
 #ifdef WITH_OSL
@@ -81,6 +93,16 @@ const char *name_from_type(ImageDataType type)
       return "nanovdb_float3";
     case IMAGE_DATA_TYPE_OIIO:
       return "openimageio";
+    case IMAGE_DATA_TYPE_PAGED:
+      return "paged";
+    case IMAGE_DATA_TYPE_BC1:
+      return "bc1";
+    case IMAGE_DATA_TYPE_BC3:
+      return "bc3";
+    case IMAGE_DATA_TYPE_BC4:
+      return "bc4";
+    case IMAGE_DATA_TYPE_LAZY:
+      return "lazy";
     case IMAGE_DATA_NUM_TYPES:
       assert(!"System enumerator type, should never be used");
       return "";
@@ -241,6 +263,12 @@ bool ImageMetaData::is_float() const
           type == IMAGE_DATA_TYPE_HALF || type == IMAGE_DATA_TYPE_HALF4);
 }
 
+bool ImageMetaData::is_rgba() const
+{
+  return (type == IMAGE_DATA_TYPE_FLOAT4 || type == IMAGE_DATA_TYPE_HALF4 ||
+          type == IMAGE_DATA_TYPE_BYTE4 || type == IMAGE_DATA_TYPE_USHORT4);
+}
+
 void ImageMetaData::detect_colorspace()
 {
   if (type == IMAGE_DATA_TYPE_OIIO) {
@@ -298,6 +326,17 @@ bool ImageLoader::equals(const ImageLoader *a, const ImageLoader *b)
   }
 }
 
+bool ImageLoader::load_level_metadata(int, int &, int &, bool &)
+{
+  return false;
+}
+
+bool ImageLoader::load_pixels_region(
+    const ImageMetaData &, int, int, int, int, int, void *, const bool)
+{
+  return false;
+}
+
 bool ImageLoader::is_vdb_loader() const
 {
   return false;
@@ -310,11 +349,18 @@ ImageManager::ImageManager(const DeviceInfo &info)
   need_update = true;
   oiio_texture_system = NULL;
   animation_frame = 0;
+  tx_num_finished = 0;
 
   /* Set image limits */
   features.has_half_float = info.has_half_images;
   features.has_nanovdb = info.has_nanovdb;
   features.has_texture_cache = false;
+  features.has_paged_images = (info.type == DEVICE_CPU);
+  features.has_compressed_images = (info.type == DEVICE_CPU);
+  features.has_shared_images = (info.type == DEVICE_CPU);
+
+  image_cache.reset(new ImageCache());
+  tx_converter.reset(new TxConverter());
 }
 
 ImageManager::~ImageManager()
@@ -344,6 +390,25 @@ bool ImageManager::set_animation_frame_update(int frame)
   return false;
 }
 
+void ImageManager::tag_converted_images()
+{
+  const int num_finished = tx_converter->num_finished();
+  if (num_finished == tx_num_finished) {
+    return;
+  }
+  tx_num_finished = num_finished;
+
+  thread_scoped_lock device_lock(images_mutex);
+
+  for (size_t slot = 0; slot < images.size(); slot++) {
+    Image *img = images[slot];
+    if (img && img->tx_pending) {
+      img->need_load = true;
+      need_update = true;
+    }
+  }
+}
+
 void ImageManager::load_image_metadata(Image *img)
 {
   if (!img->need_metadata) {
@@ -400,6 +465,11 @@ ImageHandle ImageManager::add_image(const string &filename,
     }
     const int slot = add_image_slot(new OIIOImageLoader(tile_filename), params, false);
     handle.tile_slots.push_back(slot);
+
+    if (tile != 0) {
+      thread_scoped_lock images_lock(images_mutex);
+      images[slot]->udim_tile = true;
+    }
   }
 
   return handle;
@@ -475,8 +545,17 @@ int ImageManager::add_image_slot(ImageLoader *loader,
   img->need_metadata = true;
   img->need_load = true;
   img->builtin = builtin;
+  img->tx_pending = false;
+  img->udim_tile = false;
   img->users = 1;
   img->mem = NULL;
+  img->paged = NULL;
+  img->lazy = NULL;
+  img->oiio_texture = NULL;
+  img->content_hash = 0;
+  img->need_dedup = false;
+  img->dedup_slot = -1;
+  img->resolution_limit = 0;
 
   images[slot] = img;
 
@@ -520,53 +599,15 @@ static bool image_associate_alpha(ImageManager::Image *img)
 }
 
 template<TypeDesc::BASETYPE FileFormat, typename StorageType>
-bool ImageManager::file_load_image(Image *img, int texture_limit)
+static void image_process_pixels(const ImageParams &params,
+                                 const ImageMetaData &metadata,
+                                 StorageType *pixels,
+                                 const size_t num_pixels)
 {
-  /* we only handle certain number of components */
-  if (!(img->metadata.channels >= 1 && img->metadata.channels <= 4)) {
-    return false;
-  }
-
-  /* Get metadata. */
-  int width = img->metadata.width;
-  int height = img->metadata.height;
-  int depth = img->metadata.depth;
-  int components = img->metadata.channels;
-
-  /* Read pixels. */
-  vector<StorageType> pixels_storage;
-  StorageType *pixels;
-  const size_t max_size = max(max(width, height), depth);
-  if (max_size == 0) {
-    /* Don't bother with empty images. */
-    return false;
-  }
-
-  /* Allocate memory as needed, may be smaller to resize down. */
-  if (texture_limit > 0 && max_size > texture_limit) {
-    pixels_storage.resize(((size_t)width) * height * depth * 4);
-    pixels = &pixels_storage[0];
-  }
-  else {
-    thread_scoped_lock device_lock(device_mutex);
-    pixels = (StorageType *)img->mem->alloc(width, height, depth);
-  }
-
-  if (pixels == NULL) {
-    /* Could be that we've run out of memory. */
-    return false;
-  }
-
-  const size_t num_pixels = ((size_t)width) * height * depth;
-  img->loader->load_pixels(
-      img->metadata, pixels, num_pixels * components, image_associate_alpha(img));
-
   /* The kernel can handle 1 and 4 channel images. Anything that is not a single
    * channel image is converted to RGBA format. */
-  bool is_rgba = (img->metadata.type == IMAGE_DATA_TYPE_FLOAT4 ||
-                  img->metadata.type == IMAGE_DATA_TYPE_HALF4 ||
-                  img->metadata.type == IMAGE_DATA_TYPE_BYTE4 ||
-                  img->metadata.type == IMAGE_DATA_TYPE_USHORT4);
+  const bool is_rgba = metadata.is_rgba();
+  const int components = metadata.channels;
 
   if (is_rgba) {
     const StorageType one = util_image_cast_from_float<StorageType>(1.0f);
@@ -600,17 +641,17 @@ bool ImageManager::file_load_image(Image *img, int texture_limit)
     }
 
     /* Disable alpha if requested by the user. */
-    if (img->params.alpha_type == IMAGE_ALPHA_IGNORE) {
+    if (params.alpha_type == IMAGE_ALPHA_IGNORE) {
       for (size_t i = num_pixels - 1, pixel = 0; pixel < num_pixels; pixel++, i--) {
         pixels[i * 4 + 3] = one;
       }
     }
 
-    if (img->metadata.colorspace != u_colorspace_raw &&
-        img->metadata.colorspace != u_colorspace_srgb) {
+    if (metadata.colorspace != u_colorspace_raw &&
+        metadata.colorspace != u_colorspace_srgb) {
       /* Convert to scene linear. */
       ColorSpaceManager::to_scene_linear(
-          img->metadata.colorspace, pixels, num_pixels, img->metadata.compress_as_srgb);
+          metadata.colorspace, pixels, num_pixels, metadata.compress_as_srgb);
     }
   }
 
@@ -640,6 +681,80 @@ bool ImageManager::file_load_image(Image *img, int texture_limit)
       }
     }
   }
+}
+
+void image_process_pixels(const ImageParams &params,
+                          const ImageMetaData &metadata,
+                          void *pixels,
+                          size_t num_pixels)
+{
+  switch (metadata.type) {
+    case IMAGE_DATA_TYPE_FLOAT4:
+    case IMAGE_DATA_TYPE_FLOAT:
+      image_process_pixels<TypeDesc::FLOAT, float>(params, metadata, (float *)pixels, num_pixels);
+      break;
+    case IMAGE_DATA_TYPE_BYTE4:
+    case IMAGE_DATA_TYPE_BYTE:
+      image_process_pixels<TypeDesc::UINT8, uchar>(params, metadata, (uchar *)pixels, num_pixels);
+      break;
+    case IMAGE_DATA_TYPE_HALF4:
+    case IMAGE_DATA_TYPE_HALF:
+      image_process_pixels<TypeDesc::HALF, half>(params, metadata, (half *)pixels, num_pixels);
+      break;
+    case IMAGE_DATA_TYPE_USHORT4:
+    case IMAGE_DATA_TYPE_USHORT:
+      image_process_pixels<TypeDesc::USHORT, uint16_t>(
+          params, metadata, (uint16_t *)pixels, num_pixels);
+      break;
+    default:
+      break;
+  }
+}
+
+template<TypeDesc::BASETYPE FileFormat, typename StorageType>
+bool ImageManager::file_load_image(Image *img, device_texture *mem, int texture_limit)
+{
+  /* we only handle certain number of components */
+  if (!(img->metadata.channels >= 1 && img->metadata.channels <= 4)) {
+    return false;
+  }
+
+  /* Get metadata. */
+  int width = img->metadata.width;
+  int height = img->metadata.height;
+  int depth = img->metadata.depth;
+  int components = img->metadata.channels;
+
+  /* Read pixels. */
+  vector<StorageType> pixels_storage;
+  StorageType *pixels;
+  const size_t max_size = max(max(width, height), depth);
+  if (max_size == 0) {
+    /* Don't bother with empty images. */
+    return false;
+  }
+
+  /* Allocate memory as needed, may be smaller to resize down. */
+  if (texture_limit > 0 && max_size > texture_limit) {
+    pixels_storage.resize(((size_t)width) * height * depth * 4);
+    pixels = &pixels_storage[0];
+  }
+  else {
+    thread_scoped_lock device_lock(device_mutex);
+    pixels = (StorageType *)mem->alloc(width, height, depth);
+  }
+
+  if (pixels == NULL) {
+    /* Could be that we've run out of memory. */
+    return false;
+  }
+
+  const size_t num_pixels = ((size_t)width) * height * depth;
+  img->loader->load_pixels(
+      img->metadata, pixels, num_pixels * components, image_associate_alpha(img));
+
+  image_process_pixels<FileFormat, StorageType>(
+      img->params, img->metadata, pixels, num_pixels);
 
   /* Scale image down if needed. */
   if (pixels_storage.size() > 0) {
@@ -655,7 +770,7 @@ bool ImageManager::file_load_image(Image *img, int texture_limit)
                              width,
                              height,
                              depth,
-                             is_rgba ? 4 : 1,
+                             img->metadata.is_rgba() ? 4 : 1,
                              scale_factor,
                              &scaled_pixels,
                              &scaled_width,
@@ -666,7 +781,7 @@ bool ImageManager::file_load_image(Image *img, int texture_limit)
 
     {
       thread_scoped_lock device_lock(device_mutex);
-      texture_pixels = (StorageType *)img->mem->alloc(scaled_width, scaled_height, scaled_depth);
+      texture_pixels = (StorageType *)mem->alloc(scaled_width, scaled_height, scaled_depth);
     }
 
     memcpy(texture_pixels, &scaled_pixels[0], scaled_pixels.size() * sizeof(StorageType));
@@ -675,60 +790,255 @@ bool ImageManager::file_load_image(Image *img, int texture_limit)
   return true;
 }
 
-void ImageManager::device_load_image(Device *device, Scene *scene, int slot, Progress *progress)
+/* Build the lookup options of all lookup types once, rather than for every lookup. */
+static void image_oiio_texture_init(OIIOTexture *texture,
+                                    OIIO::TextureSystem::TextureHandle *handle,
+                                    const ImageParams &params,
+                                    const TextureCacheParams &texture_params)
 {
-  if (progress->get_cancel()) {
-    return;
+  texture->handle = handle;
+  texture->missingcolor[0] = TEX_IMAGE_MISSING_R;
+  texture->missingcolor[1] = TEX_IMAGE_MISSING_G;
+  texture->missingcolor[2] = TEX_IMAGE_MISSING_B;
+  texture->missingcolor[3] = TEX_IMAGE_MISSING_A;
+
+  OIIO::TextureOpt options;
+  options.missingcolor = texture->missingcolor;
+  options.mipmode = OIIO::TextureOpt::MipModeAniso;
+
+  /* Interpolation and extensions are supported in OIIO under different constants. */
+  switch (params.interpolation) {
+    case INTERPOLATION_SMART:
+      options.interpmode = OIIO::TextureOpt::InterpSmartBicubic;
+      break;
+    case INTERPOLATION_CUBIC:
+      options.interpmode = OIIO::TextureOpt::InterpBicubic;
+      break;
+    case INTERPOLATION_LINEAR:
+      options.interpmode = OIIO::TextureOpt::InterpBilinear;
+      break;
+    case INTERPOLATION_CLOSEST:
+    default:
+      options.interpmode = OIIO::TextureOpt::InterpClosest;
+      break;
+  }
+  switch (params.extension) {
+    case EXTENSION_CLIP:
+      options.swrap = options.twrap = OIIO::TextureOpt::WrapBlack;
+      break;
+    case EXTENSION_EXTEND:
+      options.swrap = options.twrap = OIIO::TextureOpt::WrapClamp;
+      break;
+    case EXTENSION_REPEAT:
+    default:
+      options.swrap = options.twrap = OIIO::TextureOpt::WrapPeriodic;
+      break;
   }
 
-  Image *img = images[slot];
+  /* The texture system derives the anisotropy from the ray differentials, the option only
+   * caps it. Blurred lookups do not gain much from many anisotropic probes. */
+  for (int type = 0; type < OIIO_LOOKUP_NUM_TYPES; type++) {
+    OIIO::TextureOpt &type_options = texture->options[type];
+    type_options = options;
+
+    switch (type % OIIO_LOOKUP_NEAREST) {
+      case OIIO_LOOKUP_GLOSSY:
+        type_options.sblur = type_options.tblur = texture_params.glossy_blur;
+        type_options.anisotropic = 4;
+        break;
+      case OIIO_LOOKUP_DIFFUSE:
+        type_options.sblur = type_options.tblur = texture_params.diffuse_blur;
+        type_options.anisotropic = 2;
+        break;
+      default:
+        type_options.sblur = type_options.tblur = 0.0f;
+        type_options.anisotropic = 8;
+        break;
+    }
 
-  if (features.has_texture_cache && !img->builtin) {
-    /* Get or generate a mip mapped tile image file.
-     * If we have a mip map, assume it's linear, not sRGB. */
-    const char *cache_path = scene->params.texture.use_custom_cache_path ?
-                                 scene->params.texture.custom_cache_path.c_str() :
-                                 NULL;
-    bool have_mip = ((OIIOImageLoader *)img->loader)
-                        ->get_tx(img->metadata.colorspace,
-                                 img->params.extension,
-                                 progress,
-                                 scene->params.texture.auto_convert,
-                                 cache_path);
-    if (have_mip) {
-      img->need_metadata = true;
+    if (type >= OIIO_LOOKUP_NEAREST) {
+      type_options.interpmode = OIIO::TextureOpt::InterpClosest;
+      type_options.mipmode = OIIO::TextureOpt::MipModeOneLevel;
     }
   }
+}
 
-  progress->set_status("Updating Images", "Loading " + img->loader->name());
+/* Images fully loaded into memory as pixels by the image manager, possibly block compressed. */
+static bool image_is_pixel_type(ImageDataType type)
+{
+  switch (type) {
+    case IMAGE_DATA_TYPE_FLOAT4:
+    case IMAGE_DATA_TYPE_BYTE4:
+    case IMAGE_DATA_TYPE_HALF4:
+    case IMAGE_DATA_TYPE_FLOAT:
+    case IMAGE_DATA_TYPE_BYTE:
+    case IMAGE_DATA_TYPE_HALF:
+    case IMAGE_DATA_TYPE_USHORT4:
+    case IMAGE_DATA_TYPE_USHORT:
+    case IMAGE_DATA_TYPE_BC1:
+    case IMAGE_DATA_TYPE_BC3:
+    case IMAGE_DATA_TYPE_BC4:
+      return true;
+    default:
+      return false;
+  }
+}
 
-  const int texture_limit = scene->params.texture_limit;
+/* Hash of the dimensions and a sample of the pixels, enough to find candidates that are
+ * then compared in full. */
+static uint image_content_hash(device_texture *mem)
+{
+  const int chunk_size = 64;
+  const size_t num_chunks = 1024;
 
-  load_image_metadata(img);
-  ImageDataType type = img->metadata.type;
+  const uchar *pixels = (const uchar *)mem->host_pointer;
+  const size_t size = mem->memory_size();
+  const size_t dimensions[4] = {mem->data_width, mem->data_height, mem->data_depth, size};
+  uint hash = util_murmur_hash3(dimensions, sizeof(dimensions), mem->info.data_type);
 
-  /* Name for debugging. */
-  img->mem_name = string_printf("__tex_image_%s_%03d", name_from_type(type), slot);
+  if (size <= chunk_size * num_chunks) {
+    return util_murmur_hash3(pixels, size, hash);
+  }
 
-  /* Free previous texture in slot. */
-  if (img->mem) {
+  const size_t stride = (size - chunk_size) / (num_chunks - 1);
+  for (size_t i = 0; i < num_chunks; i++) {
+    hash = util_murmur_hash3(pixels + i * stride, chunk_size, hash);
+  }
+  return hash;
+}
+
+static bool image_pixels_equal(device_texture *a, device_texture *b)
+{
+  return a->info.data_type == b->info.data_type && a->data_width == b->data_width &&
+         a->data_height == b->data_height && a->data_depth == b->data_depth &&
+         a->memory_size() == b->memory_size() &&
+         memcmp(a->host_pointer, b->host_pointer, a->memory_size()) == 0;
+}
+
+bool ImageManager::image_use_paged(Image *img, Scene *scene)
+{
+  if (!(scene->params.texture.use_paged_images && features.has_paged_images) || img->builtin) {
+    return false;
+  }
+
+  /* Only 2D images that would otherwise be fully loaded by the image manager. */
+  const ImageMetaData &metadata = img->metadata;
+  if (metadata.depth > 1 || !(metadata.channels >= 1 && metadata.channels <= 4)) {
+    return false;
+  }
+
+  return image_is_pixel_type(metadata.type);
+}
+
+bool ImageManager::image_use_lazy(Image *img, Scene *scene)
+{
+  /* Same device and image support as demand paged images. */
+  if (!(scene->params.texture.use_lazy_udim_tiles && features.has_paged_images) ||
+      !img->udim_tile || img->builtin) {
+    return false;
+  }
+
+  const ImageMetaData &metadata = img->metadata;
+  if (metadata.depth > 1 || !(metadata.channels >= 1 && metadata.channels <= 4)) {
+    return false;
+  }
+
+  return image_is_pixel_type(metadata.type);
+}
+
+bool ImageManager::image_use_compression(Image *img, Scene *scene)
+{
+  if (!(scene->params.use_image_compression && features.has_compressed_images) ||
+      img->builtin) {
+    return false;
+  }
+
+  /* Only 2D images with 8 bit pixels, higher precision is what the other types are for. */
+  const device_texture *mem = img->mem;
+  const ImageDataType type = (ImageDataType)mem->info.data_type;
+  return (type == IMAGE_DATA_TYPE_BYTE4 || type == IMAGE_DATA_TYPE_BYTE) &&
+         mem->host_pointer && mem->data_width > 0 && mem->data_height > 0 &&
+         mem->data_depth <= 1;
+}
+
+/* Replace the pixels of an 8 bit image with blocks of 4x4 texels, BC1 for opaque color,
+ * BC3 for color with alpha and BC4 for a single channel. */
+void ImageManager::device_compress_image(Device *device, Image *img, int slot)
+{
+  device_texture *pixels_mem = img->mem;
+  const int width = pixels_mem->data_width;
+  const int height = pixels_mem->data_height;
+
+  ImageDataType type;
+  if (pixels_mem->info.data_type == IMAGE_DATA_TYPE_BYTE) {
+    type = IMAGE_DATA_TYPE_BC4;
+  }
+  else {
+    const uchar4 *pixels = (const uchar4 *)pixels_mem->host_pointer;
+    const size_t num_pixels = ((size_t)width) * height;
+    bool opaque = true;
+    for (size_t i = 0; i < num_pixels && opaque; i++) {
+      opaque = (pixels[i].w == 255);
+    }
+    type = opaque ? IMAGE_DATA_TYPE_BC1 : IMAGE_DATA_TYPE_BC3;
+  }
+
+  const string mem_name = string_printf("__tex_image_%s_%03d", name_from_type(type), slot);
+  device_texture *mem = new device_texture(
+      device, mem_name.c_str(), slot, type, img->params.interpolation, img->params.extension);
+  mem->info.use_transform_3d = pixels_mem->info.use_transform_3d;
+  mem->info.transform_3d = pixels_mem->info.transform_3d;
+  mem->info.compress_as_srgb = pixels_mem->info.compress_as_srgb;
+
+  void *blocks;
+  {
     thread_scoped_lock device_lock(device_mutex);
-    delete img->mem;
-    img->mem = NULL;
+    blocks = mem->alloc(width, height);
   }
 
-  img->mem = new device_texture(
-      device, img->mem_name.c_str(), slot, type, img->params.interpolation, img->params.extension);
-  img->mem->info.use_transform_3d = img->metadata.use_transform_3d;
-  img->mem->info.transform_3d = img->metadata.transform_3d;
-  img->mem->info.compress_as_srgb = img->metadata.compress_as_srgb;
+  if (blocks == NULL) {
+    /* Keep the uncompressed pixels when out of memory. */
+    thread_scoped_lock device_lock(device_mutex);
+    delete mem;
+    return;
+  }
+
+  switch (type) {
+    case IMAGE_DATA_TYPE_BC1:
+      texture_compress_bc1(
+          (const uchar4 *)pixels_mem->host_pointer, width, height, (TextureBlockBC1 *)blocks);
+      break;
+    case IMAGE_DATA_TYPE_BC3:
+      texture_compress_bc3(
+          (const uchar4 *)pixels_mem->host_pointer, width, height, (TextureBlockBC3 *)blocks);
+      break;
+    default:
+      texture_compress_bc4(
+          (const uchar *)pixels_mem->host_pointer, width, height, (TextureBlockBC4 *)blocks);
+      break;
+  }
+
+  VLOG(1) << "Compressed image " << img->loader->name() << " from "
+          << string_human_readable_size(pixels_mem->memory_size()) << " to "
+          << string_human_readable_size(mem->memory_size()) << ".";
+
+  thread_scoped_lock device_lock(device_mutex);
+  delete img->mem;
+  img->mem = mem;
+  img->mem_name = mem_name;
+}
+
+/* Load the pixels of a 2D or 3D image into the texture memory, or a single pixel with the
+ * missing texture color on failure. */
+void ImageManager::device_load_pixels(Image *img, device_texture *mem, int texture_limit)
+{
+  const ImageDataType type = img->metadata.type;
 
-  /* Create new texture. */
   if (type == IMAGE_DATA_TYPE_FLOAT4) {
-    if (!file_load_image<TypeDesc::FLOAT, float>(img, texture_limit)) {
+    if (!file_load_image<TypeDesc::FLOAT, float>(img, mem, texture_limit)) {
       /* on failure to load, we set a 1x1 pixels pink image */
       thread_scoped_lock device_lock(device_mutex);
-      float *pixels = (float *)img->mem->alloc(1, 1);
+      float *pixels = (float *)mem->alloc(1, 1);
 
       pixels[0] = TEX_IMAGE_MISSING_R;
       pixels[1] = TEX_IMAGE_MISSING_G;
@@ -737,19 +1047,19 @@ void ImageManager::device_load_image(Device *device, Scene *scene, int slot, Pro
     }
   }
   else if (type == IMAGE_DATA_TYPE_FLOAT) {
-    if (!file_load_image<TypeDesc::FLOAT, float>(img, texture_limit)) {
+    if (!file_load_image<TypeDesc::FLOAT, float>(img, mem, texture_limit)) {
       /* on failure to load, we set a 1x1 pixels pink image */
       thread_scoped_lock device_lock(device_mutex);
-      float *pixels = (float *)img->mem->alloc(1, 1);
+      float *pixels = (float *)mem->alloc(1, 1);
 
       pixels[0] = TEX_IMAGE_MISSING_R;
     }
   }
   else if (type == IMAGE_DATA_TYPE_BYTE4) {
-    if (!file_load_image<TypeDesc::UINT8, uchar>(img, texture_limit)) {
+    if (!file_load_image<TypeDesc::UINT8, uchar>(img, mem, texture_limit)) {
       /* on failure to load, we set a 1x1 pixels pink image */
       thread_scoped_lock device_lock(device_mutex);
-      uchar *pixels = (uchar *)img->mem->alloc(1, 1);
+      uchar *pixels = (uchar *)mem->alloc(1, 1);
 
       pixels[0] = (TEX_IMAGE_MISSING_R * 255);
       pixels[1] = (TEX_IMAGE_MISSING_G * 255);
@@ -758,19 +1068,19 @@ void ImageManager::device_load_image(Device *device, Scene *scene, int slot, Pro
     }
   }
   else if (type == IMAGE_DATA_TYPE_BYTE) {
-    if (!file_load_image<TypeDesc::UINT8, uchar>(img, texture_limit)) {
+    if (!file_load_image<TypeDesc::UINT8, uchar>(img, mem, texture_limit)) {
       /* on failure to load, we set a 1x1 pixels pink image */
       thread_scoped_lock device_lock(device_mutex);
-      uchar *pixels = (uchar *)img->mem->alloc(1, 1);
+      uchar *pixels = (uchar *)mem->alloc(1, 1);
 
       pixels[0] = (TEX_IMAGE_MISSING_R * 255);
     }
   }
   else if (type == IMAGE_DATA_TYPE_HALF4) {
-    if (!file_load_image<TypeDesc::HALF, half>(img, texture_limit)) {
+    if (!file_load_image<TypeDesc::HALF, half>(img, mem, texture_limit)) {
       /* on failure to load, we set a 1x1 pixels pink image */
       thread_scoped_lock device_lock(device_mutex);
-      half *pixels = (half *)img->mem->alloc(1, 1);
+      half *pixels = (half *)mem->alloc(1, 1);
 
       pixels[0] = TEX_IMAGE_MISSING_R;
       pixels[1] = TEX_IMAGE_MISSING_G;
@@ -779,19 +1089,19 @@ void ImageManager::device_load_image(Device *device, Scene *scene, int slot, Pro
     }
   }
   else if (type == IMAGE_DATA_TYPE_USHORT) {
-    if (!file_load_image<TypeDesc::USHORT, uint16_t>(img, texture_limit)) {
+    if (!file_load_image<TypeDesc::USHORT, uint16_t>(img, mem, texture_limit)) {
       /* on failure to load, we set a 1x1 pixels pink image */
       thread_scoped_lock device_lock(device_mutex);
-      uint16_t *pixels = (uint16_t *)img->mem->alloc(1, 1);
+      uint16_t *pixels = (uint16_t *)mem->alloc(1, 1);
 
       pixels[0] = (TEX_IMAGE_MISSING_R * 65535);
     }
   }
   else if (type == IMAGE_DATA_TYPE_USHORT4) {
-    if (!file_load_image<TypeDesc::USHORT, uint16_t>(img, texture_limit)) {
+    if (!file_load_image<TypeDesc::USHORT, uint16_t>(img, mem, texture_limit)) {
       /* on failure to load, we set a 1x1 pixels pink image */
       thread_scoped_lock device_lock(device_mutex);
-      uint16_t *pixels = (uint16_t *)img->mem->alloc(1, 1);
+      uint16_t *pixels = (uint16_t *)mem->alloc(1, 1);
 
       pixels[0] = (TEX_IMAGE_MISSING_R * 65535);
       pixels[1] = (TEX_IMAGE_MISSING_G * 65535);
@@ -800,14 +1110,113 @@ void ImageManager::device_load_image(Device *device, Scene *scene, int slot, Pro
     }
   }
   else if (type == IMAGE_DATA_TYPE_HALF) {
-    if (!file_load_image<TypeDesc::HALF, half>(img, texture_limit)) {
+    if (!file_load_image<TypeDesc::HALF, half>(img, mem, texture_limit)) {
       /* on failure to load, we set a 1x1 pixels pink image */
       thread_scoped_lock device_lock(device_mutex);
-      half *pixels = (half *)img->mem->alloc(1, 1);
+      half *pixels = (half *)mem->alloc(1, 1);
 
       pixels[0] = TEX_IMAGE_MISSING_R;
     }
   }
+}
+
+void ImageManager::device_load_image(Device *device, Scene *scene, int slot, Progress *progress)
+{
+  if (progress->get_cancel()) {
+    return;
+  }
+
+  Image *img = images[slot];
+
+  if (features.has_texture_cache && !img->builtin) {
+    /* Get a mip mapped tile image file, or have one converted in the background.
+     * If we have a mip map, assume it's linear, not sRGB. */
+    const TextureCacheParams &texture = scene->params.texture;
+    const string cache_path = texture.use_custom_cache_path ? texture.custom_cache_path :
+                                                              path_cache_get("textures");
+    TxConverter *converter = texture.auto_convert ? tx_converter.get() : NULL;
+    bool have_mip = ((OIIOImageLoader *)img->loader)
+                        ->get_tx(img->metadata.colorspace,
+                                 img->params.extension,
+                                 converter,
+                                 cache_path);
+    if (have_mip) {
+      img->need_metadata = true;
+    }
+    img->tx_pending = !have_mip && converter;
+  }
+
+  progress->set_status("Updating Images", "Loading " + img->loader->name());
+
+  int texture_limit = scene->params.texture_limit;
+  if (img->resolution_limit > 0) {
+    texture_limit = (texture_limit > 0) ? min(texture_limit, img->resolution_limit) :
+                                          img->resolution_limit;
+  }
+
+  load_image_metadata(img);
+  ImageDataType type = img->metadata.type;
+
+  /* Name for debugging. */
+  img->mem_name = string_printf("__tex_image_%s_%03d", name_from_type(type), slot);
+
+  /* Free previous texture in slot. */
+  if (img->mem) {
+    thread_scoped_lock device_lock(device_mutex);
+    delete img->mem;
+    img->mem = NULL;
+  }
+  img->need_dedup = false;
+  img->dedup_slot = -1;
+  if (img->paged) {
+    image_cache->remove_image(img->paged);
+    delete img->paged;
+    img->paged = NULL;
+  }
+  if (img->lazy) {
+    thread_scoped_lock device_lock(device_mutex);
+    delete img->lazy;
+    img->lazy = NULL;
+  }
+  if (img->oiio_texture) {
+    delete img->oiio_texture;
+    img->oiio_texture = NULL;
+  }
+
+  /* Demand paged images only store a pointer in the texture, the storage type is kept in
+   * the paged image. */
+  if (image_use_paged(img, scene)) {
+    PagedImage *paged = new PagedImage(
+        image_cache.get(), img->loader, img->params, img->metadata, image_associate_alpha(img));
+    if (paged->init()) {
+      image_cache->set_budget(((size_t)scene->params.texture.paged_cache_size) * 1024 * 1024);
+      img->paged = paged;
+      type = IMAGE_DATA_TYPE_PAGED;
+      img->mem_name = string_printf("__tex_image_%s_%03d", name_from_type(type), slot);
+    }
+    else {
+      delete paged;
+    }
+  }
+
+  /* Lazily loaded UDIM tiles only store a pointer in the texture, the pixels are loaded on
+   * the first texture lookup. */
+  if (type != IMAGE_DATA_TYPE_PAGED && image_use_lazy(img, scene)) {
+    img->lazy = new LazyImage(this, device, img, slot, texture_limit);
+    type = IMAGE_DATA_TYPE_LAZY;
+    img->mem_name = string_printf("__tex_image_%s_%03d", name_from_type(type), slot);
+  }
+
+  img->mem = new device_texture(
+      device, img->mem_name.c_str(), slot, type, img->params.interpolation, img->params.extension);
+  img->mem->info.use_transform_3d = img->metadata.use_transform_3d;
+  img->mem->info.transform_3d = img->metadata.transform_3d;
+  img->mem->info.compress_as_srgb = img->metadata.compress_as_srgb;
+
+  /* Create new texture. */
+  if (image_is_pixel_type(type)) {
+    device_load_pixels(img, img->mem, texture_limit);
+  }
 #ifdef WITH_NANOVDB
   else if (type == IMAGE_DATA_TYPE_NANOVDB_FLOAT || type == IMAGE_DATA_TYPE_NANOVDB_FLOAT3) {
     thread_scoped_lock device_lock(device_mutex);
@@ -818,6 +1227,22 @@ void ImageManager::device_load_image(Device *device, Scene *scene, int slot, Pro
     }
   }
 #endif
+  else if (type == IMAGE_DATA_TYPE_PAGED) {
+    thread_scoped_lock device_lock(device_mutex);
+    void *pixels = img->mem->alloc(1, 1);
+
+    if (pixels != NULL) {
+      *((KernelPagedImage **)pixels) = img->paged;
+    }
+  }
+  else if (type == IMAGE_DATA_TYPE_LAZY) {
+    thread_scoped_lock device_lock(device_mutex);
+    void *pixels = img->mem->alloc(1, 1);
+
+    if (pixels != NULL) {
+      *((KernelLazyImage **)pixels) = img->lazy;
+    }
+  }
   else if (type == IMAGE_DATA_TYPE_OIIO) {
     thread_scoped_lock device_lock(device_mutex);
     void *pixels = img->mem->alloc(1, 1);
@@ -826,19 +1251,72 @@ void ImageManager::device_load_image(Device *device, Scene *scene, int slot, Pro
       OIIO::TextureSystem *tex_sys = (OIIO::TextureSystem *)oiio_texture_system;
       OIIO::TextureSystem::TextureHandle *handle = tex_sys->get_texture_handle(
           OIIO::ustring(img->loader->osl_filepath()));
-      *((OIIO::TextureSystem::TextureHandle **)pixels) = tex_sys->good(handle) ? handle : NULL;
+
+      img->oiio_texture = new OIIOTexture();
+      image_oiio_texture_init(img->oiio_texture,
+                              tex_sys->good(handle) ? handle : NULL,
+                              img->params,
+                              scene->params.texture);
+      *((OIIOTexture **)pixels) = img->oiio_texture;
     }
   }
+
+  if (image_use_compression(img, scene)) {
+    device_compress_image(device, img, slot);
+    type = (ImageDataType)img->mem->info.data_type;
+  }
+
   {
     thread_scoped_lock device_lock(device_mutex);
     img->mem->copy_to_device();
   }
 
-  /* Cleanup memory in image loader. */
-  img->loader->cleanup();
+  /* Compare against other images once all are loaded. */
+  if (scene->params.use_image_dedup && features.has_shared_images && !img->builtin &&
+      image_is_pixel_type(type)) {
+    img->content_hash = image_content_hash(img->mem);
+    img->need_dedup = true;
+  }
+
+  /* Cleanup memory in image loader, paged images keep reading tiles through it. */
+  if (!img->paged) {
+    img->loader->cleanup();
+  }
   img->need_load = false;
 }
 
+/* Load the pixels of a lazily loaded image while rendering, into a texture that is only
+ * used through the lazy image. */
+device_texture *ImageManager::device_load_lazy_image(LazyImage *lazy)
+{
+  Image *img = lazy->img;
+  const ImageDataType type = img->metadata.type;
+
+  lazy->mem_name = string_printf("__tex_image_%s_%03d", name_from_type(type), lazy->slot);
+
+  device_texture *mem;
+  {
+    thread_scoped_lock device_lock(device_mutex);
+    mem = new device_texture(lazy->device,
+                             lazy->mem_name.c_str(),
+                             lazy->slot,
+                             type,
+                             img->params.interpolation,
+                             img->params.extension);
+  }
+  mem->info.use_transform_3d = img->metadata.use_transform_3d;
+  mem->info.transform_3d = img->metadata.transform_3d;
+  mem->info.compress_as_srgb = img->metadata.compress_as_srgb;
+
+  device_load_pixels(img, mem, lazy->texture_limit);
+  img->loader->cleanup();
+
+  VLOG(1) << "Loaded UDIM tile " << img->loader->name() << " on first use, "
+          << string_human_readable_size(mem->memory_size()) << ".";
+
+  return mem;
+}
+
 void ImageManager::device_free_image(Device *, int slot)
 {
   Image *img = images[slot];
@@ -860,17 +1338,325 @@ void ImageManager::device_free_image(Device *, int slot)
     delete img->mem;
   }
 
+  if (img->paged) {
+    image_cache->remove_image(img->paged);
+    delete img->paged;
+  }
+
+  if (img->lazy) {
+    thread_scoped_lock device_lock(device_mutex);
+    delete img->lazy;
+  }
+
+  delete img->oiio_texture;
   delete img->loader;
   delete img;
   images[slot] = NULL;
 }
 
+/* Texture Memory Budget
+ *
+ * The resolution an image needs is estimated from the objects using it: the size of a
+ * pixel at the point of the object closest to the dicing camera, and how much of the
+ * texture maps to the object surface. MIP levels finer than needed are dropped, and then
+ * more levels until the images fit the budget. */
+
+static size_t image_pixel_size(ImageDataType type)
+{
+  switch (type) {
+    case IMAGE_DATA_TYPE_FLOAT4:
+      return sizeof(float4);
+    case IMAGE_DATA_TYPE_BYTE4:
+      return sizeof(uchar4);
+    case IMAGE_DATA_TYPE_HALF4:
+      return sizeof(half4);
+    case IMAGE_DATA_TYPE_FLOAT:
+      return sizeof(float);
+    case IMAGE_DATA_TYPE_BYTE:
+      return sizeof(uchar);
+    case IMAGE_DATA_TYPE_HALF:
+      return sizeof(half);
+    case IMAGE_DATA_TYPE_USHORT4:
+      return sizeof(ushort4);
+    case IMAGE_DATA_TYPE_USHORT:
+      return sizeof(uint16_t);
+    default:
+      return 0;
+  }
+}
+
+/* Object space length of the UV range [0, 1] on the surface, from the areas of the
+ * triangles and their UV coordinates. Zero when the geometry has no usable UV map. */
+static float geometry_uv_length(Geometry *geom)
+{
+  if (geom->type != Geometry::MESH) {
+    return 0.0f;
+  }
+
+  Mesh *mesh = static_cast<Mesh *>(geom);
+  Attribute *attr = mesh->attributes.find(ATTR_STD_UV);
+  const size_t num_triangles = mesh->num_triangles();
+  if (!attr || attr->element != ATTR_ELEMENT_CORNER ||
+      attr->buffer.size() < num_triangles * 3 * sizeof(float2)) {
+    return 0.0f;
+  }
+
+  const float2 *uv = attr->data_float2();
+  double area = 0.0, uv_area = 0.0;
+  for (size_t i = 0; i < num_triangles; i++) {
+    const Mesh::Triangle t = mesh->get_triangle(i);
+    const float3 v0 = mesh->verts[t.v[0]];
+    area += 0.5 * len(cross(mesh->verts[t.v[1]] - v0, mesh->verts[t.v[2]] - v0));
+
+    const float2 e1 = uv[i * 3 + 1] - uv[i * 3];
+    const float2 e2 = uv[i * 3 + 2] - uv[i * 3];
+    uv_area += 0.5f * fabsf(e1.x * e2.y - e1.y * e2.x);
+  }
+
+  if (!(uv_area > 0.0 && area > 0.0)) {
+    return 0.0f;
+  }
+  return (float)sqrt(area / uv_area);
+}
+
+void ImageManager::device_update_resolution_limits(Scene *scene)
+{
+  struct BudgetImage {
+    int slot;
+    int size;
+    size_t num_pixels;
+    size_t pixel_size;
+    int level;
+    float needed;
+
+    size_t memory_size() const
+    {
+      return (num_pixels >> (2 * level)) * pixel_size;
+    }
+  };
+
+  /* Resolution needed per image slot, zero for unknown. */
+  vector<float> needed(images.size(), 0.0f);
+
+  Camera *camera = scene->dicing_camera;
+  camera->update(scene);
+  const float3 camera_P = transform_get_column(&camera->cameratoworld, 3);
+  const bool use_osl = scene->shader_manager->use_osl();
+
+  map<Geometry *, vector<int>> geometry_slots;
+  map<Geometry *, float> geometry_uv_lengths;
+
+  foreach (Object *object, scene->objects) {
+    Geometry *geom = object->geometry;
+    if (!geom) {
+      continue;
+    }
+
+    /* Image slots used by the shaders of the geometry. */
+    auto it = geometry_slots.find(geom);
+    if (it == geometry_slots.end()) {
+      vector<int> &slots = geometry_slots[geom];
+      foreach (Shader *shader, geom->used_shaders) {
+        if (!shader->graph) {
+          continue;
+        }
+        foreach (ShaderNode *node, shader->graph->nodes) {
+          if (node->special_type != SHADER_SPECIAL_TYPE_IMAGE_SLOT) {
+            continue;
+          }
+          ImageSlotTextureNode *image_node = static_cast<ImageSlotTextureNode *>(node);
+          for (int i = 0; i < image_node->handle.num_tiles(); i++) {
+            const int slot = image_node->handle.svm_slot(use_osl, i);
+            if (slot >= 0 && slot < (int)images.size()) {
+              slots.push_back(slot);
+            }
+          }
+        }
+      }
+
+      if (!slots.empty()) {
+        if (geom->need_update || !geom->bounds.valid()) {
+          geom->compute_bounds();
+        }
+        geometry_uv_lengths[geom] = geometry_uv_length(geom);
+      }
+      it = geometry_slots.find(geom);
+    }
+
+    if (it->second.empty() || !geom->bounds.valid()) {
+      continue;
+    }
+
+    const BoundBox bounds = geom->transform_applied ? geom->bounds :
+                                                       geom->bounds.transformed(&object->tfm);
+
+    /* Size of a pixel on the point closest to the camera, in object space when the
+     * transform is not applied to the geometry. */
+    const float3 P = clamp(camera_P, bounds.min, bounds.max);
+    float pixel_size = max(camera->world_to_raster_size(P), 1e-8f);
+    if (!geom->transform_applied) {
+      const Transform &tfm = object->tfm;
+      const float scale = cbrtf(fabsf(dot(cross(transform_get_column(&tfm, 0),
+                                                transform_get_column(&tfm, 1)),
+                                          transform_get_column(&tfm, 2))));
+      pixel_size /= max(scale, 1e-8f);
+    }
+
+    /* Without UV map assume the texture spans the object once. */
+    float uv_length = geometry_uv_lengths[geom];
+    if (uv_length == 0.0f) {
+      uv_length = len(geom->bounds.size());
+    }
+
+    const float resolution = min(uv_length / pixel_size, 1e9f);
+    foreach (int slot, it->second) {
+      needed[slot] = max(needed[slot], resolution);
+    }
+  }
+
+  /* Images used by the background or lights are not limited, their footprint is not known. */
+  vector<bool> unlimited(images.size(), false);
+  vector<Shader *> unlimited_shaders;
+  unlimited_shaders.push_back(scene->background->get_shader(scene));
+  foreach (Light *light, scene->lights) {
+    unlimited_shaders.push_back(light->shader);
+  }
+  foreach (Shader *shader, unlimited_shaders) {
+    if (!shader || !shader->graph) {
+      continue;
+    }
+    foreach (ShaderNode *node, shader->graph->nodes) {
+      if (node->special_type != SHADER_SPECIAL_TYPE_IMAGE_SLOT) {
+        continue;
+      }
+      ImageSlotTextureNode *image_node = static_cast<ImageSlotTextureNode *>(node);
+      for (int i = 0; i < image_node->handle.num_tiles(); i++) {
+        const int slot = image_node->handle.svm_slot(use_osl, i);
+        if (slot >= 0 && slot < (int)images.size()) {
+          unlimited[slot] = true;
+        }
+      }
+    }
+  }
+
+  /* Drop the levels that are not needed, fully loaded 2D images only. */
+  vector<BudgetImage> budget_images;
+  vector<int> old_limits(images.size(), 0);
+  size_t total_size = 0;
+  for (size_t slot = 0; slot < images.size(); slot++) {
+    Image *img = images[slot];
+    if (!img || img->users == 0) {
+      continue;
+    }
+    old_limits[slot] = img->resolution_limit;
+    img->resolution_limit = 0;
+
+    if ((features.has_texture_cache && !img->builtin) || image_use_paged(img, scene)) {
+      continue;
+    }
+
+    load_image_metadata(img);
+    const ImageMetaData &metadata = img->metadata;
+    const size_t pixel_size = image_pixel_size(metadata.type);
+    if (pixel_size == 0 || metadata.depth > 1 || metadata.width == 0 || metadata.height == 0) {
+      continue;
+    }
+
+    /* Unlimited images keep their full resolution, but take memory from the budget. */
+    if (unlimited[slot]) {
+      total_size += ((size_t)metadata.width) * metadata.height * pixel_size;
+      continue;
+    }
+
+    BudgetImage budget_image;
+    budget_image.slot = slot;
+    budget_image.size = max(metadata.width, metadata.height);
+    budget_image.num_pixels = ((size_t)metadata.width) * metadata.height;
+    budget_image.pixel_size = pixel_size;
+    budget_image.level = 0;
+    budget_image.needed = (needed[slot] > 0.0f) ? needed[slot] : FLT_MAX;
+
+    while ((budget_image.size >> (budget_image.level + 1)) >= budget_image.needed) {
+      budget_image.level++;
+    }
+
+    total_size += budget_image.memory_size();
+    budget_images.push_back(budget_image);
+  }
+
+  /* Then more levels from the images with the most texels per needed pixel. */
+  const size_t budget = ((size_t)scene->params.texture_memory_budget) * 1024 * 1024;
+  while (total_size > budget) {
+    BudgetImage *reduce = NULL;
+    float reduce_ratio = 0.0f;
+    foreach (BudgetImage &budget_image, budget_images) {
+      const int size = budget_image.size >> budget_image.level;
+      const float ratio = size / min(budget_image.needed, 1e9f);
+      if (size > 1 && (reduce == NULL || ratio > reduce_ratio)) {
+        reduce = &budget_image;
+        reduce_ratio = ratio;
+      }
+    }
+
+    if (reduce == NULL) {
+      break;
+    }
+
+    total_size -= reduce->memory_size();
+    reduce->level++;
+    total_size += reduce->memory_size();
+  }
+
+  foreach (const BudgetImage &budget_image, budget_images) {
+    Image *img = images[budget_image.slot];
+    if (budget_image.level > 0) {
+      img->resolution_limit = budget_image.size >> budget_image.level;
+    }
+
+    VLOG(1) << "Texture budget: " << img->loader->name() << " at "
+            << (budget_image.size >> budget_image.level) << " of " << budget_image.size
+            << " pixels, " << string_human_readable_size(budget_image.memory_size())
+            << ", needs "
+            << ((budget_image.needed == FLT_MAX) ?
+                    string("full resolution") :
+                    string_printf("%d pixels", (int)budget_image.needed))
+            << ".";
+  }
+
+  /* Reload images whose limit changed. */
+  for (size_t slot = 0; slot < images.size(); slot++) {
+    Image *img = images[slot];
+    if (img && img->users > 0 && img->resolution_limit != old_limits[slot]) {
+      img->need_load = true;
+    }
+  }
+
+  VLOG(1) << "Texture budget: images use " << string_human_readable_size(total_size) << " of "
+          << string_human_readable_size(budget) << ".";
+}
+
 void ImageManager::device_update(Device *device, Scene *scene, Progress &progress)
 {
   if (!need_update) {
     return;
   }
 
+  /* Before updating shared images, limits may cause their sources to be reloaded. */
+  if (scene->params.texture_memory_budget > 0) {
+    device_update_resolution_limits(scene);
+  }
+  else {
+    /* Budget turned off, reload images at full resolution. */
+    foreach (Image *img, images) {
+      if (img && img->resolution_limit > 0) {
+        img->resolution_limit = 0;
+        img->need_load = true;
+      }
+    }
+  }
+
+  device_update_dedup_sources();
+
   TaskPool pool;
   for (size_t slot = 0; slot < images.size(); slot++) {
     Image *img = images[slot];
@@ -885,6 +1671,8 @@ void ImageManager::device_update(Device *device, Scene *scene, Progress &progres
 
   pool.wait_work();
 
+  device_dedup_images(device);
+
   need_update = false;
 }
 
@@ -893,6 +1681,8 @@ void ImageManager::device_update_slot(Device *device, Scene *scene, int slot, Pr
   Image *img = images[slot];
   assert(img != NULL);
 
+  device_update_dedup_sources();
+
   if (img->users == 0) {
     device_free_image(device, slot);
   }
@@ -901,6 +1691,88 @@ void ImageManager::device_update_slot(Device *device, Scene *scene, int slot, Pr
   }
 }
 
+void ImageManager::device_update_dedup_sources()
+{
+  /* Images sharing the pixels of an image that is about to be freed or reloaded get their
+   * own copy again, they may no longer be identical. */
+  for (size_t slot = 0; slot < images.size(); slot++) {
+    Image *img = images[slot];
+    if (!img || img->dedup_slot < 0) {
+      continue;
+    }
+
+    Image *source = images[img->dedup_slot];
+    if (source && source->users > 0 && !source->need_load) {
+      continue;
+    }
+
+    {
+      thread_scoped_lock device_lock(device_mutex);
+      delete img->mem;
+      img->mem = NULL;
+    }
+    img->dedup_slot = -1;
+    img->need_load = true;
+    need_update = true;
+  }
+}
+
+void ImageManager::device_dedup_images(Device *device)
+{
+  /* Images whose pixels can be shared, those that are not shared themselves, by hash. */
+  unordered_multimap<uint, int> sources;
+  for (size_t slot = 0; slot < images.size(); slot++) {
+    Image *img = images[slot];
+    if (img && !img->need_dedup && img->dedup_slot < 0 && !img->builtin && img->mem &&
+        image_is_pixel_type((ImageDataType)img->mem->info.data_type)) {
+      sources.insert(std::make_pair(img->content_hash, (int)slot));
+    }
+  }
+
+  for (size_t slot = 0; slot < images.size(); slot++) {
+    Image *img = images[slot];
+    if (!img || !img->need_dedup) {
+      continue;
+    }
+    img->need_dedup = false;
+
+    int source_slot = -1;
+    const auto range = sources.equal_range(img->content_hash);
+    for (auto it = range.first; it != range.second; it++) {
+      if (image_pixels_equal(img->mem, images[it->second]->mem)) {
+        source_slot = it->second;
+        break;
+      }
+    }
+
+    /* Not shared, images checked after this one may share its pixels. */
+    if (source_slot < 0) {
+      sources.insert(std::make_pair(img->content_hash, (int)slot));
+      continue;
+    }
+
+    Image *source = images[source_slot];
+    VLOG(1) << "Image " << img->loader->name() << " has the same pixels as "
+            << source->loader->name() << ", sharing "
+            << string_human_readable_size(img->mem->memory_size()) << ".";
+
+    thread_scoped_lock device_lock(device_mutex);
+    device_texture *mem = new device_texture(device,
+                                             img->mem_name.c_str(),
+                                             slot,
+                                             (ImageDataType)img->mem->info.data_type,
+                                             img->params.interpolation,
+                                             img->params.extension);
+    mem->info = img->mem->info;
+    mem->share_host_memory(*source->mem);
+
+    delete img->mem;
+    img->mem = mem;
+    img->mem->copy_to_device();
+    img->dedup_slot = source_slot;
+  }
+}
+
 void ImageManager::device_load_builtin(Device *device, Scene *scene, Progress &progress)
 {
   /* Load only builtin images, Blender needs this to load evaluated
@@ -933,17 +1805,54 @@ void ImageManager::device_free_builtin(Device *device)
 
 void ImageManager::device_free(Device *device)
 {
+  /* Conversions are requested again when the images are loaded again. */
+  tx_converter->cancel();
+
   for (size_t slot = 0; slot < images.size(); slot++) {
     device_free_image(device, slot);
   }
   images.clear();
+
+  image_cache->free_retired();
 }
 
 void ImageManager::collect_statistics(RenderStats *stats)
 {
   foreach (const Image *image, images) {
-    stats->image.textures.add_entry(
-        NamedSizeEntry(image->loader->name(), image->mem->memory_size()));
+    if (image->paged) {
+      stats->image.textures.add_entry(
+          NamedSizeEntry(image->loader->name(), image->paged->resident_size));
+      stats->image.paged_hits += image->paged->num_hits();
+      stats->image.paged_misses += image->paged->num_misses;
+    }
+    else if (image->lazy) {
+      const size_t size = (image->lazy->is_loaded()) ? image->lazy->mem->memory_size() : 0;
+      stats->image.textures.add_entry(NamedSizeEntry(image->loader->name(), size));
+      stats->image.lazy_tiles++;
+      stats->image.lazy_loaded_tiles += (image->lazy->is_loaded()) ? 1 : 0;
+    }
+    else if (image->dedup_slot >= 0) {
+      stats->image.textures.add_entry(NamedSizeEntry(image->loader->name(), 0));
+      stats->image.dedup_images++;
+      stats->image.dedup_saved_size += image->mem->memory_size();
+    }
+    else {
+      stats->image.textures.add_entry(
+          NamedSizeEntry(image->loader->name(), image->mem->memory_size()));
+    }
+  }
+
+  stats->image.paged_evictions = image_cache->num_evictions;
+  stats->image.paged_peak_size = image_cache->peak_resident_size;
+}
+
+void ImageManager::collect_profiling(RenderStats *stats, Profiler &prof)
+{
+  for (size_t slot = 0; slot < images.size(); slot++) {
+    uint64_t samples, hits;
+    if (images[slot] && prof.get_texture(slot, samples, hits)) {
+      stats->textures.add(ustring(images[slot]->loader->name()), samples, hits);
+    }
   }
 }
 
@@ -33,13 +33,19 @@ class Device;
 class DeviceInfo;
 class ImageHandle;
 class ImageKey;
+class ImageCache;
+class TxConverter;
 class ImageMetaData;
 class ImageManager;
+class LazyImage;
+class PagedImage;
+class Profiler;
 class Progress;
 class RenderStats;
 class Scene;
 class ColorSpaceProcessor;
 class VDBImageLoader;
+struct OIIOTexture;
 
 /* Image Parameters */
 class ImageParams {
@@ -94,6 +100,7 @@ class ImageMetaData {
   ImageMetaData();
   bool operator==(const ImageMetaData &other) const;
   bool is_float() const;
+  bool is_rgba() const;
   void detect_colorspace();
 };
 
@@ -103,6 +110,13 @@ class ImageDeviceFeatures {
   bool has_half_float;
   bool has_nanovdb;
   bool has_texture_cache;
+  /* Demand paged images, CPU only. */
+  bool has_paged_images;
+  /* Block compressed images, CPU only. */
+  bool has_compressed_images;
+  /* Textures sharing the host memory of another, CPU only. Other devices may replace the
+   * host memory of a texture with their own. */
+  bool has_shared_images;
 };
 
 /* Image loader base class, that can be subclassed to load image data
@@ -121,6 +135,22 @@ class ImageLoader {
                            const size_t pixels_size,
                            const bool associate_alpha) = 0;
 
+  /* Optional for demand paged images, dimensions of a MIP level stored in the file. Returns
+   * false if there is no such level. Tiled is set when reading small regions does not
+   * require decoding full rows of the image. */
+  virtual bool load_level_metadata(int level, int &width, int &height, bool &tiled);
+
+  /* Optional for demand paged images, load a region of a MIP level. Rows are stored top to
+   * bottom like in the file, in the format of the metadata type with its channels. */
+  virtual bool load_pixels_region(const ImageMetaData &metadata,
+                                  int level,
+                                  int x,
+                                  int y,
+                                  int width,
+                                  int height,
+                                  void *pixels,
+                                  const bool associate_alpha);
+
   /* Name for logs and stats. */
   virtual string name() const = 0;
 
@@ -139,6 +169,14 @@ class ImageLoader {
   /* Work around for no RTTI. */
 };
 
+/* Convert pixels as loaded by an image loader to the format used for rendering: expand to
+ * RGBA, apply the alpha type and convert to scene linear. Pixels must have room for 4
+ * channels for RGBA types. */
+void image_process_pixels(const ImageParams &params,
+                          const ImageMetaData &metadata,
+                          void *pixels,
+                          size_t num_pixels);
+
 /* Image Handle
  *
  * Access handle for image in the image manager. Multiple shader nodes may
@@ -198,6 +236,16 @@ class ImageManager {
   bool set_animation_frame_update(int frame);
 
   void collect_statistics(RenderStats *stats);
+  void collect_profiling(RenderStats *stats, Profiler &prof);
+
+  /* Number of image slots, texture lookups in the profiler are counted per slot. */
+  int num_slots() const
+  {
+    return images.size();
+  }
+
+  /* Reload images whose .tx file finished converting in the background. */
+  void tag_converted_images();
 
   bool need_update;
 
@@ -210,9 +258,25 @@ class ImageManager {
     bool need_metadata;
     bool need_load;
     bool builtin;
+    /* Rendering with the source file while the .tx file is being converted. */
+    bool tx_pending;
+    /* Tile of a UDIM image, may be loaded lazily. */
+    bool udim_tile;
 
     string mem_name;
     device_texture *mem;
+    PagedImage *paged;
+    LazyImage *lazy;
+    OIIOTexture *oiio_texture;
+
+    /* Deduplication: hash of the loaded pixels, and the slot whose pixels are shared when
+     * they are identical. */
+    uint content_hash;
+    bool need_dedup;
+    int dedup_slot;
+
+    /* Maximum resolution chosen for the texture memory budget, zero for none. */
+    int resolution_limit;
 
     int users;
     thread_mutex mutex;
@@ -224,23 +288,37 @@ class ImageManager {
   thread_mutex device_mutex;
   thread_mutex images_mutex;
   int animation_frame;
+  int tx_num_finished;
 
   vector<Image *> images;
   void *oiio_texture_system;
+  unique_ptr<ImageCache> image_cache;
+  unique_ptr<TxConverter> tx_converter;
 
   int add_image_slot(ImageLoader *loader, const ImageParams &params, const bool builtin);
   void add_image_user(int slot);
   void remove_image_user(int slot);
 
   void load_image_metadata(Image *img);
+  bool image_use_paged(Image *img, Scene *scene);
+  bool image_use_compression(Image *img, Scene *scene);
+  bool image_use_lazy(Image *img, Scene *scene);
 
   template<TypeDesc::BASETYPE FileFormat, typename StorageType>
-  bool file_load_image(Image *img, int texture_limit);
+  bool file_load_image(Image *img, device_texture *mem, int texture_limit);
 
+  void device_load_pixels(Image *img, device_texture *mem, int texture_limit);
   void device_load_image(Device *device, Scene *scene, int slot, Progress *progress);
+  device_texture *device_load_lazy_image(LazyImage *lazy);
   void device_free_image(Device *device, int slot);
+  void device_compress_image(Device *device, Image *img, int slot);
+
+  void device_update_resolution_limits(Scene *scene);
+  void device_dedup_images(Device *device);
+  void device_update_dedup_sources();
 
   friend class ImageHandle;
+  friend class LazyImage;
 };
 
 CCL_NAMESPACE_END
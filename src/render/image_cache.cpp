@@ -0,0 +1,401 @@
+/*
+ * Copyright 2011-2020 Blender Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "render/image_cache.h"
+
+#include "device/device_memory.h"
+
+#include "util/util_aligned_malloc.h"
+#include "util/util_algorithm.h"
+#include "util/util_foreach.h"
+#include "util/util_half.h"
+#include "util/util_logging.h"
+
+CCL_NAMESPACE_BEGIN
+
+static size_t paged_image_component_size(ImageDataType type)
+{
+  switch (type) {
+    case IMAGE_DATA_TYPE_FLOAT4:
+    case IMAGE_DATA_TYPE_FLOAT:
+      return sizeof(float);
+    case IMAGE_DATA_TYPE_HALF4:
+    case IMAGE_DATA_TYPE_HALF:
+      return sizeof(half);
+    case IMAGE_DATA_TYPE_USHORT4:
+    case IMAGE_DATA_TYPE_USHORT:
+      return sizeof(uint16_t);
+    default:
+      return sizeof(uchar);
+  }
+}
+
+/* Paged Image */
+
+PagedImage::PagedImage(ImageCache *cache,
+                       ImageLoader *loader,
+                       const ImageParams &params,
+                       const ImageMetaData &metadata,
+                       const bool associate_alpha)
+    : num_misses(0),
+      resident_size(0),
+      cache(cache),
+      loader(loader),
+      params(params),
+      metadata(metadata),
+      associate_alpha(associate_alpha),
+      tiled(false)
+{
+  readers = &cache->readers;
+  data_type = metadata.type;
+  texel_size = paged_image_component_size(data_type) * (metadata.is_rgba() ? 4 : 1);
+}
+
+PagedImage::~PagedImage()
+{
+  loader->cleanup();
+
+  for (int level = 0; level < num_levels; level++) {
+    delete[] levels[level].tiles;
+  }
+}
+
+bool PagedImage::init()
+{
+  for (int level = 0; level < PAGED_IMAGE_MAX_LEVELS; level++) {
+    int width, height;
+    bool level_tiled;
+    if (!loader->load_level_metadata(level, width, height, level_tiled)) {
+      break;
+    }
+    if (width <= 0 || height <= 0) {
+      break;
+    }
+
+    /* Reading single tiles is only efficient if all levels are tiled. */
+    tiled = (level == 0) ? level_tiled : (tiled && level_tiled);
+
+    Level &l = levels[level];
+    l.width = width;
+    l.height = height;
+    l.tiles_x = divide_up(width, PAGED_IMAGE_TILE_SIZE);
+    l.tiles_y = divide_up(height, PAGED_IMAGE_TILE_SIZE);
+
+    const int num_tiles = l.tiles_x * l.tiles_y;
+    l.tiles = new Tile[num_tiles];
+    for (int i = 0; i < num_tiles; i++) {
+      l.tiles[i].pixels = NULL;
+      l.tiles[i].used = false;
+    }
+
+    num_levels = level + 1;
+  }
+
+  if (num_levels == 0) {
+    return false;
+  }
+
+  VLOG(1) << "Paging image " << loader->name() << ", " << num_levels << " levels, "
+          << (tiled ? "tiled" : "scanline") << ".";
+
+  return true;
+}
+
+bool PagedImage::load_region(int level, int x, int y, int width, int height)
+{
+  const size_t num_pixels = ((size_t)width) * height;
+  const size_t size = num_pixels * paged_image_component_size(data_type) * 4;
+  if (buffer.size() < size) {
+    buffer.resize(size);
+  }
+
+  if (!loader->load_pixels_region(
+          metadata, level, x, y, width, height, buffer.data(), associate_alpha)) {
+    return false;
+  }
+
+  image_process_pixels(params, metadata, buffer.data(), num_pixels);
+  return true;
+}
+
+void PagedImage::copy_tile(int level, int tx, int ty, int x, int width, void *pixels)
+{
+  /* Copy the tile out of the loaded region starting at texel x of the row of tiles. */
+  const Level &l = levels[level];
+  const int tile_width = min(PAGED_IMAGE_TILE_SIZE, l.width - tx * PAGED_IMAGE_TILE_SIZE);
+  const int tile_height = min(PAGED_IMAGE_TILE_SIZE, l.height - ty * PAGED_IMAGE_TILE_SIZE);
+  const size_t row_size = tile_width * texel_size;
+
+  for (int row = 0; row < tile_height; row++) {
+    memcpy((uchar *)pixels + row * PAGED_IMAGE_TILE_SIZE * texel_size,
+           buffer.data() + (((size_t)row) * width + x) * texel_size,
+           row_size);
+  }
+}
+
+const void *PagedImage::load_tile(int level, int tx, int ty)
+{
+  thread_scoped_lock lock(mutex);
+
+  const Level &l = levels[level];
+  const int index = ty * l.tiles_x + tx;
+
+  /* Another thread may have loaded it while we were waiting. */
+  void *pixels = l.tiles[index].pixels.load(std::memory_order_acquire);
+  if (pixels) {
+    return pixels;
+  }
+
+  const int y = ty * PAGED_IMAGE_TILE_SIZE;
+  const int height = min(PAGED_IMAGE_TILE_SIZE, l.height - y);
+
+  if (tiled) {
+    const int x = tx * PAGED_IMAGE_TILE_SIZE;
+    const int width = min(PAGED_IMAGE_TILE_SIZE, l.width - x);
+
+    pixels = cache->alloc_tile(tile_size());
+    if (load_region(level, x, y, width, height)) {
+      copy_tile(level, tx, ty, 0, width, pixels);
+    }
+    else {
+      memset(pixels, 0, tile_size());
+    }
+    num_misses++;
+    cache->insert_tile(this, level, index, pixels);
+    return pixels;
+  }
+
+  /* Scanline files decode full rows, so keep all tiles of the row that are not resident. */
+  const bool loaded = load_region(level, 0, y, l.width, height);
+  const void *result = NULL;
+
+  for (int i = 0; i < l.tiles_x; i++) {
+    const int row_index = ty * l.tiles_x + i;
+    if (i != tx && l.tiles[row_index].pixels.load(std::memory_order_acquire)) {
+      continue;
+    }
+
+    void *tile_pixels = cache->alloc_tile(tile_size());
+    if (loaded) {
+      copy_tile(level, i, ty, i * PAGED_IMAGE_TILE_SIZE, l.width, tile_pixels);
+    }
+    else {
+      memset(tile_pixels, 0, tile_size());
+    }
+    num_misses++;
+    cache->insert_tile(this, level, row_index, tile_pixels);
+
+    if (i == tx) {
+      result = tile_pixels;
+    }
+  }
+
+  if (!loaded) {
+    VLOG(1) << "Failed to load tiles of paged image " << loader->name() << ".";
+  }
+
+  return result;
+}
+
+/* Image Cache */
+
+ImageCache::ImageCache()
+    : num_evictions(0),
+      resident_size(0),
+      peak_resident_size(0),
+      budget(0),
+      clock_hand(0)
+{
+}
+
+ImageCache::~ImageCache()
+{
+  assert(resident.empty());
+  free_retired();
+}
+
+void ImageCache::set_budget(size_t budget_)
+{
+  thread_scoped_lock lock(mutex);
+  budget = budget_;
+}
+
+void *ImageCache::alloc_tile(size_t size)
+{
+  thread_scoped_lock lock(mutex);
+
+  while (resident_size + size > budget && !resident.empty()) {
+    evict_tile();
+  }
+
+  resident_size += size;
+  peak_resident_size = max(peak_resident_size, resident_size);
+
+  reclaim();
+
+  vector<void *> &free = free_tiles[size];
+  if (!free.empty()) {
+    void *pixels = free.back();
+    free.pop_back();
+    return pixels;
+  }
+
+  return util_aligned_malloc(size, 16);
+}
+
+void ImageCache::insert_tile(PagedImage *image, int level, int index, void *pixels)
+{
+  thread_scoped_lock lock(mutex);
+
+  KernelPagedImage::Tile &tile = image->levels[level].tiles[index];
+  tile.used.store(true, std::memory_order_relaxed);
+  tile.pixels.store(pixels, std::memory_order_release);
+
+  Entry entry;
+  entry.image = image;
+  entry.level = level;
+  entry.index = index;
+  resident.push_back(entry);
+
+  image->resident_size += image->tile_size();
+}
+
+void ImageCache::evict_tile()
+{
+  /* Second chance: tiles used since the hand last passed them are skipped once. */
+  for (;;) {
+    if (clock_hand >= resident.size()) {
+      clock_hand = 0;
+    }
+
+    Entry &entry = resident[clock_hand];
+    KernelPagedImage::Tile &tile = entry.image->levels[entry.level].tiles[entry.index];
+
+    if (tile.used.exchange(false, std::memory_order_relaxed)) {
+      clock_hand++;
+      continue;
+    }
+
+    const size_t size = entry.image->tile_size();
+    retire(tile.pixels.exchange(NULL, std::memory_order_seq_cst), size);
+
+    entry.image->resident_size -= size;
+    resident_size -= size;
+    num_evictions++;
+
+    entry = resident.back();
+    resident.pop_back();
+    return;
+  }
+}
+
+void ImageCache::retire(void *pixels, size_t size)
+{
+  RetiredTile tile;
+  tile.pixels = pixels;
+  tile.size = size;
+  tile.epoch = readers.epoch.load(std::memory_order_relaxed);
+  retired.push_back(tile);
+}
+
+void ImageCache::reclaim()
+{
+  /* A lookup that could still see a tile registered no later than the epoch the tile was
+   * evicted in. Once the epoch advanced twice past it, all such lookups have finished. */
+  const uint64_t epoch = readers.try_advance();
+
+  size_t num_reclaimed = 0;
+  while (num_reclaimed < retired.size() && retired[num_reclaimed].epoch + 2 <= epoch) {
+    const RetiredTile &tile = retired[num_reclaimed++];
+    free_tiles[tile.size].push_back(tile.pixels);
+  }
+  retired.erase(retired.begin(), retired.begin() + num_reclaimed);
+}
+
+void ImageCache::remove_image(PagedImage *image)
+{
+  thread_scoped_lock lock(mutex);
+
+  for (size_t i = 0; i < resident.size();) {
+    Entry &entry = resident[i];
+    if (entry.image != image) {
+      i++;
+      continue;
+    }
+
+    KernelPagedImage::Tile &tile = image->levels[entry.level].tiles[entry.index];
+    util_aligned_free(tile.pixels.exchange(NULL));
+    resident_size -= image->tile_size();
+
+    entry = resident.back();
+    resident.pop_back();
+  }
+
+  image->resident_size = 0;
+  clock_hand = 0;
+}
+
+void ImageCache::free_retired()
+{
+  thread_scoped_lock lock(mutex);
+
+  foreach (RetiredTile &tile, retired) {
+    util_aligned_free(tile.pixels);
+  }
+  retired.clear();
+
+  for (map<size_t, vector<void *>>::iterator it = free_tiles.begin(); it != free_tiles.end();
+       it++) {
+    foreach (void *pixels, it->second) {
+      util_aligned_free(pixels);
+    }
+  }
+  free_tiles.clear();
+}
+
+/* Lazily Loaded Image */
+
+LazyImage::LazyImage(
+    ImageManager *manager, Device *device, ImageManager::Image *img, int slot, int texture_limit)
+    : device(device),
+      img(img),
+      slot(slot),
+      texture_limit(texture_limit),
+      mem(NULL),
+      manager(manager)
+{
+}
+
+LazyImage::~LazyImage()
+{
+  delete mem;
+}
+
+const TextureInfo *LazyImage::load()
+{
+  thread_scoped_lock lock(mutex);
+
+  if (!is_loaded()) {
+    mem = manager->device_load_lazy_image(this);
+    texture_info = mem->info;
+    texture_info.data = (uint64_t)mem->host_pointer;
+    info.store(&texture_info, std::memory_order_release);
+  }
+
+  return info.load(std::memory_order_relaxed);
+}
+
+CCL_NAMESPACE_END
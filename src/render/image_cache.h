@@ -0,0 +1,180 @@
+/*
+ * Copyright 2011-2020 Blender Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __IMAGE_CACHE_H__
+#define __IMAGE_CACHE_H__
+
+#include "render/image.h"
+
+#include "util/util_map.h"
+#include "util/util_texture.h"
+#include "util/util_thread.h"
+#include "util/util_types.h"
+#include "util/util_vector.h"
+
+#include "kernel/kernel_paged_image.h"
+
+CCL_NAMESPACE_BEGIN
+
+class ImageCache;
+
+/* Demand Paged Image
+ *
+ * Image whose tiles are read from the image loader on first access by the kernel. Tiled
+ * files only read the tile itself, for scanline files the whole row of tiles is read and
+ * kept since the file has to be decoded for it anyway. */
+class PagedImage : public KernelPagedImage {
+ public:
+  PagedImage(ImageCache *cache,
+             ImageLoader *loader,
+             const ImageParams &params,
+             const ImageMetaData &metadata,
+             const bool associate_alpha);
+  ~PagedImage();
+
+  /* Query the MIP levels from the loader, returns false if the image can not be paged. */
+  bool init();
+
+  /* Memory of a single tile, edge tiles are allocated at full size too. */
+  size_t tile_size() const
+  {
+    return texel_size * PAGED_IMAGE_TILE_SIZE * PAGED_IMAGE_TILE_SIZE;
+  }
+
+  /* Number of tiles loaded, including reloads after eviction. */
+  size_t num_misses;
+  /* Memory of the resident tiles, updated by the cache. */
+  size_t resident_size;
+
+ protected:
+  const void *load_tile(int level, int tx, int ty) override;
+
+  /* Read a region of a level and convert it to the storage type, the result is in
+   * buffer with rows of width texels. */
+  bool load_region(int level, int x, int y, int width, int height);
+  void copy_tile(int level, int tx, int ty, int x, int width, void *pixels);
+
+  ImageCache *cache;
+  ImageLoader *loader;
+  ImageParams params;
+  ImageMetaData metadata;
+  bool associate_alpha;
+  bool tiled;
+  size_t texel_size;
+
+  /* Serializes loading, so every tile is only read once. */
+  thread_mutex mutex;
+  vector<uchar> buffer;
+};
+
+/* Lazily Loaded Image
+ *
+ * Image whose pixels are loaded by the image manager on the first texture lookup, the
+ * same way as images loaded before rendering. */
+class LazyImage : public KernelLazyImage {
+ public:
+  LazyImage(ImageManager *manager,
+            Device *device,
+            ImageManager::Image *img,
+            int slot,
+            int texture_limit);
+  ~LazyImage();
+
+  Device *device;
+  ImageManager::Image *img;
+  int slot;
+  int texture_limit;
+
+  /* Texture with the pixels, NULL until loaded. */
+  string mem_name;
+  device_texture *mem;
+
+ protected:
+  const TextureInfo *load() override;
+
+  ImageManager *manager;
+  TextureInfo texture_info;
+
+  /* Serializes loading, threads using the image meanwhile wait for it. */
+  thread_mutex mutex;
+};
+
+/* Image Cache
+ *
+ * Memory of the tiles of all paged images, evicting the least recently used ones when
+ * the budget is exceeded. Kernel threads may still be reading an evicted tile, so its
+ * memory is never freed while rendering. It is only reused for other tiles once every
+ * texture lookup that started before the eviction has finished, as tracked by the reader
+ * epoch shared with the kernel. */
+class ImageCache {
+ public:
+  ImageCache();
+  ~ImageCache();
+
+  void set_budget(size_t budget);
+
+  /* Allocate memory for a tile, evicting tiles as needed to stay within budget. */
+  void *alloc_tile(size_t size);
+  /* Make an allocated and filled tile visible to the kernel. */
+  void insert_tile(PagedImage *image, int level, int index, void *pixels);
+  /* Free all tiles of an image, must not be used by the kernel anymore. */
+  void remove_image(PagedImage *image);
+  /* Free memory of evicted tiles, only when no kernel is running. */
+  void free_retired();
+
+  /* Texture lookups reading tiles, for reclaiming the memory of evicted ones. */
+  KernelPagedImageEpoch readers;
+
+  /* Statistics since the cache was created. */
+  size_t num_evictions;
+  size_t resident_size;
+  size_t peak_resident_size;
+
+ protected:
+  void evict_tile();
+  void retire(void *pixels, size_t size);
+  /* Make memory of evicted tiles no lookup can see anymore available for reuse. */
+  void reclaim();
+
+  struct Entry {
+    PagedImage *image;
+    int level;
+    int index;
+  };
+
+  struct RetiredTile {
+    void *pixels;
+    size_t size;
+    /* Reader epoch when the tile was evicted. */
+    uint64_t epoch;
+  };
+
+  size_t budget;
+  /* Resident tiles in the order they were inserted, with the clock hand of the second
+   * chance eviction going over them. */
+  vector<Entry> resident;
+  size_t clock_hand;
+  /* Evicted tiles that lookups may still be reading, oldest first. */
+  vector<RetiredTile> retired;
+  /* Memory of evicted tiles by size, ready to be reused. */
+  map<size_t, vector<void *>> free_tiles;
+
+  thread_mutex mutex;
+};
+
+CCL_NAMESPACE_END
+
+#endif /* __IMAGE_CACHE_H__ */
@@ -15,6 +15,9 @@
  */
 
 #include "render/image_oiio.h"
+#include "render/image_tx.h"
+
+#include "kernel/kernel_paged_image.h"
 
 #include "util/util_image.h"
 #include "util/util_logging.h"
@@ -25,7 +28,8 @@
 
 CCL_NAMESPACE_BEGIN
 
-OIIOImageLoader::OIIOImageLoader(const string &filepath) : filepath(filepath)
+OIIOImageLoader::OIIOImageLoader(const string &filepath)
+    : filepath(filepath), region_associate_alpha(false)
 {
 }
 
@@ -218,6 +222,11 @@ bool OIIOImageLoader::load_pixels(const ImageMetaData &metadata,
     case IMAGE_DATA_TYPE_NANOVDB_FLOAT:
     case IMAGE_DATA_TYPE_NANOVDB_FLOAT3:
     case IMAGE_DATA_TYPE_OIIO:
+    case IMAGE_DATA_TYPE_PAGED:
+    case IMAGE_DATA_TYPE_BC1:
+    case IMAGE_DATA_TYPE_BC3:
+    case IMAGE_DATA_TYPE_BC4:
+    case IMAGE_DATA_TYPE_LAZY:
     case IMAGE_DATA_NUM_TYPES:
       break;
   }
@@ -226,6 +235,157 @@ bool OIIOImageLoader::load_pixels(const ImageMetaData &metadata,
   return true;
 }
 
+ImageInput *OIIOImageLoader::region_input(const bool associate_alpha)
+{
+  /* Reopen only when the alpha handling differs, it is part of the open configuration. */
+  if (region_in && region_associate_alpha == associate_alpha) {
+    return region_in.get();
+  }
+
+  cleanup();
+
+  unique_ptr<ImageInput> in(ImageInput::create(filepath.string()));
+  if (!in) {
+    return NULL;
+  }
+
+  ImageSpec spec = ImageSpec();
+  ImageSpec config = ImageSpec();
+
+  if (!associate_alpha) {
+    config.attribute("oiio:UnassociatedAlpha", 1);
+  }
+
+  if (!in->open(filepath.string(), spec, config)) {
+    return NULL;
+  }
+
+  region_in = std::move(in);
+  region_associate_alpha = associate_alpha;
+  return region_in.get();
+}
+
+void OIIOImageLoader::cleanup()
+{
+  if (region_in) {
+    region_in->close();
+    region_in.reset();
+  }
+}
+
+bool OIIOImageLoader::load_level_metadata(int level, int &width, int &height, bool &tiled)
+{
+  /* Keep the alpha handling of an already open file, levels are the same either way. */
+  ImageInput *in = region_input(region_in ? region_associate_alpha : true);
+  if (!in) {
+    return false;
+  }
+
+  if (!in->seek_subimage(0, 0)) {
+    return false;
+  }
+  const int nchannels = in->spec().nchannels;
+
+  if (level > 0 && !in->seek_subimage(0, level)) {
+    return false;
+  }
+
+  const ImageSpec &level_spec = in->spec();
+
+  /* Regions are read without the CMYK conversion of load_pixels(). */
+  if (level_spec.depth > 1 || (strcmp(in->format_name(), "jpeg") == 0 && nchannels == 4)) {
+    return false;
+  }
+
+  width = level_spec.width;
+  height = level_spec.height;
+  /* Paged image tiles must consist of whole file tiles to read them directly. */
+  tiled = level_spec.tile_width > 0 && level_spec.tile_height > 0 &&
+          PAGED_IMAGE_TILE_SIZE % level_spec.tile_width == 0 &&
+          PAGED_IMAGE_TILE_SIZE % level_spec.tile_height == 0;
+
+  return true;
+}
+
+static TypeDesc oiio_format_from_type(ImageDataType type)
+{
+  switch (type) {
+    case IMAGE_DATA_TYPE_USHORT:
+    case IMAGE_DATA_TYPE_USHORT4:
+      return TypeDesc::USHORT;
+    case IMAGE_DATA_TYPE_HALF:
+    case IMAGE_DATA_TYPE_HALF4:
+      return TypeDesc::HALF;
+    case IMAGE_DATA_TYPE_FLOAT:
+    case IMAGE_DATA_TYPE_FLOAT4:
+      return TypeDesc::FLOAT;
+    default:
+      return TypeDesc::UINT8;
+  }
+}
+
+bool OIIOImageLoader::load_pixels_region(const ImageMetaData &metadata,
+                                         int level,
+                                         int x,
+                                         int y,
+                                         int width,
+                                         int height,
+                                         void *pixels,
+                                         const bool associate_alpha)
+{
+  ImageInput *in = region_input(associate_alpha);
+  if (!in) {
+    return false;
+  }
+
+  if (!in->seek_subimage(0, level)) {
+    return false;
+  }
+  const ImageSpec spec = in->spec();
+
+  const TypeDesc format = oiio_format_from_type(metadata.type);
+  const int channels = min(spec.nchannels, 4);
+  const size_t pixel_size = channels * format.size();
+  bool ok;
+
+  const bool aligned = spec.tile_width > 0 && spec.tile_height > 0 &&
+                       x % spec.tile_width == 0 && y % spec.tile_height == 0 &&
+                       ((x + width) % spec.tile_width == 0 || x + width == spec.width) &&
+                       ((y + height) % spec.tile_height == 0 || y + height == spec.height);
+
+  if (aligned) {
+    ok = in->read_tiles(0,
+                        level,
+                        spec.x + x,
+                        spec.x + x + width,
+                        spec.y + y,
+                        spec.y + y + height,
+                        spec.z,
+                        spec.z + 1,
+                        0,
+                        channels,
+                        format,
+                        pixels);
+  }
+  else if (x == 0 && width == spec.width) {
+    ok = in->read_scanlines(
+        0, level, spec.y + y, spec.y + y + height, spec.z, 0, channels, format, pixels);
+  }
+  else {
+    /* Read full scanlines and keep the part of the region. */
+    vector<uchar> scanlines(pixel_size * spec.width * height);
+    ok = in->read_scanlines(
+        0, level, spec.y + y, spec.y + y + height, spec.z, 0, channels, format, scanlines.data());
+    for (int row = 0; ok && row < height; row++) {
+      memcpy((uchar *)pixels + pixel_size * width * row,
+             scanlines.data() + pixel_size * (((size_t)spec.width) * row + x),
+             pixel_size * width);
+    }
+  }
+
+  return ok;
+}
+
 string OIIOImageLoader::name() const
 {
   return path_filename(filepath.string());
@@ -285,9 +445,8 @@ bool OIIOImageLoader::make_tx(const string &filename,
 
 bool OIIOImageLoader::get_tx(const ustring &colorspace,
                              const ExtensionType &extension,
-                             Progress *progress,
-                             bool auto_convert,
-                             const char *cache_path)
+                             TxConverter *converter,
+                             const string &cache_path)
 {
   if (!path_exists(osl_filepath().c_str())) {
     return false;
@@ -302,24 +461,29 @@ bool OIIOImageLoader::get_tx(const ustring &colorspace,
   }
 
   string tx_name = string(osl_filepath().substr(0, idx).c_str()) + ".tx";
-  if (cache_path) {
-    string filename = path_filename(tx_name);
-    tx_name = path_join(string(cache_path), filename);
+
+  /* Files converted before, by name in the cache directory or next to the source. */
+  if (!cache_path.empty()) {
+    const string cache_tx_name = path_join(cache_path, path_filename(tx_name));
+    if (path_exists(cache_tx_name)) {
+      filepath = cache_tx_name;
+      return true;
+    }
   }
   if (path_exists(tx_name)) {
     filepath = tx_name;
     return true;
   }
 
-  if (auto_convert && progress) {
-    progress->set_status("Updating Images", string("Converting ") + osl_filepath().c_str());
-
-    bool ok = make_tx(osl_filepath().c_str(), tx_name, colorspace, extension);
-    if (ok) {
+  /* Converted in the background, the source file is used until it is done. */
+  if (converter) {
+    tx_name = converter->request(osl_filepath().c_str(), colorspace, extension, cache_path);
+    if (!tx_name.empty()) {
       filepath = tx_name;
       return true;
     }
   }
+
   return false;
 }
 
@@ -19,8 +19,12 @@
 
 #include "render/image.h"
 
+#include "util/util_image.h"
+
 CCL_NAMESPACE_BEGIN
 
+class TxConverter;
+
 class OIIOImageLoader : public ImageLoader {
  public:
   OIIOImageLoader(const string &filepath);
@@ -33,17 +37,31 @@ class OIIOImageLoader : public ImageLoader {
                    const size_t pixels_size,
                    const bool associate_alpha) override;
 
+  bool load_level_metadata(int level, int &width, int &height, bool &tiled) override;
+
+  bool load_pixels_region(const ImageMetaData &metadata,
+                          int level,
+                          int x,
+                          int y,
+                          int width,
+                          int height,
+                          void *pixels,
+                          const bool associate_alpha) override;
+
   string name() const override;
 
   ustring osl_filepath() const override;
 
+  void cleanup() override;
+
   bool equals(const ImageLoader &other) const override;
 
+  /* Use the mip mapped .tx version of the file if available, converting it in the
+   * background with the converter if given. Returns true if the .tx file is used. */
   bool get_tx(const ustring &colorspace,
               const ExtensionType &extension,
-              Progress *progress,
-              bool auto_convert,
-              const char *cache_path);
+              TxConverter *converter,
+              const string &cache_path);
 
   static bool make_tx(const string &filename,
                       const string &outputfilename,
@@ -51,7 +69,13 @@ class OIIOImageLoader : public ImageLoader {
                       ExtensionType extension);
 
  protected:
+  /* File opened for reading regions, kept open between calls so paged tiles don't parse
+   * the file header again. Not thread safe, paged images serialize their loading. */
+  ImageInput *region_input(const bool associate_alpha);
+
   ustring filepath;
+  unique_ptr<ImageInput> region_in;
+  bool region_associate_alpha;
 };
 
 CCL_NAMESPACE_END
@@ -0,0 +1,190 @@
+/*
+ * Copyright 2011-2020 Blender Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "render/image_tx.h"
+#include "render/image_oiio.h"
+
+#include "util/util_cache.h"
+#include "util/util_foreach.h"
+#include "util/util_function.h"
+#include "util/util_logging.h"
+#include "util/util_md5.h"
+#include "util/util_path.h"
+#include "util/util_time.h"
+
+CCL_NAMESPACE_BEGIN
+
+/* Bump when the settings of OIIOImageLoader::make_tx change, so old files are not used. */
+static const char *TX_CONVERTER_VERSION = "1";
+/* OpenImageIO already uses multiple threads for a single conversion. */
+static const size_t TX_CONVERTER_NUM_THREADS = 2;
+
+TxConverter::TxConverter() : stop(false), finished(0)
+{
+}
+
+TxConverter::~TxConverter()
+{
+  cancel();
+}
+
+void TxConverter::cancel()
+{
+  {
+    thread_scoped_lock lock(mutex);
+    stop = true;
+    queue.clear();
+    requested.clear();
+  }
+  queue_cond.notify_all();
+
+  /* Conversions can not be interrupted, wait for the running ones. No threads are added
+   * while stopping. */
+  foreach (thread *t, threads) {
+    t->join();
+    delete t;
+  }
+  threads.clear();
+
+  thread_scoped_lock lock(mutex);
+  stop = false;
+}
+
+string TxConverter::ref_filepath(const string &filepath,
+                                 const ustring &colorspace,
+                                 ExtensionType extension,
+                                 const string &cache_path)
+{
+  MD5Hash md5;
+  md5.append(TX_CONVERTER_VERSION);
+  md5.append(filepath);
+  md5.append(string_printf("%zu %llu %s %d",
+                           path_file_size(filepath),
+                           (unsigned long long)path_modified_time(filepath),
+                           colorspace.c_str(),
+                           (int)extension));
+  return path_join(cache_path, md5.get_hex() + ".txref");
+}
+
+string TxConverter::request(const string &filepath,
+                            const ustring &colorspace,
+                            ExtensionType extension,
+                            const string &cache_path)
+{
+  if (cache_path.empty()) {
+    return "";
+  }
+
+  const string ref = ref_filepath(filepath, colorspace, extension, cache_path);
+
+  /* Already converted, by this or another process. */
+  string hash;
+  if (path_read_text(ref, hash)) {
+    const string tx_filepath = path_join(cache_path, string_strip(hash) + ".tx");
+    if (path_exists(tx_filepath)) {
+      return tx_filepath;
+    }
+  }
+
+  thread_scoped_lock lock(mutex);
+
+  if (stop || !requested.insert(ref).second) {
+    return "";
+  }
+
+  Job job;
+  job.filepath = filepath;
+  job.colorspace = colorspace;
+  job.extension = extension;
+  job.cache_path = cache_path;
+  job.ref_filepath = ref;
+  queue.push_back(job);
+
+  if (threads.size() < TX_CONVERTER_NUM_THREADS && threads.size() < queue.size()) {
+    threads.push_back(new thread(function_bind(&TxConverter::run, this)));
+  }
+
+  lock.unlock();
+  queue_cond.notify_one();
+
+  VLOG(1) << "Queued conversion of " << filepath << " to a .tx file.";
+
+  return "";
+}
+
+void TxConverter::run()
+{
+  for (;;) {
+    Job job;
+    {
+      thread_scoped_lock lock(mutex);
+      while (!stop && queue.empty()) {
+        queue_cond.wait(lock);
+      }
+      if (stop) {
+        return;
+      }
+      job = queue.front();
+      queue.pop_front();
+    }
+
+    if (convert(job)) {
+      finished++;
+    }
+  }
+}
+
+bool TxConverter::convert(const Job &job)
+{
+  const double time_start = time_dt();
+
+  /* Name the file after the contents, so the same texture under another path or on
+   * another machine finds it too. */
+  MD5Hash md5;
+  md5.append(TX_CONVERTER_VERSION);
+  if (!md5.append_file(job.filepath)) {
+    return false;
+  }
+  md5.append(string_printf("%s %d", job.colorspace.c_str(), (int)job.extension));
+  string hash = md5.get_hex();
+
+  const string tx_filepath = path_join(job.cache_path, hash + ".tx");
+
+  if (!path_exists(tx_filepath)) {
+    /* The extension must stay .tx for OpenImageIO to pick the file format. */
+    CacheFileWriter tx_writer(tx_filepath, "tx");
+    if (!OIIOImageLoader::make_tx(
+            job.filepath, tx_writer.tmp_filepath(), job.colorspace, job.extension) ||
+        !tx_writer.commit()) {
+      VLOG(1) << "Failed to convert " << job.filepath << " to a .tx file.";
+      return false;
+    }
+  }
+
+  /* Written last, its existence means the .tx file is complete. */
+  CacheFileWriter ref_writer(job.ref_filepath);
+  if (!ref_writer.write(hash.data(), hash.size()) || !ref_writer.commit()) {
+    VLOG(1) << "Failed to write " << job.ref_filepath << ".";
+    return false;
+  }
+
+  VLOG(1) << "Converted " << job.filepath << " to " << tx_filepath << " in "
+          << time_dt() - time_start << "s.";
+
+  return true;
+}
+
+CCL_NAMESPACE_END
@@ -0,0 +1,94 @@
+/*
+ * Copyright 2011-2020 Blender Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __IMAGE_TX_H__
+#define __IMAGE_TX_H__
+
+#include "util/util_list.h"
+#include "util/util_param.h"
+#include "util/util_set.h"
+#include "util/util_string.h"
+#include "util/util_texture.h"
+#include "util/util_thread.h"
+#include "util/util_vector.h"
+
+#include <atomic>
+
+CCL_NAMESPACE_BEGIN
+
+/* Background conversion of image files to tiled and mip mapped .tx files for the
+ * OpenImageIO texture cache.
+ *
+ * Converted files are stored in a cache directory, named after a hash of the source file
+ * contents and the conversion settings. Identical textures are only converted once, also
+ * when shared between scenes or render nodes using the same directory. Conversions run on
+ * a few threads of their own, renders use the source file until the .tx file is ready.
+ * Owned by the image manager, which cancels the conversions when freeing its images. */
+class TxConverter {
+ public:
+  TxConverter();
+  ~TxConverter();
+
+  /* Path of the converted file if it is available in the cache directory. Otherwise the
+   * conversion is queued and an empty string is returned. */
+  string request(const string &filepath,
+                 const ustring &colorspace,
+                 ExtensionType extension,
+                 const string &cache_path);
+
+  /* Incremented whenever a conversion finished, so users can poll for new files. */
+  int num_finished() const
+  {
+    return finished;
+  }
+
+  /* Drop the queued conversions and wait for the running ones to finish. Files requested
+   * afterwards are queued again. */
+  void cancel();
+
+ protected:
+  struct Job {
+    string filepath;
+    ustring colorspace;
+    ExtensionType extension;
+    string cache_path;
+    string ref_filepath;
+  };
+
+  void run();
+  bool convert(const Job &job);
+
+  /* Small file mapping the source file path, size and modification time to the content
+   * hash of the converted file, so finding it does not require reading the source. */
+  static string ref_filepath(const string &filepath,
+                             const ustring &colorspace,
+                             ExtensionType extension,
+                             const string &cache_path);
+
+  list<Job> queue;
+  /* Reference files of queued, running and failed conversions, to request them once. */
+  set<string> requested;
+  vector<thread *> threads;
+  bool stop;
+  std::atomic<int> finished;
+
+  thread_mutex mutex;
+  thread_condition_variable queue_cond;
+};
+
+CCL_NAMESPACE_END
+
+#endif /* __IMAGE_TX_H__ */
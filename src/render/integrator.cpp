@@ -278,6 +278,10 @@ void Integrator::tag_update(Scene *scene)
       break;
     }
   }
+  /* The light tree is only used by some integrator methods. */
+  if (scene->params.use_light_tree) {
+    scene->light_manager->tag_update(scene);
+  }
   need_update = true;
 }
 
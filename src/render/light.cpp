@@ -17,9 +17,11 @@
 #include "render/light.h"
 #include "device/device.h"
 #include "render/background.h"
+#include "render/background_map.h"
 #include "render/film.h"
 #include "render/graph.h"
 #include "render/integrator.h"
+#include "render/light_tree.h"
 #include "render/mesh.h"
 #include "render/nodes.h"
 #include "render/object.h"
@@ -29,12 +31,17 @@
 #include "util/util_foreach.h"
 #include "util/util_hash.h"
 #include "util/util_logging.h"
+#include "util/util_map.h"
 #include "util/util_path.h"
 #include "util/util_progress.h"
 #include "util/util_task.h"
 
 CCL_NAMESPACE_BEGIN
 
+/* Automatic World MIS resolution: smallest width and maximum error of the reduced map. */
+#define BACKGROUND_MAP_MIN_AUTO_WIDTH 256
+#define BACKGROUND_MAP_MAX_AUTO_ERROR 0.02f
+
 static void shade_background_pixels(Device *device,
                                     DeviceScene *dscene,
                                     int width,
@@ -331,6 +338,21 @@ void LightManager::device_update_distribution(Device *,
   KernelLightDistribution *distribution = dscene->light_distribution.alloc(num_distribution + 1);
   float totarea = 0.0f;
 
+  /* Light tree emitters, and the table to find the distribution index of a primitive or
+   * lamp. The table starts with a per object offset into the primitive slices, followed
+   * by one entry per lamp. The branched path integrator relies on triangles and lamps
+   * being split in the distribution, so it keeps using the flat distribution. */
+  const bool use_light_tree = scene->params.use_light_tree &&
+                              scene->integrator->method != Integrator::BRANCHED_PATH;
+  const int num_objects = scene->objects.size();
+  vector<LightTreeEmitter> tree_emitters;
+  vector<int> tree_table;
+  unordered_map<Shader *, float> shader_emission;
+
+  if (use_light_tree) {
+    tree_table.resize(num_objects + num_lights, LIGHT_TREE_NONE);
+  }
+
   /* triangles */
   size_t offset = 0;
   int j = 0;
@@ -368,6 +390,14 @@ void LightManager::device_update_distribution(Device *,
     }
 
     size_t mesh_num_triangles = mesh->num_triangles();
+    int tree_slice = 0;
+
+    if (use_light_tree) {
+      tree_slice = tree_table.size();
+      tree_table[object_id] = tree_slice - (int)mesh->prim_offset;
+      tree_table.resize(tree_slice + mesh_num_triangles, LIGHT_TREE_NONE);
+    }
+
     for (size_t i = 0; i < mesh_num_triangles; i++) {
       int shader_index = mesh->shader[i];
       Shader *shader = (shader_index < mesh->used_shaders.size()) ?
@@ -375,6 +405,10 @@ void LightManager::device_update_distribution(Device *,
                            scene->default_surface;
 
       if (shader->use_mis && shader->has_surface_emission) {
+        if (use_light_tree) {
+          tree_table[tree_slice + i] = offset;
+        }
+
         distribution[offset].totarea = totarea;
         distribution[offset].prim = i + mesh->prim_offset;
         distribution[offset].mesh_light.shader_flag = shader_flag;
@@ -395,7 +429,32 @@ void LightManager::device_update_distribution(Device *,
           p3 = transform_point(&tfm, p3);
         }
 
-        totarea += triangle_area(p1, p2, p3);
+        const float area = triangle_area(p1, p2, p3);
+        totarea += area;
+
+        if (use_light_tree) {
+          /* Rough estimate of emitted power, textured emission counts as one. */
+          unordered_map<Shader *, float>::iterator it = shader_emission.find(shader);
+          if (it == shader_emission.end()) {
+            float3 emission;
+            const float strength = shader->is_constant_emission(&emission) ? average(emission) :
+                                                                              1.0f;
+            it = shader_emission.insert(std::make_pair(shader, strength)).first;
+          }
+
+          /* Triangles emit on both sides. */
+          LightTreeEmitter emitter;
+          emitter.bbox.grow(p1);
+          emitter.bbox.grow(p2);
+          emitter.bbox.grow(p3);
+          emitter.centroid = (p1 + p2 + p3) * (1.0f / 3.0f);
+          emitter.axis = make_float3(0.0f, 0.0f, 1.0f);
+          emitter.theta_o = M_PI_F;
+          emitter.theta_e = M_PI_2_F;
+          emitter.energy = M_PI_F * area * fabsf(it->second);
+          emitter.index = offset - 1;
+          tree_emitters.push_back(emitter);
+        }
       }
     }
 
@@ -428,6 +487,51 @@ void LightManager::device_update_distribution(Device *,
     distribution[offset].lamp.size = light->size;
     totarea += lightarea;
 
+    if (use_light_tree) {
+      tree_table[num_objects + light_index] = offset;
+
+      if (light->type == LIGHT_POINT || light->type == LIGHT_SPOT || light->type == LIGHT_AREA) {
+        Shader *shader = (light->shader) ? light->shader : scene->default_light;
+        float3 emission;
+        const float strength = shader->is_constant_emission(&emission) ? average(emission) :
+                                                                          1.0f;
+
+        LightTreeEmitter emitter;
+        emitter.energy = fabsf(average(light->strength) * strength);
+        emitter.index = offset;
+
+        if (light->type == LIGHT_AREA) {
+          /* One sided, emitting in the hemisphere around the direction. */
+          const float3 axisu = light->axisu * (light->sizeu * light->size);
+          const float3 axisv = light->axisv * (light->sizev * light->size);
+          emitter.bbox.grow(light->co - 0.5f * axisu - 0.5f * axisv);
+          emitter.bbox.grow(light->co + 0.5f * axisu - 0.5f * axisv);
+          emitter.bbox.grow(light->co - 0.5f * axisu + 0.5f * axisv);
+          emitter.bbox.grow(light->co + 0.5f * axisu + 0.5f * axisv);
+          emitter.axis = safe_normalize(light->dir);
+          emitter.theta_o = 0.0f;
+          emitter.theta_e = M_PI_2_F;
+          emitter.energy *= M_PI_4_F;
+        }
+        else {
+          emitter.bbox.grow(light->co, light->size);
+          if (light->type == LIGHT_SPOT) {
+            emitter.axis = safe_normalize(light->dir);
+            emitter.theta_o = 0.0f;
+            emitter.theta_e = min(light->spot_angle * 0.5f, M_PI_F);
+          }
+          else {
+            emitter.axis = make_float3(0.0f, 0.0f, 1.0f);
+            emitter.theta_o = M_PI_F;
+            emitter.theta_e = M_PI_2_F;
+          }
+        }
+
+        emitter.centroid = emitter.bbox.center();
+        tree_emitters.push_back(emitter);
+      }
+    }
+
     if (light->type == LIGHT_DISTANT) {
       use_lamp_mis |= (light->angle > 0.0f && light->use_mis);
     }
@@ -452,6 +556,17 @@ void LightManager::device_update_distribution(Device *,
   distribution[num_distribution].lamp.pad = 0.0f;
   distribution[num_distribution].lamp.size = 0.0f;
 
+  if (use_light_tree && !tree_emitters.empty() && totarea > 0.0f) {
+    device_update_light_tree(dscene, tree_emitters, tree_table, num_objects);
+    totarea = distribution[num_distribution].totarea;
+  }
+  else {
+    dscene->light_tree_nodes.free();
+    dscene->light_tree_emitters.free();
+    dscene->data.integrator.use_light_tree = false;
+    dscene->data.integrator.light_tree_lamp_offset = 0;
+  }
+
   if (totarea > 0.0f) {
     for (size_t i = 0; i < num_distribution; i++)
       distribution[i].totarea /= totarea;
@@ -541,42 +656,66 @@ void LightManager::device_update_distribution(Device *,
   }
 }
 
-static void background_cdf(
-    int start, int end, int res_x, int res_y, const vector<float3> *pixels, float2 *cond_cdf)
+void LightManager::device_update_light_tree(DeviceScene *dscene,
+                                            vector<LightTreeEmitter> &emitters,
+                                            vector<int> &emitter_table,
+                                            int num_objects)
 {
-  int cdf_width = res_x + 1;
-  /* Conditional CDFs (rows, U direction). */
-  for (int i = start; i < end; i++) {
-    float sin_theta = sinf(M_PI_F * (i + 0.5f) / res_y);
-    float3 env_color = (*pixels)[i * res_x];
-    float ave_luminance = average(env_color);
-
-    cond_cdf[i * cdf_width].x = ave_luminance * sin_theta;
-    cond_cdf[i * cdf_width].y = 0.0f;
-
-    for (int j = 1; j < res_x; j++) {
-      env_color = (*pixels)[i * res_x + j];
-      ave_luminance = average(env_color);
-
-      cond_cdf[i * cdf_width + j].x = ave_luminance * sin_theta;
-      cond_cdf[i * cdf_width + j].y = cond_cdf[i * cdf_width + j - 1].y +
-                                      cond_cdf[i * cdf_width + j - 1].x / res_x;
-    }
+  KernelLightDistribution *distribution = dscene->light_distribution.data();
+  const int num_distribution = dscene->light_distribution.size() - 1;
 
-    float cdf_total = cond_cdf[i * cdf_width + res_x - 1].y +
-                      cond_cdf[i * cdf_width + res_x - 1].x / res_x;
-    float cdf_total_inv = 1.0f / cdf_total;
+  LightTree tree(emitters);
 
-    /* stuff the total into the brightness value for the last entry, because
-     * we are going to normalize the CDFs to 0.0 to 1.0 afterwards */
-    cond_cdf[i * cdf_width + res_x].x = cdf_total;
+  /* Reorder the distribution so the emitters of every node are one continuous range,
+   * followed by the distant and background lights. */
+  vector<int> old_index;
+  vector<int> new_index(num_distribution, -1);
+  old_index.reserve(num_distribution);
 
-    if (cdf_total > 0.0f)
-      for (int j = 1; j < res_x; j++)
-        cond_cdf[i * cdf_width + j].y *= cdf_total_inv;
+  foreach (const LightTreeEmitter &emitter, emitters) {
+    new_index[emitter.index] = old_index.size();
+    old_index.push_back(emitter.index);
+  }
+  for (int i = 0; i < num_distribution; i++) {
+    if (new_index[i] == -1) {
+      new_index[i] = old_index.size();
+      old_index.push_back(i);
+    }
+  }
+
+  vector<KernelLightDistribution> old_distribution(distribution,
+                                                   distribution + num_distribution + 1);
+  float totarea = 0.0f;
 
-    cond_cdf[i * cdf_width + res_x].y = 1.0f;
+  for (int i = 0; i < num_distribution; i++) {
+    const int j = old_index[i];
+    distribution[i] = old_distribution[j];
+    distribution[i].totarea = totarea;
+    totarea += old_distribution[j + 1].totarea - old_distribution[j].totarea;
+  }
+  distribution[num_distribution].totarea = totarea;
+
+  /* Object offsets stay, primitive and lamp entries point to the new distribution. */
+  for (size_t i = num_objects; i < emitter_table.size(); i++) {
+    if (emitter_table[i] != LIGHT_TREE_NONE) {
+      emitter_table[i] = new_index[emitter_table[i]];
+    }
   }
+
+  const vector<KernelLightTreeNode> &nodes = tree.get_nodes();
+  KernelLightTreeNode *knodes = dscene->light_tree_nodes.alloc(nodes.size());
+  memcpy(knodes, nodes.data(), nodes.size() * sizeof(KernelLightTreeNode));
+  dscene->light_tree_nodes.copy_to_device();
+
+  int *ktable = dscene->light_tree_emitters.alloc(emitter_table.size());
+  memcpy(ktable, emitter_table.data(), emitter_table.size() * sizeof(int));
+  dscene->light_tree_emitters.copy_to_device();
+
+  dscene->data.integrator.use_light_tree = true;
+  dscene->data.integrator.light_tree_lamp_offset = num_objects;
+
+  VLOG(1) << "Light tree with " << nodes.size() << " nodes over " << emitters.size()
+          << " emitters.";
 }
 
 void LightManager::device_update_background(Device *device,
@@ -688,47 +827,51 @@ void LightManager::device_update_background(Device *device,
   kbackground->map_res_x = res.x;
   kbackground->map_res_y = res.y;
 
-  vector<float3> pixels;
-  shade_background_pixels(device, dscene, res.x, res.y, pixels, progress);
+  /* Reuse the map of a background that was shaded before. */
+  const bool auto_resolution = (background_light->map_resolution == 0);
+  background_map_cache.set_path(scene->params.background_cache_path);
+  const string cache_key = BackgroundMapCache::key(shader, res, auto_resolution);
 
-  if (progress.get_cancel())
-    return;
+  BackgroundMap map;
+  if (cache_key.empty() || !background_map_cache.load(cache_key, map)) {
+    vector<float3> pixels;
+    shade_background_pixels(device, dscene, res.x, res.y, pixels, progress);
 
-  /* build row distributions and column distribution for the infinite area environment light */
-  int cdf_width = res.x + 1;
-  float2 *marg_cdf = dscene->light_background_marginal_cdf.alloc(res.y + 1);
-  float2 *cond_cdf = dscene->light_background_conditional_cdf.alloc(cdf_width * res.y);
-
-  double time_start = time_dt();
-
-  /* Create CDF in parallel. */
-  const int rows_per_task = divide_up(10240, res.x);
-  parallel_for(blocked_range<size_t>(0, res.y, rows_per_task),
-               [&](const blocked_range<size_t> &r) {
-                 background_cdf(r.begin(), r.end(), res.x, res.y, &pixels, cond_cdf);
-               });
+    if (progress.get_cancel())
+      return;
 
-  /* marginal CDFs (column, V direction, sum of rows) */
-  marg_cdf[0].x = cond_cdf[res.x].x;
-  marg_cdf[0].y = 0.0f;
+    double time_start = time_dt();
 
-  for (int i = 1; i < res.y; i++) {
-    marg_cdf[i].x = cond_cdf[i * cdf_width + res.x].x;
-    marg_cdf[i].y = marg_cdf[i - 1].y + marg_cdf[i - 1].x / res.y;
-  }
+    if (auto_resolution) {
+      const int2 full_res = res;
+      res = background_map_reduce_resolution(
+          pixels, res, BACKGROUND_MAP_MIN_AUTO_WIDTH, BACKGROUND_MAP_MAX_AUTO_ERROR);
+      if (res.x != full_res.x) {
+        VLOG(2) << "Reduced World MIS resolution to " << res.x << " by " << res.y << "\n";
+      }
+    }
 
-  float cdf_total = marg_cdf[res.y - 1].y + marg_cdf[res.y - 1].x / res.y;
-  marg_cdf[res.y].x = cdf_total;
+    map.build(pixels, res);
 
-  if (cdf_total > 0.0f)
-    for (int i = 1; i < res.y; i++)
-      marg_cdf[i].y /= cdf_total;
+    VLOG(2) << "Background MIS build time " << time_dt() - time_start << "\n";
 
-  marg_cdf[res.y].y = 1.0f;
+    if (!cache_key.empty()) {
+      background_map_cache.store(cache_key, map);
+    }
+  }
+  else {
+    VLOG(2) << "Using cached World MIS map of " << map.res.x << " by " << map.res.y << "\n";
+  }
 
-  VLOG(2) << "Background MIS build time " << time_dt() - time_start << "\n";
+  kbackground->map_res_x = map.res.x;
+  kbackground->map_res_y = map.res.y;
 
   /* update device */
+  float2 *marg_cdf = dscene->light_background_marginal_cdf.alloc(map.marginal_cdf.size());
+  float2 *cond_cdf = dscene->light_background_conditional_cdf.alloc(map.conditional_cdf.size());
+  memcpy(marg_cdf, map.marginal_cdf.data(), map.marginal_cdf.size() * sizeof(float2));
+  memcpy(cond_cdf, map.conditional_cdf.data(), map.conditional_cdf.size() * sizeof(float2));
+
   dscene->light_background_marginal_cdf.copy_to_device();
   dscene->light_background_conditional_cdf.copy_to_device();
 }
@@ -1022,6 +1165,8 @@ void LightManager::device_update(Device *device,
 void LightManager::device_free(Device *, DeviceScene *dscene, const bool free_background)
 {
   dscene->light_distribution.free();
+  dscene->light_tree_nodes.free();
+  dscene->light_tree_emitters.free();
   dscene->lights.free();
   if (free_background) {
     dscene->light_background_marginal_cdf.free();
@@ -21,6 +21,8 @@
 
 #include "graph/node.h"
 
+#include "render/background_map.h"
+
 #include "util/util_ies.h"
 #include "util/util_thread.h"
 #include "util/util_types.h"
@@ -34,6 +36,7 @@ class Object;
 class Progress;
 class Scene;
 class Shader;
+struct LightTreeEmitter;
 
 class Light : public Node {
  public:
@@ -126,6 +129,10 @@ class LightManager {
                                 Scene *scene,
                                 Progress &progress);
   void device_update_ies(DeviceScene *dscene);
+  void device_update_light_tree(DeviceScene *dscene,
+                                vector<LightTreeEmitter> &emitters,
+                                vector<int> &emitter_table,
+                                int num_objects);
 
   /* Check whether light manager can use the object as a light-emissive. */
   bool object_usable_as_light(Object *object);
@@ -141,6 +148,8 @@ class LightManager {
 
   bool last_background_enabled;
   int last_background_resolution;
+
+  BackgroundMapCache background_map_cache;
 };
 
 CCL_NAMESPACE_END
@@ -0,0 +1,130 @@
+/*
+ * Copyright 2011-2020 Blender Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "render/light_tree.h"
+
+#include "util/util_algorithm.h"
+#include "util/util_math.h"
+
+CCL_NAMESPACE_BEGIN
+
+/* Smallest cone containing both cones, written to the first one. */
+static void light_tree_cone_merge(
+    float3 &axis, float &theta_o, float &theta_e, float3 b_axis, float b_theta_o, float b_theta_e)
+{
+  theta_e = max(theta_e, b_theta_e);
+
+  if (b_theta_o > theta_o) {
+    swap(axis, b_axis);
+    swap(theta_o, b_theta_o);
+  }
+
+  if (theta_o >= M_PI_F) {
+    return;
+  }
+
+  const float cos_d = clamp(dot(axis, b_axis), -1.0f, 1.0f);
+  const float theta_d = safe_acosf(cos_d);
+
+  if (min(theta_d + b_theta_o, M_PI_F) <= theta_o) {
+    return;
+  }
+
+  const float new_theta_o = (theta_o + theta_d + b_theta_o) * 0.5f;
+  const float3 ortho = b_axis - axis * cos_d;
+  const float ortho_len = len(ortho);
+
+  if (new_theta_o >= M_PI_F || ortho_len < 1e-6f) {
+    theta_o = M_PI_F;
+    return;
+  }
+
+  /* Rotate the axis towards the other one, keeping the first cone on the boundary. */
+  const float theta_r = new_theta_o - theta_o;
+  axis = normalize(axis * cosf(theta_r) + ortho * (sinf(theta_r) / ortho_len));
+  theta_o = new_theta_o;
+}
+
+LightTree::LightTree(vector<LightTreeEmitter> &emitters) : emitters(emitters)
+{
+  if (!emitters.empty()) {
+    nodes.reserve(2 * emitters.size() / MAX_LEAF_SIZE + 1);
+    build(0, emitters.size());
+  }
+}
+
+int LightTree::build(int first, int num)
+{
+  const int index = nodes.size();
+  nodes.push_back(KernelLightTreeNode());
+
+  /* Bounds. */
+  BoundBox bbox = BoundBox::empty;
+  BoundBox centroid_bbox = BoundBox::empty;
+  float energy = 0.0f;
+  float3 axis = emitters[first].axis;
+  float theta_o = emitters[first].theta_o;
+  float theta_e = emitters[first].theta_e;
+
+  for (int i = first; i < first + num; i++) {
+    const LightTreeEmitter &emitter = emitters[i];
+    bbox.grow(emitter.bbox);
+    centroid_bbox.grow(emitter.centroid);
+    energy += emitter.energy;
+    light_tree_cone_merge(axis, theta_o, theta_e, emitter.axis, emitter.theta_o, emitter.theta_e);
+  }
+
+  /* Split at the median of the largest centroid axis. */
+  const float3 extent = centroid_bbox.size();
+  const int split_axis = (extent.x > extent.y) ? ((extent.x > extent.z) ? 0 : 2) :
+                                                 ((extent.y > extent.z) ? 1 : 2);
+  int right_child = -1;
+
+  if (num > MAX_LEAF_SIZE && extent[split_axis] > 0.0f) {
+    const int middle = first + num / 2;
+    std::nth_element(emitters.begin() + first,
+                     emitters.begin() + middle,
+                     emitters.begin() + first + num,
+                     [split_axis](const LightTreeEmitter &a, const LightTreeEmitter &b) {
+                       return a.centroid[split_axis] < b.centroid[split_axis];
+                     });
+
+    build(first, middle - first);
+    right_child = build(middle, first + num - middle);
+  }
+
+  KernelLightTreeNode &node = nodes[index];
+  node.bbox_min[0] = bbox.min.x;
+  node.bbox_min[1] = bbox.min.y;
+  node.bbox_min[2] = bbox.min.z;
+  node.energy = energy;
+  node.bbox_max[0] = bbox.max.x;
+  node.bbox_max[1] = bbox.max.y;
+  node.bbox_max[2] = bbox.max.z;
+  node.theta_o = theta_o;
+  node.axis[0] = axis.x;
+  node.axis[1] = axis.y;
+  node.axis[2] = axis.z;
+  node.theta_e = theta_e;
+  node.first = first;
+  node.num = num;
+  node.right_child = right_child;
+  node.pad = 0;
+
+  return index;
+}
+
+CCL_NAMESPACE_END
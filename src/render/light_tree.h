@@ -0,0 +1,71 @@
+/*
+ * Copyright 2011-2020 Blender Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __LIGHT_TREE_H__
+#define __LIGHT_TREE_H__
+
+#include "kernel/kernel_types.h"
+
+#include "util/util_boundbox.h"
+#include "util/util_types.h"
+#include "util/util_vector.h"
+
+CCL_NAMESPACE_BEGIN
+
+/* Emitter with a finite extent, either an emissive triangle or a point, spot or area
+ * light. Distant and background lights are not part of the tree. */
+struct LightTreeEmitter {
+  BoundBox bbox;
+  float3 centroid;
+  /* Bounding cone of the emission direction: normals are within theta_o of the axis,
+   * and light leaves within theta_e of a normal. */
+  float3 axis;
+  float theta_o;
+  float theta_e;
+  float energy;
+  /* Index in the unsorted light distribution. */
+  int index;
+
+  LightTreeEmitter() : bbox(BoundBox::empty)
+  {
+  }
+};
+
+/* Binary BVH over emitters, storing energy and orientation bounds in each node so the
+ * kernel can pick a light proportional to its estimated contribution at a point. */
+class LightTree {
+ public:
+  static const int MAX_LEAF_SIZE = 8;
+
+  /* Builds the tree, reordering the emitters so each leaf references a continuous
+   * range of them. */
+  explicit LightTree(vector<LightTreeEmitter> &emitters);
+
+  const vector<KernelLightTreeNode> &get_nodes() const
+  {
+    return nodes;
+  }
+
+ protected:
+  int build(int first, int num);
+
+  vector<LightTreeEmitter> &emitters;
+  vector<KernelLightTreeNode> nodes;
+};
+
+CCL_NAMESPACE_END
+
+#endif /* __LIGHT_TREE_H__ */
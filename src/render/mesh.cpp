@@ -28,10 +28,14 @@
 #include "subd/subd_patch_table.h"
 #include "subd/subd_split.h"
 
+#include "util/util_algorithm.h"
+#include "util/util_atomic.h"
 #include "util/util_foreach.h"
 #include "util/util_logging.h"
 #include "util/util_progress.h"
 #include "util/util_set.h"
+#include "util/util_simd.h"
+#include "util/util_tbb.h"
 
 CCL_NAMESPACE_BEGIN
 
@@ -142,12 +146,15 @@ Mesh::Mesh() : Geometry(node_type, Geometry::MESH), subd_attributes(this, ATTR_P
   patch_offset = 0;
   face_offset = 0;
   corner_offset = 0;
+  normals_offset = 0;
 
   num_subd_verts = 0;
 
   volume_clipping = 0.001f;
   volume_step_size = 0.0f;
   volume_object_space = false;
+  volume_majorant_resolution = make_int3(0, 0, 0);
+  volume_majorant_tfm = transform_identity();
 
   num_ngons = 0;
 
@@ -235,6 +242,11 @@ void Mesh::clear(bool preserve_voxel_data, bool preserve_custom_data)
   subd_attributes.clear();
   attributes.clear(preserve_voxel_data, preserve_custom_data);
 
+  if (!preserve_voxel_data) {
+    volume_majorant.clear();
+    volume_majorant_resolution = make_int3(0, 0, 0);
+  }
+
   vert_to_stitching_key_map.clear();
   vert_stitching_map.clear();
 
@@ -410,6 +422,129 @@ void Mesh::apply_transform(const Transform &tfm, const bool apply_to_motion)
   }
 }
 
+/* Normals
+ *
+ * Meshes with many triangles compute their normals in parallel. Vertex normals are
+ * gathered per vertex from a vertex to triangle map rather than scattered from the
+ * triangles, summing adjacent triangles in index order, so the result is exactly the
+ * same as the serial loop regardless of thread scheduling. */
+
+static const size_t NORMALS_PARALLEL_MIN_TRIANGLES = 65536;
+static const size_t NORMALS_PER_TASK = 4096;
+
+static inline float3 compute_face_normal(const float3 *verts, const int v[3])
+{
+#ifdef __KERNEL_SSE2__
+  const ssef v0 = load4f(verts[v[0]]);
+  const ssef e1 = load4f(verts[v[1]]) - v0;
+  const ssef e2 = load4f(verts[v[2]]) - v0;
+  const ssef norm = cross(e1, e2);
+  const ssef normlen = mm_sqrt(dot3_splat(norm, norm));
+
+  if (extract<0>(normlen) == 0.0f) {
+    return make_float3(1.0f, 0.0f, 0.0f);
+  }
+
+  float3 N;
+  storeu4f(&N.x, norm / normlen);
+  return N;
+#else
+  Mesh::Triangle tri = {{v[0], v[1], v[2]}};
+  return tri.compute_normal(verts);
+#endif
+}
+
+/* Map from vertex to the sorted list of triangles using it. */
+struct VertexTriangleMap {
+  vector<uint> offsets;
+  vector<uint> triangles;
+
+  void build(const Mesh *mesh)
+  {
+    const size_t verts_size = mesh->verts.size();
+    const size_t triangles_size = mesh->num_triangles();
+    const int *vindex = mesh->triangles.data();
+
+    /* Count triangles per vertex. */
+    offsets.clear();
+    offsets.resize(verts_size + 1, 0);
+    uint *counts = offsets.data() + 1;
+
+    parallel_for(blocked_range<size_t>(0, triangles_size, NORMALS_PER_TASK),
+                 [&](const blocked_range<size_t> &r) {
+                   for (size_t i = r.begin(); i != r.end(); i++) {
+                     for (size_t j = 0; j < 3; j++) {
+                       atomic_fetch_and_add_uint32(&counts[vindex[i * 3 + j]], 1);
+                     }
+                   }
+                 });
+
+    for (size_t i = 0; i < verts_size; i++) {
+      offsets[i + 1] += offsets[i];
+    }
+
+    /* Fill, the order within a vertex depends on scheduling so sort afterwards. */
+    triangles.resize(offsets[verts_size]);
+    vector<uint> cursor(offsets.begin(), offsets.end() - 1);
+
+    parallel_for(blocked_range<size_t>(0, triangles_size, NORMALS_PER_TASK),
+                 [&](const blocked_range<size_t> &r) {
+                   for (size_t i = r.begin(); i != r.end(); i++) {
+                     for (size_t j = 0; j < 3; j++) {
+                       uint slot = atomic_fetch_and_add_uint32(&cursor[vindex[i * 3 + j]], 1);
+                       triangles[slot] = (uint)i;
+                     }
+                   }
+                 });
+
+    parallel_for(blocked_range<size_t>(0, verts_size, NORMALS_PER_TASK),
+                 [&](const blocked_range<size_t> &r) {
+                   for (size_t i = r.begin(); i != r.end(); i++) {
+                     sort(triangles.begin() + offsets[i], triangles.begin() + offsets[i + 1]);
+                   }
+                 });
+  }
+
+  void gather_normals(const float3 *fN, float3 *vN, bool flip) const
+  {
+    const size_t verts_size = offsets.size() - 1;
+
+    parallel_for(blocked_range<size_t>(0, verts_size, NORMALS_PER_TASK),
+                 [&](const blocked_range<size_t> &r) {
+                   for (size_t i = r.begin(); i != r.end(); i++) {
+                     float3 N = make_float3(0.0f, 0.0f, 0.0f);
+
+                     for (uint k = offsets[i]; k < offsets[i + 1]; k++) {
+                       N += fN[triangles[k]];
+                     }
+
+                     N = normalize(N);
+                     vN[i] = (flip) ? -N : N;
+                   }
+                 });
+  }
+};
+
+static void compute_face_normals(const Mesh *mesh, const float3 *verts, float3 *fN)
+{
+  const size_t triangles_size = mesh->num_triangles();
+  const int *vindex = mesh->triangles.data();
+
+  if (triangles_size < NORMALS_PARALLEL_MIN_TRIANGLES) {
+    for (size_t i = 0; i < triangles_size; i++) {
+      fN[i] = compute_face_normal(verts, vindex + i * 3);
+    }
+    return;
+  }
+
+  parallel_for(blocked_range<size_t>(0, triangles_size, NORMALS_PER_TASK),
+               [&](const blocked_range<size_t> &r) {
+                 for (size_t i = r.begin(); i != r.end(); i++) {
+                   fN[i] = compute_face_normal(verts, vindex + i * 3);
+                 }
+               });
+}
+
 void Mesh::add_face_normals()
 {
   /* don't compute if already there */
@@ -424,19 +559,19 @@ void Mesh::add_face_normals()
   size_t triangles_size = num_triangles();
 
   if (triangles_size) {
-    float3 *verts_ptr = verts.data();
-
-    for (size_t i = 0; i < triangles_size; i++) {
-      fN[i] = get_triangle(i).compute_normal(verts_ptr);
-    }
+    compute_face_normals(this, verts.data(), fN);
   }
 
   /* expected to be in local space */
   if (transform_applied) {
     Transform ntfm = transform_inverse(transform_normal);
 
-    for (size_t i = 0; i < triangles_size; i++)
-      fN[i] = normalize(transform_direction(&ntfm, fN[i]));
+    parallel_for(blocked_range<size_t>(0, triangles_size, NORMALS_PER_TASK),
+                 [&](const blocked_range<size_t> &r) {
+                   for (size_t i = r.begin(); i != r.end(); i++) {
+                     fN[i] = normalize(transform_direction(&ntfm, fN[i]));
+                   }
+                 });
   }
 }
 
@@ -445,6 +580,10 @@ void Mesh::add_vertex_normals()
   bool flip = transform_negative_scaled;
   size_t verts_size = verts.size();
   size_t triangles_size = num_triangles();
+  bool use_parallel = triangles_size >= NORMALS_PARALLEL_MIN_TRIANGLES;
+
+  /* built on demand, shared by static and motion vertex normals */
+  VertexTriangleMap vert_tri_map;
 
   /* static vertex normals */
   if (!attributes.find(ATTR_STD_VERTEX_NORMAL) && triangles_size) {
@@ -456,18 +595,24 @@ void Mesh::add_vertex_normals()
     float3 *vN = attr_vN->data_float3();
 
     /* compute vertex normals */
-    memset(vN, 0, verts.size() * sizeof(float3));
+    if (use_parallel) {
+      vert_tri_map.build(this);
+      vert_tri_map.gather_normals(fN, vN, flip);
+    }
+    else {
+      memset(vN, 0, verts.size() * sizeof(float3));
 
-    for (size_t i = 0; i < triangles_size; i++) {
-      for (size_t j = 0; j < 3; j++) {
-        vN[get_triangle(i).v[j]] += fN[i];
+      for (size_t i = 0; i < triangles_size; i++) {
+        for (size_t j = 0; j < 3; j++) {
+          vN[get_triangle(i).v[j]] += fN[i];
+        }
       }
-    }
 
-    for (size_t i = 0; i < verts_size; i++) {
-      vN[i] = normalize(vN[i]);
-      if (flip) {
-        vN[i] = -vN[i];
+      for (size_t i = 0; i < verts_size; i++) {
+        vN[i] = normalize(vN[i]);
+        if (flip) {
+          vN[i] = -vN[i];
+        }
       }
     }
   }
@@ -480,11 +625,25 @@ void Mesh::add_vertex_normals()
     /* create attribute */
     attr_mN = attributes.add(ATTR_STD_MOTION_VERTEX_NORMAL);
 
+    vector<float3> step_fN;
+    if (use_parallel) {
+      step_fN.resize(triangles_size);
+      if (vert_tri_map.offsets.empty()) {
+        vert_tri_map.build(this);
+      }
+    }
+
     for (int step = 0; step < motion_steps - 1; step++) {
       float3 *mP = attr_mP->data_float3() + step * verts.size();
       float3 *mN = attr_mN->data_float3() + step * verts.size();
 
       /* compute */
+      if (use_parallel) {
+        compute_face_normals(this, mP, step_fN.data());
+        vert_tri_map.gather_normals(step_fN.data(), mN, flip);
+        continue;
+      }
+
       memset(mN, 0, verts.size() * sizeof(float3));
 
       for (size_t i = 0; i < triangles_size; i++) {
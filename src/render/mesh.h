@@ -137,6 +137,12 @@ class Mesh : public Geometry {
   float volume_step_size;
   bool volume_object_space;
 
+  /* Coarse grid with the maximum density per block of voxels, zero where the volume is empty.
+   * Created with the volume mesh, the transform maps object space to cells. */
+  array<float> volume_majorant;
+  int3 volume_majorant_resolution;
+  Transform volume_majorant_tfm;
+
   array<SubdFace> subd_faces;
   array<int> subd_face_corners;
   int num_ngons;
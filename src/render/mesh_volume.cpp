@@ -23,17 +23,23 @@
 #  include <openvdb/tools/Dense.h>
 #  include <openvdb/tools/GridTransformer.h>
 #  include <openvdb/tools/Morphology.h>
+#  include <openvdb/tree/LeafManager.h>
 #endif
 
+#include "util/util_algorithm.h"
 #include "util/util_foreach.h"
 #include "util/util_hash.h"
 #include "util/util_logging.h"
 #include "util/util_openvdb.h"
 #include "util/util_progress.h"
+#include "util/util_set.h"
+#include "util/util_tbb.h"
 #include "util/util_types.h"
 
 CCL_NAMESPACE_BEGIN
 
+/* Quad with the triangles (v0, v2, v1) and (v0, v3, v2), a single triangle when v3 is the
+ * same as v2. */
 struct QuadData {
   int v0, v1, v2, v3;
 
@@ -81,10 +87,12 @@ const float3 quads_normals[6] = {
 
 static int add_vertex(int3 v,
                       vector<int3> &vertices,
+                      int3 origin,
                       int3 res,
                       unordered_map<size_t, int> &used_verts)
 {
-  size_t vert_key = v.x + v.y * (res.x + 1) + v.z * (res.x + 1) * (res.y + 1);
+  const size_t x = v.x - origin.x, y = v.y - origin.y, z = v.z - origin.z;
+  size_t vert_key = x + y * (res.x + 1) + z * (res.x + 1) * (res.y + 1);
   unordered_map<size_t, int>::iterator it = used_verts.find(vert_key);
 
   if (it != used_verts.end()) {
@@ -100,20 +108,95 @@ static int add_vertex(int3 v,
 static void create_quad(int3 corners[8],
                         vector<int3> &vertices,
                         vector<QuadData> &quads,
+                        int3 origin,
                         int3 res,
                         unordered_map<size_t, int> &used_verts,
                         int face_index)
 {
   QuadData quad;
-  quad.v0 = add_vertex(corners[quads_indices[face_index][0]], vertices, res, used_verts);
-  quad.v1 = add_vertex(corners[quads_indices[face_index][1]], vertices, res, used_verts);
-  quad.v2 = add_vertex(corners[quads_indices[face_index][2]], vertices, res, used_verts);
-  quad.v3 = add_vertex(corners[quads_indices[face_index][3]], vertices, res, used_verts);
+  quad.v0 = add_vertex(corners[quads_indices[face_index][0]], vertices, origin, res, used_verts);
+  quad.v1 = add_vertex(corners[quads_indices[face_index][1]], vertices, origin, res, used_verts);
+  quad.v2 = add_vertex(corners[quads_indices[face_index][2]], vertices, origin, res, used_verts);
+  quad.v3 = add_vertex(corners[quads_indices[face_index][3]], vertices, origin, res, used_verts);
   quad.normal = quads_normals[face_index];
 
   quads.push_back(quad);
 }
 
+/* Boundary face of a leaf or rectangle of merged faces, in leaf units. The plane is along
+ * the axis of the face, u and v along the next two axes. */
+struct VolumeLeafFace {
+  int face;
+  int plane;
+  int u, v;
+  int size_u, size_v;
+
+  bool operator<(const VolumeLeafFace &other) const
+  {
+    if (face != other.face) {
+      return face < other.face;
+    }
+    if (plane != other.plane) {
+      return plane < other.plane;
+    }
+    if (v != other.v) {
+      return v < other.v;
+    }
+    return u < other.u;
+  }
+};
+
+static const size_t LEAVES_PER_TASK = 1024;
+
+static size_t leaf_face_key(int u, int v)
+{
+  return (((size_t)(uint)u) << 32) | (uint)v;
+}
+
+/* Greedily merge faces in the same plane into rectangles, growing along u first and then
+ * along v while the whole row is available. Faces are sorted by v and u. */
+static void merge_faces(const VolumeLeafFace *faces,
+                        size_t num_faces,
+                        vector<VolumeLeafFace> &rects)
+{
+  unordered_set<size_t> available;
+  for (size_t i = 0; i < num_faces; i++) {
+    available.insert(leaf_face_key(faces[i].u, faces[i].v));
+  }
+
+  auto take = [&](int u, int v) { return available.erase(leaf_face_key(u, v)) != 0; };
+
+  for (size_t i = 0; i < num_faces; i++) {
+    VolumeLeafFace rect = faces[i];
+    if (!take(rect.u, rect.v)) {
+      continue;
+    }
+
+    rect.size_u = 1;
+    while (take(rect.u + rect.size_u, rect.v)) {
+      rect.size_u++;
+    }
+
+    rect.size_v = 1;
+    for (;;) {
+      const int v = rect.v + rect.size_v;
+      bool row_available = true;
+      for (int u = rect.u; u < rect.u + rect.size_u && row_available; u++) {
+        row_available = available.count(leaf_face_key(u, v)) != 0;
+      }
+      if (!row_available) {
+        break;
+      }
+      for (int u = rect.u; u < rect.u + rect.size_u; u++) {
+        take(u, v);
+      }
+      rect.size_v++;
+    }
+
+    rects.push_back(rect);
+  }
+}
+
 /* Create a mesh from a volume.
  *
  * The way the algorithm works is as follows:
@@ -122,7 +205,8 @@ static void create_quad(int3 corners[8],
  * - Voxels of the temporary grid are dilated to account for the padding necessary for volume
  * sampling.
  * - Quads are created on the boundary between active and inactive leaf nodes of the temporary
- * grid.
+ * grid, coplanar quads are merged into larger ones to reduce the number of triangles. Merged
+ * quads with corners of other quads on their edges are split there, to keep the mesh watertight.
  */
 class VolumeMeshBuilder {
  public:
@@ -159,6 +243,12 @@ class VolumeMeshBuilder {
   bool empty_grid() const;
 
 #ifdef WITH_OPENVDB
+  void create_majorant(openvdb::GridBase::ConstPtr density_grid,
+                       const float volume_clipping,
+                       array<float> &majorant,
+                       int3 &resolution,
+                       Transform &tfm);
+
   template <typename GridType>
   void merge_grid(openvdb::GridBase::ConstPtr grid, bool do_clipping, float volume_clipping)
   {
@@ -166,8 +256,21 @@ class VolumeMeshBuilder {
 
     if (do_clipping) {
       using ValueType = typename GridType::ValueType;
+      using LeafType = typename GridType::TreeType::LeafNodeType;
       typename GridType::Ptr copy = typed_grid->deepCopy();
+
+      /* Clip voxels of leaves in parallel, then the remaining active tiles. */
+      openvdb::tree::LeafManager<typename GridType::TreeType> leaves(copy->tree());
+      leaves.foreach([&](LeafType &leaf, size_t) {
+        for (typename LeafType::ValueOnIter iter = leaf.beginValueOn(); iter; ++iter) {
+          if (iter.getValue() < ValueType(volume_clipping)) {
+            iter.setValueOff();
+          }
+        }
+      });
+
       typename GridType::ValueOnIter iter = copy->beginValueOn();
+      iter.setMaxDepth(GridType::ValueOnIter::LEAF_DEPTH - 1);
 
       for (; iter; ++iter) {
         if (iter.getValue() < ValueType(volume_clipping)) {
@@ -274,62 +377,186 @@ void VolumeMeshBuilder::generate_vertices_and_quads(vector<ccl::int3> &vertices_
   const openvdb::MaskGrid::TreeType &tree = topology_grid->tree();
   tree.evalLeafBoundingBox(bbox);
 
+  const int3 origin = make_int3(bbox.min().x(), bbox.min().y(), bbox.min().z());
   const int3 resolution = make_int3(bbox.dim().x(), bbox.dim().y(), bbox.dim().z());
 
-  unordered_map<size_t, int> used_verts;
+  static const int LEAF_LOG2DIM = openvdb::MaskGrid::TreeType::LeafNodeType::LOG2DIM;
+  static const int LEAF_DIM = openvdb::MaskGrid::TreeType::LeafNodeType::DIM;
 
+  vector<openvdb::Coord> leaf_origins;
+  leaf_origins.reserve(tree.leafCount());
   for (auto iter = tree.cbeginLeaf(); iter; ++iter) {
-    openvdb::CoordBBox leaf_bbox = iter->getNodeBoundingBox();
-    /* +1 to convert from exclusive to include bounds. */
-    leaf_bbox.max() = leaf_bbox.max().offsetBy(1);
-
-    int3 min = make_int3(leaf_bbox.min().x(), leaf_bbox.min().y(), leaf_bbox.min().z());
-    int3 max = make_int3(leaf_bbox.max().x(), leaf_bbox.max().y(), leaf_bbox.max().z());
-
-    int3 corners[8] = {
-        make_int3(min[0], min[1], min[2]),
-        make_int3(max[0], min[1], min[2]),
-        make_int3(max[0], max[1], min[2]),
-        make_int3(min[0], max[1], min[2]),
-        make_int3(min[0], min[1], max[2]),
-        make_int3(max[0], min[1], max[2]),
-        make_int3(max[0], max[1], max[2]),
-        make_int3(min[0], max[1], max[2]),
-    };
-
-    /* Only create a quad if on the border between an active and an inactive leaf.
-     *
-     * We verify that a leaf exists by probing a coordinate that is at its center,
-     * to do so we compute the center of the current leaf and offset this coordinate
-     * by the size of a leaf in each direction.
-     */
-    static const int LEAF_DIM = openvdb::MaskGrid::TreeType::LeafNodeType::DIM;
-    auto center = leaf_bbox.min() + openvdb::Coord(LEAF_DIM / 2);
-
-    if (!tree.probeLeaf(openvdb::Coord(center.x() - LEAF_DIM, center.y(), center.z()))) {
-      create_quad(corners, vertices_is, quads, resolution, used_verts, QUAD_X_MIN);
-    }
+    leaf_origins.push_back(iter->origin());
+  }
 
-    if (!tree.probeLeaf(openvdb::Coord(center.x() + LEAF_DIM, center.y(), center.z()))) {
-      create_quad(corners, vertices_is, quads, resolution, used_verts, QUAD_X_MAX);
-    }
+  /* Only create a face if on the border between an active and an inactive leaf, one bit per
+   * face. Leaves are probed in parallel, the tree is not modified. */
+  vector<uchar> leaf_faces(leaf_origins.size());
+
+  parallel_for(blocked_range<size_t>(0, leaf_origins.size(), LEAVES_PER_TASK),
+               [&](const blocked_range<size_t> &r) {
+                 for (size_t i = r.begin(); i != r.end(); i++) {
+                   uchar faces = 0;
+                   for (int face = 0; face < 6; face++) {
+                     openvdb::Coord neighbor = leaf_origins[i];
+                     neighbor[face / 2] += (face & 1) ? LEAF_DIM : -LEAF_DIM;
+                     if (!tree.probeConstLeaf(neighbor)) {
+                       faces |= 1 << face;
+                     }
+                   }
+                   leaf_faces[i] = faces;
+                 }
+               });
+
+  /* Group faces by orientation and plane, in leaf units. */
+  vector<VolumeLeafFace> faces;
+  for (size_t i = 0; i < leaf_origins.size(); i++) {
+    for (int face = 0; face < 6; face++) {
+      if (!(leaf_faces[i] & (1 << face))) {
+        continue;
+      }
 
-    if (!tree.probeLeaf(openvdb::Coord(center.x(), center.y() - LEAF_DIM, center.z()))) {
-      create_quad(corners, vertices_is, quads, resolution, used_verts, QUAD_Y_MIN);
+      const int axis = face / 2;
+      const openvdb::Coord &leaf = leaf_origins[i];
+
+      VolumeLeafFace leaf_face;
+      leaf_face.face = face;
+      leaf_face.plane = (leaf[axis] >> LEAF_LOG2DIM) + (face & 1);
+      leaf_face.u = leaf[(axis + 1) % 3] >> LEAF_LOG2DIM;
+      leaf_face.v = leaf[(axis + 2) % 3] >> LEAF_LOG2DIM;
+      leaf_face.size_u = 1;
+      leaf_face.size_v = 1;
+      faces.push_back(leaf_face);
     }
+  }
 
-    if (!tree.probeLeaf(openvdb::Coord(center.x(), center.y() + LEAF_DIM, center.z()))) {
-      create_quad(corners, vertices_is, quads, resolution, used_verts, QUAD_Y_MAX);
+  sort(faces.begin(), faces.end());
+
+  vector<size_t> plane_offsets;
+  for (size_t i = 0; i < faces.size(); i++) {
+    if (i == 0 || faces[i].face != faces[i - 1].face || faces[i].plane != faces[i - 1].plane) {
+      plane_offsets.push_back(i);
     }
+  }
+  plane_offsets.push_back(faces.size());
+
+  /* Merge the faces of each plane into rectangles in parallel. */
+  const size_t num_planes = plane_offsets.size() - 1;
+  vector<vector<VolumeLeafFace>> plane_rects(num_planes);
 
-    if (!tree.probeLeaf(openvdb::Coord(center.x(), center.y(), center.z() - LEAF_DIM))) {
-      create_quad(corners, vertices_is, quads, resolution, used_verts, QUAD_Z_MIN);
+  parallel_for(blocked_range<size_t>(0, num_planes, 1), [&](const blocked_range<size_t> &r) {
+    for (size_t i = r.begin(); i != r.end(); i++) {
+      merge_faces(faces.data() + plane_offsets[i],
+                  plane_offsets[i + 1] - plane_offsets[i],
+                  plane_rects[i]);
     }
+  });
+
+  /* Corners of all rectangles, in leaf units. */
+  unordered_set<size_t> rect_corners;
+  const int3 leaf_origin = make_int3(origin.x >> LEAF_LOG2DIM,
+                                     origin.y >> LEAF_LOG2DIM,
+                                     origin.z >> LEAF_LOG2DIM);
+  const size_t leaf_res_x = resolution.x / LEAF_DIM + 1;
+  const size_t leaf_res_y = resolution.y / LEAF_DIM + 1;
+  auto leaf_corner_key = [&](const int3 &corner) {
+    const size_t x = (corner.x >> LEAF_LOG2DIM) - leaf_origin.x;
+    const size_t y = (corner.y >> LEAF_LOG2DIM) - leaf_origin.y;
+    const size_t z = (corner.z >> LEAF_LOG2DIM) - leaf_origin.z;
+    return x + (y + z * leaf_res_y) * leaf_res_x;
+  };
+
+  foreach (const vector<VolumeLeafFace> &rects, plane_rects) {
+    foreach (const VolumeLeafFace &rect, rects) {
+      const int axis = rect.face / 2;
+      const int axis_u = (axis + 1) % 3;
+      const int axis_v = (axis + 2) % 3;
+      for (int corner = 0; corner < 4; corner++) {
+        int3 p;
+        p[axis] = rect.plane * LEAF_DIM;
+        p[axis_u] = (rect.u + ((corner & 1) ? rect.size_u : 0)) * LEAF_DIM;
+        p[axis_v] = (rect.v + ((corner & 2) ? rect.size_v : 0)) * LEAF_DIM;
+        rect_corners.insert(leaf_corner_key(p));
+      }
+    }
+  }
 
-    if (!tree.probeLeaf(openvdb::Coord(center.x(), center.y(), center.z() + LEAF_DIM))) {
-      create_quad(corners, vertices_is, quads, resolution, used_verts, QUAD_Z_MAX);
+  unordered_map<size_t, int> used_verts;
+  vector<int3> boundary;
+
+  foreach (const vector<VolumeLeafFace> &rects, plane_rects) {
+    foreach (const VolumeLeafFace &rect, rects) {
+      const int axis = rect.face / 2;
+      const int axis_u = (axis + 1) % 3;
+      const int axis_v = (axis + 2) % 3;
+
+      /* Flat box in index space, the face selects the corners on its side. */
+      int3 min, max;
+      min[axis] = max[axis] = rect.plane * LEAF_DIM;
+      min[axis_u] = rect.u * LEAF_DIM;
+      max[axis_u] = (rect.u + rect.size_u) * LEAF_DIM;
+      min[axis_v] = rect.v * LEAF_DIM;
+      max[axis_v] = (rect.v + rect.size_v) * LEAF_DIM;
+
+      int3 corners[8] = {
+          make_int3(min[0], min[1], min[2]),
+          make_int3(max[0], min[1], min[2]),
+          make_int3(max[0], max[1], min[2]),
+          make_int3(min[0], max[1], min[2]),
+          make_int3(min[0], min[1], max[2]),
+          make_int3(max[0], min[1], max[2]),
+          make_int3(max[0], max[1], max[2]),
+          make_int3(min[0], max[1], max[2]),
+      };
+
+      /* Corners of other rectangles on the edges would leave T-junctions and cracks in the
+       * mesh, include them in the boundary of the rectangle. */
+      boundary.clear();
+      for (int i = 0; i < 4; i++) {
+        const int3 a = corners[quads_indices[rect.face][i]];
+        const int3 b = corners[quads_indices[rect.face][(i + 1) % 4]];
+        const int3 step = make_int3(((b.x > a.x) - (b.x < a.x)) * LEAF_DIM,
+                                    ((b.y > a.y) - (b.y < a.y)) * LEAF_DIM,
+                                    ((b.z > a.z) - (b.z < a.z)) * LEAF_DIM);
+
+        boundary.push_back(a);
+        for (int3 p = a + step; p != b; p = p + step) {
+          if (rect_corners.count(leaf_corner_key(p))) {
+            boundary.push_back(p);
+          }
+        }
+      }
+
+      if (boundary.size() == 4) {
+        create_quad(corners, vertices_is, quads, origin, resolution, used_verts, rect.face);
+        continue;
+      }
+
+      /* Fan of triangles around the center, two per quad. */
+      const int3 center = make_int3((min.x + max.x) / 2, (min.y + max.y) / 2, (min.z + max.z) / 2);
+      const int center_index = add_vertex(center, vertices_is, origin, resolution, used_verts);
+
+      for (size_t i = 0; i < boundary.size(); i += 2) {
+        QuadData quad;
+        quad.v0 = center_index;
+        quad.v1 = add_vertex(boundary[i], vertices_is, origin, resolution, used_verts);
+        quad.v2 = add_vertex(
+            boundary[(i + 1) % boundary.size()], vertices_is, origin, resolution, used_verts);
+        quad.v3 = (i + 1 < boundary.size()) ?
+                      add_vertex(boundary[(i + 2) % boundary.size()],
+                                 vertices_is,
+                                 origin,
+                                 resolution,
+                                 used_verts) :
+                      quad.v2;
+        quad.normal = quads_normals[rect.face];
+        quads.push_back(quad);
+      }
     }
   }
+
+  VLOG(1) << "Volume mesh with " << quads.size() << " quads for " << faces.size()
+          << " leaf faces.";
 #else
   (void)vertices_is;
   (void)quads;
@@ -378,14 +605,125 @@ void VolumeMeshBuilder::convert_quads_to_tris(const vector<QuadData> &quads,
 
     face_normals.push_back(quads[i].normal);
 
+    if (quads[i].v3 == quads[i].v2) {
+      continue;
+    }
+
     tris[index_offset++] = quads[i].v0;
     tris[index_offset++] = quads[i].v3;
     tris[index_offset++] = quads[i].v2;
 
     face_normals.push_back(quads[i].normal);
   }
+
+  tris.resize(index_offset);
+}
+
+#ifdef WITH_OPENVDB
+/* Maximum of the voxels in a leaf, or of the tile containing it. */
+static float volume_leaf_max(const openvdb::FloatGrid &grid, const openvdb::Coord &origin)
+{
+  const openvdb::FloatGrid::TreeType::LeafNodeType *leaf = grid.tree().probeConstLeaf(origin);
+  if (leaf == NULL) {
+    return grid.tree().getValue(origin);
+  }
+
+  float value = -FLT_MAX;
+  for (auto iter = leaf->cbeginValueAll(); iter; ++iter) {
+    value = max(value, *iter);
+  }
+  return value;
 }
 
+/* One cell per leaf of the topology grid, matching the volume mesh. Cells hold the maximum of
+ * the density grid in the cell and its neighbors, to cover interpolation and the padding, and
+ * are zero where neither has a leaf. Occupied cells are at least the clipping value, since
+ * voxels below it may be missing from the grid. Without a density grid aligned to the
+ * topology there is no majorant. */
+void VolumeMeshBuilder::create_majorant(openvdb::GridBase::ConstPtr density_grid,
+                                        const float volume_clipping,
+                                        array<float> &majorant,
+                                        int3 &resolution,
+                                        Transform &tfm)
+{
+  const openvdb::math::Transform &grid_transform = topology_grid->transform();
+  if (!grid_transform.isLinear() || !density_grid ||
+      !density_grid->isType<openvdb::FloatGrid>() ||
+      density_grid->transform() != grid_transform) {
+    return;
+  }
+
+  const openvdb::FloatGrid &density = *openvdb::gridConstPtrCast<openvdb::FloatGrid>(
+      density_grid);
+
+  static const int LEAF_LOG2DIM = openvdb::MaskGrid::TreeType::LeafNodeType::LOG2DIM;
+  static const int LEAF_DIM = openvdb::MaskGrid::TreeType::LeafNodeType::DIM;
+
+  const openvdb::MaskGrid::TreeType &tree = topology_grid->tree();
+  openvdb::CoordBBox leaf_bbox;
+  tree.evalLeafBoundingBox(leaf_bbox);
+
+  /* Border of one cell around the leaves. */
+  const int3 cell_min = make_int3((leaf_bbox.min().x() >> LEAF_LOG2DIM) - 1,
+                                  (leaf_bbox.min().y() >> LEAF_LOG2DIM) - 1,
+                                  (leaf_bbox.min().z() >> LEAF_LOG2DIM) - 1);
+  const int3 cell_max = make_int3((leaf_bbox.max().x() >> LEAF_LOG2DIM) + 1,
+                                  (leaf_bbox.max().y() >> LEAF_LOG2DIM) + 1,
+                                  (leaf_bbox.max().z() >> LEAF_LOG2DIM) + 1);
+  resolution = make_int3(cell_max.x - cell_min.x + 1,
+                         cell_max.y - cell_min.y + 1,
+                         cell_max.z - cell_min.z + 1);
+  const size_t num_cells = ((size_t)resolution.x) * resolution.y * resolution.z;
+
+  /* Density per leaf, negative for cells without a leaf. */
+  vector<float> leaf_values(num_cells, -1.0f);
+
+  for (auto iter = tree.cbeginLeaf(); iter; ++iter) {
+    const openvdb::Coord origin = iter->origin();
+    const int x = (origin.x() >> LEAF_LOG2DIM) - cell_min.x;
+    const int y = (origin.y() >> LEAF_LOG2DIM) - cell_min.y;
+    const int z = (origin.z() >> LEAF_LOG2DIM) - cell_min.z;
+
+    leaf_values[(((size_t)z) * resolution.y + y) * resolution.x + x] = max(
+        volume_leaf_max(density, origin), volume_clipping);
+  }
+
+  majorant.resize(num_cells);
+  for (int z = 0; z < resolution.z; z++) {
+    for (int y = 0; y < resolution.y; y++) {
+      for (int x = 0; x < resolution.x; x++) {
+        float value = 0.0f;
+
+        for (int k = max(z - 1, 0); k <= min(z + 1, resolution.z - 1); k++) {
+          for (int j = max(y - 1, 0); j <= min(y + 1, resolution.y - 1); j++) {
+            for (int i = max(x - 1, 0); i <= min(x + 1, resolution.x - 1); i++) {
+              value = max(value, leaf_values[(((size_t)k) * resolution.y + j) * resolution.x + i]);
+            }
+          }
+        }
+
+        majorant[(((size_t)z) * resolution.y + y) * resolution.x + x] = value;
+      }
+    }
+  }
+
+  /* Object space to index space, where voxel centers are at integer coordinates, to cells. */
+  openvdb::math::Mat4d grid_matrix = grid_transform.baseMap()->getAffineMap()->getMat4();
+  Transform index_to_object;
+  for (int col = 0; col < 4; col++) {
+    for (int row = 0; row < 3; row++) {
+      index_to_object[row][col] = (float)grid_matrix[col][row];
+    }
+  }
+
+  tfm = transform_scale(make_float3(1.0f / LEAF_DIM, 1.0f / LEAF_DIM, 1.0f / LEAF_DIM)) *
+        transform_translate(make_float3(0.5f - cell_min.x * LEAF_DIM,
+                                        0.5f - cell_min.y * LEAF_DIM,
+                                        0.5f - cell_min.z * LEAF_DIM)) *
+        transform_inverse(index_to_object);
+}
+#endif
+
 bool VolumeMeshBuilder::empty_grid() const
 {
 #ifdef WITH_OPENVDB
@@ -447,7 +785,12 @@ void GeometryManager::create_volume_mesh(Mesh *mesh, Progress &progress)
 
   VolumeMeshBuilder builder;
 
+  mesh->volume_majorant.clear();
+  mesh->volume_majorant_resolution = make_int3(0, 0, 0);
+
 #ifdef WITH_OPENVDB
+  openvdb::GridBase::ConstPtr density_grid;
+
   foreach (Attribute &attr, mesh->attributes.attributes) {
     if (attr.element != ATTR_ELEMENT_VOXEL) {
       continue;
@@ -490,6 +833,10 @@ void GeometryManager::create_volume_mesh(Mesh *mesh, Progress &progress)
 
     if (grid) {
       builder.add_grid(grid, do_clipping, mesh->volume_clipping);
+
+      if (attr.std == ATTR_STD_VOLUME_DENSITY) {
+        density_grid = grid;
+      }
     }
   }
 #endif
@@ -525,6 +872,14 @@ void GeometryManager::create_volume_mesh(Mesh *mesh, Progress &progress)
 
   builder.add_padding(pad_size);
 
+#ifdef WITH_OPENVDB
+  builder.create_majorant(density_grid,
+                          mesh->volume_clipping,
+                          mesh->volume_majorant,
+                          mesh->volume_majorant_resolution,
+                          mesh->volume_majorant_tfm);
+#endif
+
   /* Slightly offset vertex coordinates to avoid overlapping faces with other
    * volumes or meshes. The proper solution would be to improve intersection in
    * the kernel to support robust handling of multiple overlapping faces or use
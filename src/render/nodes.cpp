@@ -32,6 +32,7 @@
 
 #include "util/util_foreach.h"
 #include "util/util_logging.h"
+#include "util/util_md5.h"
 #include "util/util_transform.h"
 
 #include "kernel/svm/svm_color_util.h"
@@ -207,6 +208,29 @@ void TextureMapping::compile(OSLCompiler &compiler)
   }
 }
 
+/* Image Slot Texture */
+
+static void image_handle_hash(MD5Hash &md5, ImageHandle &handle)
+{
+  const int num_tiles = handle.num_tiles();
+  md5.append((const uint8_t *)&num_tiles, sizeof(num_tiles));
+  for (int i = 0; i < num_tiles; i++) {
+    const int slot = handle.svm_slot(false, i);
+    md5.append((const uint8_t *)&slot, sizeof(slot));
+  }
+
+  /* Compiled into the node flags, and may change on reload while the slot stays the same. */
+  if (num_tiles > 0) {
+    const uint8_t compress_as_srgb = handle.metadata().compress_as_srgb;
+    md5.append(&compress_as_srgb, sizeof(compress_as_srgb));
+  }
+}
+
+void ImageSlotTextureNode::hash_compile_state(MD5Hash &md5)
+{
+  image_handle_hash(md5, handle);
+}
+
 /* Image Texture */
 
 NODE_DEFINE(ImageTextureNode)
@@ -831,6 +855,11 @@ SkyTextureNode::SkyTextureNode() : TextureNode(node_type)
 {
 }
 
+void SkyTextureNode::hash_compile_state(MD5Hash &md5)
+{
+  image_handle_hash(md5, handle);
+}
+
 void SkyTextureNode::compile(SVMCompiler &compiler)
 {
   ShaderInput *vector_in = input("Vector");
@@ -1279,6 +1308,11 @@ void IESLightNode::get_slot()
   }
 }
 
+void IESLightNode::hash_compile_state(MD5Hash &md5)
+{
+  md5.append((const uint8_t *)&slot, sizeof(slot));
+}
+
 void IESLightNode::compile(SVMCompiler &compiler)
 {
   light_manager = compiler.scene->light_manager;
@@ -1821,6 +1855,11 @@ ImageParams PointDensityTextureNode::image_params() const
   return params;
 }
 
+void PointDensityTextureNode::hash_compile_state(MD5Hash &md5)
+{
+  image_handle_hash(md5, handle);
+}
+
 void PointDensityTextureNode::compile(SVMCompiler &compiler)
 {
   ShaderInput *vector_in = input("Vector");
@@ -1889,6 +1928,92 @@ void PointDensityTextureNode::compile(OSLCompiler &compiler)
   }
 }
 
+/* Baked Texture */
+
+NODE_DEFINE(BakedTextureNode)
+{
+  NodeType *type = NodeType::add("baked_texture", create, NodeType::SHADER);
+
+  SOCKET_INT(resolution, "Resolution", 64);
+  SOCKET_POINT(bounds_min, "Bounds Min", make_float3(0.0f, 0.0f, 0.0f));
+  SOCKET_POINT(bounds_max, "Bounds Max", make_float3(1.0f, 1.0f, 1.0f));
+
+  static NodeEnum interpolation_enum;
+  interpolation_enum.insert("closest", INTERPOLATION_CLOSEST);
+  interpolation_enum.insert("linear", INTERPOLATION_LINEAR);
+  interpolation_enum.insert("cubic", INTERPOLATION_CUBIC);
+  SOCKET_ENUM(interpolation, "Interpolation", interpolation_enum, INTERPOLATION_LINEAR);
+
+  SOCKET_IN_COLOR(color, "Color", make_float3(0.8f, 0.8f, 0.8f));
+  SOCKET_IN_POINT(
+      vector, "Vector", make_float3(0.0f, 0.0f, 0.0f), SocketType::LINK_TEXTURE_GENERATED);
+
+  SOCKET_OUT_COLOR(color, "Color");
+
+  return type;
+}
+
+BakedTextureNode::BakedTextureNode() : ShaderNode(node_type)
+{
+}
+
+ShaderNode *BakedTextureNode::clone() const
+{
+  BakedTextureNode *node = new BakedTextureNode(*this);
+  node->handle = handle;
+  return node;
+}
+
+ImageParams BakedTextureNode::image_params() const
+{
+  ImageParams params;
+  params.interpolation = interpolation;
+  params.extension = EXTENSION_EXTEND;
+  return params;
+}
+
+void BakedTextureNode::hash_compile_state(MD5Hash &md5)
+{
+  image_handle_hash(md5, handle);
+}
+
+void BakedTextureNode::compile(SVMCompiler &compiler)
+{
+  ShaderInput *color_in = input("Color");
+  ShaderInput *vector_in = input("Vector");
+  ShaderOutput *color_out = output("Color");
+
+  const int slot = handle.svm_slot();
+  if (slot == -1) {
+    if (color_in->link) {
+      compiler.stack_link(color_in, color_out);
+    }
+    else {
+      compiler.add_node(NODE_VALUE_V, compiler.stack_assign(color_out));
+      compiler.add_node(NODE_VALUE_V, color);
+    }
+    return;
+  }
+
+  const float3 size = bounds_max - bounds_min;
+  const float3 inv_size = make_float3((size.x != 0.0f) ? 1.0f / size.x : 0.0f,
+                                      (size.y != 0.0f) ? 1.0f / size.y : 0.0f,
+                                      (size.z != 0.0f) ? 1.0f / size.z : 0.0f);
+
+  compiler.add_node(NODE_TEX_BAKED,
+                    slot,
+                    compiler.encode_uchar4(compiler.stack_assign(vector_in),
+                                           compiler.stack_assign(color_out)));
+  compiler.add_node(make_float4(bounds_min.x, bounds_min.y, bounds_min.z, 0.0f));
+  compiler.add_node(make_float4(inv_size.x, inv_size.y, inv_size.z, 0.0f));
+}
+
+void BakedTextureNode::compile(OSLCompiler &compiler)
+{
+  /* Baking is done for SVM only, OSL evaluates the subgraph. */
+  compiler.add(this, "node_baked_texture");
+}
+
 /* Volume Texture */
 
 NODE_DEFINE(VolumeTextureNode)
@@ -1978,6 +2103,11 @@ ImageParams VolumeTextureNode::image_params() const
   return params;
 }
 
+void VolumeTextureNode::hash_compile_state(MD5Hash &md5)
+{
+  image_handle_hash(md5, handle);
+}
+
 void VolumeTextureNode::compile(SVMCompiler &compiler)
 {
   ShaderInput *position_in = input("Position");
@@ -3560,6 +3690,26 @@ void PrincipledVolumeNode::attributes(Shader *shader, AttributeRequestSet *attri
   ShaderNode::attributes(shader, attributes);
 }
 
+float PrincipledVolumeNode::extinction_bound(bool *has_emission)
+{
+  *has_emission = input("Emission Strength")->link || emission_strength > 0.0f ||
+                  input("Blackbody Intensity")->link || blackbody_intensity > 0.0f;
+
+  /* Linked inputs and attributes other than the density can scale it arbitrarily. */
+  if (input("Color")->link || input("Density")->link || input("Absorption Color")->link ||
+      !color_attribute.empty() ||
+      Attribute::name_standard(density_attribute.c_str()) != ATTR_STD_VOLUME_DENSITY) {
+    return 0.0f;
+  }
+
+  /* Extinction as computed by the kernel. */
+  const float3 zero = make_float3(0.0f, 0.0f, 0.0f);
+  const float3 one = make_float3(1.0f, 1.0f, 1.0f);
+  const float3 absorption = max(one - color, zero) *
+                            max(one - sqrt(max(absorption_color, zero)), zero);
+  return max(density, 0.0f) * max3(max(color + absorption, zero));
+}
+
 void PrincipledVolumeNode::compile(SVMCompiler &compiler)
 {
   ShaderInput *color_in = input("Color");
@@ -6069,6 +6219,11 @@ void OutputAOVNode::simplify_settings(Scene *scene)
   }
 }
 
+void OutputAOVNode::hash_compile_state(MD5Hash &md5)
+{
+  md5.append((const uint8_t *)&slot, sizeof(slot));
+}
+
 void OutputAOVNode::compile(SVMCompiler &compiler)
 {
   assert(slot >= 0);
@@ -86,6 +86,8 @@ class ImageSlotTextureNode : public TextureNode {
     return TextureNode::equals(other) && handle == other_node.handle;
   }
 
+  virtual void hash_compile_state(MD5Hash &md5);
+
   ImageHandle handle;
 };
 
@@ -166,6 +168,8 @@ class SkyTextureNode : public TextureNode {
     return NODE_GROUP_LEVEL_2;
   }
 
+  virtual void hash_compile_state(MD5Hash &md5);
+
   NodeSkyType type;
   float3 sun_direction;
   float turbidity;
@@ -209,6 +213,7 @@ class OutputAOVNode : public ShaderNode {
  public:
   SHADER_NODE_CLASS(OutputAOVNode)
   virtual void simplify_settings(Scene *scene);
+  virtual void hash_compile_state(MD5Hash &md5);
 
   float value;
   float3 color;
@@ -395,6 +400,47 @@ class PointDensityTextureNode : public ShaderNode {
     const PointDensityTextureNode &other_node = (const PointDensityTextureNode &)other;
     return ShaderNode::equals(other) && handle == other_node.handle;
   }
+
+  virtual void hash_compile_state(MD5Hash &md5);
+};
+
+/* Texture baked from the subgraph linked to Color, once into a 3D texture within the bounds
+ * and then looked up at the Vector coordinate. The bake is done by the procedural bake
+ * manager before compiling, the node passes Color through until then or when the subgraph
+ * can't be baked. */
+class BakedTextureNode : public ShaderNode {
+ public:
+  SHADER_NODE_NO_CLONE_CLASS(BakedTextureNode)
+  virtual int get_group()
+  {
+    return NODE_GROUP_LEVEL_2;
+  }
+
+  ShaderNode *clone() const;
+
+  /* Parameters. */
+  float3 color;
+  float3 vector;
+  int resolution;
+  float3 bounds_min;
+  float3 bounds_max;
+  InterpolationType interpolation;
+
+  /* Runtime. */
+  ImageHandle handle;
+  /* Hash of the baked subgraph and settings, set once the subgraph is replaced. */
+  string bake_key;
+
+  ImageParams image_params() const;
+
+  virtual bool equals(const ShaderNode &other)
+  {
+    const BakedTextureNode &other_node = (const BakedTextureNode &)other;
+    return ShaderNode::equals(other) && handle == other_node.handle &&
+           bake_key == other_node.bake_key;
+  }
+
+  virtual void hash_compile_state(MD5Hash &md5);
 };
 
 class VolumeTextureNode : public TextureNode {
@@ -427,6 +473,8 @@ class VolumeTextureNode : public TextureNode {
     return ShaderNode::equals(other) && handle == other_node.handle;
   }
 
+  void hash_compile_state(MD5Hash &md5) override;
+
   ImageParams image_params() const;
 
   /* Parameters */
@@ -452,6 +500,8 @@ class IESLightNode : public TextureNode {
     return NODE_GROUP_LEVEL_2;
   }
 
+  virtual void hash_compile_state(MD5Hash &md5);
+
   ustring filename;
   ustring ies;
 
@@ -858,6 +908,9 @@ class PrincipledVolumeNode : public VolumeNode {
     return true;
   }
 
+  /* Bound of the extinction relative to the density attribute, zero when it is not known. */
+  float extinction_bound(bool *has_emission);
+
   ustring density_attribute;
   ustring color_attribute;
   ustring temperature_attribute;
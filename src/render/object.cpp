@@ -22,9 +22,11 @@
 #include "render/integrator.h"
 #include "render/light.h"
 #include "render/mesh.h"
+#include "render/nodes.h"
 #include "render/particles.h"
 #include "render/pointcloud.h"
 #include "render/scene.h"
+#include "render/shader.h"
 
 #include "util/util_foreach.h"
 #include "util/util_logging.h"
@@ -764,6 +766,113 @@ void ObjectManager::device_update_flags(
   /* Copy object flag. */
   dscene->object_flag.copy_to_device();
   dscene->object_volume_step.copy_to_device();
+
+  device_update_volume_majorants(dscene, scene);
+}
+
+/* Bound of the extinction of the volume shader of a mesh relative to its density grid, zero
+ * when it is not known. */
+static float volume_majorant_scale(Mesh *mesh, bool *has_emission)
+{
+  *has_emission = true;
+
+  if (mesh->used_shaders.size() != 1) {
+    return 0.0f;
+  }
+
+  ShaderInput *volume_in = mesh->used_shaders[0]->graph->output()->input("Volume");
+  if (!volume_in->link || volume_in->link->parent->type != PrincipledVolumeNode::node_type) {
+    return 0.0f;
+  }
+
+  PrincipledVolumeNode *node = static_cast<PrincipledVolumeNode *>(volume_in->link->parent);
+  return node->extinction_bound(has_emission);
+}
+
+void ObjectManager::device_update_volume_majorants(DeviceScene *dscene, Scene *scene)
+{
+  dscene->object_volume_majorant.free();
+  dscene->volume_majorant.free();
+
+  /* Grids of volume meshes, shared by their instances. Objects with motion blur are not
+   * supported, their transform changes over the shutter. */
+  const bool motion_blur = scene->need_motion() == Scene::MOTION_BLUR;
+  map<Mesh *, int> mesh_offsets;
+  int num_cells = 0;
+  bool has_volume_objects = false;
+
+  foreach (Object *object, scene->objects) {
+    Geometry *geom = object->geometry;
+    if (!geom->has_volume) {
+      continue;
+    }
+    has_volume_objects = true;
+
+    if (geom->type != Geometry::MESH || (motion_blur && object->use_motion())) {
+      continue;
+    }
+
+    Mesh *mesh = static_cast<Mesh *>(geom);
+    bool has_emission;
+    if (mesh->volume_majorant.size() == 0 || mesh_offsets.count(mesh) ||
+        volume_majorant_scale(mesh, &has_emission) == 0.0f) {
+      continue;
+    }
+
+    mesh_offsets[mesh] = num_cells;
+    num_cells += mesh->volume_majorant.size();
+  }
+
+  /* Allocated for all objects when there are volumes, the kernel looks up the objects of
+   * the volume stack. */
+  if (!has_volume_objects) {
+    return;
+  }
+
+  KernelVolumeMajorant *kmajorants = dscene->object_volume_majorant.alloc(scene->objects.size());
+  float *cells = dscene->volume_majorant.alloc(max(num_cells, 1));
+
+  foreach (Object *object, scene->objects) {
+    KernelVolumeMajorant &kmajorant = kmajorants[object->index];
+    kmajorant.tfm = transform_identity();
+    kmajorant.offset = -1;
+    kmajorant.res_x = kmajorant.res_y = kmajorant.res_z = 0;
+    kmajorant.scale = 0.0f;
+    kmajorant.emission = 0;
+    kmajorant.pad1 = kmajorant.pad2 = 0;
+
+    Geometry *geom = object->geometry;
+    if (geom->type != Geometry::MESH || (motion_blur && object->use_motion())) {
+      continue;
+    }
+
+    Mesh *mesh = static_cast<Mesh *>(geom);
+    map<Mesh *, int>::iterator it = mesh_offsets.find(mesh);
+    if (it == mesh_offsets.end()) {
+      continue;
+    }
+
+    /* Volume grids are looked up in the space of the object transform, also when the
+     * transform is applied to the mesh. */
+    kmajorant.tfm = mesh->volume_majorant_tfm * transform_inverse(object->tfm);
+    kmajorant.offset = it->second;
+    kmajorant.res_x = mesh->volume_majorant_resolution.x;
+    kmajorant.res_y = mesh->volume_majorant_resolution.y;
+    kmajorant.res_z = mesh->volume_majorant_resolution.z;
+
+    bool has_emission;
+    kmajorant.scale = volume_majorant_scale(mesh, &has_emission);
+    kmajorant.emission = has_emission;
+  }
+
+  cells[0] = 0.0f;
+  foreach (auto &it, mesh_offsets) {
+    const array<float> &majorant = it.first->volume_majorant;
+    memcpy(cells + it.second, majorant.data(), majorant.size() * sizeof(float));
+  }
+
+  dscene->object_volume_majorant.copy_to_device();
+  dscene->volume_majorant.copy_to_device();
 }
 
 void ObjectManager::device_update_mesh_offsets(Device *, DeviceScene *dscene, Scene *scene)
@@ -811,6 +920,8 @@ void ObjectManager::device_free(Device *, DeviceScene *dscene)
   dscene->object_motion.free();
   dscene->object_flag.free();
   dscene->object_volume_step.free();
+  dscene->object_volume_majorant.free();
+  dscene->volume_majorant.free();
 }
 
 void ObjectManager::apply_static_transforms(DeviceScene *dscene, Scene *scene, Progress &progress)
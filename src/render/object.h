@@ -133,6 +133,7 @@ class ObjectManager {
                            Progress &progress,
                            bool bounds_valid = true);
   void device_update_mesh_offsets(Device *device, DeviceScene *dscene, Scene *scene);
+  void device_update_volume_majorants(DeviceScene *dscene, Scene *scene);
 
   void device_free(Device *device, DeviceScene *dscene);
 
@@ -0,0 +1,568 @@
+/*
+ * Copyright 2011-2020 Blender Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "render/procedural_bake.h"
+
+#include "device/device.h"
+#include "render/graph.h"
+#include "render/nodes.h"
+#include "render/scene.h"
+#include "render/shader.h"
+
+#include "util/util_algorithm.h"
+#include "util/util_foreach.h"
+#include "util/util_logging.h"
+#include "util/util_md5.h"
+#include "util/util_path.h"
+#include "util/util_progress.h"
+#include "util/util_time.h"
+
+CCL_NAMESPACE_BEGIN
+
+/* Increase when the file format or the way subgraphs are baked changes. */
+#define PROCEDURAL_BAKE_CACHE_VERSION 1
+/* Number of bakes kept in memory. */
+#define PROCEDURAL_BAKE_CACHE_NUM_RECENT 4
+/* Largest resolution per axis, 256^3 voxels take 256 MB. */
+#define PROCEDURAL_BAKE_MAX_RESOLUTION 256
+
+static const char PROCEDURAL_BAKE_CACHE_MAGIC[8] = {'C', 'Y', 'C', 'L', 'P', 'B', 'K', '\0'};
+
+struct ProceduralBakeCacheHeader {
+  char magic[8];
+  uint32_t version;
+  int32_t resolution;
+};
+
+template<typename T> static void procedural_bake_hash_value(MD5Hash &md5, const T &value)
+{
+  md5.append((const uint8_t *)&value, sizeof(value));
+}
+
+static int procedural_bake_resolution(BakedTextureNode *node)
+{
+  return clamp(node->resolution, 1, PROCEDURAL_BAKE_MAX_RESOLUTION);
+}
+
+/* Subgraphs can be baked when they only vary with the texture coordinate, which the voxel
+ * position stands in for. Images are not baked, the key can't tell when their files change. */
+static bool procedural_bake_supported(ShaderGraph *graph, ShaderInput *input)
+{
+  const int spatial_link_flags = SocketType::LINK_TEXTURE_NORMAL | SocketType::LINK_TEXTURE_UV |
+                                 SocketType::LINK_INCOMING | SocketType::LINK_NORMAL |
+                                 SocketType::LINK_TANGENT;
+
+  ShaderNodeSet dependencies;
+  graph->find_dependencies(dependencies, input);
+
+  foreach (ShaderNode *node, dependencies) {
+    if (node->type == TextureCoordinateNode::node_type) {
+      foreach (ShaderOutput *output, node->outputs) {
+        if (!output->links.empty() && output->name() != "Generated" &&
+            output->name() != "Object") {
+          return false;
+        }
+      }
+      continue;
+    }
+
+    if (node->has_spatial_varying() || node->has_attribute_dependency() ||
+        node->has_integrator_dependency() || node->has_raytrace() ||
+        node->special_type == SHADER_SPECIAL_TYPE_IMAGE_SLOT ||
+        node->special_type == SHADER_SPECIAL_TYPE_OSL ||
+        node->type == BakedTextureNode::node_type || node->type == LightPathNode::node_type ||
+        node->type == ObjectInfoNode::node_type || node->type == IESLightNode::node_type) {
+      return false;
+    }
+
+    foreach (ShaderInput *in, node->inputs) {
+      if (!in->link && (in->flags() & spatial_link_flags)) {
+        return false;
+      }
+    }
+  }
+
+  return true;
+}
+
+/* Procedural Bake */
+
+float3 procedural_bake_voxel_position(const int resolution,
+                                      const float3 bounds_min,
+                                      const float3 bounds_max,
+                                      const int x,
+                                      const int y,
+                                      const int z)
+{
+  const float3 voxel_size = (bounds_max - bounds_min) / (float)resolution;
+  return bounds_min + make_float3(x + 0.5f, y + 0.5f, z + 0.5f) * voxel_size;
+}
+
+void procedural_bake_shade(Device *device,
+                           DeviceScene *dscene,
+                           Shader *shader,
+                           const vector<float3> &positions,
+                           vector<float4> &colors,
+                           Progress &progress)
+{
+  const size_t num_positions = positions.size();
+
+  /* create input */
+  device_vector<uint4> d_input(device, "procedural_bake_input", MEM_READ_ONLY);
+  device_vector<float4> d_output(device, "procedural_bake_output", MEM_READ_WRITE);
+
+  uint4 *d_input_data = d_input.alloc(num_positions);
+
+  for (size_t i = 0; i < num_positions; i++) {
+    const float3 P = positions[i];
+    d_input_data[i] = make_uint4(
+        __float_as_uint(P.x), __float_as_uint(P.y), __float_as_uint(P.z), shader->id + 1);
+  }
+
+  /* compute on device */
+  d_output.alloc(num_positions);
+  d_output.zero_to_device();
+  d_input.copy_to_device();
+
+  device->const_copy_to("__data", &dscene->data, sizeof(dscene->data));
+
+  DeviceTask main_task(DeviceTask::SHADER);
+  main_task.shader_input = d_input.device_pointer;
+  main_task.shader_output = d_output.device_pointer;
+  main_task.shader_eval_type = SHADER_EVAL_BACKGROUND;
+  main_task.shader_x = 0;
+  main_task.shader_w = num_positions;
+  main_task.num_samples = 1;
+  main_task.get_cancel = function_bind(&Progress::get_cancel, &progress);
+
+  list<DeviceTask> split_tasks;
+  main_task.split(split_tasks, 1, 128 * 128);
+
+  foreach (DeviceTask &task, split_tasks) {
+    device->task_add(task);
+    device->task_wait();
+    d_output.copy_from_device(task.shader_x, 1, task.shader_w);
+  }
+
+  d_input.free();
+
+  const float4 *d_output_data = d_output.data();
+
+  colors.resize(num_positions);
+  for (size_t i = 0; i < num_positions; i++) {
+    const float4 color = d_output_data[i];
+    colors[i] = make_float4(color.x, color.y, color.z, 1.0f);
+  }
+
+  d_output.free();
+}
+
+ProceduralBake::ProceduralBake() : resolution(0)
+{
+}
+
+/* Procedural Bake Loader */
+
+ProceduralBakeLoader::ProceduralBakeLoader(const string &key, const ProceduralBake &bake)
+    : key(key), bake(bake)
+{
+}
+
+bool ProceduralBakeLoader::load_metadata(const ImageDeviceFeatures &, ImageMetaData &metadata)
+{
+  metadata.width = bake.resolution;
+  metadata.height = bake.resolution;
+  metadata.depth = bake.resolution;
+  metadata.channels = 4;
+  metadata.type = IMAGE_DATA_TYPE_FLOAT4;
+  metadata.compress_as_srgb = false;
+  return true;
+}
+
+bool ProceduralBakeLoader::load_pixels(const ImageMetaData &,
+                                       void *pixels,
+                                       const size_t pixels_size,
+                                       const bool /*associate_alpha*/)
+{
+  const size_t num_floats = min(pixels_size, bake.voxels.size() * 4);
+  memcpy(pixels, bake.voxels.data(), num_floats * sizeof(float));
+  return true;
+}
+
+string ProceduralBakeLoader::name() const
+{
+  return "procedural_bake_" + key;
+}
+
+bool ProceduralBakeLoader::equals(const ImageLoader &other) const
+{
+  const ProceduralBakeLoader &other_loader = (const ProceduralBakeLoader &)other;
+  return key == other_loader.key;
+}
+
+/* Procedural Bake Cache */
+
+ProceduralBakeCache::ProceduralBakeCache()
+    : num_hits(0), num_misses(0), recent(PROCEDURAL_BAKE_CACHE_NUM_RECENT)
+{
+}
+
+void ProceduralBakeCache::set_path(const string &path_)
+{
+  thread_scoped_lock lock(mutex);
+  path = path_;
+}
+
+string ProceduralBakeCache::filepath(const string &key) const
+{
+  return path_join(path, key + ".pbake");
+}
+
+string ProceduralBakeCache::key(ShaderGraph *graph, BakedTextureNode *node)
+{
+  MD5Hash md5;
+
+  procedural_bake_hash_value(md5, (int)PROCEDURAL_BAKE_CACHE_VERSION);
+  procedural_bake_hash_value(md5, procedural_bake_resolution(node));
+  procedural_bake_hash_value(md5, node->bounds_min);
+  procedural_bake_hash_value(md5, node->bounds_max);
+
+  graph->hash(md5, node->input("Color"));
+
+  return md5.get_hex();
+}
+
+bool ProceduralBakeCache::load(const string &key, ProceduralBake &bake)
+{
+  thread_scoped_lock lock(mutex);
+
+  if (recent.find(key, bake)) {
+    num_hits++;
+    return true;
+  }
+
+  if (!path.empty() && load_file(key, bake)) {
+    recent.insert(key, bake);
+    num_hits++;
+    return true;
+  }
+
+  num_misses++;
+  return false;
+}
+
+bool ProceduralBakeCache::load_file(const string &key, ProceduralBake &bake)
+{
+  const double time_start = time_dt();
+  const string filepath = this->filepath(key);
+
+  vector<uint8_t> data;
+  if (!path_read_binary(filepath, data) || data.size() < sizeof(ProceduralBakeCacheHeader)) {
+    return false;
+  }
+
+  ProceduralBakeCacheHeader header;
+  memcpy(&header, data.data(), sizeof(header));
+  if (memcmp(header.magic, PROCEDURAL_BAKE_CACHE_MAGIC, sizeof(header.magic)) != 0 ||
+      header.version != PROCEDURAL_BAKE_CACHE_VERSION || header.resolution <= 0 ||
+      header.resolution > PROCEDURAL_BAKE_MAX_RESOLUTION) {
+    return false;
+  }
+
+  const size_t num_voxels = (size_t)header.resolution * header.resolution * header.resolution;
+  if (data.size() != sizeof(header) + num_voxels * sizeof(float4)) {
+    return false;
+  }
+
+  bake.resolution = header.resolution;
+  bake.voxels.resize(num_voxels);
+  memcpy(bake.voxels.data(), data.data() + sizeof(header), num_voxels * sizeof(float4));
+
+  VLOG(2) << "Loaded cached procedural bake " << filepath << " ("
+          << string_human_readable_size(data.size()) << ") in " << time_dt() - time_start
+          << " seconds.";
+
+  return true;
+}
+
+void ProceduralBakeCache::store(const string &key, const ProceduralBake &bake)
+{
+  string filepath;
+  {
+    thread_scoped_lock lock(mutex);
+    recent.insert(key, bake);
+    if (path.empty()) {
+      return;
+    }
+    filepath = this->filepath(key);
+  }
+
+  ProceduralBakeCacheHeader header;
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, PROCEDURAL_BAKE_CACHE_MAGIC, sizeof(header.magic));
+  header.version = PROCEDURAL_BAKE_CACHE_VERSION;
+  header.resolution = bake.resolution;
+
+  CacheFileWriter writer(filepath);
+  writer.write(&header, sizeof(header));
+  writer.write_array(bake.voxels.data(), bake.voxels.size());
+  writer.commit();
+}
+
+/* Procedural Bake Manager */
+
+ProceduralBakeManager::ProceduralBakeManager()
+{
+}
+
+ProceduralBakeManager::~ProceduralBakeManager()
+{
+}
+
+bool ProceduralBakeManager::is_pending(const string &key) const
+{
+  foreach (const PendingBake &bake, pending) {
+    if (bake.key == key) {
+      return true;
+    }
+  }
+  return false;
+}
+
+void ProceduralBakeManager::tag_used_shaders()
+{
+  foreach (PendingBake &bake, pending) {
+    bake.shader->used = true;
+  }
+}
+
+void ProceduralBakeManager::assign_image(Scene *scene,
+                                         BakedTextureNode *node,
+                                         const ProceduralBake &bake)
+{
+  ImageManager *image_manager = scene->image_manager;
+  node->handle = image_manager->add_image(new ProceduralBakeLoader(node->bake_key, bake),
+                                          node->image_params());
+}
+
+Shader *ProceduralBakeManager::add_bake_shader(BakedTextureNode *node)
+{
+  ShaderGraph *bake_graph = new ShaderGraph();
+  ShaderOutput *color_out = bake_graph->copy_dependencies(node->input("Color"));
+
+  /* Texture coordinates of the subgraph are the voxel position. */
+  GeometryNode *geometry = new GeometryNode();
+  bake_graph->add(geometry);
+  ShaderOutput *position_out = geometry->output("Position");
+
+  foreach (ShaderNode *bake_node, bake_graph->nodes) {
+    if (bake_node == geometry || bake_node == bake_graph->output()) {
+      continue;
+    }
+    if (bake_node->type == TextureCoordinateNode::node_type) {
+      foreach (ShaderOutput *output, bake_node->outputs) {
+        bake_graph->relink(output, position_out);
+      }
+      continue;
+    }
+
+    foreach (ShaderInput *input, bake_node->inputs) {
+      if (!input->link &&
+          (input->flags() & (SocketType::LINK_TEXTURE_GENERATED | SocketType::LINK_POSITION))) {
+        bake_graph->connect(position_out, input);
+      }
+    }
+  }
+
+  /* Emit the subgraph like a background, evaluated without an object. */
+  BackgroundNode *background = new BackgroundNode();
+  background->strength = 1.0f;
+  bake_graph->add(background);
+
+  bake_graph->connect(color_out, background->input("Color"));
+  bake_graph->connect(background->output("Background"), bake_graph->output()->input("Surface"));
+
+  Shader *shader = new Shader();
+  shader->name = "procedural_bake";
+  shader->set_graph(bake_graph);
+
+  return shader;
+}
+
+void ProceduralBakeManager::device_update_preprocess(Scene *scene)
+{
+  /* OSL evaluates the subgraphs as they are. */
+  if (scene->shader_manager->use_osl()) {
+    return;
+  }
+
+  cache.set_path(scene->params.procedural_bake_cache_path);
+
+  vector<Shader *> new_shaders;
+
+  foreach (Shader *shader, scene->shaders) {
+    ShaderGraph *graph = shader->graph;
+    if (!graph || graph->finalized) {
+      continue;
+    }
+    /* Displacement is applied to meshes before the bakes are done. */
+    if (shader->has_displacement && shader->displacement_method != DISPLACE_BUMP) {
+      continue;
+    }
+
+    bool modified = false;
+
+    foreach (ShaderNode *node, graph->nodes) {
+      if (node->type != BakedTextureNode::node_type) {
+        continue;
+      }
+
+      BakedTextureNode *baked = static_cast<BakedTextureNode *>(node);
+      ShaderInput *color_in = baked->input("Color");
+      if (!color_in->link || !baked->handle.empty() ||
+          !procedural_bake_supported(graph, color_in)) {
+        continue;
+      }
+
+      baked->bake_key = ProceduralBakeCache::key(graph, baked);
+
+      ProceduralBake bake;
+      if (cache.load(baked->bake_key, bake)) {
+        assign_image(scene, baked, bake);
+      }
+      else if (!is_pending(baked->bake_key)) {
+        PendingBake pending_bake;
+        pending_bake.key = baked->bake_key;
+        pending_bake.resolution = procedural_bake_resolution(baked);
+        pending_bake.bounds_min = baked->bounds_min;
+        pending_bake.bounds_max = baked->bounds_max;
+        pending_bake.shader = add_bake_shader(baked);
+        pending.push_back(pending_bake);
+        new_shaders.push_back(pending_bake.shader);
+      }
+
+      /* The subgraph is evaluated from the texture from now on, unused nodes are removed
+       * when the graph is finalized. */
+      graph->disconnect(color_in);
+      modified = true;
+    }
+
+    if (modified) {
+      shader->tag_update(scene);
+    }
+  }
+
+  /* Added after all other shaders, so their ids do not change. Used shaders were already
+   * tagged for this update. */
+  foreach (Shader *shader, new_shaders) {
+    shader->id = scene->shaders.size();
+    shader->used = true;
+    scene->shaders.push_back(shader);
+    shader->tag_update(scene);
+  }
+}
+
+bool ProceduralBakeManager::device_update(Device *device,
+                                          DeviceScene *dscene,
+                                          Scene *scene,
+                                          Progress &progress)
+{
+  if (pending.empty()) {
+    return false;
+  }
+
+  const double time_start = time_dt();
+  map<string, ProceduralBake> bakes;
+
+  foreach (PendingBake &pending_bake, pending) {
+    progress.set_status("Updating Procedural Bakes",
+                        string_printf("%d/%d", (int)bakes.size() + 1, (int)pending.size()));
+
+    const int resolution = pending_bake.resolution;
+    vector<float3> positions;
+    positions.reserve((size_t)resolution * resolution * resolution);
+    for (int z = 0; z < resolution; z++) {
+      for (int y = 0; y < resolution; y++) {
+        for (int x = 0; x < resolution; x++) {
+          positions.push_back(procedural_bake_voxel_position(
+              resolution, pending_bake.bounds_min, pending_bake.bounds_max, x, y, z));
+        }
+      }
+    }
+
+    ProceduralBake &bake = bakes[pending_bake.key];
+    bake.resolution = resolution;
+    procedural_bake_shade(device, dscene, pending_bake.shader, positions, bake.voxels, progress);
+
+    /* Keep the pending bakes for the next update when cancelled. */
+    if (progress.get_cancel() || device->have_error()) {
+      return false;
+    }
+
+    cache.store(pending_bake.key, bake);
+  }
+
+  /* Remove the temporary shaders. */
+  foreach (PendingBake &pending_bake, pending) {
+    vector<Shader *>::iterator it = std::find(
+        scene->shaders.begin(), scene->shaders.end(), pending_bake.shader);
+    if (it != scene->shaders.end()) {
+      scene->shaders.erase(it);
+    }
+    delete pending_bake.shader;
+  }
+  pending.clear();
+  scene->shader_manager->need_update = true;
+
+  /* Give the baked texture nodes waiting for these bakes their image. */
+  foreach (Shader *shader, scene->shaders) {
+    bool modified = false;
+
+    foreach (ShaderNode *node, shader->graph->nodes) {
+      if (node->type != BakedTextureNode::node_type) {
+        continue;
+      }
+
+      BakedTextureNode *baked = static_cast<BakedTextureNode *>(node);
+      if (!baked->handle.empty() || baked->bake_key.empty()) {
+        continue;
+      }
+
+      map<string, ProceduralBake>::iterator it = bakes.find(baked->bake_key);
+      if (it != bakes.end()) {
+        assign_image(scene, baked, it->second);
+        modified = true;
+      }
+    }
+
+    if (modified) {
+      shader->tag_update(scene);
+    }
+  }
+
+  VLOG(1) << "Baked " << bakes.size() << " procedural subgraphs in " << time_dt() - time_start
+          << " seconds, " << cache.num_hits << " cache hits.";
+
+  return true;
+}
+
+void ProceduralBakeManager::device_free(Device * /*device*/, DeviceScene * /*dscene*/)
+{
+  /* Temporary shaders are freed with the other shaders of the scene. */
+  pending.clear();
+}
+
+CCL_NAMESPACE_END
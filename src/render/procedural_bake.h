@@ -0,0 +1,158 @@
+/*
+ * Copyright 2011-2020 Blender Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __PROCEDURAL_BAKE_H__
+#define __PROCEDURAL_BAKE_H__
+
+#include "render/image.h"
+
+#include "util/util_cache.h"
+#include "util/util_string.h"
+#include "util/util_thread.h"
+#include "util/util_types.h"
+#include "util/util_vector.h"
+
+CCL_NAMESPACE_BEGIN
+
+class BakedTextureNode;
+class Device;
+class DeviceScene;
+class Progress;
+class Scene;
+class Shader;
+class ShaderGraph;
+
+/* Voxels of a procedural subgraph baked into a 3D texture, x varying fastest. */
+class ProceduralBake {
+ public:
+  ProceduralBake();
+
+  int resolution;
+  vector<float4> voxels;
+};
+
+/* Center of a voxel of a bake with the given resolution per axis and bounds. */
+float3 procedural_bake_voxel_position(const int resolution,
+                                      const float3 bounds_min,
+                                      const float3 bounds_max,
+                                      const int x,
+                                      const int y,
+                                      const int z);
+
+/* Evaluate a shader that emits a color as background at the given positions, like the
+ * background is shaded for its importance map. The position stands in for the texture
+ * coordinate of the baked subgraph. */
+void procedural_bake_shade(Device *device,
+                           DeviceScene *dscene,
+                           Shader *shader,
+                           const vector<float3> &positions,
+                           vector<float4> &colors,
+                           Progress &progress);
+
+/* Image loader for the baked voxels, images of the same bake are shared. */
+class ProceduralBakeLoader : public ImageLoader {
+ public:
+  ProceduralBakeLoader(const string &key, const ProceduralBake &bake);
+
+  bool load_metadata(const ImageDeviceFeatures &features, ImageMetaData &metadata) override;
+  bool load_pixels(const ImageMetaData &metadata,
+                   void *pixels,
+                   const size_t pixels_size,
+                   const bool associate_alpha) override;
+
+  string name() const override;
+
+  bool equals(const ImageLoader &other) const override;
+
+ protected:
+  string key;
+  ProceduralBake bake;
+};
+
+/* Cache of baked subgraphs, kept in memory for the most recently used ones so editing other
+ * parts of a shader does not bake again, and optionally stored on disk for renders of the
+ * same subgraphs in other sessions. */
+class ProceduralBakeCache {
+ public:
+  ProceduralBakeCache();
+
+  /* Directory to store the cache files in, no files are stored when empty. */
+  void set_path(const string &path);
+
+  /* Hash of the subgraph linked to the Color input of the node and the bake settings. */
+  static string key(ShaderGraph *graph, BakedTextureNode *node);
+
+  /* Load the bake of the given key from memory or disk, returns false when not cached. */
+  bool load(const string &key, ProceduralBake &bake);
+  /* Add the bake to the memory cache and write it to disk. */
+  void store(const string &key, const ProceduralBake &bake);
+
+  /* Statistics since the cache was created. */
+  size_t num_hits;
+  size_t num_misses;
+
+ protected:
+  string filepath(const string &key) const;
+  bool load_file(const string &key, ProceduralBake &bake);
+
+  string path;
+  CacheMRU<ProceduralBake> recent;
+  thread_mutex mutex;
+};
+
+/* Procedural Bake Manager
+ *
+ * Replaces subgraphs linked to baked texture nodes by a 3D texture lookup. Before shaders
+ * are compiled, the subgraphs are taken out of their graphs, and those not found in the
+ * cache are copied into temporary shaders that emit them as background. After the images
+ * and tables are on the device, these are evaluated at the voxel centers, the temporary
+ * shaders are removed and the nodes get their images. */
+class ProceduralBakeManager {
+ public:
+  ProceduralBakeManager();
+  ~ProceduralBakeManager();
+
+  /* Take baked subgraphs out of graphs that are not finalized yet. */
+  void device_update_preprocess(Scene *scene);
+  /* Bake the subgraphs that were not cached, returns true when shaders and images need to be
+   * updated again for the new textures. */
+  bool device_update(Device *device, DeviceScene *dscene, Scene *scene, Progress &progress);
+  void device_free(Device *device, DeviceScene *dscene);
+
+  /* Mark the temporary shaders of pending bakes as used, so they are compiled. */
+  void tag_used_shaders();
+
+  ProceduralBakeCache cache;
+
+ protected:
+  struct PendingBake {
+    string key;
+    int resolution;
+    float3 bounds_min;
+    float3 bounds_max;
+    Shader *shader;
+  };
+
+  Shader *add_bake_shader(BakedTextureNode *node);
+  void assign_image(Scene *scene, BakedTextureNode *node, const ProceduralBake &bake);
+  bool is_pending(const string &key) const;
+
+  vector<PendingBake> pending;
+};
+
+CCL_NAMESPACE_END
+
+#endif /* __PROCEDURAL_BAKE_H__ */
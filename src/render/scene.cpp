@@ -29,6 +29,7 @@
 #include "render/osl.h"
 #include "render/particles.h"
 #include "render/pointcloud.h"
+#include "render/procedural_bake.h"
 #include "render/scene.h"
 #include "render/shader.h"
 #include "render/svm.h"
@@ -68,6 +69,8 @@ DeviceScene::DeviceScene(Device *device)
       object_motion(device, "__object_motion", MEM_GLOBAL),
       object_flag(device, "__object_flag", MEM_GLOBAL),
       object_volume_step(device, "__object_volume_step", MEM_GLOBAL),
+      object_volume_majorant(device, "__object_volume_majorant", MEM_GLOBAL),
+      volume_majorant(device, "__volume_majorant", MEM_GLOBAL),
       camera_motion(device, "__camera_motion", MEM_GLOBAL),
       attributes_map(device, "__attributes_map", MEM_GLOBAL),
       attributes_float(device, "__attributes_float", MEM_GLOBAL),
@@ -78,6 +81,8 @@ DeviceScene::DeviceScene(Device *device)
       lights(device, "__lights", MEM_GLOBAL),
       light_background_marginal_cdf(device, "__light_background_marginal_cdf", MEM_GLOBAL),
       light_background_conditional_cdf(device, "__light_background_conditional_cdf", MEM_GLOBAL),
+      light_tree_nodes(device, "__light_tree_nodes", MEM_GLOBAL),
+      light_tree_emitters(device, "__light_tree_emitters", MEM_GLOBAL),
       particles(device, "__particles", MEM_GLOBAL),
       svm_nodes(device, "__svm_nodes", MEM_GLOBAL),
       shaders(device, "__shaders", MEM_GLOBAL),
@@ -113,6 +118,7 @@ Scene::Scene(const SceneParams &params_, Device *device)
   image_manager = new ImageManager(device->info);
   particle_system_manager = new ParticleSystemManager();
   bake_manager = new BakeManager();
+  procedural_bake_manager = new ProceduralBakeManager();
 
   /* OSL only works on the CPU */
   if (device->info.has_osl)
@@ -161,6 +167,7 @@ void Scene::free_memory(bool final)
     particle_system_manager->device_free(device, &dscene);
 
     bake_manager->device_free(device, &dscene);
+    procedural_bake_manager->device_free(device, &dscene);
 
     if (!params.persistent_data || final)
       image_manager->device_free(device);
@@ -184,6 +191,7 @@ void Scene::free_memory(bool final)
     delete particle_system_manager;
     delete image_manager;
     delete bake_manager;
+    delete procedural_bake_manager;
   }
 }
 
@@ -203,6 +211,8 @@ void Scene::device_update(Device *device_, Progress &progress)
    * - Light manager needs lookup tables and final mesh data to compute emission CDF.
    * - Film needs light manager to run for use_light_visibility
    * - Lookup tables are done a second time to handle film tables
+   * - Procedural bakes take subgraphs out of shaders before they are compiled, and shade
+   *   them once images and tables are on the device.
    */
 
   if (film->need_update) {
@@ -215,6 +225,8 @@ void Scene::device_update(Device *device_, Progress &progress)
     }
   }
 
+  procedural_bake_manager->device_update_preprocess(this);
+
   progress.set_status("Updating Shaders");
   shader_manager->device_update(device, &dscene, this, progress);
 
@@ -277,6 +289,22 @@ void Scene::device_update(Device *device_, Progress &progress)
   progress.set_status("Updating Lookup Tables");
   lookup_tables->device_update(device, &dscene);
 
+  if (progress.get_cancel() || device->have_error())
+    return;
+
+  progress.set_status("Updating Procedural Bakes");
+  if (procedural_bake_manager->device_update(device, &dscene, this, progress)) {
+    /* Compile the shaders again with the baked textures, and load them. */
+    progress.set_status("Updating Shaders");
+    shader_manager->device_update(device, &dscene, this, progress);
+
+    if (progress.get_cancel() || device->have_error())
+      return;
+
+    progress.set_status("Updating Images");
+    image_manager->device_update(device, this, progress);
+  }
+
   if (progress.get_cancel() || device->have_error())
     return;
 
@@ -57,6 +57,7 @@ class ShaderManager;
 class Progress;
 class BakeManager;
 class BakeData;
+class ProceduralBakeManager;
 class RenderStats;
 
 /* Scene Device Data */
@@ -99,6 +100,8 @@ class DeviceScene {
   device_vector<DecomposedTransform> object_motion;
   device_vector<uint> object_flag;
   device_vector<float> object_volume_step;
+  device_vector<KernelVolumeMajorant> object_volume_majorant;
+  device_vector<float> volume_majorant;
 
   /* cameras */
   device_vector<DecomposedTransform> camera_motion;
@@ -115,6 +118,8 @@ class DeviceScene {
   device_vector<KernelLight> lights;
   device_vector<float2> light_background_marginal_cdf;
   device_vector<float2> light_background_conditional_cdf;
+  device_vector<KernelLightTreeNode> light_tree_nodes;
+  device_vector<int> light_tree_emitters;
 
   /* particles */
   device_vector<KernelParticle> particles;
@@ -151,7 +156,10 @@ class TextureCacheParams {
         accept_untiled(false),
         auto_tile(false),
         auto_mip(false),
-        use_custom_cache_path(false)
+        use_custom_cache_path(false),
+        use_paged_images(false),
+        paged_cache_size(4096),
+        use_lazy_udim_tiles(false)
   {
   }
 
@@ -164,7 +172,10 @@ class TextureCacheParams {
              accept_untiled == params.accept_untiled && auto_tile == params.auto_tile &&
              auto_mip == params.auto_mip &&
              use_custom_cache_path == params.use_custom_cache_path &&
-             custom_cache_path == params.custom_cache_path);
+             custom_cache_path == params.custom_cache_path &&
+             use_paged_images == params.use_paged_images &&
+             paged_cache_size == params.paged_cache_size &&
+             use_lazy_udim_tiles == params.use_lazy_udim_tiles);
   }
 
   bool use_cache;
@@ -179,6 +190,12 @@ class TextureCacheParams {
   bool auto_mip;
   bool use_custom_cache_path;
   string custom_cache_path;
+  /* Load tiles of image textures on demand on the CPU, keeping at most the cache size in
+   * MB in memory. */
+  bool use_paged_images;
+  int paged_cache_size;
+  /* Load UDIM tiles on the CPU when a texture lookup first uses them. */
+  bool use_lazy_udim_tiles;
 };
 
 /* Scene Parameters */
@@ -218,12 +235,28 @@ class SceneParams {
   BVHType bvh_type;
   bool use_bvh_spatial_split;
   bool use_bvh_unaligned_nodes;
+  bool use_bvh_compressed_nodes;
   int num_bvh_time_steps;
+  /* Directory to cache geometry BVHs in, disabled when empty. */
+  string bvh_cache_path;
+  /* Directory to cache background importance maps in, disabled when empty. */
+  string background_cache_path;
+  /* Directory to cache baked procedural textures in, disabled when empty. */
+  string procedural_bake_cache_path;
   int hair_subdivisions;
   CurveShapeType hair_shape;
   bool persistent_data;
   int texture_limit;
+  /* Memory for image textures in MB, choosing the resolution of each image from its
+   * estimated footprint on screen to fit. Disabled when zero. */
+  int texture_memory_budget;
+  /* Share the memory of images with identical pixels loaded from different files, on the CPU. */
+  bool use_image_dedup;
+  /* Store 8 bit images block compressed, trading quality for memory on the CPU. */
+  bool use_image_compression;
   TextureCacheParams texture;
+  /* Sample local lights with a light tree instead of the flat distribution. */
+  bool use_light_tree;
 
   bool background;
 
@@ -234,11 +267,16 @@ class SceneParams {
     bvh_type = BVH_DYNAMIC;
     use_bvh_spatial_split = false;
     use_bvh_unaligned_nodes = true;
+    use_bvh_compressed_nodes = false;
     num_bvh_time_steps = 0;
     hair_subdivisions = 3;
     hair_shape = CURVE_RIBBON;
     persistent_data = false;
     texture_limit = 0;
+    texture_memory_budget = 0;
+    use_image_dedup = false;
+    use_image_compression = false;
+    use_light_tree = false;
     background = true;
   }
 
@@ -248,9 +286,17 @@ class SceneParams {
              bvh_type == params.bvh_type &&
              use_bvh_spatial_split == params.use_bvh_spatial_split &&
              use_bvh_unaligned_nodes == params.use_bvh_unaligned_nodes &&
+             use_bvh_compressed_nodes == params.use_bvh_compressed_nodes &&
+             bvh_cache_path == params.bvh_cache_path &&
+             background_cache_path == params.background_cache_path &&
+             procedural_bake_cache_path == params.procedural_bake_cache_path &&
              num_bvh_time_steps == params.num_bvh_time_steps &&
              hair_subdivisions == params.hair_subdivisions && hair_shape == params.hair_shape &&
-             persistent_data == params.persistent_data && texture_limit == params.texture_limit);
+             persistent_data == params.persistent_data && texture_limit == params.texture_limit &&
+             texture_memory_budget == params.texture_memory_budget &&
+             use_image_dedup == params.use_image_dedup &&
+             use_image_compression == params.use_image_compression &&
+             use_light_tree == params.use_light_tree);
   }
 
   int curve_subdivisions()
@@ -293,6 +339,7 @@ class Scene {
   ObjectManager *object_manager;
   ParticleSystemManager *particle_system_manager;
   BakeManager *bake_manager;
+  ProceduralBakeManager *procedural_bake_manager;
 
   /* default shaders */
   Shader *default_surface;
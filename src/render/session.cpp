@@ -22,6 +22,7 @@
 #include "render/buffers.h"
 #include "render/camera.h"
 #include "render/graph.h"
+#include "render/image.h"
 #include "render/integrator.h"
 #include "render/light.h"
 #include "render/mesh.h"
@@ -283,7 +284,9 @@ void Session::run_gpu()
       /* update scene */
       scoped_timer update_timer;
       if (update_scene()) {
-        profiler.reset(scene->shaders.size(), scene->objects.size());
+        profiler.reset(scene->shaders.size(),
+                       scene->objects.size(),
+                       scene->image_manager->num_slots());
       }
       progress.add_skip_time(update_timer, params.background);
 
@@ -703,7 +706,9 @@ void Session::run_cpu()
       /* update scene */
       scoped_timer update_timer;
       if (update_scene()) {
-        profiler.reset(scene->shaders.size(), scene->objects.size());
+        profiler.reset(scene->shaders.size(),
+                       scene->objects.size(),
+                       scene->image_manager->num_slots());
       }
       progress.add_skip_time(update_timer, params.background);
 
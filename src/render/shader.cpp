@@ -26,6 +26,7 @@
 #include "render/nodes.h"
 #include "render/object.h"
 #include "render/osl.h"
+#include "render/procedural_bake.h"
 #include "render/scene.h"
 #include "render/shader.h"
 #include "render/svm.h"
@@ -488,11 +489,24 @@ void ShaderManager::update_shaders_used(Scene *scene)
   /* figure out which shaders are in use, so SVM/OSL can skip compiling them
    * for speed and avoid loading image textures into memory */
   uint id = 0;
+  bool id_changed = false;
   foreach (Shader *shader, scene->shaders) {
     shader->used = false;
+    if (shader->id != id) {
+      id_changed = true;
+    }
     shader->id = id++;
   }
 
+  /* Shader ids are packed into the geometry device arrays, repack all of them if the ids
+   * moved around. */
+  if (id_changed) {
+    foreach (Geometry *geom, scene->geometry) {
+      geom->need_update_packed = true;
+    }
+    scene->geometry_manager->need_update = true;
+  }
+
   scene->default_surface->used = true;
   scene->default_light->used = true;
   scene->default_background->used = true;
@@ -508,6 +522,8 @@ void ShaderManager::update_shaders_used(Scene *scene)
   foreach (Light *light, scene->lights)
     if (light->shader)
       light->shader->used = true;
+
+  scene->procedural_bake_manager->tag_used_shaders();
 }
 
 void ShaderManager::device_update_common(Device *device,
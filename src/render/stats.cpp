@@ -15,6 +15,7 @@
  */
 
 #include "render/stats.h"
+#include "render/image.h"
 #include "render/object.h"
 #include "util/util_algorithm.h"
 #include "util/util_foreach.h"
@@ -164,7 +165,7 @@ void NamedSampleCountStats::add(const ustring &name, uint64_t samples, uint64_t
   entries.emplace(name, NamedSampleCountPair(name, samples, hits));
 }
 
-string NamedSampleCountStats::full_report(int indent_level)
+string NamedSampleCountStats::full_report(int indent_level, bool show_hits)
 {
   const string indent(indent_level * kIndentNumSpaces, ' ');
 
@@ -189,9 +190,19 @@ string NamedSampleCountStats::full_report(int indent_level)
     const double seconds = entry.samples * 0.001;
     const double relative = ((double)entry.samples) / (entry.hits * avg_samples_per_hit);
 
-    result += indent +
-              string_printf(
-                  "%-32s: %.2fs (Relative cost: %.2f)\n", entry.name.c_str(), seconds, relative);
+    if (show_hits) {
+      result += indent + string_printf("%-32s: %.2fs, %llu hits (Relative cost: %.2f)\n",
+                                       entry.name.c_str(),
+                                       seconds,
+                                       (unsigned long long)entry.hits,
+                                       (total_samples > 0) ? relative : 0.0);
+    }
+    else {
+      result += indent + string_printf("%-32s: %.2fs (Relative cost: %.2f)\n",
+                                       entry.name.c_str(),
+                                       seconds,
+                                       relative);
+    }
   }
   return result;
 }
@@ -214,6 +225,14 @@ string MeshStats::full_report(int indent_level)
 
 ImageStats::ImageStats()
 {
+  paged_hits = 0;
+  paged_misses = 0;
+  paged_evictions = 0;
+  paged_peak_size = 0;
+  dedup_images = 0;
+  dedup_saved_size = 0;
+  lazy_tiles = 0;
+  lazy_loaded_tiles = 0;
 }
 
 string ImageStats::full_report(int indent_level)
@@ -221,6 +240,65 @@ string ImageStats::full_report(int indent_level)
   const string indent(indent_level * kIndentNumSpaces, ' ');
   string result = "";
   result += indent + "Textures:\n" + textures.full_report(indent_level + 1);
+  if (paged_hits || paged_misses) {
+    result += string_printf(
+        "%sPaged textures: %llu hits, %llu misses (%.2f%% hits), %zu evictions, %s peak\n",
+        indent.c_str(),
+        (unsigned long long)paged_hits,
+        (unsigned long long)paged_misses,
+        100.0 * paged_hits / (paged_hits + paged_misses),
+        paged_evictions,
+        string_human_readable_size(paged_peak_size).c_str());
+  }
+  if (dedup_images) {
+    result += string_printf("%sDeduplicated textures: %zu, %s saved\n",
+                            indent.c_str(),
+                            dedup_images,
+                            string_human_readable_size(dedup_saved_size).c_str());
+  }
+  if (lazy_tiles) {
+    result += string_printf(
+        "%sLazy UDIM tiles: %zu of %zu loaded\n", indent.c_str(), lazy_loaded_tiles, lazy_tiles);
+  }
+  return result;
+}
+
+/* BVH statistics. */
+
+BVHStats::BVHStats()
+{
+  num_nodes = 0;
+  num_compressed_nodes = 0;
+  nodes_size = 0;
+  uncompressed_nodes_size = 0;
+  build_time = 0.0;
+  cache_hits = 0;
+  cache_misses = 0;
+  cache_loaded_size = 0;
+  cache_stored_size = 0;
+}
+
+string BVHStats::full_report(int indent_level)
+{
+  const string indent(indent_level * kIndentNumSpaces, ' ');
+  string result = "";
+  result += string_printf("%sNodes: %s (%s compressed)\n",
+                          indent.c_str(),
+                          string_human_readable_number(num_nodes).c_str(),
+                          string_human_readable_number(num_compressed_nodes).c_str());
+  result += string_printf("%sNode memory: %s (%s uncompressed)\n",
+                          indent.c_str(),
+                          string_human_readable_size(nodes_size).c_str(),
+                          string_human_readable_size(uncompressed_nodes_size).c_str());
+  result += string_printf("%sBuild time: %.2fs\n", indent.c_str(), build_time);
+  if (cache_hits || cache_misses) {
+    result += string_printf("%sCache: %zu hits, %zu misses, %s loaded, %s stored\n",
+                            indent.c_str(),
+                            cache_hits,
+                            cache_misses,
+                            string_human_readable_size(cache_loaded_size).c_str(),
+                            string_human_readable_size(cache_stored_size).c_str());
+  }
   return result;
 }
 
@@ -248,7 +326,9 @@ void RenderStats::collect_profiling(Scene *scene, Profiler &prof)
 
   NamedNestedSampleStats &shading = integrator.add_entry("Shading", 0);
   shading.add_entry("Shader Setup", prof.get_event(PROFILING_SHADER_SETUP));
-  shading.add_entry("Shader Eval", prof.get_event(PROFILING_SHADER_EVAL));
+  NamedNestedSampleStats &eval = shading.add_entry("Shader Eval",
+                                                    prof.get_event(PROFILING_SHADER_EVAL));
+  eval.add_entry("Texture Lookups", prof.get_event(PROFILING_TEXTURE_LOOKUP));
   shading.add_entry("Shader Apply", prof.get_event(PROFILING_SHADER_APPLY));
   shading.add_entry("Ambient Occlusion", prof.get_event(PROFILING_AO));
   shading.add_entry("Subsurface", prof.get_event(PROFILING_SUBSURFACE));
@@ -299,17 +379,22 @@ void RenderStats::collect_profiling(Scene *scene, Profiler &prof)
       objects.add(object->name, samples, hits);
     }
   }
+
+  textures.entries.clear();
+  scene->image_manager->collect_profiling(this, prof);
 }
 
 string RenderStats::full_report()
 {
   string result = "";
   result += "Mesh statistics:\n" + mesh.full_report(1);
+  result += "BVH statistics:\n" + bvh.full_report(1);
   result += "Image statistics:\n" + image.full_report(1);
   if (has_profiling) {
     result += "Kernel statistics:\n" + kernel.full_report(1);
     result += "Shader statistics:\n" + shaders.full_report(1);
     result += "Object statistics:\n" + objects.full_report(1);
+    result += "Texture statistics:\n" + textures.full_report(1, true);
   }
   else {
     result += "Profiling information not available (only works with CPU rendering)";
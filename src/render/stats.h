@@ -102,7 +102,8 @@ class NamedSampleCountStats {
  public:
   NamedSampleCountStats();
 
-  string full_report(int indent_level = 0);
+  /* Optionally lists the hit counts too, for entries where these matter on their own. */
+  string full_report(int indent_level = 0, bool show_hits = false);
   void add(const ustring &name, uint64_t samples, uint64_t hits);
 
   typedef unordered_map<ustring, NamedSampleCountPair, ustringHash> entry_map;
@@ -133,6 +134,50 @@ class ImageStats {
   string full_report(int indent_level = 0);
 
   NamedSizeStats textures;
+
+  /* Demand paged images: tile lookups that found the tile resident, tiles loaded and
+   * tiles evicted to stay within the memory budget. */
+  uint64_t paged_hits;
+  uint64_t paged_misses;
+  size_t paged_evictions;
+  size_t paged_peak_size;
+
+  /* Images sharing the pixels of another image with identical content, and the memory
+   * this saved. */
+  size_t dedup_images;
+  size_t dedup_saved_size;
+
+  /* Lazily loaded UDIM tiles, and how many of them were used by rendering. */
+  size_t lazy_tiles;
+  size_t lazy_loaded_tiles;
+};
+
+/* Statistics about the scene BVH, only collected for the BVH2 layout. */
+class BVHStats {
+ public:
+  BVHStats();
+
+  /* Generate full human-readable report. */
+  string full_report(int indent_level = 0);
+
+  /* Inner nodes, including the merged geometry BVHs. */
+  size_t num_nodes;
+  size_t num_compressed_nodes;
+
+  /* Memory used by the inner nodes, and the memory they would use without
+   * compression. */
+  size_t nodes_size;
+  size_t uncompressed_nodes_size;
+
+  /* Time to build and pack the scene BVH, in seconds. */
+  double build_time;
+
+  /* Geometry BVHs loaded from and missing in the persistent cache, and the bytes read
+   * and written. */
+  size_t cache_hits;
+  size_t cache_misses;
+  size_t cache_loaded_size;
+  size_t cache_stored_size;
 };
 
 /* Render process statistics. */
@@ -149,10 +194,12 @@ class RenderStats {
   bool has_profiling;
 
   MeshStats mesh;
+  BVHStats bvh;
   ImageStats image;
   NamedNestedSampleStats kernel;
   NamedSampleCountStats shaders;
   NamedSampleCountStats objects;
+  NamedSampleCountStats textures;
 };
 
 CCL_NAMESPACE_END
@@ -27,11 +27,64 @@
 
 #include "util/util_foreach.h"
 #include "util/util_logging.h"
+#include "util/util_md5.h"
 #include "util/util_progress.h"
 #include "util/util_task.h"
 
 CCL_NAMESPACE_BEGIN
 
+/* Compiled Shader */
+
+SVMCompiledShader::SVMCompiledShader()
+    : compiled(false),
+      duplicate_of(-1),
+      has_surface(false),
+      has_surface_emission(false),
+      has_surface_transparent(false),
+      has_surface_bssrdf(false),
+      has_bump(false),
+      has_bssrdf_bump(false),
+      has_volume(false),
+      has_displacement(false),
+      has_surface_spatial_varying(false),
+      has_volume_spatial_varying(false),
+      has_volume_attribute_dependency(false),
+      has_integrator_dependency(false)
+{
+}
+
+void SVMCompiledShader::store_flags(const Shader *shader)
+{
+  has_surface = shader->has_surface;
+  has_surface_emission = shader->has_surface_emission;
+  has_surface_transparent = shader->has_surface_transparent;
+  has_surface_bssrdf = shader->has_surface_bssrdf;
+  has_bump = shader->has_bump;
+  has_bssrdf_bump = shader->has_bssrdf_bump;
+  has_volume = shader->has_volume;
+  has_displacement = shader->has_displacement;
+  has_surface_spatial_varying = shader->has_surface_spatial_varying;
+  has_volume_spatial_varying = shader->has_volume_spatial_varying;
+  has_volume_attribute_dependency = shader->has_volume_attribute_dependency;
+  has_integrator_dependency = shader->has_integrator_dependency;
+}
+
+void SVMCompiledShader::restore_flags(Shader *shader) const
+{
+  shader->has_surface = has_surface;
+  shader->has_surface_emission = has_surface_emission;
+  shader->has_surface_transparent = has_surface_transparent;
+  shader->has_surface_bssrdf = has_surface_bssrdf;
+  shader->has_bump = has_bump;
+  shader->has_bssrdf_bump = has_bssrdf_bump;
+  shader->has_volume = has_volume;
+  shader->has_displacement = has_displacement;
+  shader->has_surface_spatial_varying = has_surface_spatial_varying;
+  shader->has_volume_spatial_varying = has_volume_spatial_varying;
+  shader->has_volume_attribute_dependency = has_volume_attribute_dependency;
+  shader->has_integrator_dependency = has_integrator_dependency;
+}
+
 /* Shader Manager */
 
 SVMShaderManager::SVMShaderManager()
@@ -46,24 +99,59 @@ SVMShaderManager::~SVMShaderManager()
 
 void SVMShaderManager::reset(Scene * /*scene*/)
 {
+  compiled_shaders.clear();
+  compiling_keys.clear();
+  svm_nodes_keys.clear();
+  svm_nodes_sizes.clear();
 }
 
 void SVMShaderManager::device_update_shader(Scene *scene,
                                             Shader *shader,
                                             Progress *progress,
-                                            array<int4> *svm_nodes)
+                                            SVMCompiledShader *compiled,
+                                            const int index,
+                                            const bool share)
 {
   if (progress->get_cancel()) {
     return;
   }
   assert(shader->graph);
 
-  svm_nodes->push_back_slow(make_int4(NODE_SHADER_JUMP, 0, 0, 0));
-
   SVMCompiler::Summary summary;
   SVMCompiler compiler(scene);
   compiler.background = (shader == scene->background->get_shader(scene));
-  compiler.compile(shader, *svm_nodes, 0, &summary);
+  compiler.finalize(shader, &summary);
+
+  /* Reuse the program when the shader was compiled before. */
+  const string key = compiler.compile_key(shader);
+  unordered_map<string, SVMCompiledShader>::const_iterator it = compiled_shaders.find(key);
+  if (it != compiled_shaders.end()) {
+    *compiled = it->second;
+    compiled->compiled = false;
+    compiled->restore_flags(shader);
+    return;
+  }
+
+  /* Let the first shader with this graph compile it, the others share its program. */
+  if (share) {
+    thread_scoped_lock lock(compiling_mutex);
+    std::pair<unordered_map<string, int>::iterator, bool> claim = compiling_keys.insert(
+        std::make_pair(key, index));
+    if (!claim.second) {
+      compiled->key = key;
+      compiled->duplicate_of = claim.first->second;
+      return;
+    }
+  }
+
+  compiled->svm_nodes.push_back_slow(make_int4(NODE_SHADER_JUMP, 0, 0, 0));
+  compiler.compile(shader, compiled->svm_nodes, 0, &summary);
+  compiled->compiled = true;
+  compiled->store_flags(shader);
+
+  /* Compiling assigns image and IES slots, so take the key afterwards to match the one
+   * of the next update. */
+  compiled->key = compiler.compile_key(shader);
 
   VLOG(2) << "Compilation summary:\n"
           << "Shader name: " << shader->name << "\n"
@@ -85,36 +173,107 @@ void SVMShaderManager::device_update(Device *device,
   double start_time = time_dt();
 
   /* test if we need to update */
-  device_free(device, dscene, scene);
+  device_free_common(device, dscene, scene);
 
-  /* Build all shaders. */
+  /* Build all shaders, only compiling the ones that changed. */
   TaskPool task_pool;
-  vector<array<int4>> shader_svm_nodes(num_shaders);
+  vector<SVMCompiledShader> shader_compiled(num_shaders);
+  compiling_keys.clear();
   for (int i = 0; i < num_shaders; i++) {
     task_pool.push(function_bind(&SVMShaderManager::device_update_shader,
                                  this,
                                  scene,
                                  scene->shaders[i],
                                  &progress,
-                                 &shader_svm_nodes[i]));
+                                 &shader_compiled[i],
+                                 i,
+                                 true));
   }
   task_pool.wait_work();
+  compiling_keys.clear();
 
   if (progress.get_cancel()) {
     return;
   }
 
+  /* Shaders with the same graph as one compiled above share its program if they already
+   * hold the images and other resources it refers to, which is the case when the key after
+   * compiling is still the same. Otherwise compiling them acquires their own. */
+  int num_shared = 0;
+  for (int i = 0; i < num_shaders; i++) {
+    SVMCompiledShader &compiled = shader_compiled[i];
+    if (compiled.duplicate_of == -1) {
+      continue;
+    }
+
+    const SVMCompiledShader &owner = shader_compiled[compiled.duplicate_of];
+    if (owner.key == compiled.key) {
+      owner.restore_flags(scene->shaders[i]);
+      compiled.store_flags(scene->shaders[i]);
+      num_shared++;
+    }
+    else {
+      compiled.duplicate_of = -1;
+      task_pool.push(function_bind(&SVMShaderManager::device_update_shader,
+                                   this,
+                                   scene,
+                                   scene->shaders[i],
+                                   &progress,
+                                   &compiled,
+                                   i,
+                                   false));
+    }
+  }
+  task_pool.wait_work();
+
+  if (progress.get_cancel()) {
+    return;
+  }
+
+  /* Shaders with the same key get the same program, only stored once. The shader that
+   * provides the nodes of each program is one that has them, shared ones do not. */
+  vector<int> program_shader;
+  vector<int> shader_program(num_shaders);
+  unordered_map<string, int> program_index;
+  for (int i = 0; i < num_shaders; i++) {
+    const SVMCompiledShader &compiled = shader_compiled[i];
+    std::pair<unordered_map<string, int>::iterator, bool> program = program_index.insert(
+        std::make_pair(compiled.key, (int)program_shader.size()));
+    if (program.second) {
+      program_shader.push_back(i);
+    }
+    else if (!compiled.svm_nodes.empty()) {
+      program_shader[program.first->second] = i;
+    }
+    shader_program[i] = program.first->second;
+  }
+
+  const int num_programs = program_shader.size();
+
   /* The global node list contains a jump table (one node per shader)
-   * followed by the nodes of all shaders. */
+   * followed by the nodes of all distinct programs. */
   int svm_nodes_size = num_shaders;
-  for (int i = 0; i < num_shaders; i++) {
+  int num_compiled = 0;
+  vector<int> program_offset(num_programs);
+  for (int p = 0; p < num_programs; p++) {
+    program_offset[p] = svm_nodes_size;
     /* Since we're not copying the local jump node, the size ends up being one node lower. */
-    svm_nodes_size += shader_svm_nodes[i].size() - 1;
+    svm_nodes_size += shader_compiled[program_shader[p]].svm_nodes.size() - 1;
+  }
+  for (int i = 0; i < num_shaders; i++) {
+    num_compiled += shader_compiled[i].compiled;
+  }
+
+  /* When every program has the same size as before, the existing nodes are patched in
+   * place and only the programs that changed are copied. */
+  bool patch_nodes = (dscene->svm_nodes.size() == svm_nodes_size) &&
+                     (svm_nodes_keys.size() == num_programs);
+  for (int p = 0; p < num_programs && patch_nodes; p++) {
+    patch_nodes = (svm_nodes_sizes[p] == shader_compiled[program_shader[p]].svm_nodes.size());
   }
 
   int4 *svm_nodes = dscene->svm_nodes.alloc(svm_nodes_size);
 
-  int node_offset = num_shaders;
   for (int i = 0; i < num_shaders; i++) {
     Shader *shader = scene->shaders[i];
 
@@ -126,38 +285,65 @@ void SVMShaderManager::device_update(Device *device,
     /* Update the global jump table.
      * Each compiled shader starts with a jump node that has offsets local
      * to the shader, so copy those and add the offset into the global node list. */
+    const int program = shader_program[i];
+    const int node_offset = program_offset[program];
     int4 &global_jump_node = svm_nodes[shader->id];
-    int4 &local_jump_node = shader_svm_nodes[i][0];
+    int4 &local_jump_node = shader_compiled[program_shader[program]].svm_nodes[0];
 
     global_jump_node.x = NODE_SHADER_JUMP;
     global_jump_node.y = local_jump_node.y - 1 + node_offset;
     global_jump_node.z = local_jump_node.z - 1 + node_offset;
     global_jump_node.w = local_jump_node.w - 1 + node_offset;
-
-    node_offset += shader_svm_nodes[i].size() - 1;
   }
 
-  /* Copy the nodes of each shader into the correct location. */
+  /* Copy the nodes of each program into the correct location. When patching, only the jump
+   * table and the programs that changed are uploaded. */
+  dscene->svm_nodes.tag_modified(0, num_shaders);
   svm_nodes += num_shaders;
-  for (int i = 0; i < num_shaders; i++) {
-    int shader_size = shader_svm_nodes[i].size() - 1;
-
-    memcpy(svm_nodes, &shader_svm_nodes[i][1], sizeof(int4) * shader_size);
-    svm_nodes += shader_size;
+  int num_copied = 0;
+  for (int p = 0; p < num_programs; p++) {
+    const SVMCompiledShader &compiled = shader_compiled[program_shader[p]];
+    int program_size = compiled.svm_nodes.size() - 1;
+
+    if (!patch_nodes || svm_nodes_keys[p] != compiled.key) {
+      memcpy(svm_nodes, &compiled.svm_nodes[1], sizeof(int4) * program_size);
+      dscene->svm_nodes.tag_modified(program_offset[p], program_size);
+      num_copied++;
+    }
+    svm_nodes += program_size;
   }
 
   if (progress.get_cancel()) {
     return;
   }
 
-  dscene->svm_nodes.copy_to_device();
+  dscene->svm_nodes.copy_to_device_if_modified();
+
+  /* Remember the compiled programs for the next update, dropping unused ones. */
+  svm_nodes_keys.resize(num_programs);
+  svm_nodes_sizes.resize(num_programs);
+  unordered_map<string, SVMCompiledShader> used_compiled_shaders;
+  for (int p = 0; p < num_programs; p++) {
+    SVMCompiledShader &compiled = shader_compiled[program_shader[p]];
+    svm_nodes_keys[p] = compiled.key;
+    svm_nodes_sizes[p] = compiled.svm_nodes.size();
+
+    /* Move the nodes instead of copying them with the rest. */
+    array<int4> compiled_svm_nodes;
+    compiled_svm_nodes.steal_data(compiled.svm_nodes);
+    SVMCompiledShader &cached = used_compiled_shaders[compiled.key];
+    cached = compiled;
+    cached.svm_nodes.steal_data(compiled_svm_nodes);
+  }
+  compiled_shaders.swap(used_compiled_shaders);
 
   device_update_common(device, dscene, scene, progress);
 
   need_update = false;
 
-  VLOG(1) << "Shader manager updated " << num_shaders << " shaders in " << time_dt() - start_time
-          << " seconds.";
+  VLOG(1) << "Shader manager updated " << num_shaders << " shaders (" << num_compiled
+          << " compiled, " << num_shared << " shared, " << num_programs << " distinct, "
+          << num_copied << " copied) in " << time_dt() - start_time << " seconds.";
 }
 
 void SVMShaderManager::device_free(Device *device, DeviceScene *dscene, Scene *scene)
@@ -175,9 +361,15 @@ SVMCompiler::SVMCompiler(Scene *scene) : scene(scene)
   current_type = SHADER_TYPE_SURFACE;
   current_shader = NULL;
   current_graph = NULL;
+  finalized_shader = NULL;
+  finalized_has_bump = false;
   background = false;
   mix_weight_offset = SVM_STACK_INVALID;
   compile_failed = false;
+  num_reused_values = 0;
+  num_reused_svm_nodes = 0;
+  num_fused_nodes = 0;
+  num_threaded_jumps = 0;
 }
 
 int SVMCompiler::stack_size(SocketType::Type type)
@@ -224,6 +416,8 @@ int SVMCompiler::stack_find_offset(int size)
       while (i >= offset)
         active_stack.users[i--] = 1;
 
+      stack_values_invalidate(offset, size);
+
       return offset;
     }
   }
@@ -262,32 +456,73 @@ int SVMCompiler::stack_assign(ShaderInput *input)
     }
     else {
       Node *node = input->parent;
-
-      /* not linked to output -> add nodes to load default value */
-      input->stack_offset = stack_find_offset(input->type());
+      int4 value = make_int4(0, 0, 0, 0);
+      bool is_float = false;
 
       if (input->type() == SocketType::FLOAT) {
-        add_node(NODE_VALUE_F,
-                 __float_as_int(node->get_float(input->socket_type)),
-                 input->stack_offset);
+        value.x = __float_as_int(node->get_float(input->socket_type));
+        is_float = true;
       }
       else if (input->type() == SocketType::INT) {
-        add_node(NODE_VALUE_F, node->get_int(input->socket_type), input->stack_offset);
+        value.x = node->get_int(input->socket_type);
+        is_float = true;
       }
       else if (input->type() == SocketType::VECTOR || input->type() == SocketType::NORMAL ||
                input->type() == SocketType::POINT || input->type() == SocketType::COLOR) {
-
-        add_node(NODE_VALUE_V, input->stack_offset);
-        add_node(NODE_VALUE_V, node->get_float3(input->socket_type));
+        float3 f = node->get_float3(input->socket_type);
+        value = make_int4(__float_as_int(f.x), __float_as_int(f.y), __float_as_int(f.z), 0);
       }
-      else /* should not get called for closure */
+      else {
+        /* should not get called for closure */
         assert(0);
+        input->stack_offset = stack_find_offset(input->type());
+        return input->stack_offset;
+      }
+
+      /* reuse an equal value that is still on the stack */
+      input->stack_offset = stack_find_value(input->type(), value);
+
+      if (input->stack_offset == SVM_STACK_INVALID) {
+        /* not linked to output -> add nodes to load default value */
+        input->stack_offset = stack_find_offset(input->type());
+
+        StackValue stack_value = {
+            input->stack_offset, stack_size(input->type()), value, (int)current_svm_nodes.size()};
+        stack_values.push_back(stack_value);
+
+        if (is_float) {
+          add_node(NODE_VALUE_F, value.x, input->stack_offset);
+        }
+        else {
+          add_node(NODE_VALUE_V, input->stack_offset);
+          add_node(NODE_VALUE_V, value.x, value.y, value.z);
+        }
+      }
     }
   }
 
   return input->stack_offset;
 }
 
+int SVMCompiler::stack_find_value(SocketType::Type type, const int4 &value)
+{
+  const int size = stack_size(type);
+
+  foreach (const StackValue &stack_value, stack_values) {
+    if (stack_value.size == size && stack_value.value.x == value.x &&
+        stack_value.value.y == value.y && stack_value.value.z == value.z) {
+      for (int i = 0; i < size; i++)
+        active_stack.users[stack_value.offset + i]++;
+
+      num_reused_values++;
+      num_reused_svm_nodes += (size == 1) ? 1 : 2;
+      return stack_value.offset;
+    }
+  }
+
+  return SVM_STACK_INVALID;
+}
+
 int SVMCompiler::stack_assign(ShaderOutput *output)
 {
   /* if no stack offset assigned yet, find one */
@@ -434,10 +669,30 @@ void SVMCompiler::find_dependencies(ShaderNodeSet &dependencies,
 
 void SVMCompiler::generate_node(ShaderNode *node, ShaderNodeSet &done)
 {
+  const int num_svm_nodes = current_svm_nodes.size();
+
   node->compile(*this);
   stack_clear_users(node, done);
   stack_clear_temporary(node);
 
+  /* Remember math nodes for fusing them with their neighbours. Value loads for the inputs
+   * come first, so the math node is at the end. */
+  if (current_svm_nodes.size() > num_svm_nodes) {
+    int2 math_node = make_int2(current_svm_nodes.size() - 1, 1);
+    if (node->type == VectorMathNode::node_type &&
+        static_cast<VectorMathNode *>(node)->type == NODE_VECTOR_MATH_WRAP) {
+      math_node = make_int2(current_svm_nodes.size() - 2, 2);
+    }
+
+    if (math_node.x >= num_svm_nodes &&
+        ((node->type == MathNode::node_type &&
+          current_svm_nodes[math_node.x].x == NODE_MATH) ||
+         (node->type == VectorMathNode::node_type &&
+          current_svm_nodes[math_node.x].x == NODE_VECTOR_MATH))) {
+      math_nodes.push_back(math_node);
+    }
+  }
+
   if (current_type == SHADER_TYPE_SURFACE) {
     if (node->has_spatial_varying())
       current_shader->has_surface_spatial_varying = true;
@@ -644,12 +899,14 @@ void SVMCompiler::generate_multi_closure(ShaderNode *root_node,
          */
         current_svm_nodes.push_back_slow(make_int4(NODE_JUMP_IF_ONE, 0, stack_assign(facin), 0));
         int node_jump_skip_index = current_svm_nodes.size() - 1;
+        jump_nodes.push_back(node_jump_skip_index);
 
         generate_multi_closure(root_node, cl1in->link->parent, state);
 
         /* Fill in jump instruction location to be after closure. */
         current_svm_nodes[node_jump_skip_index].y = current_svm_nodes.size() -
                                                     node_jump_skip_index - 1;
+        stack_values_leave_branch(node_jump_skip_index);
       }
 
       /* generate instructions for input closure 2 */
@@ -659,12 +916,14 @@ void SVMCompiler::generate_multi_closure(ShaderNode *root_node,
          */
         current_svm_nodes.push_back_slow(make_int4(NODE_JUMP_IF_ZERO, 0, stack_assign(facin), 0));
         int node_jump_skip_index = current_svm_nodes.size() - 1;
+        jump_nodes.push_back(node_jump_skip_index);
 
         generate_multi_closure(root_node, cl2in->link->parent, state);
 
         /* Fill in jump instruction location to be after closure. */
         current_svm_nodes[node_jump_skip_index].y = current_svm_nodes.size() -
                                                     node_jump_skip_index - 1;
+        stack_values_leave_branch(node_jump_skip_index);
       }
 
       /* unassign */
@@ -688,6 +947,84 @@ void SVMCompiler::generate_multi_closure(ShaderNode *root_node,
   state->nodes_done_flag[node->id] = true;
 }
 
+/* Optimization */
+
+void SVMCompiler::stack_values_invalidate(int offset, int size)
+{
+  /* The stack offset will be written, so forget the values it holds. */
+  for (size_t i = 0; i < stack_values.size();) {
+    const StackValue &stack_value = stack_values[i];
+    if (stack_value.offset < offset + size && offset < stack_value.offset + stack_value.size) {
+      stack_values[i] = stack_values.back();
+      stack_values.pop_back();
+    }
+    else {
+      i++;
+    }
+  }
+}
+
+void SVMCompiler::stack_values_leave_branch(int jump_index)
+{
+  /* Values loaded after the jump are missing when it was taken. */
+  for (size_t i = 0; i < stack_values.size();) {
+    if (stack_values[i].node_index > jump_index) {
+      stack_values[i] = stack_values.back();
+      stack_values.pop_back();
+    }
+    else {
+      i++;
+    }
+  }
+}
+
+void SVMCompiler::optimize_svm_nodes()
+{
+  const int num_nodes = current_svm_nodes.size();
+
+  /* Jump threading. A jump taken on a mix weight of zero or one that lands on another jump
+   * on the same weight knows the outcome of that jump, since nothing runs in between. */
+  foreach (int index, jump_nodes) {
+    int4 &jump = current_svm_nodes[index];
+    int target = index + 1 + jump.y;
+
+    while (target < num_nodes) {
+      const int4 &next = current_svm_nodes[target];
+      if ((next.x != NODE_JUMP_IF_ZERO && next.x != NODE_JUMP_IF_ONE) || next.z != jump.z) {
+        break;
+      }
+
+      target = (next.x == jump.x) ? target + 1 + next.y : target + 1;
+      num_threaded_jumps++;
+    }
+
+    jump.y = target - index - 1;
+  }
+
+  /* Fuse pairs of adjacent math nodes into a single dispatch, the first node gets the pair
+   * type and the second is read as its data. Nodes that jumps land on must stay separate. */
+  vector<bool> jump_target(num_nodes + 1, false);
+  foreach (int index, jump_nodes) {
+    jump_target[index + 1 + current_svm_nodes[index].y] = true;
+  }
+
+  for (size_t i = 0; i + 1 < math_nodes.size(); i++) {
+    const int2 first = math_nodes[i];
+    const int2 second = math_nodes[i + 1];
+    int4 &first_node = current_svm_nodes[first.x];
+
+    if (second.x != first.x + first.y || jump_target[second.x] ||
+        first_node.x != current_svm_nodes[second.x].x) {
+      continue;
+    }
+
+    first_node.x = (first_node.x == NODE_MATH) ? NODE_MATH_PAIR : NODE_VECTOR_MATH_PAIR;
+    num_fused_nodes++;
+    /* The second node can't start another pair. */
+    i++;
+  }
+}
+
 void SVMCompiler::compile_type(Shader *shader, ShaderGraph *graph, ShaderType type)
 {
   /* Converting a shader graph into svm_nodes that can be executed
@@ -734,6 +1071,9 @@ void SVMCompiler::compile_type(Shader *shader, ShaderGraph *graph, ShaderType ty
   /* clear all compiler state */
   memset((void *)&active_stack, 0, sizeof(active_stack));
   current_svm_nodes.clear();
+  stack_values.clear();
+  math_nodes.clear();
+  jump_nodes.clear();
 
   foreach (ShaderNode *node, graph->nodes) {
     foreach (ShaderInput *input, node->inputs)
@@ -814,6 +1154,8 @@ void SVMCompiler::compile_type(Shader *shader, ShaderGraph *graph, ShaderType ty
     add_node(NODE_LEAVE_BUMP_EVAL, bump_state_offset);
   }
 
+  optimize_svm_nodes();
+
   /* if compile failed, generate empty shader */
   if (compile_failed) {
     current_svm_nodes.clear();
@@ -827,18 +1169,13 @@ void SVMCompiler::compile_type(Shader *shader, ShaderGraph *graph, ShaderType ty
   }
 }
 
-void SVMCompiler::compile(Shader *shader, array<int4> &svm_nodes, int index, Summary *summary)
+void SVMCompiler::finalize(Shader *shader, Summary *summary)
 {
   /* copy graph for shader with bump mapping */
   ShaderNode *output = shader->graph->output();
-  int start_num_svm_nodes = svm_nodes.size();
-
-  const double time_start = time_dt();
-
   bool has_bump = (shader->displacement_method != DISPLACE_TRUE) &&
                   output->input("Surface")->link && output->input("Displacement")->link;
 
-  /* finalize */
   {
     scoped_timer timer((summary != NULL) ? &summary->time_finalize : NULL);
     shader->graph->finalize(scene,
@@ -847,6 +1184,46 @@ void SVMCompiler::compile(Shader *shader, array<int4> &svm_nodes, int index, Sum
                             shader->displacement_method == DISPLACE_BOTH);
   }
 
+  finalized_shader = shader;
+  finalized_has_bump = has_bump;
+}
+
+string SVMCompiler::compile_key(Shader *shader)
+{
+  MD5Hash md5;
+  shader->graph->hash(md5);
+
+  foreach (ShaderNode *node, shader->graph->nodes) {
+    md5.append((const uint8_t *)&node->bump, sizeof(node->bump));
+    node->hash_compile_state(md5);
+  }
+
+  const int settings[4] = {background,
+                           shader->used,
+                           shader->displacement_method,
+                           (finalized_shader == shader) && finalized_has_bump};
+  md5.append((const uint8_t *)settings, sizeof(settings));
+
+  return md5.get_hex();
+}
+
+void SVMCompiler::compile(Shader *shader, array<int4> &svm_nodes, int index, Summary *summary)
+{
+  int start_num_svm_nodes = svm_nodes.size();
+
+  const double time_start = time_dt();
+
+  num_reused_values = 0;
+  num_reused_svm_nodes = 0;
+  num_fused_nodes = 0;
+  num_threaded_jumps = 0;
+
+  /* finalize */
+  if (finalized_shader != shader) {
+    finalize(shader, summary);
+  }
+  const bool has_bump = finalized_has_bump;
+
   current_shader = shader;
 
   shader->has_surface = false;
@@ -903,6 +1280,10 @@ void SVMCompiler::compile(Shader *shader, array<int4> &svm_nodes, int index, Sum
     summary->time_total = time_dt() - time_start;
     summary->peak_stack_usage = max_stack_use;
     summary->num_svm_nodes = svm_nodes.size() - start_num_svm_nodes;
+    summary->num_svm_nodes_unoptimized = summary->num_svm_nodes + num_reused_svm_nodes;
+    summary->num_reused_values = num_reused_values;
+    summary->num_fused_nodes = num_fused_nodes;
+    summary->num_threaded_jumps = num_threaded_jumps;
   }
 }
 
@@ -910,6 +1291,10 @@ void SVMCompiler::compile(Shader *shader, array<int4> &svm_nodes, int index, Sum
 
 SVMCompiler::Summary::Summary()
     : num_svm_nodes(0),
+      num_svm_nodes_unoptimized(0),
+      num_reused_values(0),
+      num_fused_nodes(0),
+      num_threaded_jumps(0),
       peak_stack_usage(0),
       time_finalize(0.0),
       time_generate_surface(0.0),
@@ -926,6 +1311,15 @@ string SVMCompiler::Summary::full_report() const
   report += string_printf("Number of SVM nodes: %d\n", num_svm_nodes);
   report += string_printf("Peak stack usage:    %d\n", peak_stack_usage);
 
+  report += string_printf("Optimization:\n");
+  report += string_printf("  Unoptimized nodes: %d\n", num_svm_nodes_unoptimized);
+  report += string_printf("  Optimized nodes:   %d\n", num_svm_nodes);
+  report += string_printf("  Reused values:     %d\n", num_reused_values);
+  report += string_printf("  Fused math nodes:  %d\n", num_fused_nodes);
+  report += string_printf("  Threaded jumps:    %d\n", num_threaded_jumps);
+  report += string_printf("  Dispatches saved:  %d\n",
+                          num_reused_values + num_fused_nodes + num_threaded_jumps);
+
   report += string_printf("Time (in seconds):\n");
   report += string_printf("Finalize:            %f\n", time_finalize);
   report += string_printf("  Surface:           %f\n", time_generate_surface);
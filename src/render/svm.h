@@ -22,6 +22,7 @@
 #include "render/shader.h"
 
 #include "util/util_array.h"
+#include "util/util_map.h"
 #include "util/util_set.h"
 #include "util/util_string.h"
 #include "util/util_thread.h"
@@ -37,6 +38,39 @@ class ShaderInput;
 class ShaderNode;
 class ShaderOutput;
 
+/* Compiled Shader
+ *
+ * Program of a shader starting with its local jump node, and the shader flags that
+ * compiling it sets, so the shader does not have to be compiled again while its finalized
+ * graph stays the same. */
+struct SVMCompiledShader {
+  SVMCompiledShader();
+
+  void store_flags(const Shader *shader);
+  void restore_flags(Shader *shader) const;
+
+  /* Hash of the finalized graph and everything else compiling depends on. */
+  string key;
+  array<int4> svm_nodes;
+  /* Compiled in this update, or reused from before. */
+  bool compiled;
+  /* Index of the shader compiling the same graph in this update, -1 if none. */
+  int duplicate_of;
+
+  bool has_surface;
+  bool has_surface_emission;
+  bool has_surface_transparent;
+  bool has_surface_bssrdf;
+  bool has_bump;
+  bool has_bssrdf_bump;
+  bool has_volume;
+  bool has_displacement;
+  bool has_surface_spatial_varying;
+  bool has_volume_spatial_varying;
+  bool has_volume_attribute_dependency;
+  bool has_integrator_dependency;
+};
+
 /* Shader Manager */
 
 class SVMShaderManager : public ShaderManager {
@@ -53,7 +87,22 @@ class SVMShaderManager : public ShaderManager {
   void device_update_shader(Scene *scene,
                             Shader *shader,
                             Progress *progress,
-                            array<int4> *svm_nodes);
+                            SVMCompiledShader *compiled,
+                            const int index,
+                            const bool share);
+
+  /* Shaders compiled in the last update by key, only read while compiling in parallel. */
+  unordered_map<string, SVMCompiledShader> compiled_shaders;
+
+  /* Index of the shader compiling each key in this update, so shaders with the same graph
+   * are compiled only once. */
+  unordered_map<string, int> compiling_keys;
+  thread_mutex compiling_mutex;
+
+  /* Key and size of every distinct program in the global node array, to only copy the
+   * programs that changed into it when the sizes are the same as in the last update. */
+  vector<string> svm_nodes_keys;
+  vector<int> svm_nodes_sizes;
 };
 
 /* Graph Compiler */
@@ -66,6 +115,18 @@ class SVMCompiler {
     /* Number of SVM nodes shader was compiled into. */
     int num_svm_nodes;
 
+    /* Number of SVM nodes before optimization. */
+    int num_svm_nodes_unoptimized;
+
+    /* Constant loads replaced by equal values still on the stack. */
+    int num_reused_values;
+
+    /* Pairs of math nodes evaluated in a single dispatch. */
+    int num_fused_nodes;
+
+    /* Jumps redirected past jumps on the same mix weight. */
+    int num_threaded_jumps;
+
     /* Peak stack usage during shader evaluation. */
     int peak_stack_usage;
 
@@ -94,6 +155,10 @@ class SVMCompiler {
   };
 
   SVMCompiler(Scene *scene);
+  /* Finalize the shader graph for compiling, compile() does this when not done before. */
+  void finalize(Shader *shader, Summary *summary = NULL);
+  /* Hash of the finalized graph and the state compiling it depends on. */
+  string compile_key(Shader *shader);
   void compile(Shader *shader, array<int4> &svm_nodes, int index, Summary *summary = NULL);
 
   int stack_assign(ShaderOutput *output);
@@ -102,6 +167,7 @@ class SVMCompiler {
   int stack_assign_if_linked(ShaderOutput *output);
   int stack_find_offset(int size);
   int stack_find_offset(SocketType::Type type);
+  int stack_find_value(SocketType::Type type, const int4 &value);
   void stack_clear_offset(SocketType::Type type, int offset);
   void stack_link(ShaderInput *input, ShaderOutput *output);
 
@@ -211,16 +277,42 @@ class SVMCompiler {
   /* multi closure */
   void generate_multi_closure(ShaderNode *root_node, ShaderNode *node, CompilerState *state);
 
+  /* optimization */
+  void stack_values_invalidate(int offset, int size);
+  void stack_values_leave_branch(int jump_index);
+  void optimize_svm_nodes();
+
   /* compile */
   void compile_type(Shader *shader, ShaderGraph *graph, ShaderType type);
 
   array<int4> current_svm_nodes;
   ShaderType current_type;
   Shader *current_shader;
+  Shader *finalized_shader;
+  bool finalized_has_bump;
   Stack active_stack;
   int max_stack_use;
   uint mix_weight_offset;
   bool compile_failed;
+
+  /* Constant value loaded into the stack, reused by later inputs with the same value as
+   * long as its stack offset was not allocated again. */
+  struct StackValue {
+    int offset;
+    int size;
+    int4 value;
+    /* Index of the load, to forget values loaded in code that may have been skipped. */
+    int node_index;
+  };
+  vector<StackValue> stack_values;
+  /* Index and size of math nodes that can be fused, and of jump nodes. */
+  vector<int2> math_nodes;
+  vector<int> jump_nodes;
+
+  int num_reused_values;
+  int num_reused_svm_nodes;
+  int num_fused_nodes;
+  int num_threaded_jumps;
 };
 
 CCL_NAMESPACE_END
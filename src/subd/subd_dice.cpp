@@ -45,8 +45,9 @@ void EdgeDice::reserve(int num_verts, int num_triangles)
   vert_offset = mesh->verts.size();
   tri_offset = mesh->num_triangles();
 
-  mesh->resize_mesh(mesh->verts.size() + num_verts, mesh->num_triangles());
-  mesh->reserve_mesh(mesh->verts.size() + num_verts, mesh->num_triangles() + num_triangles);
+  /* Allocate all verts and triangles up front, so subpatches can be diced in parallel
+   * into their own ranges. */
+  mesh->resize_mesh(mesh->verts.size() + num_verts, mesh->num_triangles() + num_triangles);
 
   Attribute *attr_vN = mesh->attributes.add(ATTR_STD_VERTEX_NORMAL);
 
@@ -69,17 +70,22 @@ void EdgeDice::set_vert(const Patch *patch, int index, float2 uv)
   params.mesh->vert_patch_uv[index + vert_offset] = make_float2(uv.x, uv.y);
 }
 
-void EdgeDice::add_triangle(const Patch *patch, int v0, int v1, int v2)
+void EdgeDice::set_triangle(const Patch *patch, int index, int v0, int v1, int v2)
 {
   Mesh *mesh = params.mesh;
+  size_t tri = tri_offset + index;
 
-  mesh->add_triangle(v0 + vert_offset, v1 + vert_offset, v2 + vert_offset, patch->shader, true);
-  params.mesh->triangle_patch[params.mesh->num_triangles() - 1] = patch->patch_index;
+  assert(tri < mesh->num_triangles());
 
-  tri_offset++;
+  mesh->triangles[tri * 3 + 0] = v0 + vert_offset;
+  mesh->triangles[tri * 3 + 1] = v1 + vert_offset;
+  mesh->triangles[tri * 3 + 2] = v2 + vert_offset;
+  mesh->shader[tri] = patch->shader;
+  mesh->smooth[tri] = true;
+  mesh->triangle_patch[tri] = patch->patch_index;
 }
 
-void EdgeDice::stitch_triangles(Subpatch &sub, int edge)
+void EdgeDice::stitch_triangles(Subpatch &sub, int edge, int &tri)
 {
   int Mu = max(sub.edge_u0.T, sub.edge_u1.T);
   int Mv = max(sub.edge_v0.T, sub.edge_v1.T);
@@ -122,7 +128,7 @@ void EdgeDice::stitch_triangles(Subpatch &sub, int edge)
         v2 = sub.get_vert_along_grid_edge(edge, ++i);
     }
 
-    add_triangle(sub.patch, v1, v0, v2);
+    set_triangle(sub.patch, tri++, v1, v0, v2);
   }
 }
 
@@ -224,7 +230,7 @@ float QuadDice::scale_factor(Subpatch &sub, int Mu, int Mv)
   return S;
 }
 
-void QuadDice::add_grid(Subpatch &sub, int Mu, int Mv, int offset)
+void QuadDice::add_grid(Subpatch &sub, int Mu, int Mv, int offset, int &tri)
 {
   /* create inner grid */
   float du = 1.0f / (float)Mu;
@@ -243,18 +249,18 @@ void QuadDice::add_grid(Subpatch &sub, int Mu, int Mv, int offset)
         int i3 = offset + i + j * (Mu - 1);
         int i4 = offset + (i - 1) + j * (Mu - 1);
 
-        add_triangle(sub.patch, i1, i2, i3);
-        add_triangle(sub.patch, i1, i3, i4);
+        set_triangle(sub.patch, tri++, i1, i2, i3);
+        set_triangle(sub.patch, tri++, i1, i3, i4);
       }
     }
   }
 }
 
-void QuadDice::dice(Subpatch &sub)
+static void dice_grid_size(const Subpatch &sub, int &Mu, int &Mv)
 {
   /* compute inner grid size with scale factor */
-  int Mu = max(sub.edge_u0.T, sub.edge_u1.T);
-  int Mv = max(sub.edge_v0.T, sub.edge_v1.T);
+  Mu = max(sub.edge_u0.T, sub.edge_u1.T);
+  Mv = max(sub.edge_v0.T, sub.edge_v1.T);
 
 #if 0 /* Doesn't work very well, especially at grazing angles. */
   float S = scale_factor(sub, ef, Mu, Mv);
@@ -264,20 +270,45 @@ void QuadDice::dice(Subpatch &sub)
 
   Mu = max((int)ceilf(S * Mu), 2);  // XXX handle 0 & 1?
   Mv = max((int)ceilf(S * Mv), 2);  // XXX handle 0 & 1?
+}
+
+void QuadDice::dice_grid(Subpatch &sub)
+{
+  int Mu, Mv;
+  dice_grid_size(sub, Mu, Mv);
 
   /* inner grid */
-  add_grid(sub, Mu, Mv, sub.inner_grid_vert_offset);
+  int tri = sub.triangle_offset;
+  add_grid(sub, Mu, Mv, sub.inner_grid_vert_offset, tri);
+}
 
-  /* sides */
+void QuadDice::dice_sides(Subpatch &sub)
+{
   set_side(sub, 0);
   set_side(sub, 1);
   set_side(sub, 2);
   set_side(sub, 3);
+}
+
+void QuadDice::dice_stitch(Subpatch &sub)
+{
+  int Mu, Mv;
+  dice_grid_size(sub, Mu, Mv);
+
+  /* stitch triangles come right after the inner grid triangles */
+  int tri = sub.triangle_offset + (Mu - 2) * (Mv - 2) * 2;
 
-  stitch_triangles(sub, 0);
-  stitch_triangles(sub, 1);
-  stitch_triangles(sub, 2);
-  stitch_triangles(sub, 3);
+  stitch_triangles(sub, 0, tri);
+  stitch_triangles(sub, 1, tri);
+  stitch_triangles(sub, 2, tri);
+  stitch_triangles(sub, 3, tri);
+}
+
+void QuadDice::dice(Subpatch &sub)
+{
+  dice_grid(sub);
+  dice_sides(sub);
+  dice_stitch(sub);
 }
 
 CCL_NAMESPACE_END
@@ -72,9 +72,9 @@ class EdgeDice {
   void reserve(int num_verts, int num_triangles);
 
   void set_vert(const Patch *patch, int index, float2 uv);
-  void add_triangle(const Patch *patch, int v0, int v1, int v2);
+  void set_triangle(const Patch *patch, int index, int v0, int v1, int v2);
 
-  void stitch_triangles(Subpatch &sub, int edge);
+  void stitch_triangles(Subpatch &sub, int edge, int &tri);
 };
 
 /* Quad EdgeDice */
@@ -88,13 +88,20 @@ class QuadDice : public EdgeDice {
   float2 map_uv(Subpatch &sub, float u, float v);
   void set_vert(Subpatch &sub, int index, float u, float v);
 
-  void add_grid(Subpatch &sub, int Mu, int Mv, int offset);
+  void add_grid(Subpatch &sub, int Mu, int Mv, int offset, int &tri);
 
   void set_side(Subpatch &sub, int edge);
 
   float quad_area(const float3 &a, const float3 &b, const float3 &c, const float3 &d);
   float scale_factor(Subpatch &sub, int Mu, int Mv);
 
+  /* Dicing is split into stages so subpatches can be processed in parallel. The inner
+   * grid and stitching only write to verts and triangles owned by the subpatch, while
+   * the sides are shared with neighboring subpatches and must be set serially. */
+  void dice_grid(Subpatch &sub);
+  void dice_sides(Subpatch &sub);
+  void dice_stitch(Subpatch &sub);
+
   void dice(Subpatch &sub);
 };
 
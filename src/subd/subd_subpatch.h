@@ -28,6 +28,7 @@ class Subpatch {
  public:
   const class Patch *patch; /* Patch this is a subpatch of. */
   int inner_grid_vert_offset;
+  int triangle_offset; /* First triangle written by this subpatch, relative to dicing start. */
 
   struct edge_t {
     int T;
@@ -0,0 +1,159 @@
+/*
+ * Copyright 2011-2020 Blender Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "testing/testing.h"
+
+#include "render/background_map.h"
+#include "render/graph.h"
+#include "render/nodes.h"
+#include "render/shader.h"
+
+#include "util/util_path.h"
+#include "util/util_string.h"
+#include "util/util_time.h"
+
+CCL_NAMESPACE_BEGIN
+
+TEST(render_background_map, build)
+{
+  const int2 res = make_int2(8, 4);
+  vector<float3> pixels(res.x * res.y, make_float3(1.0f, 1.0f, 1.0f));
+
+  BackgroundMap map;
+  map.build(pixels, res);
+
+  EXPECT_EQ(map.marginal_cdf.size(), res.y + 1);
+  EXPECT_EQ(map.conditional_cdf.size(), (res.x + 1) * res.y);
+
+  /* Uniform rows, and a marginal CDF that is symmetric around the equator. */
+  for (int x = 0; x < res.x; x++) {
+    EXPECT_NEAR(map.conditional_cdf[x].y, (float)x / res.x, 1e-6f);
+  }
+  EXPECT_NEAR(map.marginal_cdf[2].y, 0.5f, 1e-6f);
+  EXPECT_EQ(map.marginal_cdf[res.y].y, 1.0f);
+}
+
+TEST(render_background_map, reduce_resolution)
+{
+  /* A constant background is reduced to the minimum width. */
+  vector<float3> pixels(64 * 32, make_float3(0.5f, 0.5f, 0.5f));
+  int2 res = background_map_reduce_resolution(pixels, make_int2(64, 32), 8, 0.02f);
+  EXPECT_EQ(res.x, 8);
+  EXPECT_EQ(res.y, 4);
+  EXPECT_EQ(pixels.size(), 8 * 4);
+
+  /* A single bright pixel, like a sun, keeps the full resolution. */
+  pixels.assign(64 * 32, make_float3(0.0f, 0.0f, 0.0f));
+  pixels[16 * 64 + 8] = make_float3(100.0f, 100.0f, 100.0f);
+  res = background_map_reduce_resolution(pixels, make_int2(64, 32), 8, 0.02f);
+  EXPECT_EQ(res.x, 64);
+  EXPECT_EQ(res.y, 32);
+}
+
+TEST(render_background_map, key_procedural_bake)
+{
+  ShaderGraph *graph = new ShaderGraph();
+  BakedTextureNode *baked = new BakedTextureNode();
+  graph->add(baked);
+  BackgroundNode *background = new BackgroundNode();
+  graph->add(background);
+  graph->connect(baked->output("Color"), background->input("Color"));
+  graph->connect(background->output("Background"), graph->output()->input("Surface"));
+
+  Shader shader;
+  shader.set_graph(graph);
+  EXPECT_NE(BackgroundMapCache::key(&shader, make_int2(64, 32), false), "");
+
+  /* The subgraph was taken out for a bake that is not done yet. */
+  baked->bake_key = "0123456789abcdef";
+  EXPECT_EQ(BackgroundMapCache::key(&shader, make_int2(64, 32), false), "");
+}
+
+TEST(render_background_map, cache_memory)
+{
+  vector<float3> pixels(16 * 8, make_float3(1.0f, 0.5f, 0.25f));
+  BackgroundMap map;
+  map.build(pixels, make_int2(16, 8));
+
+  /* Without a path only the most recently used maps are kept. */
+  BackgroundMapCache cache;
+  for (int i = 0; i < 8; i++) {
+    cache.store(string_printf("key%d", i), map);
+  }
+
+  BackgroundMap loaded;
+  EXPECT_FALSE(cache.load("key0", loaded));
+  EXPECT_TRUE(cache.load("key7", loaded));
+  EXPECT_EQ(loaded.res.x, 16);
+  EXPECT_EQ(loaded.res.y, 8);
+  EXPECT_EQ(cache.num_hits, 1);
+  EXPECT_EQ(cache.num_misses, 1);
+}
+
+TEST(render_background_map, cache_file)
+{
+  /* Unique directory, tests may run in parallel. */
+  const string path = path_join(::testing::TempDir(),
+                                string_printf("render_background_map_test_%llx",
+                                              (unsigned long long)(time_dt() * 1e6)));
+  const string key = "0123456789abcdef";
+
+  vector<float3> pixels(16 * 8, make_float3(1.0f, 0.5f, 0.25f));
+  pixels[3] = make_float3(4.0f, 4.0f, 4.0f);
+  BackgroundMap map;
+  map.build(pixels, make_int2(16, 8));
+
+  {
+    BackgroundMapCache cache;
+    cache.set_path(path);
+    BackgroundMap loaded;
+    EXPECT_FALSE(cache.load("missing", loaded));
+    cache.store(key, map);
+  }
+
+  /* A new cache reads the map back from disk. */
+  BackgroundMapCache cache;
+  cache.set_path(path);
+  BackgroundMap loaded;
+  ASSERT_TRUE(cache.load(key, loaded));
+  EXPECT_EQ(loaded.res.x, 16);
+  EXPECT_EQ(loaded.res.y, 8);
+  ASSERT_EQ(loaded.marginal_cdf.size(), map.marginal_cdf.size());
+  for (size_t i = 0; i < map.marginal_cdf.size(); i++) {
+    EXPECT_EQ(loaded.marginal_cdf[i].x, map.marginal_cdf[i].x);
+    EXPECT_EQ(loaded.marginal_cdf[i].y, map.marginal_cdf[i].y);
+  }
+  ASSERT_EQ(loaded.conditional_cdf.size(), map.conditional_cdf.size());
+  for (size_t i = 0; i < map.conditional_cdf.size(); i++) {
+    EXPECT_EQ(loaded.conditional_cdf[i].x, map.conditional_cdf[i].x);
+    EXPECT_EQ(loaded.conditional_cdf[i].y, map.conditional_cdf[i].y);
+  }
+
+  /* Truncated files are ignored. */
+  const string filepath = path_join(path, key + ".bgmap");
+  vector<uint8_t> data;
+  ASSERT_TRUE(path_read_binary(filepath, data));
+  data.resize(data.size() - 1);
+  ASSERT_TRUE(path_write_binary(filepath, data));
+  BackgroundMapCache other_cache;
+  other_cache.set_path(path);
+  EXPECT_FALSE(other_cache.load(key, loaded));
+
+  path_remove(filepath);
+  path_remove(path);
+}
+
+CCL_NAMESPACE_END
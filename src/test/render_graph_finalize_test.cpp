@@ -22,6 +22,8 @@
 #include "render/graph.h"
 #include "render/nodes.h"
 #include "render/scene.h"
+#include "render/shader.h"
+#include "render/svm.h"
 
 #include "util/util_array.h"
 #include "util/util_logging.h"
@@ -1532,4 +1534,32 @@ TEST_F(RenderGraph, constant_fold_convert_color_float_color)
   graph.finalize(scene);
 }
 
+/*
+ * Tests that relinking an input to another output of the same node changes the compile key,
+ * so the shader is compiled again instead of reusing the old program.
+ */
+TEST_F(RenderGraph, compile_key_relink_output)
+{
+  EXPECT_ANY_MESSAGE(log);
+
+  const char *outputs[3] = {"TexCoord::Generated", "TexCoord::Generated", "TexCoord::UV"};
+  string keys[3];
+  SVMCompiler compiler(scene);
+
+  for (int i = 0; i < 3; i++) {
+    ShaderGraph *shader_graph = new ShaderGraph();
+    ShaderGraphBuilder(shader_graph)
+        .add_node(ShaderNodeBuilder<TextureCoordinateNode>("TexCoord"))
+        .output_color(outputs[i]);
+
+    Shader shader;
+    shader.set_graph(shader_graph);
+    compiler.finalize(&shader);
+    keys[i] = compiler.compile_key(&shader);
+  }
+
+  EXPECT_EQ(keys[0], keys[1]);
+  EXPECT_NE(keys[0], keys[2]);
+}
+
 CCL_NAMESPACE_END
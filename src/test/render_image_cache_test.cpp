@@ -0,0 +1,192 @@
+/*
+ * Copyright 2011-2020 Blender Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "testing/testing.h"
+
+#include "render/image_cache.h"
+
+CCL_NAMESPACE_BEGIN
+
+/* Single channel byte image with a texel value derived from its position, and a second
+ * level of half the size. */
+class ImageCacheTestLoader : public ImageLoader {
+ public:
+  ImageCacheTestLoader(int width, int height) : width(width), height(height)
+  {
+  }
+
+  bool load_metadata(const ImageDeviceFeatures &, ImageMetaData &metadata) override
+  {
+    metadata.width = width;
+    metadata.height = height;
+    metadata.channels = 1;
+    metadata.type = IMAGE_DATA_TYPE_BYTE;
+    return true;
+  }
+
+  bool load_pixels(const ImageMetaData &, void *, const size_t, const bool) override
+  {
+    return false;
+  }
+
+  bool load_level_metadata(int level, int &level_width, int &level_height, bool &tiled) override
+  {
+    if (level > 1) {
+      return false;
+    }
+    level_width = width >> level;
+    level_height = height >> level;
+    tiled = true;
+    return true;
+  }
+
+  bool load_pixels_region(const ImageMetaData &,
+                          int level,
+                          int x,
+                          int y,
+                          int region_width,
+                          int region_height,
+                          void *pixels,
+                          const bool) override
+  {
+    for (int j = 0; j < region_height; j++) {
+      for (int i = 0; i < region_width; i++) {
+        ((uchar *)pixels)[j * region_width + i] = texel(level, x + i, y + j);
+      }
+    }
+    return true;
+  }
+
+  static uchar texel(int level, int x, int y)
+  {
+    return (uchar)(x * 7 + y * 13 + level * 101);
+  }
+
+  string name() const override
+  {
+    return "image_cache_test";
+  }
+
+  bool equals(const ImageLoader &) const override
+  {
+    return false;
+  }
+
+  int width, height;
+};
+
+static void image_cache_test_check(PagedImage &image, int level)
+{
+  const KernelPagedImage::Level &l = image.levels[level];
+  for (int y = 0; y < l.height; y++) {
+    for (int x = 0; x < l.width; x++) {
+      const uchar *pixels = (const uchar *)image.tile_pixels(
+          level, x / PAGED_IMAGE_TILE_SIZE, y / PAGED_IMAGE_TILE_SIZE, 0);
+      const int index = (y % PAGED_IMAGE_TILE_SIZE) * PAGED_IMAGE_TILE_SIZE +
+                        (x % PAGED_IMAGE_TILE_SIZE);
+      ASSERT_EQ(pixels[index], ImageCacheTestLoader::texel(level, x, y));
+    }
+  }
+}
+
+TEST(render_image_cache, load)
+{
+  ImageCacheTestLoader loader(200, 130);
+  ImageMetaData metadata;
+  loader.load_metadata(ImageDeviceFeatures(), metadata);
+
+  ImageCache cache;
+  cache.set_budget(1024 * 1024 * 1024);
+
+  PagedImage image(&cache, &loader, ImageParams(), metadata, true);
+  ASSERT_TRUE(image.init());
+  EXPECT_EQ(image.num_levels, 2);
+  EXPECT_EQ(image.levels[0].tiles_x, 4);
+  EXPECT_EQ(image.levels[0].tiles_y, 3);
+
+  /* Every tile is loaded once, all later lookups are hits. */
+  image_cache_test_check(image, 0);
+  image_cache_test_check(image, 1);
+  EXPECT_EQ(image.num_misses, (size_t)(4 * 3 + 2 * 2));
+  EXPECT_EQ(image.num_hits(), (uint64_t)(200 * 130 + 100 * 65 - image.num_misses));
+  EXPECT_EQ(cache.num_evictions, (size_t)0);
+  EXPECT_EQ(image.resident_size, image.num_misses * image.tile_size());
+
+  cache.remove_image(&image);
+  EXPECT_EQ(cache.resident_size, (size_t)0);
+}
+
+TEST(render_image_cache, evict)
+{
+  ImageCacheTestLoader loader(512, 512);
+  ImageMetaData metadata;
+  loader.load_metadata(ImageDeviceFeatures(), metadata);
+
+  ImageCache cache;
+  PagedImage image(&cache, &loader, ImageParams(), metadata, true);
+  ASSERT_TRUE(image.init());
+
+  /* Room for two tiles only, lookups keep working while tiles get evicted. */
+  cache.set_budget(image.tile_size() * 2);
+  image_cache_test_check(image, 0);
+  image_cache_test_check(image, 0);
+
+  EXPECT_LE(cache.peak_resident_size, image.tile_size() * 2);
+  EXPECT_LE(image.resident_size, image.tile_size() * 2);
+  EXPECT_GT(cache.num_evictions, (size_t)0);
+  EXPECT_EQ(image.num_misses, cache.num_evictions + 2);
+
+  cache.remove_image(&image);
+}
+
+TEST(render_image_cache, retire)
+{
+  ImageCacheTestLoader loader(512, 512);
+  ImageMetaData metadata;
+  loader.load_metadata(ImageDeviceFeatures(), metadata);
+
+  ImageCache cache;
+  PagedImage image(&cache, &loader, ImageParams(), metadata, true);
+  ASSERT_TRUE(image.init());
+  cache.set_budget(image.tile_size());
+
+  /* A lookup holding a tile keeps its texels while other threads evict it. */
+  const int parity = cache.readers.enter(0);
+  const uchar *pixels = (const uchar *)image.tile_pixels(0, 0, 0, 0);
+
+  for (int ty = 0; ty < image.levels[0].tiles_y; ty++) {
+    for (int tx = 0; tx < image.levels[0].tiles_x; tx++) {
+      const int other_parity = cache.readers.enter(1);
+      const uchar *other_pixels = (const uchar *)image.tile_pixels(0, tx, ty, 1);
+      cache.readers.exit(1, other_parity);
+      if (tx != 0 || ty != 0) {
+        EXPECT_NE(other_pixels, pixels);
+      }
+    }
+  }
+  EXPECT_GT(cache.num_evictions, (size_t)0);
+
+  for (int y = 0; y < PAGED_IMAGE_TILE_SIZE; y++) {
+    for (int x = 0; x < PAGED_IMAGE_TILE_SIZE; x++) {
+      ASSERT_EQ(pixels[y * PAGED_IMAGE_TILE_SIZE + x], ImageCacheTestLoader::texel(0, x, y));
+    }
+  }
+  cache.readers.exit(0, parity);
+
+  cache.remove_image(&image);
+}
+
+CCL_NAMESPACE_END
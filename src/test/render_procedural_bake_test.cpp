@@ -0,0 +1,187 @@
+/*
+ * Copyright 2011-2020 Blender Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "testing/testing.h"
+
+#include "device/device.h"
+#include "render/graph.h"
+#include "render/mesh.h"
+#include "render/nodes.h"
+#include "render/procedural_bake.h"
+#include "render/scene.h"
+#include "render/shader.h"
+
+#include "util/util_progress.h"
+#include "util/util_stats.h"
+
+CCL_NAMESPACE_BEGIN
+
+/* Graph with a noise texture baked, optionally after an unrelated node. */
+static BakedTextureNode *add_baked_noise(ShaderGraph &graph, float scale, bool add_other)
+{
+  if (add_other) {
+    graph.add(new CheckerTextureNode());
+  }
+
+  NoiseTextureNode *noise = new NoiseTextureNode();
+  noise->scale = scale;
+  graph.add(noise);
+
+  BakedTextureNode *baked = new BakedTextureNode();
+  graph.add(baked);
+  graph.connect(noise->output("Color"), baked->input("Color"));
+  return baked;
+}
+
+TEST(render_procedural_bake, key)
+{
+  ShaderGraph graph_a, graph_b, graph_c;
+  BakedTextureNode *baked_a = add_baked_noise(graph_a, 5.0f, false);
+  BakedTextureNode *baked_b = add_baked_noise(graph_b, 5.0f, true);
+  BakedTextureNode *baked_c = add_baked_noise(graph_c, 2.0f, false);
+
+  /* The same subgraph has the same key in any graph. */
+  const string key_a = ProceduralBakeCache::key(&graph_a, baked_a);
+  EXPECT_EQ(key_a, ProceduralBakeCache::key(&graph_b, baked_b));
+  EXPECT_NE(key_a, ProceduralBakeCache::key(&graph_c, baked_c));
+
+  baked_a->resolution = 32;
+  EXPECT_NE(key_a, ProceduralBakeCache::key(&graph_a, baked_a));
+}
+
+TEST(render_procedural_bake, voxel_position)
+{
+  const float3 bounds_min = make_float3(-1.0f, 0.0f, 2.0f);
+  const float3 bounds_max = make_float3(1.0f, 4.0f, 6.0f);
+
+  /* Voxels are evaluated at their centers, half a voxel inside the bounds. */
+  const float3 first = procedural_bake_voxel_position(4, bounds_min, bounds_max, 0, 0, 0);
+  EXPECT_FLOAT_EQ(first.x, -0.75f);
+  EXPECT_FLOAT_EQ(first.y, 0.5f);
+  EXPECT_FLOAT_EQ(first.z, 2.5f);
+
+  const float3 last = procedural_bake_voxel_position(4, bounds_min, bounds_max, 3, 3, 3);
+  EXPECT_FLOAT_EQ(last.x, 0.75f);
+  EXPECT_FLOAT_EQ(last.y, 3.5f);
+  EXPECT_FLOAT_EQ(last.z, 5.5f);
+}
+
+class RenderProceduralBake : public testing::Test {
+ protected:
+  Stats stats;
+  Profiler profiler;
+  DeviceInfo device_info;
+  Device *device_cpu;
+  SceneParams scene_params;
+  Scene *scene;
+  Progress progress;
+
+  virtual void SetUp()
+  {
+    device_cpu = Device::create(device_info, stats, profiler, true);
+    scene = new Scene(scene_params, device_cpu);
+  }
+
+  virtual void TearDown()
+  {
+    delete scene;
+    delete device_cpu;
+  }
+
+  /* Shader emitting a linear gradient along X as background, looked up from the baked
+   * texture node when given one. The position is the texture coordinate, like in bakes. */
+  Shader *add_gradient_shader(BakedTextureNode *baked)
+  {
+    ShaderGraph *graph = new ShaderGraph();
+
+    GeometryNode *geometry = new GeometryNode();
+    graph->add(geometry);
+    GradientTextureNode *gradient = new GradientTextureNode();
+    graph->add(gradient);
+    BackgroundNode *background = new BackgroundNode();
+    background->strength = 1.0f;
+    graph->add(background);
+
+    if (baked) {
+      graph->add(baked);
+      graph->connect(gradient->output("Color"), baked->input("Color"));
+      graph->connect(geometry->output("Position"), baked->input("Vector"));
+      graph->connect(baked->output("Color"), background->input("Color"));
+    }
+    else {
+      graph->connect(geometry->output("Position"), gradient->input("Vector"));
+      graph->connect(gradient->output("Color"), background->input("Color"));
+    }
+    graph->connect(background->output("Background"), graph->output()->input("Surface"));
+
+    Shader *shader = new Shader();
+    shader->set_graph(graph);
+    scene->shaders.push_back(shader);
+    shader->tag_update(scene);
+    return shader;
+  }
+};
+
+TEST_F(RenderProceduralBake, lookup)
+{
+  BakedTextureNode *baked = new BakedTextureNode();
+  baked->resolution = 8;
+  Shader *baked_shader = add_gradient_shader(baked);
+  Shader *direct_shader = add_gradient_shader(NULL);
+
+  /* Shaders are only compiled when used. */
+  Mesh *mesh = new Mesh();
+  mesh->used_shaders.push_back(baked_shader);
+  mesh->used_shaders.push_back(direct_shader);
+  scene->geometry.push_back(mesh);
+
+  scene->device_update(device_cpu, progress);
+  ASSERT_FALSE(baked->handle.empty());
+
+  /* The voxels hold the subgraph evaluated at their centers. */
+  ProceduralBake bake;
+  ASSERT_TRUE(scene->procedural_bake_manager->cache.load(baked->bake_key, bake));
+  ASSERT_EQ(bake.resolution, 8);
+  ASSERT_EQ(bake.voxels.size(), 8 * 8 * 8);
+  for (int x = 0; x < 8; x++) {
+    const float3 P = procedural_bake_voxel_position(
+        8, baked->bounds_min, baked->bounds_max, x, 3, 5);
+    EXPECT_NEAR(bake.voxels[(5 * 8 + 3) * 8 + x].x, P.x, 1e-5f);
+  }
+
+  /* Between the outer voxel centers the linear interpolation of the gradient is exact, so
+   * the lookup matches the subgraph evaluated without the bake. */
+  vector<float3> positions;
+  for (int i = 0; i <= 28; i++) {
+    positions.push_back(make_float3(0.0625f + i * 0.03125f, 0.3f, 0.7f));
+  }
+
+  vector<float4> baked_colors, direct_colors;
+  procedural_bake_shade(
+      device_cpu, &scene->dscene, baked_shader, positions, baked_colors, progress);
+  procedural_bake_shade(
+      device_cpu, &scene->dscene, direct_shader, positions, direct_colors, progress);
+
+  ASSERT_EQ(baked_colors.size(), positions.size());
+  ASSERT_EQ(direct_colors.size(), positions.size());
+  for (size_t i = 0; i < positions.size(); i++) {
+    EXPECT_NEAR(direct_colors[i].x, positions[i].x, 1e-5f);
+    EXPECT_NEAR(baked_colors[i].x, direct_colors[i].x, 1e-4f);
+    EXPECT_NEAR(baked_colors[i].y, direct_colors[i].y, 1e-4f);
+  }
+}
+
+CCL_NAMESPACE_END
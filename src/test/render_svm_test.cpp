@@ -0,0 +1,241 @@
+/*
+ * Copyright 2011-2020 Blender Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "testing/testing.h"
+
+#include "render/graph.h"
+#include "render/nodes.h"
+#include "render/svm.h"
+
+CCL_NAMESPACE_BEGIN
+
+namespace {
+
+/* Compiler with access to the state of the SVM program optimizations. */
+class SVMCompilerTest : public SVMCompiler {
+ public:
+  SVMCompilerTest() : SVMCompiler(NULL)
+  {
+  }
+
+  using SVMCompiler::current_svm_nodes;
+  using SVMCompiler::generate_node;
+  using SVMCompiler::jump_nodes;
+  using SVMCompiler::math_nodes;
+  using SVMCompiler::num_fused_nodes;
+  using SVMCompiler::num_reused_values;
+  using SVMCompiler::num_threaded_jumps;
+  using SVMCompiler::optimize_svm_nodes;
+  using SVMCompiler::stack_values_leave_branch;
+
+  /* Stack offset of an unlinked float input with the given value, like nodes get it. */
+  int assign_value(MathNode &node, const float value)
+  {
+    ShaderInput *input = node.input("Value1");
+    node.value1 = value;
+    input->stack_offset = SVM_STACK_INVALID;
+    return stack_assign(input);
+  }
+
+  int num_nodes_of_type(const ShaderNodeType type) const
+  {
+    int num = 0;
+    for (size_t i = 0; i < current_svm_nodes.size(); i++) {
+      num += (current_svm_nodes[i].x == type);
+    }
+    return num;
+  }
+
+  int add_jump(const ShaderNodeType type, const int weight_offset)
+  {
+    add_node(type, 0, weight_offset, 0);
+    jump_nodes.push_back(current_svm_nodes.size() - 1);
+    return current_svm_nodes.size() - 1;
+  }
+
+  /* Let the jump land on the given node, like after compiling the branch it skips. */
+  void set_jump_target(const int index, const int target)
+  {
+    current_svm_nodes[index].y = target - index - 1;
+  }
+
+  int jump_target(const int index) const
+  {
+    return index + 1 + current_svm_nodes[index].y;
+  }
+};
+
+}  // namespace
+
+TEST(render_svm, reuse_value)
+{
+  SVMCompilerTest compiler;
+  MathNode node;
+
+  const int offset = compiler.assign_value(node, 0.25f);
+  EXPECT_EQ(compiler.assign_value(node, 0.25f), offset);
+  EXPECT_NE(compiler.assign_value(node, 0.75f), offset);
+  EXPECT_EQ(compiler.num_nodes_of_type(NODE_VALUE_F), 2);
+  EXPECT_EQ(compiler.num_reused_values, 1);
+}
+
+TEST(render_svm, reuse_value_leave_branch)
+{
+  SVMCompilerTest compiler;
+  MathNode node;
+
+  /* Loaded before the closure mix jump, so available on both sides of it. */
+  const int outer_offset = compiler.assign_value(node, 0.25f);
+
+  const int jump = compiler.add_jump(NODE_JUMP_IF_ONE, outer_offset);
+  const int inner_offset = compiler.assign_value(node, 0.75f);
+  compiler.set_jump_target(jump, compiler.current_svm_nodes.size());
+  compiler.stack_values_leave_branch(jump);
+
+  /* The value loaded in the skipped branch is loaded again after it. */
+  EXPECT_EQ(compiler.assign_value(node, 0.25f), outer_offset);
+  const int reloaded_offset = compiler.assign_value(node, 0.75f);
+  EXPECT_NE(reloaded_offset, inner_offset);
+  EXPECT_EQ(compiler.num_nodes_of_type(NODE_VALUE_F), 3);
+  EXPECT_EQ(compiler.num_reused_values, 1);
+}
+
+TEST(render_svm, reuse_value_reallocated)
+{
+  SVMCompilerTest compiler;
+  MathNode node;
+
+  const int offset = compiler.assign_value(node, 0.25f);
+
+  /* Free the offset and allocate it for another output, overwriting the value. */
+  compiler.stack_clear_offset(SocketType::FLOAT, offset);
+  EXPECT_EQ(compiler.stack_find_offset(SocketType::FLOAT), offset);
+
+  EXPECT_NE(compiler.assign_value(node, 0.25f), offset);
+  EXPECT_EQ(compiler.num_nodes_of_type(NODE_VALUE_F), 2);
+  EXPECT_EQ(compiler.num_reused_values, 0);
+}
+
+TEST(render_svm, fuse_math_nodes)
+{
+  SVMCompilerTest compiler;
+  compiler.add_node(NODE_MATH, NODE_MATH_ADD, 0, 1);
+  compiler.add_node(NODE_MATH, NODE_MATH_MULTIPLY, 1, 2);
+  compiler.add_node(NODE_MATH, NODE_MATH_SUBTRACT, 2, 3);
+  compiler.math_nodes.push_back(make_int2(0, 1));
+  compiler.math_nodes.push_back(make_int2(1, 1));
+  compiler.math_nodes.push_back(make_int2(2, 1));
+
+  compiler.optimize_svm_nodes();
+
+  /* The second node is read as data of the pair, so it can't start another one. */
+  EXPECT_EQ(compiler.current_svm_nodes[0].x, NODE_MATH_PAIR);
+  EXPECT_EQ(compiler.current_svm_nodes[1].x, NODE_MATH);
+  EXPECT_EQ(compiler.current_svm_nodes[1].y, NODE_MATH_MULTIPLY);
+  EXPECT_EQ(compiler.current_svm_nodes[2].x, NODE_MATH);
+  EXPECT_EQ(compiler.num_fused_nodes, 1);
+}
+
+TEST(render_svm, fuse_math_nodes_jump_target)
+{
+  SVMCompilerTest compiler;
+  const int jump = compiler.add_jump(NODE_JUMP_IF_ZERO, 10);
+  compiler.add_node(NODE_MATH, NODE_MATH_ADD, 0, 1);
+  compiler.add_node(NODE_MATH, NODE_MATH_MULTIPLY, 1, 2);
+  compiler.math_nodes.push_back(make_int2(1, 1));
+  compiler.math_nodes.push_back(make_int2(2, 1));
+
+  /* Skipping the first node must not skip into the middle of a pair. */
+  compiler.set_jump_target(jump, 2);
+  compiler.optimize_svm_nodes();
+
+  EXPECT_EQ(compiler.current_svm_nodes[1].x, NODE_MATH);
+  EXPECT_EQ(compiler.current_svm_nodes[2].x, NODE_MATH);
+  EXPECT_EQ(compiler.num_fused_nodes, 0);
+  EXPECT_EQ(compiler.jump_target(jump), 2);
+}
+
+TEST(render_svm, fuse_vector_math_wrap)
+{
+  SVMCompilerTest compiler;
+  ShaderNodeSet done;
+
+  VectorMathNode wrap;
+  wrap.type = NODE_VECTOR_MATH_WRAP;
+  VectorMathNode add;
+  add.type = NODE_VECTOR_MATH_ADD;
+
+  /* The inputs of the second node reuse the values loaded for the first, so the nodes are
+   * adjacent. The wrap node is followed by its data node. */
+  compiler.generate_node(&wrap, done);
+  const int first = compiler.current_svm_nodes.size() - 2;
+  compiler.generate_node(&add, done);
+  ASSERT_EQ(compiler.current_svm_nodes.size(), first + 3);
+
+  compiler.optimize_svm_nodes();
+
+  EXPECT_EQ(compiler.current_svm_nodes[first].x, NODE_VECTOR_MATH_PAIR);
+  EXPECT_EQ(compiler.current_svm_nodes[first].y, NODE_VECTOR_MATH_WRAP);
+  EXPECT_EQ(compiler.current_svm_nodes[first + 2].x, NODE_VECTOR_MATH);
+  EXPECT_EQ(compiler.current_svm_nodes[first + 2].y, NODE_VECTOR_MATH_ADD);
+  EXPECT_EQ(compiler.num_fused_nodes, 1);
+}
+
+TEST(render_svm, thread_jumps_opposite)
+{
+  SVMCompilerTest compiler;
+  const int weight = 4;
+
+  /* When the first jump is taken the weight is one, so the second is not taken. */
+  const int first = compiler.add_jump(NODE_JUMP_IF_ONE, weight);
+  compiler.add_node(NODE_VALUE_F, 0, 1);
+  const int second = compiler.add_jump(NODE_JUMP_IF_ZERO, weight);
+  compiler.add_node(NODE_VALUE_F, 0, 2);
+  compiler.add_node(NODE_VALUE_F, 0, 3);
+  compiler.set_jump_target(first, second);
+  compiler.set_jump_target(second, second + 2);
+
+  compiler.optimize_svm_nodes();
+
+  EXPECT_EQ(compiler.jump_target(first), second + 1);
+  EXPECT_EQ(compiler.jump_target(second), second + 2);
+  EXPECT_EQ(compiler.num_threaded_jumps, 1);
+}
+
+TEST(render_svm, thread_jumps_same)
+{
+  SVMCompilerTest compiler;
+  const int weight = 4;
+
+  /* The second jump is taken too, the third is on another weight and stops threading. */
+  const int first = compiler.add_jump(NODE_JUMP_IF_ZERO, weight);
+  compiler.add_node(NODE_VALUE_F, 0, 1);
+  const int second = compiler.add_jump(NODE_JUMP_IF_ZERO, weight);
+  compiler.add_node(NODE_VALUE_F, 0, 2);
+  const int third = compiler.add_jump(NODE_JUMP_IF_ZERO, weight + 1);
+  compiler.add_node(NODE_VALUE_F, 0, 3);
+  compiler.set_jump_target(first, second);
+  compiler.set_jump_target(second, third);
+  compiler.set_jump_target(third, third + 1);
+
+  compiler.optimize_svm_nodes();
+
+  EXPECT_EQ(compiler.jump_target(first), third);
+  EXPECT_EQ(compiler.jump_target(second), third);
+  EXPECT_EQ(compiler.num_threaded_jumps, 1);
+}
+
+CCL_NAMESPACE_END
@@ -0,0 +1,121 @@
+/*
+ * Copyright 2011-2020 Blender Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "testing/testing.h"
+
+#include "util/util_cache.h"
+#include "util/util_path.h"
+#include "util/util_string.h"
+#include "util/util_time.h"
+
+CCL_NAMESPACE_BEGIN
+
+/* Unique directory, tests may run in parallel. */
+static string util_cache_test_path(const char *name)
+{
+  return path_join(::testing::TempDir(),
+                   string_printf("util_cache_test_%s_%llx",
+                                 name,
+                                 (unsigned long long)(time_dt() * 1e6)));
+}
+
+TEST(util_cache, file_writer_commit)
+{
+  const string path = util_cache_test_path("commit");
+  const string filepath = path_join(path, "file.bin");
+
+  const int values[4] = {1, 2, 3, 4};
+  string tmp_filepath;
+  {
+    CacheFileWriter writer(filepath);
+    tmp_filepath = writer.tmp_filepath();
+    EXPECT_TRUE(writer.write_array(values, 4));
+    EXPECT_EQ(writer.size(), sizeof(values));
+
+    /* Nothing is visible under the final name before committing. */
+    EXPECT_FALSE(path_exists(filepath));
+    EXPECT_TRUE(writer.commit());
+  }
+
+  EXPECT_FALSE(path_exists(tmp_filepath));
+  vector<uint8_t> data;
+  ASSERT_TRUE(path_read_binary(filepath, data));
+  ASSERT_EQ(data.size(), sizeof(values));
+  EXPECT_EQ(memcmp(data.data(), values, sizeof(values)), 0);
+
+  path_remove(filepath);
+  path_remove(path);
+}
+
+TEST(util_cache, file_writer_abandon)
+{
+  const string path = util_cache_test_path("abandon");
+  const string filepath = path_join(path, "file.bin");
+
+  string tmp_filepath;
+  {
+    CacheFileWriter writer(filepath);
+    tmp_filepath = writer.tmp_filepath();
+    EXPECT_TRUE(writer.write("data", 4));
+    EXPECT_TRUE(path_exists(tmp_filepath));
+  }
+
+  /* The temporary file is removed without committing. */
+  EXPECT_FALSE(path_exists(tmp_filepath));
+  EXPECT_FALSE(path_exists(filepath));
+
+  path_remove(path);
+}
+
+TEST(util_cache, file_writer_tmp_extension)
+{
+  const string path = util_cache_test_path("extension");
+  const string filepath = path_join(path, "file.tx");
+
+  {
+    CacheFileWriter writer_a(filepath, "tx");
+    CacheFileWriter writer_b(filepath, "tx");
+    EXPECT_TRUE(string_endswith(writer_a.tmp_filepath(), ".tx"));
+    EXPECT_NE(writer_a.tmp_filepath(), writer_b.tmp_filepath());
+  }
+
+  path_remove(path);
+}
+
+TEST(util_cache, mru)
+{
+  CacheMRU<int> cache(2);
+  cache.insert("a", 1);
+  cache.insert("b", 2);
+
+  /* Finding "a" makes it the most recently used, so "b" is dropped. */
+  int value = 0;
+  EXPECT_TRUE(cache.find("a", value));
+  EXPECT_EQ(value, 1);
+  cache.insert("c", 3);
+  EXPECT_EQ(cache.size(), 2);
+  EXPECT_FALSE(cache.find("b", value));
+  EXPECT_TRUE(cache.find("c", value));
+  EXPECT_EQ(value, 3);
+
+  /* Inserting an existing key replaces its value. */
+  cache.insert("a", 4);
+  EXPECT_EQ(cache.size(), 2);
+  EXPECT_TRUE(cache.find("a", value));
+  EXPECT_EQ(value, 4);
+}
+
+CCL_NAMESPACE_END
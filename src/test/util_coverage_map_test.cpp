@@ -0,0 +1,148 @@
+/*
+ * Copyright 2011-2020 Blender Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "testing/testing.h"
+
+#include "util/util_coverage_map.h"
+#include "util/util_foreach.h"
+#include "util/util_hash.h"
+#include "util/util_logging.h"
+#include "util/util_map.h"
+#include "util/util_time.h"
+
+CCL_NAMESPACE_BEGIN
+
+/* Pseudo random ID out of a small set per pixel, similar to what Cryptomatte produces. */
+static float coverage_test_id(int pixel, int sample, int num_ids)
+{
+  const uint i = hash_uint2(pixel, sample) % num_ids;
+  return __uint_as_float(hash_uint2(pixel, i) & 0x3F7FFFFF);
+}
+
+static void coverage_test_compare(const CoverageMap &map,
+                                  const vector<unordered_map<float, float>> &reference)
+{
+  vector<CoverageMap::Entry> entries;
+
+  for (size_t i = 0; i < reference.size(); i++) {
+    EXPECT_EQ(map.num_entries(i), reference[i].size());
+
+    entries.clear();
+    map.get_entries(i, entries);
+    EXPECT_EQ(entries.size(), reference[i].size());
+
+    foreach (const CoverageMap::Entry &entry, entries) {
+      unordered_map<float, float>::const_iterator it = reference[i].find(entry.id);
+      ASSERT_TRUE(it != reference[i].end());
+      EXPECT_EQ(entry.weight, it->second);
+    }
+  }
+}
+
+static void coverage_test_fill(CoverageMap &map,
+                               vector<unordered_map<float, float>> &reference,
+                               int num_pixels,
+                               int num_samples,
+                               int num_ids)
+{
+  map.reset(num_pixels);
+  reference.clear();
+  reference.resize(num_pixels);
+
+  for (int sample = 0; sample < num_samples; sample++) {
+    for (int pixel = 0; pixel < num_pixels; pixel++) {
+      const float id = coverage_test_id(pixel, sample, num_ids);
+      map.set_pixel(pixel);
+      map.add(id, 0.5f);
+      reference[pixel][id] += 0.5f;
+    }
+  }
+}
+
+TEST(util_coverage_map, few_ids)
+{
+  CoverageMap map;
+  vector<unordered_map<float, float>> reference;
+  coverage_test_fill(map, reference, 64, 16, 3);
+  coverage_test_compare(map, reference);
+}
+
+TEST(util_coverage_map, spill)
+{
+  /* More IDs than fit in the inline slots and the first spill block. */
+  CoverageMap map;
+  vector<unordered_map<float, float>> reference;
+  coverage_test_fill(map, reference, 16, 256, 64);
+  coverage_test_compare(map, reference);
+}
+
+TEST(util_coverage_map, reset)
+{
+  CoverageMap map;
+  vector<unordered_map<float, float>> reference;
+  coverage_test_fill(map, reference, 32, 64, 32);
+  coverage_test_fill(map, reference, 8, 4, 2);
+  EXPECT_EQ(map.size(), 8);
+  coverage_test_compare(map, reference);
+}
+
+/* Not a correctness test, compares against the per-pixel unordered_map that was used
+ * before. Timings are logged with --v=1. */
+TEST(util_coverage_map, benchmark)
+{
+  const int num_tiles = 16;
+  const int num_pixels = 64 * 64;
+  const int num_samples = 16;
+  const int num_ids = 4;
+
+  float checksum_map = 0.0f, checksum_reference = 0.0f;
+
+  double time_start = time_dt();
+  for (int tile = 0; tile < num_tiles; tile++) {
+    vector<unordered_map<float, float>> reference(num_pixels);
+    for (int sample = 0; sample < num_samples; sample++) {
+      for (int pixel = 0; pixel < num_pixels; pixel++) {
+        reference[pixel][coverage_test_id(pixel, sample, num_ids)] += 1.0f;
+      }
+    }
+    for (int pixel = 0; pixel < num_pixels; pixel++) {
+      checksum_reference += reference[pixel].size();
+    }
+  }
+  const double time_reference = time_dt() - time_start;
+
+  time_start = time_dt();
+  CoverageMap map;
+  for (int tile = 0; tile < num_tiles; tile++) {
+    map.reset(num_pixels);
+    for (int sample = 0; sample < num_samples; sample++) {
+      for (int pixel = 0; pixel < num_pixels; pixel++) {
+        map.set_pixel(pixel);
+        map.add(coverage_test_id(pixel, sample, num_ids), 1.0f);
+      }
+    }
+    for (int pixel = 0; pixel < num_pixels; pixel++) {
+      checksum_map += map.num_entries(pixel);
+    }
+  }
+  const double time_map = time_dt() - time_start;
+
+  EXPECT_EQ(checksum_map, checksum_reference);
+
+  VLOG(1) << "Coverage map: " << time_map << "s, unordered_map: " << time_reference << "s.";
+}
+
+CCL_NAMESPACE_END
@@ -0,0 +1,125 @@
+/*
+ * Copyright 2011-2020 Blender Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "testing/testing.h"
+
+#include "util/util_texture_compress.h"
+#include "util/util_vector.h"
+
+CCL_NAMESPACE_BEGIN
+
+/* Smooth gradients, the kind of content block compression is meant for. Colors vary along a
+ * line within a block as BC1 can only represent those well. Sizes are not a multiple of the
+ * block size to cover the border blocks. */
+static const int WIDTH = 37;
+static const int HEIGHT = 21;
+
+static uchar4 texture_compress_test_pixel(int x, int y)
+{
+  const int t = (x + y) * 255 / (WIDTH + HEIGHT - 2);
+  return make_uchar4(
+      (uchar)t, (uchar)(255 - t), (uchar)(64 + t / 2), (uchar)(y * 255 / (HEIGHT - 1)));
+}
+
+static int texture_compress_test_error(float decoded, uchar expected)
+{
+  return abs((int)(decoded + 0.5f) - (int)expected);
+}
+
+TEST(util_texture_compress, bc1)
+{
+  vector<uchar4> pixels(WIDTH * HEIGHT);
+  for (int y = 0; y < HEIGHT; y++) {
+    for (int x = 0; x < WIDTH; x++) {
+      pixels[y * WIDTH + x] = texture_compress_test_pixel(x, y);
+    }
+  }
+
+  const int blocks_x = texture_num_blocks(WIDTH);
+  vector<TextureBlockBC1> blocks(blocks_x * texture_num_blocks(HEIGHT));
+  texture_compress_bc1(pixels.data(), WIDTH, HEIGHT, blocks.data());
+
+  for (int y = 0; y < HEIGHT; y++) {
+    for (int x = 0; x < WIDTH; x++) {
+      const TextureBlockBC1 &block = blocks[(y / 4) * blocks_x + x / 4];
+      const float4 decoded = 255.0f * texture_block_decode(block, (y % 4) * 4 + x % 4, false);
+      const uchar4 expected = pixels[y * WIDTH + x];
+      EXPECT_LE(texture_compress_test_error(decoded.x, expected.x), 12);
+      EXPECT_LE(texture_compress_test_error(decoded.y, expected.y), 12);
+      EXPECT_LE(texture_compress_test_error(decoded.z, expected.z), 12);
+      EXPECT_EQ(decoded.w, 255.0f);
+    }
+  }
+}
+
+TEST(util_texture_compress, bc3)
+{
+  vector<uchar4> pixels(WIDTH * HEIGHT);
+  for (int y = 0; y < HEIGHT; y++) {
+    for (int x = 0; x < WIDTH; x++) {
+      pixels[y * WIDTH + x] = texture_compress_test_pixel(x, y);
+    }
+  }
+
+  const int blocks_x = texture_num_blocks(WIDTH);
+  vector<TextureBlockBC3> blocks(blocks_x * texture_num_blocks(HEIGHT));
+  texture_compress_bc3(pixels.data(), WIDTH, HEIGHT, blocks.data());
+
+  for (int y = 0; y < HEIGHT; y++) {
+    for (int x = 0; x < WIDTH; x++) {
+      const TextureBlockBC3 &block = blocks[(y / 4) * blocks_x + x / 4];
+      const int i = (y % 4) * 4 + x % 4;
+      const float4 color = 255.0f * texture_block_decode(block.color, i, true);
+      const float alpha = texture_block_decode(block.alpha, i);
+      const uchar4 expected = pixels[y * WIDTH + x];
+      EXPECT_LE(texture_compress_test_error(color.x, expected.x), 12);
+      EXPECT_LE(texture_compress_test_error(color.y, expected.y), 12);
+      EXPECT_LE(texture_compress_test_error(color.z, expected.z), 12);
+      EXPECT_LE(texture_compress_test_error(alpha, expected.w), 3);
+    }
+  }
+}
+
+TEST(util_texture_compress, bc4)
+{
+  vector<uchar> pixels(WIDTH * HEIGHT);
+  for (int y = 0; y < HEIGHT; y++) {
+    for (int x = 0; x < WIDTH; x++) {
+      pixels[y * WIDTH + x] = texture_compress_test_pixel(x, y).x;
+    }
+  }
+  /* Uniform block is exact. */
+  for (int y = 0; y < 4; y++) {
+    for (int x = 0; x < 4; x++) {
+      pixels[y * WIDTH + x] = 77;
+    }
+  }
+
+  const int blocks_x = texture_num_blocks(WIDTH);
+  vector<TextureBlockBC4> blocks(blocks_x * texture_num_blocks(HEIGHT));
+  texture_compress_bc4(pixels.data(), WIDTH, HEIGHT, blocks.data());
+
+  for (int y = 0; y < HEIGHT; y++) {
+    for (int x = 0; x < WIDTH; x++) {
+      const TextureBlockBC4 &block = blocks[(y / 4) * blocks_x + x / 4];
+      const float decoded = texture_block_decode(block, (y % 4) * 4 + x % 4);
+      const uchar expected = pixels[y * WIDTH + x];
+      EXPECT_LE(texture_compress_test_error(decoded, expected), (x < 4 && y < 4) ? 0 : 3);
+    }
+  }
+}
+
+CCL_NAMESPACE_END
@@ -150,6 +150,11 @@ __forceinline const avxf mm256_sqrt(const avxf &a)
   return _mm256_sqrt_ps(a.m256);
 }
 
+__forceinline const avxf abs(const avxf &a)
+{
+  return _mm256_andnot_ps(_mm256_set1_ps(-0.0f), a.m256);
+}
+
 ////////////////////////////////////////////////////////////////////////////////
 /// Binary Operators
 ////////////////////////////////////////////////////////////////////////////////
@@ -0,0 +1,90 @@
+/*
+ * Copyright 2011-2020 Blender Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "util/util_cache.h"
+
+#include "util/util_logging.h"
+#include "util/util_path.h"
+#include "util/util_time.h"
+
+#include <atomic>
+
+CCL_NAMESPACE_BEGIN
+
+/* Counter for unique temporary names within the process, the time tells processes apart. */
+static std::atomic<size_t> cache_file_num_written(0);
+
+CacheFileWriter::CacheFileWriter(const string &filepath, const string &tmp_extension)
+    : path(filepath), file(NULL), written_size(0), ok(true), committed(false)
+{
+  tmp_path = string_printf("%s.%llx.%zu.tmp",
+                           path.c_str(),
+                           (unsigned long long)(time_dt() * 1e6),
+                           cache_file_num_written++);
+  if (!tmp_extension.empty()) {
+    tmp_path += "." + tmp_extension;
+  }
+
+  path_create_directories(path);
+}
+
+CacheFileWriter::~CacheFileWriter()
+{
+  if (file) {
+    fclose(file);
+  }
+  if (!committed) {
+    path_remove(tmp_path);
+  }
+}
+
+bool CacheFileWriter::write(const void *data, const size_t size)
+{
+  if (!ok) {
+    return false;
+  }
+
+  if (!file) {
+    file = path_fopen(tmp_path, "wb");
+    if (!file) {
+      VLOG(1) << "Failed to write cache file " << tmp_path;
+      ok = false;
+      return false;
+    }
+  }
+
+  if (size && fwrite(data, 1, size, file) != size) {
+    ok = false;
+    return false;
+  }
+
+  written_size += size;
+  return true;
+}
+
+bool CacheFileWriter::commit()
+{
+  if (file) {
+    ok = (fclose(file) == 0) && ok;
+    file = NULL;
+  }
+
+  /* On Windows renaming fails when another process already stored the file. */
+  committed = ok && rename(tmp_path.c_str(), path.c_str()) == 0;
+  return committed;
+}
+
+CCL_NAMESPACE_END
@@ -0,0 +1,124 @@
+/*
+ * Copyright 2011-2020 Blender Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __UTIL_CACHE_H__
+#define __UTIL_CACHE_H__
+
+/* Utilities for caches of data that is expensive to compute, in memory and in cache
+ * directories that may be shared by renders in other processes. */
+
+#include <stdio.h>
+
+#include "util/util_algorithm.h"
+#include "util/util_string.h"
+#include "util/util_types.h"
+#include "util/util_vector.h"
+
+CCL_NAMESPACE_BEGIN
+
+/* Writes a file into a cache directory atomically. The data goes to a temporary file with a
+ * unique name next to it, which commit() renames into place, so other processes never read
+ * a partially written file. The temporary file is removed when it is not committed. */
+class CacheFileWriter {
+ public:
+  /* The extension is appended to the temporary name, for libraries that choose the file
+   * format by extension. */
+  explicit CacheFileWriter(const string &filepath, const string &tmp_extension = "");
+  ~CacheFileWriter();
+
+  /* Temporary file, for data written by other means than write(). */
+  const string &tmp_filepath() const
+  {
+    return tmp_path;
+  }
+
+  bool write(const void *data, const size_t size);
+  template<typename T> bool write_array(const T *data, const size_t num)
+  {
+    return write(data, sizeof(T) * num);
+  }
+
+  /* Close the temporary file and rename it into place, returns false when writing or
+   * renaming failed. */
+  bool commit();
+
+  /* Number of bytes written so far. */
+  size_t size() const
+  {
+    return written_size;
+  }
+
+ protected:
+  string path;
+  string tmp_path;
+  FILE *file;
+  size_t written_size;
+  bool ok;
+  bool committed;
+};
+
+/* The most recently used values of a cache, so switching between a few of them does not
+ * load or compute them again. Not thread safe, users lock their own mutex. */
+template<typename T> class CacheMRU {
+ public:
+  explicit CacheMRU(const size_t capacity) : capacity(capacity)
+  {
+  }
+
+  /* Copy the value of the key and make it the most recently used one, returns false when
+   * it is not in the cache. */
+  bool find(const string &key, T &value)
+  {
+    for (size_t i = 0; i < items.size(); i++) {
+      if (items[i].first == key) {
+        value = items[i].second;
+        std::rotate(items.begin() + i, items.begin() + i + 1, items.end());
+        return true;
+      }
+    }
+    return false;
+  }
+
+  /* Add the value as the most recently used one, dropping the least recently used one when
+   * the cache is full. */
+  void insert(const string &key, const T &value)
+  {
+    for (size_t i = 0; i < items.size(); i++) {
+      if (items[i].first == key) {
+        items.erase(items.begin() + i);
+        break;
+      }
+    }
+    if (items.size() >= capacity) {
+      items.erase(items.begin());
+    }
+    items.push_back(std::make_pair(key, value));
+  }
+
+  size_t size() const
+  {
+    return items.size();
+  }
+
+ protected:
+  size_t capacity;
+  /* Least recently used first. */
+  vector<std::pair<string, T>> items;
+};
+
+CCL_NAMESPACE_END
+
+#endif /* __UTIL_CACHE_H__ */
@@ -0,0 +1,190 @@
+/*
+ * Copyright 2011-2020 Blender Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __UTIL_COVERAGE_MAP_H__
+#define __UTIL_COVERAGE_MAP_H__
+
+#include "util/util_math.h"
+#include "util/util_types.h"
+#include "util/util_vector.h"
+
+CCL_NAMESPACE_BEGIN
+
+/* Accumulated weight per ID for all pixels of a tile, used for accurate Cryptomatte.
+ *
+ * Every pixel has a few slots stored inline in one flat array, using open addressing.
+ * Pixels with more IDs continue in blocks from a shared spill arena. Memory is kept on
+ * reset, so a map that is reused for multiple tiles stops allocating once it has seen
+ * the biggest tile. */
+class CoverageMap {
+ public:
+  struct Entry {
+    float id;
+    float weight;
+  };
+
+  CoverageMap() : pixel(NULL)
+  {
+  }
+
+  /* Clear all pixels, keeping the allocated memory. */
+  void reset(size_t num_pixels)
+  {
+    pixels.resize(num_pixels);
+    for (size_t i = 0; i < num_pixels; i++) {
+      pixels[i].clear();
+    }
+    spill.clear();
+    pixel = NULL;
+  }
+
+  /* Select the pixel that add() accumulates into. */
+  void set_pixel(size_t index)
+  {
+    pixel = &pixels[index];
+  }
+
+  void add(float id, float weight)
+  {
+    add(*pixel, id, weight);
+  }
+
+  size_t size() const
+  {
+    return pixels.size();
+  }
+
+  int num_entries(size_t index) const
+  {
+    return pixels[index].num;
+  }
+
+  /* Append all entries of the pixel to the given vector, in no particular order. */
+  void get_entries(size_t index, vector<Entry> &entries) const
+  {
+    const Pixel &p = pixels[index];
+
+    for (int i = 0; i < PIXEL_SLOTS; i++) {
+      if (!is_empty(p.slots[i])) {
+        entries.push_back(p.slots[i]);
+      }
+    }
+
+    for (int block = p.spill; block != -1; block = spill[block].next) {
+      const SpillBlock &b = spill[block];
+      entries.insert(entries.end(), b.entries, b.entries + b.num);
+    }
+  }
+
+ protected:
+  /* Most pixels only see a few IDs, so these fit in a single cache line. */
+  static const int PIXEL_SLOTS = 4;
+  static const int SPILL_SLOTS = 8;
+
+  /* Cryptomatte IDs are hashes that never map to NaN, so use one as empty marker. */
+  static const uint EMPTY_ID = 0xFFFFFFFF;
+
+  struct Pixel {
+    Entry slots[PIXEL_SLOTS];
+    int num;
+    int spill;
+
+    void clear()
+    {
+      for (int i = 0; i < PIXEL_SLOTS; i++) {
+        slots[i].id = __uint_as_float(EMPTY_ID);
+        slots[i].weight = 0.0f;
+      }
+      num = 0;
+      spill = -1;
+    }
+  };
+
+  struct SpillBlock {
+    Entry entries[SPILL_SLOTS];
+    int num;
+    int next;
+  };
+
+  static bool is_empty(const Entry &entry)
+  {
+    return __float_as_uint(entry.id) == EMPTY_ID;
+  }
+
+  void add(Pixel &p, float id, float weight)
+  {
+    /* Open addressing in the inline slots. Entries are never removed, so the first empty
+     * slot ends the probe sequence. */
+    const uint bits = __float_as_uint(id);
+    const uint start = (bits ^ (bits >> 16)) & (PIXEL_SLOTS - 1);
+
+    for (int i = 0; i < PIXEL_SLOTS; i++) {
+      Entry &slot = p.slots[(start + i) & (PIXEL_SLOTS - 1)];
+      if (is_empty(slot)) {
+        slot.id = id;
+        slot.weight = weight;
+        p.num++;
+        return;
+      }
+      else if (slot.id == id) {
+        slot.weight += weight;
+        return;
+      }
+    }
+
+    /* Inline slots are full, continue in the spill arena. */
+    int last = -1;
+    for (int block = p.spill; block != -1; block = spill[block].next) {
+      SpillBlock &b = spill[block];
+      for (int i = 0; i < b.num; i++) {
+        if (b.entries[i].id == id) {
+          b.entries[i].weight += weight;
+          return;
+        }
+      }
+      last = block;
+    }
+
+    if (last == -1 || spill[last].num == SPILL_SLOTS) {
+      const int block = (int)spill.size();
+      spill.push_back(SpillBlock());
+      spill[block].num = 0;
+      spill[block].next = -1;
+
+      if (last == -1) {
+        p.spill = block;
+      }
+      else {
+        spill[last].next = block;
+      }
+      last = block;
+    }
+
+    SpillBlock &b = spill[last];
+    b.entries[b.num].id = id;
+    b.entries[b.num].weight = weight;
+    b.num++;
+    p.num++;
+  }
+
+  vector<Pixel> pixels;
+  vector<SpillBlock> spill;
+  Pixel *pixel;
+};
+
+CCL_NAMESPACE_END
+
+#endif /* __UTIL_COVERAGE_MAP_H__ */
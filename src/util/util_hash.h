@@ -364,6 +364,15 @@ ccl_device_inline avxi hash_avxi4(avxi kx, avxi ky, avxi kz, avxi kw)
 
   return c;
 }
+
+/* Hashes to floats in the range [0, 1], the same as hash_uint_to_float. The unsigned hash
+ * is converted in two halves that are exact in float, so it is only rounded once. */
+ccl_device_inline avxf hash_avxi_to_avxf(const avxi &h)
+{
+  const avxf high = _mm256_cvtepi32_ps(srl(h, 16));
+  const avxf low = _mm256_cvtepi32_ps(h & 0xFFFF);
+  return _mm256_div_ps(high * 65536.0f + low, avxf((float)0xFFFFFFFFu));
+}
 #  endif
 
 #  undef rot
@@ -40,6 +40,7 @@ void Profiler::run()
       uint32_t cur_event = state->event;
       int32_t cur_shader = state->shader;
       int32_t cur_object = state->object;
+      int32_t cur_texture = state->texture;
 
       /* The state reads/writes should be atomic, but just to be sure
        * check the values for validity anyways. */
@@ -60,6 +61,11 @@ void Profiler::run()
       if (cur_object >= 0 && cur_object < object_samples.size()) {
         object_samples[cur_object]++;
       }
+
+      if (cur_event == PROFILING_TEXTURE_LOOKUP && cur_texture >= 0 &&
+          cur_texture < texture_samples.size()) {
+        texture_samples[cur_texture]++;
+      }
     }
     lock.unlock();
 
@@ -72,7 +78,7 @@ void Profiler::run()
   }
 }
 
-void Profiler::reset(int num_shaders, int num_objects)
+void Profiler::reset(int num_shaders, int num_objects, int num_textures)
 {
   bool running = (worker != NULL);
   if (running) {
@@ -82,10 +88,12 @@ void Profiler::reset(int num_shaders, int num_objects)
   /* Resize and clear the accumulation vectors. */
   shader_hits.assign(num_shaders, 0);
   object_hits.assign(num_objects, 0);
+  texture_hits.assign(num_textures, 0);
 
   event_samples.assign(PROFILING_NUM_EVENTS, 0);
   shader_samples.assign(num_shaders, 0);
   object_samples.assign(num_objects, 0);
+  texture_samples.assign(num_textures, 0);
 
   if (running) {
     start();
@@ -121,11 +129,13 @@ void Profiler::add_state(ProfilingState *state)
   /* Resize thread-local hit counters. */
   state->shader_hits.assign(shader_hits.size(), 0);
   state->object_hits.assign(object_hits.size(), 0);
+  state->texture_hits.assign(texture_hits.size(), 0);
 
   /* Initialize the state. */
   state->event = PROFILING_UNKNOWN;
   state->shader = -1;
   state->object = -1;
+  state->texture = -1;
   state->active = true;
 }
 
@@ -147,6 +157,11 @@ void Profiler::remove_state(ProfilingState *state)
   for (int i = 0; i < object_hits.size(); i++) {
     object_hits[i] += state->object_hits[i];
   }
+
+  assert(texture_hits.size() == state->texture_hits.size());
+  for (int i = 0; i < texture_hits.size(); i++) {
+    texture_hits[i] += state->texture_hits[i];
+  }
 }
 
 uint64_t Profiler::get_event(ProfilingEvent event)
@@ -177,4 +192,15 @@ bool Profiler::get_object(int object, uint64_t &samples, uint64_t &hits)
   return true;
 }
 
+bool Profiler::get_texture(int texture, uint64_t &samples, uint64_t &hits)
+{
+  assert(worker == NULL);
+  if (texture_hits[texture] == 0) {
+    return false;
+  }
+  samples = texture_samples[texture];
+  hits = texture_hits[texture];
+  return true;
+}
+
 CCL_NAMESPACE_END
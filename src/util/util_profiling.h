@@ -34,6 +34,7 @@ enum ProfilingEvent : uint32_t {
   PROFILING_VOLUME,
   PROFILING_SHADER_SETUP,
   PROFILING_SHADER_EVAL,
+  PROFILING_TEXTURE_LOOKUP,
   PROFILING_SHADER_APPLY,
   PROFILING_AO,
   PROFILING_SUBSURFACE,
@@ -81,10 +82,12 @@ struct ProfilingState {
   volatile uint32_t event = PROFILING_UNKNOWN;
   volatile int32_t shader = -1;
   volatile int32_t object = -1;
+  volatile int32_t texture = -1;
   volatile bool active = false;
 
   vector<uint64_t> shader_hits;
   vector<uint64_t> object_hits;
+  vector<uint64_t> texture_hits;
 };
 
 class Profiler {
@@ -92,7 +95,7 @@ class Profiler {
   Profiler();
   ~Profiler();
 
-  void reset(int num_shaders, int num_objects);
+  void reset(int num_shaders, int num_objects, int num_textures);
 
   void start();
   void stop();
@@ -103,6 +106,7 @@ class Profiler {
   uint64_t get_event(ProfilingEvent event);
   bool get_shader(int shader, uint64_t &samples, uint64_t &hits);
   bool get_object(int object, uint64_t &samples, uint64_t &hits);
+  bool get_texture(int texture, uint64_t &samples, uint64_t &hits);
 
  protected:
   void run();
@@ -113,13 +117,16 @@ class Profiler {
   vector<uint64_t> event_samples;
   vector<uint64_t> shader_samples;
   vector<uint64_t> object_samples;
+  vector<uint64_t> texture_samples;
 
   /* Tracks the total amounts every object/shader was hit.
    * Used to evaluate relative cost, written by the render thread.
    * Indexed by the shader and object IDs that the kernel also uses
-   * to index __object_flag and __shaders. */
+   * to index __object_flag and __shaders, and by the image slot for
+   * texture lookups. */
   vector<uint64_t> shader_hits;
   vector<uint64_t> object_hits;
+  vector<uint64_t> texture_hits;
 
   volatile bool do_stop_worker;
   thread *worker;
@@ -159,6 +166,15 @@ class ProfilingHelper {
     }
   }
 
+  inline void set_texture(int texture)
+  {
+    state->texture = texture;
+    /* Images may be added while profiling, for example by baking. */
+    if (state->active && texture < state->texture_hits.size()) {
+      state->texture_hits[texture]++;
+    }
+  }
+
   ~ProfilingHelper()
   {
     state->event = previous_event;
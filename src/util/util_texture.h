@@ -60,6 +60,11 @@ typedef enum ImageDataType {
   IMAGE_DATA_TYPE_NANOVDB_FLOAT = 8,
   IMAGE_DATA_TYPE_NANOVDB_FLOAT3 = 9,
   IMAGE_DATA_TYPE_OIIO = 10,
+  IMAGE_DATA_TYPE_PAGED = 11,
+  IMAGE_DATA_TYPE_BC1 = 12,
+  IMAGE_DATA_TYPE_BC3 = 13,
+  IMAGE_DATA_TYPE_BC4 = 14,
+  IMAGE_DATA_TYPE_LAZY = 15,
 
   IMAGE_DATA_NUM_TYPES
 } ImageDataType;
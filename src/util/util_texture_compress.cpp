@@ -0,0 +1,273 @@
+/*
+ * Copyright 2011-2020 Blender Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "util/util_texture_compress.h"
+
+#include "util/util_algorithm.h"
+
+#include <string.h>
+
+CCL_NAMESPACE_BEGIN
+
+/* Gather the texels of a block, repeating the edge texels of the image. */
+template<typename T>
+static void texture_block_gather(
+    const T *pixels, int width, int height, int bx, int by, T block[16])
+{
+  for (int j = 0; j < TEXTURE_BLOCK_SIZE; j++) {
+    const int y = min(by * TEXTURE_BLOCK_SIZE + j, height - 1);
+    for (int i = 0; i < TEXTURE_BLOCK_SIZE; i++) {
+      const int x = min(bx * TEXTURE_BLOCK_SIZE + i, width - 1);
+      block[j * TEXTURE_BLOCK_SIZE + i] = pixels[((size_t)y) * width + x];
+    }
+  }
+}
+
+static uint texture_block_quantize_rgb565(float3 color)
+{
+  const uint r = (uint)clamp((int)(color.x * 31.0f / 255.0f + 0.5f), 0, 31);
+  const uint g = (uint)clamp((int)(color.y * 63.0f / 255.0f + 0.5f), 0, 63);
+  const uint b = (uint)clamp((int)(color.z * 31.0f / 255.0f + 0.5f), 0, 31);
+  return (r << 11) | (g << 5) | b;
+}
+
+/* Quantize the endpoints and choose the closest of the four palette colors per texel. */
+static void texture_block_fit_color(const float3 colors[16],
+                                    float3 endpoint0,
+                                    float3 endpoint1,
+                                    TextureBlockBC1 &block)
+{
+  uint color0 = texture_block_quantize_rgb565(endpoint0);
+  uint color1 = texture_block_quantize_rgb565(endpoint1);
+  if (color0 < color1) {
+    std::swap(color0, color1);
+  }
+
+  block.color0 = (uint16_t)color0;
+  block.color1 = (uint16_t)color1;
+  block.indices = 0;
+
+  if (color0 == color1) {
+    return;
+  }
+
+  /* Palette as decoded, so indices are chosen for the actual result. */
+  float3 palette[4];
+  for (int p = 0; p < 4; p++) {
+    block.indices = p * 0x55555555u;
+    palette[p] = 255.0f * float4_to_float3(texture_block_decode(block, 0, true));
+  }
+
+  uint indices = 0;
+  for (int i = 0; i < 16; i++) {
+    int best = 0;
+    float best_distance = FLT_MAX;
+    for (int p = 0; p < 4; p++) {
+      const float distance = len_squared(colors[i] - palette[p]);
+      if (distance < best_distance) {
+        best_distance = distance;
+        best = p;
+      }
+    }
+    indices |= (uint)best << (2 * i);
+  }
+  block.indices = indices;
+}
+
+static float texture_block_color_error(const float3 colors[16], const TextureBlockBC1 &block)
+{
+  float error = 0.0f;
+  for (int i = 0; i < 16; i++) {
+    const float3 decoded = 255.0f * float4_to_float3(texture_block_decode(block, i, true));
+    error += len_squared(colors[i] - decoded);
+  }
+  return error;
+}
+
+/* Endpoints on the principal axis of the colors, with indices to the closest of the four
+ * palette colors. */
+static void texture_block_encode_color(const uchar4 texels[16], TextureBlockBC1 &block)
+{
+  float3 colors[16];
+  float3 mean = make_float3(0.0f, 0.0f, 0.0f);
+  for (int i = 0; i < 16; i++) {
+    colors[i] = make_float3(texels[i].x, texels[i].y, texels[i].z);
+    mean += colors[i];
+  }
+  mean /= 16.0f;
+
+  float cov[6] = {0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f};
+  float3 lo = colors[0], hi = colors[0];
+  for (int i = 0; i < 16; i++) {
+    const float3 d = colors[i] - mean;
+    cov[0] += d.x * d.x;
+    cov[1] += d.x * d.y;
+    cov[2] += d.x * d.z;
+    cov[3] += d.y * d.y;
+    cov[4] += d.y * d.z;
+    cov[5] += d.z * d.z;
+    lo = min(lo, colors[i]);
+    hi = max(hi, colors[i]);
+  }
+
+  /* Power iteration for the principal axis, starting from the bounding box diagonal. */
+  float3 axis = hi - lo;
+  for (int iteration = 0; iteration < 4; iteration++) {
+    axis = make_float3(cov[0] * axis.x + cov[1] * axis.y + cov[2] * axis.z,
+                       cov[1] * axis.x + cov[3] * axis.y + cov[4] * axis.z,
+                       cov[2] * axis.x + cov[4] * axis.y + cov[5] * axis.z);
+    const float length = len(axis);
+    if (length < 1e-6f) {
+      break;
+    }
+    axis /= length;
+  }
+
+  float3 endpoint0 = mean, endpoint1 = mean;
+  if (len_squared(axis) > 1e-12f) {
+    float tmin = FLT_MAX, tmax = -FLT_MAX;
+    for (int i = 0; i < 16; i++) {
+      const float t = dot(colors[i] - mean, axis);
+      tmin = min(tmin, t);
+      tmax = max(tmax, t);
+    }
+    endpoint0 = mean + tmax * axis;
+    endpoint1 = mean + tmin * axis;
+  }
+
+  texture_block_fit_color(colors, endpoint0, endpoint1, block);
+
+  /* Refit the endpoints to the chosen indices with least squares, keeping the result when
+   * it reduces the error. */
+  const float weights[4] = {0.0f, 1.0f, 1.0f / 3.0f, 2.0f / 3.0f};
+  float aa = 0.0f, ab = 0.0f, bb = 0.0f;
+  float3 ax = make_float3(0.0f, 0.0f, 0.0f), bx = make_float3(0.0f, 0.0f, 0.0f);
+  for (int i = 0; i < 16; i++) {
+    const float w = weights[(block.indices >> (2 * i)) & 3];
+    aa += (1.0f - w) * (1.0f - w);
+    ab += (1.0f - w) * w;
+    bb += w * w;
+    ax += (1.0f - w) * colors[i];
+    bx += w * colors[i];
+  }
+
+  const float det = aa * bb - ab * ab;
+  if (fabsf(det) > 1e-6f) {
+    const float3 refit0 = (bb * ax - ab * bx) / det;
+    const float3 refit1 = (aa * bx - ab * ax) / det;
+
+    TextureBlockBC1 refit_block;
+    texture_block_fit_color(colors, refit0, refit1, refit_block);
+    if (texture_block_color_error(colors, refit_block) <
+        texture_block_color_error(colors, block)) {
+      block = refit_block;
+    }
+  }
+}
+
+/* Endpoints at the range of the values, using the mode with six interpolated values. */
+static void texture_block_encode_value(const uchar values[16], TextureBlockBC4 &block)
+{
+  uchar lo = values[0], hi = values[0];
+  for (int i = 1; i < 16; i++) {
+    lo = min(lo, values[i]);
+    hi = max(hi, values[i]);
+  }
+
+  block.value0 = hi;
+  block.value1 = lo;
+  memset(block.indices, 0, sizeof(block.indices));
+
+  if (hi == lo) {
+    return;
+  }
+
+  float palette[8];
+  for (int p = 0; p < 8; p++) {
+    block.indices[0] = (uchar)p;
+    palette[p] = texture_block_decode(block, 0);
+  }
+  block.indices[0] = 0;
+
+  uint64_t indices = 0;
+  for (int i = 0; i < 16; i++) {
+    int best = 0;
+    float best_distance = FLT_MAX;
+    for (int p = 0; p < 8; p++) {
+      const float distance = fabsf((float)values[i] - palette[p]);
+      if (distance < best_distance) {
+        best_distance = distance;
+        best = p;
+      }
+    }
+    indices |= (uint64_t)best << (3 * i);
+  }
+  for (int b = 0; b < 6; b++) {
+    block.indices[b] = (uchar)(indices >> (8 * b));
+  }
+}
+
+void texture_compress_bc1(const uchar4 *pixels, int width, int height, TextureBlockBC1 *blocks)
+{
+  const int blocks_x = texture_num_blocks(width);
+  const int blocks_y = texture_num_blocks(height);
+
+  for (int by = 0; by < blocks_y; by++) {
+    for (int bx = 0; bx < blocks_x; bx++) {
+      uchar4 texels[16];
+      texture_block_gather(pixels, width, height, bx, by, texels);
+      texture_block_encode_color(texels, blocks[((size_t)by) * blocks_x + bx]);
+    }
+  }
+}
+
+void texture_compress_bc3(const uchar4 *pixels, int width, int height, TextureBlockBC3 *blocks)
+{
+  const int blocks_x = texture_num_blocks(width);
+  const int blocks_y = texture_num_blocks(height);
+
+  for (int by = 0; by < blocks_y; by++) {
+    for (int bx = 0; bx < blocks_x; bx++) {
+      uchar4 texels[16];
+      texture_block_gather(pixels, width, height, bx, by, texels);
+
+      uchar alpha[16];
+      for (int i = 0; i < 16; i++) {
+        alpha[i] = texels[i].w;
+      }
+
+      TextureBlockBC3 &block = blocks[((size_t)by) * blocks_x + bx];
+      texture_block_encode_value(alpha, block.alpha);
+      texture_block_encode_color(texels, block.color);
+    }
+  }
+}
+
+void texture_compress_bc4(const uchar *pixels, int width, int height, TextureBlockBC4 *blocks)
+{
+  const int blocks_x = texture_num_blocks(width);
+  const int blocks_y = texture_num_blocks(height);
+
+  for (int by = 0; by < blocks_y; by++) {
+    for (int bx = 0; bx < blocks_x; bx++) {
+      uchar values[16];
+      texture_block_gather(pixels, width, height, bx, by, values);
+      texture_block_encode_value(values, blocks[((size_t)by) * blocks_x + bx]);
+    }
+  }
+}
+
+CCL_NAMESPACE_END
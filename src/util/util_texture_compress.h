@@ -0,0 +1,127 @@
+/*
+ * Copyright 2011-2020 Blender Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __UTIL_TEXTURE_COMPRESS_H__
+#define __UTIL_TEXTURE_COMPRESS_H__
+
+#include "util/util_math.h"
+#include "util/util_types.h"
+
+CCL_NAMESPACE_BEGIN
+
+/* Block Compressed Textures
+ *
+ * Fixed rate formats with the same layout as BC1, BC3 and BC4, storing blocks of 4x4
+ * texels row by row. Texels of a block are indexed row by row too. Blocks at the right
+ * and bottom border repeat the edge texels of the image. */
+
+#define TEXTURE_BLOCK_SIZE 4
+
+/* Two RGB565 endpoints and 2 bit indices, 4 bits per texel. */
+typedef struct TextureBlockBC1 {
+  uint16_t color0;
+  uint16_t color1;
+  uint32_t indices;
+} TextureBlockBC1;
+
+/* Two 8 bit endpoints and 3 bit indices, 4 bits per texel. */
+typedef struct TextureBlockBC4 {
+  uchar value0;
+  uchar value1;
+  uchar indices[6];
+} TextureBlockBC4;
+
+/* BC4 alpha followed by BC1 color, 8 bits per texel. */
+typedef struct TextureBlockBC3 {
+  TextureBlockBC4 alpha;
+  TextureBlockBC1 color;
+} TextureBlockBC3;
+
+ccl_device_inline int texture_num_blocks(int size)
+{
+  return (size + TEXTURE_BLOCK_SIZE - 1) / TEXTURE_BLOCK_SIZE;
+}
+
+ccl_device_inline float4 texture_block_rgb565(uint color)
+{
+  return make_float4((float)(color >> 11) * (1.0f / 31.0f),
+                     (float)((color >> 5) & 63) * (1.0f / 63.0f),
+                     (float)(color & 31) * (1.0f / 31.0f),
+                     1.0f);
+}
+
+/* Decode texel i of a color block. BC1 has a three color mode with transparent black
+ * when the endpoints are ordered the other way around, BC3 always uses four colors. */
+ccl_device_inline float4 texture_block_decode(const TextureBlockBC1 &block,
+                                              int i,
+                                              bool four_colors)
+{
+  const uint index = (block.indices >> (2 * i)) & 3;
+  const float4 color0 = texture_block_rgb565(block.color0);
+  const float4 color1 = texture_block_rgb565(block.color1);
+
+  if (four_colors || block.color0 > block.color1) {
+    const float weights[4] = {0.0f, 1.0f, 1.0f / 3.0f, 2.0f / 3.0f};
+    return color0 + weights[index] * (color1 - color0);
+  }
+
+  switch (index) {
+    case 0:
+      return color0;
+    case 1:
+      return color1;
+    case 2:
+      return 0.5f * (color0 + color1);
+    default:
+      return make_float4(0.0f, 0.0f, 0.0f, 0.0f);
+  }
+}
+
+/* Decode texel i of a single channel block, in 0..255. */
+ccl_device_inline float texture_block_decode(const TextureBlockBC4 &block, int i)
+{
+  const int bit = 3 * i;
+  const int byte = bit >> 3;
+  const uint bits = (uint)block.indices[byte] |
+                    ((byte < 5) ? ((uint)block.indices[byte + 1] << 8) : 0);
+  const uint index = (bits >> (bit & 7)) & 7;
+
+  const float value0 = (float)block.value0;
+  const float value1 = (float)block.value1;
+
+  if (index < 2) {
+    return (index == 0) ? value0 : value1;
+  }
+  if (block.value0 > block.value1) {
+    return ((float)(8 - index) * value0 + (float)(index - 1) * value1) * (1.0f / 7.0f);
+  }
+  if (index < 6) {
+    return ((float)(6 - index) * value0 + (float)(index - 1) * value1) * (1.0f / 5.0f);
+  }
+  return (index == 6) ? 0.0f : 255.0f;
+}
+
+#ifndef __KERNEL_GPU__
+/* Compress 8 bit pixels, the block arrays have texture_num_blocks() blocks per row and
+ * column. BC1 ignores alpha. */
+void texture_compress_bc1(const uchar4 *pixels, int width, int height, TextureBlockBC1 *blocks);
+void texture_compress_bc3(const uchar4 *pixels, int width, int height, TextureBlockBC3 *blocks);
+void texture_compress_bc4(const uchar *pixels, int width, int height, TextureBlockBC4 *blocks);
+#endif
+
+CCL_NAMESPACE_END
+
+#endif /* __UTIL_TEXTURE_COMPRESS_H__ */